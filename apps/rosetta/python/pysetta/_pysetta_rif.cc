@@ -0,0 +1,175 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include <riflib/RifFactory.hh>
+#include <riflib/batch_score.hh>
+
+#include <stdexcept>
+#include <string>
+
+// batch rif and grid scoring on numpy arrays. inputs are read in place when they are C ordered
+// float64 (anything else is converted once by pybind), outputs are allocated here and filled by
+// riflib/batch_score.hh, which splits the work over omp threads with the GIL released. this module
+// itself is built without -fopenmp (see apps/rosetta/CMakeLists.txt), the threads live in riflib
+//
+//   import numpy as np
+//   from pysetta import devel, rif
+//   devel.init( ["dummy", "-database", db] )
+//   r = rif.Rif( "rif_64_x_sca05.rif.gz" )
+//   keys, scores, rots = r.lookup( stubs )        # stubs: N x 4 x 4
+//   g = rif.VoxelGrid( "x__atype6.rosetta_field.gz" )
+//   e = g.energies( xyz )                          # xyz: N x 3
+//   grids = rif.AtypeGrids( "x", 21 )              # the whole __atype<N> cache set
+//   e = grids.energies( xyz, atypes )
+
+namespace py = pybind11;
+using namespace ::devel::scheme;
+
+typedef py::array_t< double, py::array::c_style | py::array::forcecast > DoubleArray;
+typedef py::array_t< int32_t, py::array::c_style | py::array::forcecast > Int32Array;
+
+// number of rows in a, which must be N x dims
+static int64_t
+num_rows( DoubleArray const & a, std::vector<size_t> const & dims, std::string const & what )
+{
+	py::buffer_info info = a.request();
+	bool ok = info.ndim == dims.size() + 1;
+	for( size_t i = 0; ok && i < dims.size(); ++i ) ok = info.shape[i+1] == dims[i];
+	if( info.ndim == 2 && dims.size() == 2 && info.shape[1] == dims[0]*dims[1] ) ok = true; // flat N x 16
+	if( !ok ) throw std::invalid_argument( what + " has the wrong shape" );
+	return info.shape[0];
+}
+
+template< class T >
+static T * data_of( py::array_t<T> & a ){ return (T*)a.request().ptr; }
+
+
+struct PyRif {
+	RifPtr rif_;
+	std::string fname_, description_, rif_type_;
+
+	PyRif( std::string const & fname ) : fname_( fname ) {
+		rif_type_ = get_rif_type_from_file( fname );
+		RifFactoryConfig config;
+		config.rif_type = rif_type_;
+		shared_ptr<RifFactory> factory = create_rif_factory( config );
+		rif_ = factory->create_rif_from_file( fname, description_ );
+		if( !rif_ ) throw std::runtime_error( "can't load rif " + fname );
+	}
+
+	// (keys uint64, best_scores float32, best_rotamers int32), -1 rotamer for empty bins
+	py::tuple lookup( DoubleArray stubs ) const {
+		int64_t const n = num_rows( stubs, {4,4}, "stubs" );
+		py::array_t<uint64_t> keys( (size_t)n );
+		py::array_t<float> scores( (size_t)n );
+		py::array_t<int32_t> rots( (size_t)n );
+		double const * in = (double const *)stubs.request().ptr;
+		uint64_t * k = data_of( keys );
+		float * s = data_of( scores );
+		int32_t * r = data_of( rots );
+		{
+			py::gil_scoped_release release;
+			rif_batch_lookup( *rif_, in, n, k, s, r );
+		}
+		return py::make_tuple( keys, scores, rots );
+	}
+
+	size_t size() const { return rif_->size(); }
+	float cart_resl() const { return rif_->cart_resl(); }
+	float ang_resl() const { return rif_->ang_resl(); }
+	size_t mem_use() const { return rif_->mem_use(); }
+	bool has_bin_filter() const { return rif_->has_bin_filter(); }
+};
+
+
+static py::array_t<float>
+grid_energies( VoxelArray const & field, DoubleArray xyz )
+{
+	int64_t const n = num_rows( xyz, {3}, "xyz" );
+	py::array_t<float> energies( (size_t)n );
+	double const * in = (double const *)xyz.request().ptr;
+	float * e = data_of( energies );
+	{
+		py::gil_scoped_release release;
+		voxel_batch_energies( field, in, n, e );
+	}
+	return energies;
+}
+
+struct PyVoxelGrid {
+	shared_ptr<VoxelArray> field_;
+
+	PyVoxelGrid( std::string const & fname ) : field_( load_voxel_array( fname ) ) {
+		if( !field_ ) throw std::runtime_error( "can't load grid " + fname );
+	}
+	py::array_t<float> energies( DoubleArray xyz ) const { return grid_energies( *field_, xyz ); }
+};
+
+// the per atom type fields get_rosetta_fields caches as <prefix>__atype<N>.rosetta_field.gz
+struct PyAtypeGrids {
+	std::vector< shared_ptr<VoxelArray> > fields_;
+	std::vector< VoxelArrayPtr > field_by_atype_;
+
+	// atypes whose file is missing score 0
+	PyAtypeGrids( std::string const & cache_prefix, int max_atype ){
+		fields_.resize( max_atype + 1 );
+		field_by_atype_.resize( max_atype + 1, nullptr );
+		int nloaded = 0;
+		for( int itype = 1; itype <= max_atype; ++itype ){
+			fields_[itype] = load_voxel_array( cache_prefix + "__atype" + std::to_string( itype ) + ".rosetta_field.gz" );
+			field_by_atype_[itype] = fields_[itype].get();
+			nloaded += fields_[itype] != nullptr;
+		}
+		if( !nloaded ) throw std::runtime_error( "no grids found for " + cache_prefix );
+	}
+
+	py::array_t<float> energies( DoubleArray xyz, Int32Array atypes ) const {
+		int64_t const n = num_rows( xyz, {3}, "xyz" );
+		py::buffer_info ainfo = atypes.request();
+		if( ainfo.ndim != 1 || (int64_t)ainfo.shape[0] != n ) throw std::invalid_argument( "need one atype per atom" );
+		py::array_t<float> energies( (size_t)n );
+		double const * in = (double const *)xyz.request().ptr;
+		int32_t const * at = (int32_t const *)ainfo.ptr;
+		float * e = data_of( energies );
+		{
+			py::gil_scoped_release release;
+			atype_batch_energies( field_by_atype_, in, at, n, e );
+		}
+		return energies;
+	}
+	bool has_atype( int itype ) const { return itype > 0 && itype < field_by_atype_.size() && field_by_atype_[itype]; }
+};
+
+
+PYBIND11_DECLARE_HOLDER_TYPE(T, std::shared_ptr<T>);
+
+PYBIND11_PLUGIN(_pysetta_rif) {
+    py::module m("_pysetta_rif", "batch rif and grid scoring on numpy arrays");
+
+	py::class_< PyRif, std::shared_ptr<PyRif> >(m, "Rif")
+		.def( py::init< std::string const & >(), py::arg("fname") )
+		.def( "lookup", &PyRif::lookup, "N x 4 x 4 stubs -> (bin keys, best rotamer scores, best rotamers)", py::arg("stubs") )
+		.def( "size", &PyRif::size )
+		.def( "cart_resl", &PyRif::cart_resl )
+		.def( "ang_resl", &PyRif::ang_resl )
+		.def( "mem_use", &PyRif::mem_use )
+		.def( "has_bin_filter", &PyRif::has_bin_filter )
+		.def_readonly( "fname", &PyRif::fname_ )
+		.def_readonly( "rif_type", &PyRif::rif_type_ )
+		.def_readonly( "description", &PyRif::description_ )
+	;
+
+	py::class_< PyVoxelGrid, std::shared_ptr<PyVoxelGrid> >(m, "VoxelGrid")
+		.def( py::init< std::string const & >(), py::arg("fname") )
+		.def( "energies", &PyVoxelGrid::energies, "N x 3 xyz -> grid value per point, 0 outside", py::arg("xyz") )
+	;
+
+	py::class_< PyAtypeGrids, std::shared_ptr<PyAtypeGrids> >(m, "AtypeGrids")
+		.def( py::init< std::string const &, int >(), py::arg("cache_prefix"), py::arg("max_atype") )
+		.def( "energies", &PyAtypeGrids::energies, "N x 3 xyz, N rosetta atypes -> energy per atom", py::arg("xyz"), py::arg("atypes") )
+		.def( "has_atype", &PyAtypeGrids::has_atype )
+	;
+
+    return m.ptr();
+}
@@ -0,0 +1,90 @@
+// converts rif / xmap files between gzip and the block compressed format (scheme/io/block_compress.hh)
+// that rif_dock_test and rifgen read on all threads. contents are copied byte for byte, so this
+// works for any rif type
+//
+//    rif_block_compress foo.rif.gz bar_BOUNDING_RIF_16.xmap.gz ...  ->  foo.rif.zblk ...
+//    rif_block_compress foo.rif.zblk                                ->  foo.rif.gz
+
+#include <riflib/util.hh>
+#include <scheme/io/block_compress.hh>
+
+#include <utility/file/file_sys_util.hh>
+#include <utility/io/izstream.hh>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using devel::scheme::KMGT;
+
+
+static std::string
+replace_suffix( std::string const & fname, std::string const & from, std::string const & to ){
+	if( fname.size() > from.size() && fname.substr( fname.size()-from.size() ) == from ){
+		return fname.substr( 0, fname.size()-from.size() ) + to;
+	}
+	return fname + to;
+}
+
+// crc32 and size of everything reader sees
+static bool
+checksum_file( std::string const & fname, uLong & crc, uint64_t & nbytes ){
+	crc = crc32( 0, Z_NULL, 0 );
+	nbytes = 0;
+	return devel::scheme::read_binary_file( fname, [&]( std::istream & in ){
+		std::vector<char> buf( 1<<20 );
+		while( in.read( buf.data(), buf.size() ) || in.gcount() ){
+			crc = crc32( crc, (Bytef const*)buf.data(), in.gcount() );
+			nbytes += in.gcount();
+		}
+		return !in.bad();
+	} );
+}
+
+int main(int argc, char *argv[])
+{
+	if( argc < 2 ){
+		cout << "usage: rif_block_compress <rif or xmap file> ..." << endl;
+		cout << "    .gz files are written block compressed as .zblk, .zblk files are written back as .gz" << endl;
+		return 1;
+	}
+	int nfail = 0;
+	for( int i = 1; i < argc; ++i ){
+		std::string const fname = argv[i];
+		if( ! utility::file::file_exists( fname ) ){
+			cout << "missing file: " << fname << endl;
+			++nfail;
+			continue;
+		}
+		bool const to_block = ! ::scheme::io::is_block_compressed_file( fname );
+		std::string const outfname = to_block ? replace_suffix( fname, ".gz", ".zblk" ) : replace_suffix( fname, ".zblk", ".gz" );
+		cout << "converting " << fname << " -> " << outfname << endl;
+
+		uint64_t nbytes = 0;
+		bool ok = devel::scheme::write_binary_file( outfname, [&]( std::ostream & out ){
+			return devel::scheme::read_binary_file( fname, [&]( std::istream & in ){
+				std::vector<char> buf( 1<<20 );
+				while( in.read( buf.data(), buf.size() ) || in.gcount() ){
+					out.write( buf.data(), in.gcount() );
+					nbytes += in.gcount();
+				}
+				return !in.bad() && out.good();
+			} );
+		}, to_block );
+
+		uLong crc_in, crc_out;
+		uint64_t nbytes_in, nbytes_out;
+		ok = ok && checksum_file( fname, crc_in, nbytes_in ) && checksum_file( outfname, crc_out, nbytes_out );
+		ok = ok && crc_in == crc_out && nbytes_in == nbytes_out && nbytes == nbytes_in;
+		if( ok ){
+			cout << "    " << KMGT( nbytes ) << "B, verified" << endl;
+		} else {
+			cout << "    FAILED, " << outfname << " is bad" << endl;
+			++nfail;
+		}
+	}
+	return nfail ? 1 : 0;
+}
@@ -67,20 +67,29 @@
 
 	#include <chrono>
 	#include <random>
+	#include <set>
+	#include <sstream>
+	#include <limits>
 
 
 /// Brian
 	#include <scheme/objective/hash/XformHash.hh>
+	#include <scheme/util/numa.hh>
+	#include <scheme/util/perf_counters.hh>
+	#include <scheme/util/mem_budget.hh>
+	#include <scheme/util/shared_arena.hh>
 	#include <riflib/scaffold/ScaffoldDataCache.hh>
 	#include <riflib/scaffold/ScaffoldProviderFactory.hh>
 	#include <riflib/BurialManager.hh>
 	#include <riflib/UnsatManager.hh>
 	#include <riflib/ScoreRotamerVsTarget.hh>
+	#include <riflib/ResultsStore.hh>
 	#include <numeric/random/random_xyz.hh>
 
 
 // Task system
 	#include <riflib/task/TaskProtocol.hh>
+	#include <riflib/task/AdaptiveBeam.hh>
 	#include <riflib/rifdock_tasks/HSearchTasks.hh>
 	#include <riflib/rifdock_tasks/SetFaModeTasks.hh>
 	#include <riflib/rifdock_tasks/HackPackTasks.hh>
@@ -91,6 +100,7 @@
 	#include <riflib/rifdock_tasks/SeedingPositionTasks.hh>
 	#include <riflib/rifdock_tasks/MorphTasks.hh>
 	#include <riflib/rifdock_tasks/SasaTasks.hh>
+	#include <riflib/rifdock_tasks/FFTPrescanTasks.hh>
 
 	#include <riflib/seeding_util.hh>
 
@@ -103,192 +113,331 @@ using ::scheme::shared_ptr;
 typedef int32_t intRot;
 
 
-int main(int argc, char *argv[]) {
-
-
-	register_options();
-	devel::init(argc,argv);
-
-	devel::scheme::fix_omp_max_threads();
-	std::cout << "Rifdock thinks there are " << devel::scheme::omp_max_threads() << " threads." << std::endl;
-
-
-	devel::scheme::print_header( "setup global options" );
-	RifDockOpt opt;
-	opt.init_from_cli();
-	utility::file::create_directory_recursive( opt.outdir );
-
-
+namespace devel {
+namespace scheme {
 
-	#ifdef USE_OPENMP
-		omp_lock_t cout_lock, dump_lock;
-		omp_init_lock( &cout_lock );
-		omp_init_lock( &dump_lock );
-	#endif
 
+// These numbers are magic, you can't change any individually
+// They come from fitting against 4S0U with 20 mini-proteins (64aa)
+// Ideally these will predict SASA after soft_design soft_min
+// Details at /home/bcov/rifdock/parametrization/sasa
+const float sasa_threshold = 10.0f;
+const float sasa_distance = 7.0f;
+const float sasa_slope = 24.0f;
 
-	using namespace core::scoring;
-		using std::cout;
-		using std::endl;
-		using namespace devel::scheme;
-		typedef numeric::xyzVector<core::Real> Vec;
-		typedef numeric::xyzMatrix<core::Real> Mat;
-		// typedef numeric::xyzTransform<core::Real> Xform;
-		using ObjexxFCL::format::F;
-		using ObjexxFCL::format::I;
-		using devel::scheme::print_header;
-		using ::devel::scheme::RotamerIndex;
 
-	/////////////////////////////////////////////////////////////////////////////////
-	/////////////////////// static shit
-	////////////////////////////////////////////////////////////////////////////////
-	typedef ::scheme::util::SimpleArray<3,float> F3;
-	typedef ::scheme::util::SimpleArray<3,int> I3;
+// Everything that depends on the target. There's one of these per -batch_targets line (or just one
+//  for the command line target) and every scaffold is docked against all of them before the next
+//  scaffold is loaded, so scaffold setup is only paid once for the whole panel.
+struct DockTarget {
+	std::string name;
+	RifDockOpt opt;                 // the command line with this target's files, outdir and dokfile
 
+	core::pose::Pose target;
+	std::vector<SimpleAtom> target_simple_atoms;
+	utility::vector1<core::Size> target_res;
+	std::vector<HBondRay> target_donors, target_acceptors;
+	float rif_radius=0.0, target_redundancy_filter_rg=0.0;
+	shared_ptr<BurialManager> burial_manager;
+	shared_ptr<UnsatManager> unsat_manager;
+	bool donor_acceptors_from_file = false;
+	std::vector< VoxelArrayPtr > target_field_by_atype;
+	std::vector< std::vector< VoxelArrayPtr > > target_bounding_by_atype;
+#ifdef USEGRIDSCORE
+	shared_ptr<protocols::ligand_docking::ga_ligand_dock::GridScorer> grid_scorer;
+#endif
+	RifScoreRotamerVsTarget rot_tgt_scorer;
+	shared_ptr<BurialVoxelArray> sasa_grid;
+	shared_ptr<HydrophobicManager> hydrophobic_manager;
+	std::vector<shared_ptr<RifBase> > rif_ptrs;
+	std::vector<bool> rif_using_rot;
 
+	FFTPrescanTargetOP fft_prescan_target;
+	shared_ptr<utility::io::ozstream> dokout;
+	shared_ptr< ResultsStoreWriter > results_store;
+
+	// for the summary
+	double time_setup=0, time_dock=0, time_rif=0, time_pck=0, time_ros=0;
+	int n_scaffolds=0, n_errors=0;
+	uint64_t n_results=0;
+	float best_score=9e9;
+};
+
+
+inline
+std::string
+path_basename( std::string const & fname ) {
+	return fname.substr( fname.find_last_of( '/' ) + 1 );
+}
+
+// (name, options) for each target. Without -batch_targets that's opt itself, otherwise opt with
+//  the target fields of each line swapped in and the output moved to <outdir>/<name>
+std::vector< std::pair< std::string, RifDockOpt > >
+get_dock_target_opts( RifDockOpt const & opt ) {
+	std::vector< std::pair< std::string, RifDockOpt > > targets;
+	if ( opt.batch_targets.empty() ) {
+		targets.push_back( std::make_pair( path_basename( opt.target_pdb ), opt ) );
+		return targets;
+	}
 
-		::scheme::search::HackPackOpts packopts;
-		packopts.pack_n_iters         = opt.pack_n_iters;
-		packopts.pack_iter_mult       = opt.pack_iter_mult;
-		packopts.hbond_weight         = opt.hbond_weight;
-		packopts.upweight_iface       = opt.upweight_iface;
-		packopts.upweight_multi_hbond = opt.upweight_multi_hbond;
-		packopts.min_hb_quality_for_satisfaction = opt.min_hb_quality_for_satisfaction;
-		packopts.use_extra_rotamers   = opt.extra_rotamers;
-		packopts.always_available_rotamers_level = opt.always_available_rotamers_level;
-		packopts.packing_use_rif_rotamers = opt.packing_use_rif_rotamers;
-		packopts.add_native_scaffold_rots_when_packing = opt.add_native_scaffold_rots_when_packing;
-		packopts.rotamer_inclusion_threshold = -0.5;//-0.5
-		packopts.rotamer_onebody_inclusion_threshold = opt.rotamer_onebody_inclusion_threshold;//5
-		packopts.init_with_best_1be_rots = true;
-		packopts.user_rotamer_bonus_constant=opt.user_rotamer_bonus_constant;
-		packopts.user_rotamer_bonus_per_chi=opt.user_rotamer_bonus_per_chi;
+	utility::io::izstream in( opt.batch_targets );
+	runtime_assert_msg( in.good(), "can't read -rif_dock:batch_targets " + opt.batch_targets );
+	std::set<std::string> names;
+	std::string line;
+	while ( std::getline( in, line ) ) {
+		line = line.substr( 0, line.find( '#' ) );
+		std::istringstream fields( line );
+		RifDockOpt t = opt;
+		std::string name, field, target_rif;
+		std::vector<std::string> bounding_xmaps;
+		bool any = false, has_bounding_xmaps = false;
+		while ( fields >> field ) {
+			any = true;
+			size_t const eq = field.find( '=' );
+			if ( eq == std::string::npos ) utility_exit_with_message( "expected key=value in " + opt.batch_targets + ", got: " + field );
+			std::string const key = field.substr( 0, eq ), value = field.substr( eq + 1 );
+			if      ( key == "name"             ) name = value;
+			else if ( key == "target_pdb"       ) t.target_pdb = value;
+			else if ( key == "target_res"       ) t.target_res_fname = value;
+			else if ( key == "target_rif"       ) target_rif = value;
+			else if ( key == "target_rf_cache"  ) t.target_rf_cache = value;
+			else if ( key == "target_donors"    ) t.target_donors = value;
+			else if ( key == "target_acceptors" ) t.target_acceptors = value;
+			else if ( key == "output_tag"       ) t.output_tag = value;
+			else if ( key == "target_bounding_xmaps" ) {
+				has_bounding_xmaps = true;
+				for ( std::string const & fn : utility::string_split( value, ',' ) ) bounding_xmaps.push_back( fn );
+			}
+			else utility_exit_with_message( "unknown key in " + opt.batch_targets + ": " + key );
+		}
+		if ( ! any ) continue;
+		if ( name.empty() || name.find( '/' ) != std::string::npos ) {
+			utility_exit_with_message( "every line of " + opt.batch_targets + " needs a name=, without slashes: " + line );
+		}
+		if ( ! names.insert( name ).second ) utility_exit_with_message( "target name used twice in " + opt.batch_targets + ": " + name );
 
-		std::string const rif_type = get_rif_type_from_file( opt.rif_files.back() );
-		BOOST_FOREACH( std::string fn, opt.rif_files ){
-			std::string rif_type2 = get_rif_type_from_file( fn );
-			runtime_assert_msg( rif_type==rif_type2, "mismatched rif types, expect: " + rif_type + " got: " + rif_type2 + " for " + fn );
+		// same order as init_from_cli, bounding rifs then the rif
+		if ( has_bounding_xmaps || target_rif.size() ) {
+			if ( ! has_bounding_xmaps ) bounding_xmaps.assign( opt.rif_files.begin(), opt.rif_files.end() - 1 );
+			bounding_xmaps.push_back( target_rif.size() ? target_rif : opt.rif_files.back() );
+			t.rif_files = bounding_xmaps;
 		}
-		std::cout << "read RIF type: " << rif_type << std::endl;
+		runtime_assert_msg( t.rif_files.back().size(), "no target_rif for target " + name );
 
-		cout << "Search Resls: " << opt.resl0;
-			std::vector<float> RESLS(1,opt.resl0);
-			for( int i = 1; i < opt.rif_files.size(); ++i ){
-				RESLS.push_back( RESLS.back()/2.0 );
-				cout << " " << RESLS.back();
+		t.outdir = opt.outdir + "/" + name;
+		t.dokfile_fname = t.outdir + "/" + path_basename( opt.dokfile_fname );
+		if ( opt.results_store.size() ) t.results_store = t.outdir + "/" + path_basename( opt.results_store );
+		targets.push_back( std::make_pair( name, t ) );
+	}
+	runtime_assert_msg( targets.size(), "no targets in " + opt.batch_targets );
+	return targets;
+}
+
+
+// Drops whatever the scaffolds of this provider built against the last target, see
+//  ScaffoldDataCache::clear_target_data
+void
+clear_scaffold_target_data( ScaffoldProviderOP const & scaffold_provider ) {
+	::scheme::scaffold::TreeLimits limits = scaffold_provider->get_scaffold_index_limits();
+	for ( uint16_t depth = 0; depth < limits.size(); depth++ ) {
+		for ( uint16_t member = 0; member < limits[depth]; member++ ) {
+			scaffold_provider->get_data_cache_slow( ScaffoldIndex( depth, member ) )->clear_target_data();
+		}
+	}
+}
+
+
+// Per target results and where the time went. Scaffold setup is shared by all targets
+void
+print_dock_target_summary(
+	std::ostream & out,
+	std::vector< shared_ptr<DockTarget> > const & dock_targets,
+	int n_scaffolds,
+	double time_scaffold_setup
+) {
+	using ObjexxFCL::format::A;
+	using ObjexxFCL::format::F;
+	using ObjexxFCL::format::I;
+	int name_width = 6;
+	for ( shared_ptr<DockTarget> const & t : dock_targets ) name_width = std::max<int>( name_width, t->name.size() );
+
+	out << A( name_width, "target" ) << " " << A( 9, "scaffolds" ) << " " << A( 6, "errors" ) << " " << A( 10, "results" )
+	    << " " << A( 9, "best" ) << " " << A( 9, "setup_s" ) << " " << A( 9, "dock_s" ) << " " << A( 9, "rif_s" )
+	    << " " << A( 9, "pack_s" ) << " " << A( 9, "rosetta_s" ) << std::endl;
+	double total_setup = 0, total_dock = 0;
+	for ( shared_ptr<DockTarget> const & t : dock_targets ) {
+		out << A( name_width, t->name ) << " " << I( 9, t->n_scaffolds ) << " " << I( 6, t->n_errors ) << " " << I( 10, t->n_results )
+		    << " " << F( 9, 3, t->n_results ? t->best_score : 0.0f ) << " " << F( 9, 1, t->time_setup ) << " " << F( 9, 1, t->time_dock )
+		    << " " << F( 9, 1, t->time_rif ) << " " << F( 9, 1, t->time_pck ) << " " << F( 9, 1, t->time_ros ) << std::endl;
+		total_setup += t->time_setup;
+		total_dock += t->time_dock;
+	}
+	out << "target setup:   " << F( 9, 1, total_setup ) << "s for " << dock_targets.size() << " targets" << std::endl;
+	out << "scaffold setup: " << F( 9, 1, time_scaffold_setup ) << "s for " << n_scaffolds << " scaffolds, done once for all targets" << std::endl;
+	out << "docking:        " << F( 9, 1, total_dock ) << "s" << std::endl;
+}
+
+
+// Target grids in a SharedArena. Each distinct grid is one block "grid<i>", its bounds and shape
+//  then the floats. "grid_index" says which grid goes in which slot: the number of
+//  target_field_by_atype slots and their grid numbers, then per resolution the same for
+//  target_bounding_by_atype. -1 is an empty slot
+struct SharedGridHeader {
+	float lb[3], ub[3], cs[3];
+	uint64_t shape[3];
+};
+
+inline
+size_t
+shared_grid_bytes( VoxelArrayPtr grid ) {
+	return sizeof(SharedGridHeader) + grid->num_elements() * sizeof(float);
+}
+
+// grids in slot order, the same grid can be in several slots
+std::vector< std::vector< VoxelArrayPtr > >
+target_grid_slots( DockTarget const & t ) {
+	std::vector< std::vector< VoxelArrayPtr > > slots( 1, t.target_field_by_atype );
+	slots.insert( slots.end(), t.target_bounding_by_atype.begin(), t.target_bounding_by_atype.end() );
+	return slots;
+}
+
+// what export_dock_target_shared will allocate, for SharedArena::create
+size_t
+shared_dock_target_bytes( DockTarget const & t, std::vector<bool> const & resl_load_map ) {
+	using ::scheme::util::SharedArena;
+	size_t bytes = SharedArena::header_bytes(), nslots = 0;
+	std::set<VoxelArrayPtr> grids;
+	for ( std::vector< VoxelArrayPtr > const & grid_slots : target_grid_slots( t ) ) {
+		nslots += grid_slots.size() + 1;
+		for ( VoxelArrayPtr grid : grid_slots ) {
+			if ( grid && grids.insert( grid ).second ) bytes += SharedArena::round_up( shared_grid_bytes( grid ) );
+		}
+	}
+	bytes += SharedArena::round_up( ( nslots + 1 ) * sizeof(int64_t) );
+	for ( int i = 0; i < t.rif_ptrs.size(); ++i ) {
+		if ( resl_load_map.at( i ) && t.rif_ptrs[i] ) bytes += SharedArena::round_up( t.rif_ptrs[i]->shared_bytes() );
+	}
+	return bytes;
+}
+
+// Copies the rifs and grids of a prepared target into arena for attach_dock_target_shared
+void
+export_dock_target_shared( DockTarget const & t, ::scheme::util::SharedArena & arena, std::vector<bool> const & resl_load_map ) {
+	std::vector< std::vector< VoxelArrayPtr > > const slots = target_grid_slots( t );
+	std::map< VoxelArrayPtr, int64_t > grid_numbers;
+	std::vector<int64_t> index( 1, slots.size() );
+	for ( std::vector< VoxelArrayPtr > const & grid_slots : slots ) {
+		index.push_back( grid_slots.size() );
+		for ( VoxelArrayPtr grid : grid_slots ) {
+			if ( ! grid ) {
+				index.push_back( -1 );
+				continue;
 			}
-			cout << endl;
-
-		std::cout << "opt.rosetta_score_fraction: " << opt.rosetta_score_fraction << std::endl;
-		std::cout << "opt.rosetta_score_then_min_below_thresh: " << opt.rosetta_score_then_min_below_thresh << std::endl;
-		std::cout << "opt.rosetta_score_at_least: " << opt.rosetta_score_at_least << std::endl;
-		std::cout << "opt.rosetta_score_at_most: " << opt.rosetta_score_at_most << std::endl;
-		std::cout << "opt.rosetta_min_fraction: " << opt.rosetta_min_fraction << std::endl;
-		std::cout << "opt.rosetta_min_targetbb: " << opt.rosetta_min_targetbb << std::endl;
-		std::cout << "opt.rosetta_min_allbb: " << opt.rosetta_min_allbb << std::endl;
-		std::cout << "opt.rosetta_score_cut: " << opt.rosetta_score_cut << std::endl;
-		std::cout << "opt.require_satisfaction: " << opt.require_satisfaction << std::endl;
-
-		std::cout << "//////////////////////////// end options /////////////////////////////////" << std::endl;
-
-
-
-		// for( int iscaff = 0; iscaff < opt.scaffold_fnames.size(); ++iscaff )
-		// {
-		// 	std::string scaff_fname = opt.scaffold_fnames.at(iscaff);
-		// 	std::cout << scaff_fname << std::endl;
-		// 	core::pose::Pose scaffold;
-		// 	utility::vector1<core::Size> scaffold_res;
-		// 	core::import_pose::pose_from_file(scaffold, scaff_fname);
-		// 	scaff_fname = utility::file::file_basename(utility::file_basename(scaff_fname));
-		// 	scaffold.dump_pdb(scaff_fname+"_0.pdb");
-		// 	scaffold_res = devel::scheme::get_designable_positions_best_guess( scaffold, opt.dont_use_scaffold_loops );
-		// 	::devel::scheme::pose_to_ala( scaffold, scaffold_res );
-		// 	scaffold.dump_pdb(scaff_fname+"_1.pdb");
-		// }
-		// utility_exit_with_message("test_scaff sel");
-
-
-		////////////////////////////// should be no more use of options at this point! ///////////////////////////
-
-
-		double time_rif=0, time_pck=0, time_ros=0;
-
-		std::mt19937 rng( 0);//std::random_device{}() );
-
-
-		{
-			std::string dokfile_fname_orig = opt.dokfile_fname;
-			int i = 2;
-			while( utility::file::file_exists(opt.dokfile_fname) ){
-				opt.dokfile_fname = dokfile_fname_orig + "." + str(i);
-				++i;
+			auto inserted = grid_numbers.insert( std::make_pair( grid, (int64_t)grid_numbers.size() ) );
+			index.push_back( inserted.first->second );
+			if ( ! inserted.second ) continue;
+			char * out = (char*)arena.allocate( "grid" + str( inserted.first->second ), shared_grid_bytes( grid ) );
+			runtime_assert_msg( out, "shared memory too small for the target grids" );
+			SharedGridHeader & h = *(SharedGridHeader*)out;
+			for ( int k = 0; k < 3; ++k ) {
+				h.lb[k] = grid->lb_[k];
+				h.ub[k] = grid->ub_[k];
+				h.cs[k] = grid->cs_[k];
+				h.shape[k] = grid->shape()[k];
 			}
-			if( i != 2)
-				std::cout << "WARNING!" << dokfile_fname_orig << " already exists, using "
-			              << opt.dokfile_fname << " instead!" << std::endl;
-             else
-             	std::cout << "output scores to " << opt.dokfile_fname << std::endl;
+			std::copy( grid->data(), grid->data() + grid->num_elements(), (float*)( out + sizeof(SharedGridHeader) ) );
 		}
-		utility::io::ozstream dokout( opt.dokfile_fname );
-
-
-		devel::scheme::RifFactoryConfig rif_factory_config;
-		rif_factory_config.rif_type = rif_type;
-		shared_ptr<RifFactory> rif_factory = ::devel::scheme::create_rif_factory( rif_factory_config );
-
-
-	print_header( "create rotamer index" );
-		
-		std::cout << "Loading " << opt.rot_spec_fname << "..." << std::endl;
-		std::string rot_index_spec_file = opt.rot_spec_fname;
-
-		::scheme::chemical::RotamerIndexSpec rot_index_spec;					// we need per-thread rotamers for new faster 1-bodies
-		shared_ptr< RotamerIndex > rot_index_p = ::devel::scheme::get_rotamer_index( rot_index_spec_file, true, rot_index_spec );
-		RotamerIndex & rot_index( *rot_index_p );
-
-
-		std::cout << "================ RotamerIndex ===================" << std::endl;
-		std::cout << rot_index << std::endl;
-		std::cout << "=================================================" << std::endl;
+	}
+	int64_t * index_out = (int64_t*)arena.allocate( "grid_index", index.size() * sizeof(int64_t) );
+	runtime_assert_msg( index_out, "shared memory too small for the target grid index" );
+	std::copy( index.begin(), index.end(), index_out );
 
-		if ( opt.dump_all_rifdock_rotamers ) {
-			std::cout << "Dumping all residues from the rotamer spec to rifdock_rotamerspec.pdb" << std::endl;
-			rot_index_spec.dump_all_rotspec_rotamers("rifdock_rotamerspec.pdb");
+	for ( int i = 0; i < t.rif_ptrs.size(); ++i ) {
+		if ( ! resl_load_map.at( i ) || ! t.rif_ptrs[i] ) continue;
+		runtime_assert_msg( t.rif_ptrs[i]->export_shared( arena, "rif" + str( i ) ), "shared memory too small for rif " + str( i ) );
+	}
+}
+
+// The grids export_dock_target_shared published, as VoxelArray views of the arena, not copies, so
+//  arena has to stay open while they are used. The rifs are attached where they are by
+//  prepare_dock_target
+void
+attach_target_grids_shared(
+	::scheme::util::SharedArena const & arena,
+	std::vector< VoxelArrayPtr > & target_field_by_atype,
+	std::vector< std::vector< VoxelArrayPtr > > & target_bounding_by_atype
+) {
+	size_t index_bytes = 0;
+	int64_t const * index = (int64_t const *)arena.find( "grid_index", &index_bytes );
+	runtime_assert_msg( index, "no target grids in shared memory " + arena.name() );
+	int64_t const * const index_end = index + index_bytes / sizeof(int64_t);
+	std::map< int64_t, VoxelArrayPtr > grids;
+	std::vector< std::vector< VoxelArrayPtr > > slots( *index++ );
+	for ( std::vector< VoxelArrayPtr > & grid_slots : slots ) {
+		runtime_assert( index < index_end );
+		grid_slots.resize( *index++ );
+		for ( VoxelArrayPtr & grid : grid_slots ) {
+			runtime_assert( index < index_end );
+			int64_t const igrid = *index++;
+			if ( igrid < 0 ) continue;
+			VoxelArrayPtr & cached = grids[ igrid ];
+			if ( ! cached ) {
+				size_t bytes = 0;
+				char const * in = (char const*)arena.find( "grid" + str( igrid ), &bytes );
+				runtime_assert_msg( in && bytes >= sizeof(SharedGridHeader), "missing target grid " + str( igrid ) + " in shared memory " + arena.name() );
+				SharedGridHeader const & h = *(SharedGridHeader const*)in;
+				cached = new VoxelArray;
+				VoxelArray::Indices extents;
+				for ( int k = 0; k < 3; ++k ) {
+					cached->lb_[k] = h.lb[k];
+					cached->ub_[k] = h.ub[k];
+					cached->cs_[k] = h.cs[k];
+					extents[k] = h.shape[k];
+				}
+				cached->attach_view( (float const*)( in + sizeof(SharedGridHeader) ), extents );
+				runtime_assert( bytes == shared_grid_bytes( cached ) );
+			}
+			grid = cached;
 		}
-
-
-		RotamerRFOpts rotrfopts;
-		rotrfopts.oversample     = opt.rotrf_oversample;
-		rotrfopts.field_resl     = opt.rotrf_resl;
-		rotrfopts.field_spread   = opt.rotrf_spread;
-		rotrfopts.data_dir       = opt.rotrf_cache_dir;
-		rotrfopts.scale_atr      = opt.rotrf_scale_atr;
-		::devel::scheme::RotamerRFTablesManager rotrf_table_manager( rot_index_p, rotrfopts );
-		// rotrf_table_manager.preinit_all();
-		
-
-		MakeTwobodyOpts make2bopts;
-		// hacked by brian             VVVV
-		make2bopts.onebody_threshold = 4;
-		make2bopts.distance_cut = 15.0;
-		make2bopts.hbond_weight = packopts.hbond_weight;
-		make2bopts.favorable_2body_multiplier = opt.favorable_2body_multiplier;
-
-
-
+	}
+	runtime_assert( slots.size() >= 1 );
+	target_field_by_atype = slots.front();
+	target_bounding_by_atype.assign( slots.begin() + 1, slots.end() );
+}
+
+
+// Reads a target structure, its grids and its rifs into t. Everything in here depends on
+//  t.opt's target files and nothing else does. With shared_arena the grids and rifs come from
+//  there, as another process published them, instead of from files
+void
+prepare_dock_target(
+	DockTarget & t,
+	shared_ptr< RotamerIndex > rot_index_p,
+	::scheme::chemical::RotamerIndexSpec & rot_index_spec,
+	::scheme::search::HackPackOpts const & packopts,
+	std::vector<float> const & RESLS,
+	std::vector<bool> const & resl_load_map,
+	shared_ptr<RifFactory> const & rif_factory,
+	::scheme::util::SharedArena const * shared_arena = nullptr
+) {
+	using std::cout;
+	using std::endl;
+	using ObjexxFCL::format::F;
+
+	RifDockOpt & opt = t.opt;
+	RotamerIndex & rot_index( *rot_index_p );
 
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	print_header( "read and prepare target structure" ); //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	core::pose::Pose target;
-	std::vector<SimpleAtom> target_simple_atoms;
-	utility::vector1<core::Size> target_res;
-	std::vector<HBondRay> target_donors, target_acceptors;
-	float rif_radius=0.0, target_redundancy_filter_rg=0.0;
-	shared_ptr<BurialManager> burial_manager;
-	shared_ptr<UnsatManager> unsat_manager;
-	bool donor_acceptors_from_file = false;
+	core::pose::Pose & target = t.target;
+	std::vector<SimpleAtom> & target_simple_atoms = t.target_simple_atoms;
+	utility::vector1<core::Size> & target_res = t.target_res;
+	std::vector<HBondRay> & target_donors = t.target_donors, & target_acceptors = t.target_acceptors;
+	float & rif_radius = t.rif_radius, & target_redundancy_filter_rg = t.target_redundancy_filter_rg;
+	shared_ptr<BurialManager> & burial_manager = t.burial_manager;
+	shared_ptr<UnsatManager> & unsat_manager = t.unsat_manager;
+	bool & donor_acceptors_from_file = t.donor_acceptors_from_file;
 	{
 		core::import_pose::pose_from_file( target, opt.target_pdb );
 
@@ -425,22 +574,13 @@ int main(int argc, char *argv[]) {
 		// }
 	}
 
-	std::vector<bool> resl_load_map(RESLS.size(), true);	// by default load all resls
-
-	if ( opt.only_load_highest_resl ) {
-		for ( int i = 0; i < resl_load_map.size() - 1; i++) {
-			resl_load_map[i] = false;
-		}
-	}
-	if ( opt.dont_load_any_resl ) {
-		for ( int i = 0; i < resl_load_map.size(); i++) {
-			resl_load_map[i] = false;
-		}
-	}
-
-	std::vector< VoxelArrayPtr > target_field_by_atype;
-	std::vector< std::vector< VoxelArrayPtr > > target_bounding_by_atype;
-	{
+	std::vector< VoxelArrayPtr > & target_field_by_atype = t.target_field_by_atype;
+	std::vector< std::vector< VoxelArrayPtr > > & target_bounding_by_atype = t.target_bounding_by_atype;
+	if ( shared_arena ) {
+		// already downscaled by the loader
+		attach_target_grids_shared( *shared_arena, target_field_by_atype, target_bounding_by_atype );
+		runtime_assert( target_bounding_by_atype.size() == RESLS.size() );
+	} else {
 		target_bounding_by_atype.resize( RESLS.size() );
 		devel::scheme::RosettaFieldOptions rfopts;
 		rfopts.field_resl = opt.target_rf_resl;
@@ -522,7 +662,7 @@ int main(int argc, char *argv[]) {
 
 
 #ifdef USEGRIDSCORE
-	shared_ptr<protocols::ligand_docking::ga_ligand_dock::GridScorer> grid_scorer;
+	shared_ptr<protocols::ligand_docking::ga_ligand_dock::GridScorer> & grid_scorer = t.grid_scorer;
 	if ( opt.use_rosetta_grid_energies ) {
 		print_header( "preparing rosetta energy grids" );
 		grid_scorer = prepare_grid_scorer( target, target_res );
@@ -534,7 +674,7 @@ int main(int argc, char *argv[]) {
 #endif
 
 
-    RifScoreRotamerVsTarget rot_tgt_scorer;
+    RifScoreRotamerVsTarget & rot_tgt_scorer = t.rot_tgt_scorer;
     rot_tgt_scorer.rot_index_p_ = rot_index_p;
     rot_tgt_scorer.target_field_by_atype_ = target_field_by_atype;
     rot_tgt_scorer.target_donors_ = target_donors;
@@ -555,15 +695,28 @@ int main(int argc, char *argv[]) {
     rot_tgt_scorer.target_donor_cache_ = target_donor_cache;
     rot_tgt_scorer.target_acceptor_cache_ = target_acceptor_cache;
 
+    if( opt.quantize_target_field ){
+        size_t mem_before = 0, mem_after = 0;
+        float max_error = rot_tgt_scorer.quantize_target_fields( opt.quantize_target_field_max );
+        for( int i = 0; i < target_field_by_atype.size(); ++i ){
+            if( ! target_field_by_atype[i] ) continue;
+            mem_before += target_field_by_atype[i]->num_elements() * sizeof(float);
+            mem_after += rot_tgt_scorer.target_field_quantized_by_atype_[i]->mem_use();
+        }
+        std::cout << "quantized target fields " << ::devel::scheme::KMGT(mem_before) << " -> " << ::devel::scheme::KMGT(mem_after)
+                  << ", max error per atom " << max_error << std::endl;
+    }
+    {
+        std::set<VoxelArrayPtr> grids( target_field_by_atype.begin(), target_field_by_atype.end() );
+        for ( std::vector<VoxelArrayPtr> const & by_atype : target_bounding_by_atype ) grids.insert( by_atype.begin(), by_atype.end() );
+        size_t grid_bytes = 0;
+        for ( VoxelArrayPtr grid : grids ) if ( grid ) grid_bytes += grid->num_elements() * sizeof(float);
+        for ( auto const & quantized : rot_tgt_scorer.target_field_quantized_by_atype_ ) if ( quantized ) grid_bytes += quantized->mem_use();
+        ::scheme::util::mem_category( "target_fields" ).add( grid_bytes );
+    }
 
-	// These numbers are magic, you can't change any individually
-	// They come from fitting against 4S0U with 20 mini-proteins (64aa)
-	// Ideally these will predict SASA after soft_design soft_min
-	// Details at /home/bcov/rifdock/parametrization/sasa
-	const float sasa_threshold = 10.0f;
-	const float sasa_distance = 7.0f;
-	const float sasa_slope = 24.0f;
-	shared_ptr<BurialVoxelArray> sasa_grid;
+
+	shared_ptr<BurialVoxelArray> & sasa_grid = t.sasa_grid;
 
     if ( opt.need_to_calculate_sasa ) {
 
@@ -585,7 +738,7 @@ int main(int argc, char *argv[]) {
 
     }
 
-    shared_ptr<HydrophobicManager> hydrophobic_manager;
+    shared_ptr<HydrophobicManager> & hydrophobic_manager = t.hydrophobic_manager;
     if ( opt.require_hydrophobic_residue_contacts > 0 || opt.hydrophobic_ddg_cut < 0 ||
         	opt.one_hydrophobic_better_than < 0 ||
         	opt.two_hydrophobics_better_than < 0 ||
@@ -619,8 +772,8 @@ int main(int argc, char *argv[]) {
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	print_header( "read in RIFs" ); /////////////////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	std::vector<shared_ptr<RifBase> > rif_ptrs;
-	std::vector<bool> rif_using_rot;
+	std::vector<shared_ptr<RifBase> > & rif_ptrs = t.rif_ptrs;
+	std::vector<bool> & rif_using_rot = t.rif_using_rot;
 	{
 		std::vector<std::string> rif_descriptions( opt.rif_files.size() );
 		rif_ptrs.resize( opt.rif_files.size() );
@@ -638,8 +791,18 @@ int main(int argc, char *argv[]) {
 						rif_ptr = nullptr;
 						continue;
 				}
-				rif_ptr = rif_factory->create_rif_from_file( rif_file, rif_dscr );
+				if ( shared_arena ) {
+					rif_ptr = rif_factory->create_rif();
+					runtime_assert_msg( rif_ptr->attach_shared( *shared_arena, "rif" + str( i_readmap ) ),
+						"no rif " + str( i_readmap ) + " in shared memory " + shared_arena->name() );
+					rif_dscr = "shared memory copy of " + rif_file;
+				} else {
+					rif_ptr = rif_factory->create_rif_from_file( rif_file, rif_dscr );
+				}
 				runtime_assert_msg( rif_ptrs[i_readmap] , "rif creation from file failed! " + rif_file );
+				if( opt.rif_bin_filter_bits_per_key > 0 && ! rif_ptr->has_bin_filter() ){
+					rif_ptr->build_bin_filter( opt.rif_bin_filter_bits_per_key );
+				}
 				if( opt.VERBOSE ){
 					#ifdef USE_OPENMP
 					#pragma omp critical
@@ -679,6 +842,23 @@ int main(int argc, char *argv[]) {
 			}
 		}
 
+		if ( opt.rif_huge_pages != 0 || opt.rif_numa_mode != "none" ) {
+			std::cout << "placing rifs in memory, huge pages: " << opt.rif_huge_pages << " numa: " << opt.rif_numa_mode
+			          << " (" << ::scheme::util::numa_num_nodes() << " nodes)" << std::endl;
+			std::set< ::devel::scheme::RifBase* > placed;
+			for( auto & rif : rif_ptrs ){
+				if( ! rif || ! placed.insert( rif.get() ).second ) continue;
+				rif->set_memory_placement( opt.rif_huge_pages, opt.rif_numa_mode );
+			}
+		}
+
+		{
+			std::set< ::devel::scheme::RifBase* > counted;
+			size_t rif_bytes = 0;
+			for( auto & rif : rif_ptrs ) if( rif && counted.insert( rif.get() ).second ) rif_bytes += rif->mem_use();
+			::scheme::util::mem_category( "rif" ).add( rif_bytes );
+		}
+
 		rif_using_rot.resize( rot_index_p->size(), false );
 
 		if ( rif_ptrs.back() ) {
@@ -686,6 +866,7 @@ int main(int argc, char *argv[]) {
 			std::cout << "load factor: " << rif_ptrs.back()->load_factor() << std::endl;
 			std::cout << "size of value-type: " << rif_ptrs.back()->sizeof_value_type() << std::endl;
 			std::cout << "mem_use: " << ::devel::scheme::KMGT( rif_ptrs.back()->mem_use() ) << std::endl;
+			std::cout << "bin filter: " << ( rif_ptrs.back()->has_bin_filter() ? "yes" : "no" ) << std::endl;
 			std::cout << "===================================================================================" << std::endl;
 
 			rif_using_rot[ rot_index.ala_rot() ] = true; // always include ala
@@ -820,52 +1001,394 @@ int main(int argc, char *argv[]) {
 			rif_ptrs.back()->dump_the_best_rifres( opt.dump_best_rifgen_rots, opt.dump_best_rifgen_rmsd, rot_index_p );
 		}
 	}
+}
 
 
-    if( 0 == opt.scaffold_fnames.size() ){
-        std::cout << "WARNING: NO SCAFFOLDS!!!!!!" << std::endl;
-    }
 
+}}
 
-	bool needs_nest_director = opt.xform_fname != "IDENTITY";
-	bool needs_stored_nest_director = needs_nest_director && opt.xform_fname != "";
 
-	std::vector< EigenXform > xform_positions;
 
-	if ( needs_stored_nest_director ) {
-		std::vector< std::pair< int64_t, EigenXform > > xform_pairs;
-		runtime_assert_msg(parse_exhausitive_searching_file(opt.xform_fname, xform_pairs /*, 10*/), "Faild to parse the xform file!!!");
-		xform_positions.reserve( xform_pairs.size() );
-		for ( auto const & pair : xform_pairs ) xform_positions.push_back( pair.second );
-	}
+int main(int argc, char *argv[]) {
 
-	for( int iscaff = 0; iscaff < opt.scaffold_fnames.size(); ++iscaff )
-	{
-		std::string scaff_fname = opt.scaffold_fnames.at(iscaff);
-		std::vector<std::string> scaffold_sequence_glob0;				// Scaffold sequence in name3 space
-		utility::vector1<core::Size> scaffold_res;//, scaffold_res_all; // Seqposs of residues to design, default whole scaffold
-		try {
 
-			ProtocolData pd;
+	register_options();
+	devel::init(argc,argv);
 
-			runtime_assert( rot_index_p );
-			std::string scafftag = utility::file_basename( utility::file::file_basename( scaff_fname ) );
+	devel::scheme::fix_omp_max_threads();
+	std::cout << "Rifdock thinks there are " << devel::scheme::omp_max_threads() << " threads." << std::endl;
 
-			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
-			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
-			std::cout << "//////   begin scaffold " << scafftag << " " << iscaff << " of " << opt.scaffold_fnames.size() << std::endl;
-			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
-			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
 
+	devel::scheme::print_header( "setup global options" );
+	RifDockOpt opt;
+	opt.init_from_cli();
+	utility::file::create_directory_recursive( opt.outdir );
+	::scheme::util::set_mem_budget( (int64_t)( opt.mem_budget_G * 1024.0 * 1024.0 * 1024.0 ) );
+	if ( opt.perf_counters ) {
+		::scheme::util::enable_perf_counters();
+		if ( ! ::scheme::util::perf_counters_available() ) std::cout << "WARNING: no hardware perf counters, -perf_counters will only time regions" << std::endl;
+	}
 
-			bool needs_scaffold_director = false;
 
-			ScaffoldProviderOP scaffold_provider = get_scaffold_provider(
-				iscaff,
+
+	#ifdef USE_OPENMP
+		omp_lock_t cout_lock, dump_lock;
+		omp_init_lock( &cout_lock );
+		omp_init_lock( &dump_lock );
+	#endif
+
+
+	using namespace core::scoring;
+		using std::cout;
+		using std::endl;
+		using namespace devel::scheme;
+		typedef numeric::xyzVector<core::Real> Vec;
+		typedef numeric::xyzMatrix<core::Real> Mat;
+		// typedef numeric::xyzTransform<core::Real> Xform;
+		using ObjexxFCL::format::F;
+		using ObjexxFCL::format::I;
+		using devel::scheme::print_header;
+		using ::devel::scheme::RotamerIndex;
+
+	/////////////////////////////////////////////////////////////////////////////////
+	/////////////////////// static shit
+	////////////////////////////////////////////////////////////////////////////////
+	typedef ::scheme::util::SimpleArray<3,float> F3;
+	typedef ::scheme::util::SimpleArray<3,int> I3;
+
+
+
+		::scheme::search::HackPackOpts packopts;
+		packopts.pack_n_iters         = opt.pack_n_iters;
+		packopts.pack_iter_mult       = opt.pack_iter_mult;
+		packopts.hbond_weight         = opt.hbond_weight;
+		packopts.upweight_iface       = opt.upweight_iface;
+		packopts.upweight_multi_hbond = opt.upweight_multi_hbond;
+		packopts.min_hb_quality_for_satisfaction = opt.min_hb_quality_for_satisfaction;
+		packopts.use_extra_rotamers   = opt.extra_rotamers;
+		packopts.always_available_rotamers_level = opt.always_available_rotamers_level;
+		packopts.packing_use_rif_rotamers = opt.packing_use_rif_rotamers;
+		packopts.add_native_scaffold_rots_when_packing = opt.add_native_scaffold_rots_when_packing;
+		packopts.rotamer_inclusion_threshold = -0.5;//-0.5
+		packopts.rotamer_onebody_inclusion_threshold = opt.rotamer_onebody_inclusion_threshold;//5
+		packopts.init_with_best_1be_rots = true;
+		packopts.user_rotamer_bonus_constant=opt.user_rotamer_bonus_constant;
+		packopts.user_rotamer_bonus_per_chi=opt.user_rotamer_bonus_per_chi;
+
+		// just opt unless -batch_targets
+		std::vector< std::pair< std::string, RifDockOpt > > target_opts = get_dock_target_opts( opt );
+		// the morph modes grow the scaffold tree during the search, and the tree is kept from one
+		//  target to the next along with the rest of the scaffold
+		if ( target_opts.size() > 1 && ( opt.scaff_search_mode == "morph" || opt.scaff_search_mode == "morph_dive_pop" ) ) {
+			utility_exit_with_message( "-batch_targets can't be used with the morph scaffold search modes" );
+		}
+
+		std::string const rif_type = get_rif_type_from_file( target_opts.front().second.rif_files.back() );
+		for( auto const & name_opt : target_opts ){
+			runtime_assert_msg( name_opt.second.rif_files.size() == target_opts.front().second.rif_files.size(),
+				"target " + name_opt.first + " has a different number of bounding rifs" );
+			BOOST_FOREACH( std::string fn, name_opt.second.rif_files ){
+				std::string rif_type2 = get_rif_type_from_file( fn );
+				runtime_assert_msg( rif_type==rif_type2, "mismatched rif types, expect: " + rif_type + " got: " + rif_type2 + " for " + fn );
+			}
+		}
+		std::cout << "read RIF type: " << rif_type << std::endl;
+
+		cout << "Search Resls: " << opt.resl0;
+			std::vector<float> RESLS(1,opt.resl0);
+			for( int i = 1; i < target_opts.front().second.rif_files.size(); ++i ){
+				RESLS.push_back( RESLS.back()/2.0 );
+				cout << " " << RESLS.back();
+			}
+			cout << endl;
+
+		std::cout << "opt.rosetta_score_fraction: " << opt.rosetta_score_fraction << std::endl;
+		std::cout << "opt.rosetta_score_then_min_below_thresh: " << opt.rosetta_score_then_min_below_thresh << std::endl;
+		std::cout << "opt.rosetta_score_at_least: " << opt.rosetta_score_at_least << std::endl;
+		std::cout << "opt.rosetta_score_at_most: " << opt.rosetta_score_at_most << std::endl;
+		std::cout << "opt.rosetta_min_fraction: " << opt.rosetta_min_fraction << std::endl;
+		std::cout << "opt.rosetta_min_targetbb: " << opt.rosetta_min_targetbb << std::endl;
+		std::cout << "opt.rosetta_min_allbb: " << opt.rosetta_min_allbb << std::endl;
+		std::cout << "opt.rosetta_score_cut: " << opt.rosetta_score_cut << std::endl;
+		std::cout << "opt.require_satisfaction: " << opt.require_satisfaction << std::endl;
+
+		std::cout << "//////////////////////////// end options /////////////////////////////////" << std::endl;
+
+
+
+		// for( int iscaff = 0; iscaff < opt.scaffold_fnames.size(); ++iscaff )
+		// {
+		// 	std::string scaff_fname = opt.scaffold_fnames.at(iscaff);
+		// 	std::cout << scaff_fname << std::endl;
+		// 	core::pose::Pose scaffold;
+		// 	utility::vector1<core::Size> scaffold_res;
+		// 	core::import_pose::pose_from_file(scaffold, scaff_fname);
+		// 	scaff_fname = utility::file::file_basename(utility::file_basename(scaff_fname));
+		// 	scaffold.dump_pdb(scaff_fname+"_0.pdb");
+		// 	scaffold_res = devel::scheme::get_designable_positions_best_guess( scaffold, opt.dont_use_scaffold_loops );
+		// 	::devel::scheme::pose_to_ala( scaffold, scaffold_res );
+		// 	scaffold.dump_pdb(scaff_fname+"_1.pdb");
+		// }
+		// utility_exit_with_message("test_scaff sel");
+
+
+		////////////////////////////// should be no more use of options at this point! ///////////////////////////
+
+
+		std::mt19937 rng( 0);//std::random_device{}() );
+
+
+		devel::scheme::RifFactoryConfig rif_factory_config;
+		rif_factory_config.rif_type = rif_type;
+		shared_ptr<RifFactory> rif_factory = ::devel::scheme::create_rif_factory( rif_factory_config );
+
+
+	print_header( "create rotamer index" );
+		
+		std::cout << "Loading " << opt.rot_spec_fname << "..." << std::endl;
+		std::string rot_index_spec_file = opt.rot_spec_fname;
+
+		::scheme::chemical::RotamerIndexSpec rot_index_spec;					// we need per-thread rotamers for new faster 1-bodies
+		shared_ptr< RotamerIndex > rot_index_p = ::devel::scheme::get_rotamer_index( rot_index_spec_file, true, rot_index_spec );
+		RotamerIndex & rot_index( *rot_index_p );
+
+
+		std::cout << "================ RotamerIndex ===================" << std::endl;
+		std::cout << rot_index << std::endl;
+		std::cout << "=================================================" << std::endl;
+
+		if ( opt.dump_all_rifdock_rotamers ) {
+			std::cout << "Dumping all residues from the rotamer spec to rifdock_rotamerspec.pdb" << std::endl;
+			rot_index_spec.dump_all_rotspec_rotamers("rifdock_rotamerspec.pdb");
+		}
+
+
+		RotamerRFOpts rotrfopts;
+		rotrfopts.oversample     = opt.rotrf_oversample;
+		rotrfopts.field_resl     = opt.rotrf_resl;
+		rotrfopts.field_spread   = opt.rotrf_spread;
+		rotrfopts.data_dir       = opt.rotrf_cache_dir;
+		rotrfopts.scale_atr      = opt.rotrf_scale_atr;
+		::devel::scheme::RotamerRFTablesManager rotrf_table_manager( rot_index_p, rotrfopts );
+		// rotrf_table_manager.preinit_all();
+		
+
+		MakeTwobodyOpts make2bopts;
+		// hacked by brian             VVVV
+		make2bopts.onebody_threshold = 4;
+		make2bopts.distance_cut = 15.0;
+		make2bopts.hbond_weight = packopts.hbond_weight;
+		make2bopts.favorable_2body_multiplier = opt.favorable_2body_multiplier;
+
+
+
+
+	std::vector<bool> resl_load_map(RESLS.size(), true);	// by default load all resls
+
+	if ( opt.only_load_highest_resl ) {
+		for ( int i = 0; i < resl_load_map.size() - 1; i++) {
+			resl_load_map[i] = false;
+		}
+	}
+	if ( opt.dont_load_any_resl ) {
+		for ( int i = 0; i < resl_load_map.size(); i++) {
+			resl_load_map[i] = false;
+		}
+	}
+
+	// -shared_memory_name: the loader publishes the rifs and grids of each target in an arena of its
+	//  own, then the scaffold queue. The others wait for the queue, join it, and attach the arenas
+	std::string const shared_memory_name = opt.shared_memory_name;
+	bool const shared_memory_loader = shared_memory_name.size() && opt.shared_memory_loader;
+	bool const shared_memory_worker = shared_memory_name.size() && ! opt.shared_memory_loader;
+	std::string const shared_queue_name = shared_memory_name + "_scaffolds";
+	auto shared_arena_name = [&]( int itarget ) { return shared_memory_name + "_target" + str( itarget ); };
+	shared_ptr< ::scheme::util::SharedWorkQueue > scaffold_queue;
+	std::vector< shared_ptr< ::scheme::util::SharedArena > > shared_arenas;
+	if ( shared_memory_name.size() ) {
+		scaffold_queue = make_shared< ::scheme::util::SharedWorkQueue >();
+		if ( shared_memory_loader ) {
+			// left from an earlier run, nobody should attach to those while this one loads
+			::scheme::util::SharedWorkQueue::unlink( shared_queue_name );
+			for ( int i = 0; i < target_opts.size(); ++i ) ::scheme::util::SharedArena::unlink( shared_arena_name( i ) );
+		} else {
+			print_header( "waiting for the shared memory loader" );
+			runtime_assert_msg( scaffold_queue->attach( shared_queue_name, opt.shared_memory_wait ),
+				"nothing from a -shared_memory_loader with -shared_memory_name " + shared_memory_name + " after " + str( opt.shared_memory_wait ) + "s" );
+			runtime_assert_msg( scaffold_queue->end() == opt.scaffold_fnames.size(), "the shared memory loader has a different number of scaffolds" );
+			if ( ! scaffold_queue->join() ) {
+				std::cout << "the shared scaffold queue is already done, nothing to dock" << std::endl;
+				return 0;
+			}
+		}
+	}
+
+	std::vector< shared_ptr<DockTarget> > dock_targets;
+	for ( auto const & name_opt : target_opts ) {
+		shared_ptr<DockTarget> t = make_shared<DockTarget>();
+		t->name = name_opt.first;
+		t->opt = name_opt.second;
+		if ( target_opts.size() > 1 ) {
+			print_header( "target " + t->name + " of " + str( target_opts.size() ) );
+			utility::file::create_directory_recursive( t->opt.outdir );
+		}
+		std::chrono::time_point<std::chrono::high_resolution_clock> start_setup = std::chrono::high_resolution_clock::now();
+
+		int const itarget = dock_targets.size();
+		shared_ptr< ::scheme::util::SharedArena > shared_arena;
+		if ( shared_memory_worker ) {
+			shared_arena = make_shared< ::scheme::util::SharedArena >();
+			runtime_assert_msg( shared_arena->attach( shared_arena_name( itarget ) ), "no shared memory for target " + t->name );
+		}
+
+		prepare_dock_target( *t, rot_index_p, rot_index_spec, packopts, RESLS, resl_load_map, rif_factory, shared_arena.get() );
+
+		if ( shared_memory_loader ) {
+			shared_arena = make_shared< ::scheme::util::SharedArena >();
+			runtime_assert_msg( shared_arena->create( shared_arena_name( itarget ), shared_dock_target_bytes( *t, resl_load_map ) ),
+				"can't create shared memory " + shared_arena_name( itarget ) );
+			export_dock_target_shared( *t, *shared_arena, resl_load_map );
+			shared_arena->publish();
+			// the loader docks from the shared copy too, so the node holds one copy of each rif
+			for ( int i = 0; i < t->rif_ptrs.size(); ++i ) {
+				if ( resl_load_map.at( i ) && t->rif_ptrs[i] ) runtime_assert( t->rif_ptrs[i]->attach_shared( *shared_arena, "rif" + str( i ) ) );
+			}
+			std::cout << "published rifs and grids of " << t->name << " in shared memory " << shared_arena->name()
+			          << ", " << ::devel::scheme::KMGT( shared_arena->used() ) << std::endl;
+		}
+		if ( shared_arena ) shared_arenas.push_back( shared_arena );
+
+		{
+			std::string dokfile_fname_orig = t->opt.dokfile_fname;
+			int i = 2;
+			while( utility::file::file_exists(t->opt.dokfile_fname) ){
+				t->opt.dokfile_fname = dokfile_fname_orig + "." + str(i);
+				++i;
+			}
+			if( i != 2)
+				std::cout << "WARNING!" << dokfile_fname_orig << " already exists, using "
+			              << t->opt.dokfile_fname << " instead!" << std::endl;
+             else
+             	std::cout << "output scores to " << t->opt.dokfile_fname << std::endl;
+		}
+		t->dokout = make_shared<utility::io::ozstream>( t->opt.dokfile_fname );
+
+		// shared by all scaffolds so the target grids are only built once
+		t->fft_prescan_target = make_shared<FFTPrescanTarget>();
+
+		// every output result of every scaffold, for rif_results_extract
+		if ( t->opt.results_store.size() ) {
+			std::map<std::string,std::string> meta;
+			meta["target_pdb"] = absolute_path( t->opt.target_pdb );
+			meta["rot_spec_fname"] = t->opt.rot_spec_fname;
+			t->results_store = make_shared< ResultsStoreWriter >( t->opt.results_store, results_store_extra_score_names(), meta );
+		}
+
+		t->time_setup = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start_setup ).count();
+		dock_targets.push_back( t );
+	}
+
+	if ( shared_memory_loader ) {
+		runtime_assert_msg( scaffold_queue->create( shared_queue_name, opt.scaffold_fnames.size() ), "can't create shared memory " + shared_queue_name );
+		std::cout << "processes with -shared_memory_name " << shared_memory_name << " can start docking" << std::endl;
+	}
+
+
+    if( 0 == opt.scaffold_fnames.size() ){
+        std::cout << "WARNING: NO SCAFFOLDS!!!!!!" << std::endl;
+    }
+
+
+	bool needs_nest_director = opt.xform_fname != "IDENTITY";
+	bool needs_stored_nest_director = needs_nest_director && opt.xform_fname != "";
+
+	std::vector< EigenXform > xform_positions;
+
+	if ( needs_stored_nest_director ) {
+		std::vector< std::pair< int64_t, EigenXform > > xform_pairs;
+		runtime_assert_msg(parse_exhausitive_searching_file(opt.xform_fname, xform_pairs /*, 10*/), "Faild to parse the xform file!!!");
+		xform_positions.reserve( xform_pairs.size() );
+		for ( auto const & pair : xform_pairs ) xform_positions.push_back( pair.second );
+	}
+
+	ScaffoldDataCacheManagerOP scaffold_data_cache_manager = nullptr;
+	if ( opt.scaffold_data_cache_budget_MB > 0 ) {
+		scaffold_data_cache_manager = make_shared<ScaffoldDataCacheManager>( (size_t)( opt.scaffold_data_cache_budget_MB * 1024.0 * 1024.0 ) );
+	} else if ( opt.mem_budget_G > 0 ) {
+		// no budget of its own, evicts only when the job is over -mem_budget_G
+		scaffold_data_cache_manager = make_shared<ScaffoldDataCacheManager>( std::numeric_limits<size_t>::max() );
+	}
+
+	// output of one scaffold is compressed and written while the next one docks
+	shared_ptr< ::scheme::io::AsyncWriter > results_writer;
+	if ( opt.output_writer_threads > 0 ) {
+		results_writer = make_shared< ::scheme::io::AsyncWriter >( opt.output_writer_threads, (size_t)( opt.output_writer_queue_MB * 1024.0 * 1024.0 ) );
+	}
+
+	// one per process, it numbers repeated searches of a scaffold for -adaptive_beam_replay
+	shared_ptr< AdaptiveBeam > adaptive_beam;
+	if ( opt.adaptive_beam ) {
+		if ( opt.scaff_search_mode == "morph_dive_pop" || opt.hsearch_bandb_nresults > 0 || opt.xform_fname.length() > 0 ) {
+			utility_exit_with_message( "-adaptive_beam only works with the default hierarchical search" );
+		}
+		adaptive_beam = make_shared< AdaptiveBeam >( opt.adaptive_beam_log, opt.adaptive_beam_replay );
+	}
+
+	double time_scaffold_setup = 0;
+
+	// in order, or whichever is next in the shared queue
+	auto next_scaffold = [&]( int iscaff ) -> int {
+		int64_t inext;
+		if ( ! scaffold_queue ) return iscaff + 1;
+		return scaffold_queue->next( inext ) ? inext : opt.scaffold_fnames.size();
+	};
+
+	for( int iscaff = next_scaffold( -1 ); iscaff < opt.scaffold_fnames.size(); iscaff = next_scaffold( iscaff ) )
+	{
+		std::string scaff_fname = opt.scaffold_fnames.at(iscaff);
+		std::vector<std::string> scaffold_sequence_glob0;				// Scaffold sequence in name3 space
+		utility::vector1<core::Size> scaffold_res;//, scaffold_res_all; // Seqposs of residues to design, default whole scaffold
+
+		// where is "" or the target, what is null for unknown errors
+		auto print_scaffold_error = [&]( std::string const & where, char const * what ) {
+			std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+			if ( ! what ) {
+				std::cout << "unknown error on scaffold " << scaff_fname << where << ", will continue with others, if any." << std::endl;
+			} else {
+				std::cout << "error (below) on scaffold " << scaff_fname << where << " (will continue with others, if any)" << std::endl;
+				std::cout << what << std::endl;
+				std::cout << "scene residue numering (may help debug):" << std::endl;
+				for( int i = 1; i <= scaffold_res.size(); ++i ){
+					std::cout << "scene res numbering: " << i-1 << " " << scaffold_sequence_glob0.at(scaffold_res[i]-1) << " pose number: " << scaffold_res[i] << std::endl;
+				}
+			}
+			std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+		};
+
+		try {
+
+			ProtocolData scaffold_pd;
+			std::chrono::time_point<std::chrono::high_resolution_clock> start_scaffold_setup = std::chrono::high_resolution_clock::now();
+
+			runtime_assert( rot_index_p );
+			std::string scafftag = utility::file_basename( utility::file::file_basename( scaff_fname ) );
+
+			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
+			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
+			std::cout << "//////   begin scaffold " << scafftag << " " << iscaff << " of " << opt.scaffold_fnames.size() << std::endl;
+			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
+			std::cout << "/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////" << std::endl;
+
+
+			bool needs_scaffold_director = false;
+
+			ScaffoldProviderOP scaffold_provider = get_scaffold_provider(
+				iscaff,
 				rot_index_p,
 				opt,
 				make2bopts,
 				rotrf_table_manager,
+				scaffold_data_cache_manager,
 				needs_scaffold_director);
 
 			// General info about a generic scaffold for debugging, cout, and the director
@@ -876,498 +1399,597 @@ int main(int argc, char *argv[]) {
 			float test_scaff_radius = test_data_cache->scaff_radius;
 			float test_scaff_redundancy_filter_rg = test_data_cache->scaff_redundancy_filter_rg;
 			Eigen::Vector3f test_scaffold_center = test_data_cache->scaffold_center;
-			float test_redundancy_filter_rg = std::min( test_scaff_redundancy_filter_rg, target_redundancy_filter_rg );
-			std::cout << "using redundancy_filter_rg: ~" << test_redundancy_filter_rg << std::endl;
-			if ( burial_manager ) test_data_cache->setup_burial_grids( burial_manager );
 
 
-			shared_ptr<std::vector<EigenXform>> seeding_positions = setup_seeding_positions( opt, pd, scaffold_provider, iscaff );
+			shared_ptr<std::vector<EigenXform>> seeding_positions = setup_seeding_positions( opt, scaffold_pd, scaffold_provider, iscaff );
 
 			if ( opt.dump_scaff_bb_hbond_rays ) dump_bbhbond_actors( test_data_cache );
 
-			///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			print_header( "setup scene from scaffold and target" );
-			///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-
-			// SOMETHING WRONG, SCORES OFF BY A LITTLE
-			// setup objectives, moved into scaffold loop to guarantee clean slate for each scaff...
-			RifSceneObjectiveConfig rso_config;
-				rso_config.packopts = &packopts;
-				rso_config.rif_ptrs = rif_ptrs;
-				rso_config.target_bounding_by_atype = &target_bounding_by_atype;
-				rso_config.rot_tgt_scorer = rot_tgt_scorer;
-				rso_config.rot_index_p = rot_index_p;
-				rso_config.require_satisfaction = opt.require_satisfaction;
-				rso_config.require_n_rifres = opt.require_n_rifres;
-                rso_config.requirements = opt.requirements;
-            	rso_config.burial_manager = burial_manager;
-            	rso_config.unsat_manager = unsat_manager;
-            	rso_config.scaff_bb_hbond_weight = opt.scaff_bb_hbond_weight;
-
-            	rso_config.sasa_grid = sasa_grid;
-            	rso_config.sasa_threshold = sasa_threshold;
-            	rso_config.sasa_multiplier = sasa_slope * SASA_SUBVERT_MULTIPLIER;
-
-            	rso_config.hydrophobic_manager = hydrophobic_manager;
-            	rso_config.require_hydrophobic_residue_contacts = opt.require_hydrophobic_residue_contacts;
-            	rso_config.hydrophobic_ddg_cut = opt.hydrophobic_ddg_cut;
-
-            	rso_config.ignore_rifres_if_worse_than = opt.ignore_rifres_if_worse_than;
-
-
-            if ( opt.require_satisfaction > 0 && rif_ptrs.back()->has_sat_data_slots() ) {
-            	if ( ! donor_acceptors_from_file && opt.num_hotspots == 0 ) {
-            		utility_exit_with_message("New error message to fix an old bug!!! You can fix this error!!!"
-            			"\n1. If you are using hotspots, you need to add this flag (and convince Brian/TaYi to fix this)"
-            			"\n    -rif_dock:num_hotspots <number of hotspots>"
-            			"\n   Feel free to overestimate. 1000 is pretty safe if in doubt."
-            			"\n2. Otherwise you need to add these two flags"
-            			"\n    -rif_dock:target_donors    <target donors file .pdb.gz>"
-            			"\n    -rif_dock:target_acceptors <target acceptors file .pdb.gz>"
-            			"\n   These files are already in your rifgen folder. Type ls <rifgen folder> *donor* to find them."
-            			);
-            	}
-
-            	if ( opt.num_hotspots != 0 ) {
-            		rso_config.n_sat_groups = opt.num_hotspots;
-            	} else {
-            		rso_config.n_sat_groups = target_donors.size() + target_acceptors.size();
-            	}
-
-
-            } else {
-            	rso_config.n_sat_groups = 0;
-            }
+			// only depend on the scaffold, built here so they're shared by (and timed apart from) the targets
+			test_data_cache->setup_onebody_tables( rot_index_p, opt );
+			if ( opt.hack_pack ) scaffold_provider->setup_twobody_tables( ScaffoldIndex() );
+
+			time_scaffold_setup += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start_scaffold_setup ).count();
+
+			// every target is docked against this scaffold before the next one is loaded
+			for ( int itarget = 0; itarget < dock_targets.size(); ++itarget )
+			{
+				DockTarget & tgt = *dock_targets[itarget];
+				std::chrono::time_point<std::chrono::high_resolution_clock> start_dock = std::chrono::high_resolution_clock::now();
+				try {
+
+					ProtocolData pd = scaffold_pd;
+
+					if ( dock_targets.size() > 1 ) {
+						print_header( "dock scaffold " + scafftag + " against target " + tgt.name );
+						if ( itarget > 0 ) clear_scaffold_target_data( scaffold_provider );
+					}
+
+					// the target this scaffold is docked against
+					core::pose::Pose & target = tgt.target;
+					std::vector<SimpleAtom> & target_simple_atoms = tgt.target_simple_atoms;
+					std::vector<HBondRay> & target_donors = tgt.target_donors, & target_acceptors = tgt.target_acceptors;
+					float & rif_radius = tgt.rif_radius, & target_redundancy_filter_rg = tgt.target_redundancy_filter_rg;
+					shared_ptr<BurialManager> & burial_manager = tgt.burial_manager;
+					shared_ptr<UnsatManager> & unsat_manager = tgt.unsat_manager;
+					std::vector< VoxelArrayPtr > & target_field_by_atype = tgt.target_field_by_atype;
+					std::vector< std::vector< VoxelArrayPtr > > & target_bounding_by_atype = tgt.target_bounding_by_atype;
+					RifScoreRotamerVsTarget & rot_tgt_scorer = tgt.rot_tgt_scorer;
+					std::vector<shared_ptr<RifBase> > & rif_ptrs = tgt.rif_ptrs;
+#ifdef USEGRIDSCORE
+					shared_ptr<protocols::ligand_docking::ga_ligand_dock::GridScorer> & grid_scorer = tgt.grid_scorer;
+#endif
+
+					float test_redundancy_filter_rg = std::min( test_scaff_redundancy_filter_rg, target_redundancy_filter_rg );
+					std::cout << "using redundancy_filter_rg: ~" << test_redundancy_filter_rg << std::endl;
+					if ( burial_manager ) test_data_cache->setup_burial_grids( burial_manager );
+
+					///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+					print_header( "setup scene from scaffold and target" );
+					///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+					// SOMETHING WRONG, SCORES OFF BY A LITTLE
+					// setup objectives, moved into scaffold loop to guarantee clean slate for each scaff...
+					RifSceneObjectiveConfig rso_config;
+						rso_config.packopts = &packopts;
+						rso_config.rif_ptrs = rif_ptrs;
+						rso_config.target_bounding_by_atype = &target_bounding_by_atype;
+						rso_config.rot_tgt_scorer = rot_tgt_scorer;
+						rso_config.rot_index_p = rot_index_p;
+						rso_config.require_satisfaction = opt.require_satisfaction;
+						rso_config.require_n_rifres = opt.require_n_rifres;
+		                rso_config.requirements = opt.requirements;
+		            	rso_config.burial_manager = burial_manager;
+		            	rso_config.unsat_manager = unsat_manager;
+		            	rso_config.scaff_bb_hbond_weight = opt.scaff_bb_hbond_weight;
+
+		            	rso_config.sasa_grid = tgt.sasa_grid;
+		            	rso_config.sasa_threshold = sasa_threshold;
+		            	rso_config.sasa_multiplier = sasa_slope * SASA_SUBVERT_MULTIPLIER;
+
+		            	rso_config.hydrophobic_manager = tgt.hydrophobic_manager;
+		            	rso_config.require_hydrophobic_residue_contacts = opt.require_hydrophobic_residue_contacts;
+		            	rso_config.hydrophobic_ddg_cut = opt.hydrophobic_ddg_cut;
+
+		            	rso_config.ignore_rifres_if_worse_than = opt.ignore_rifres_if_worse_than;
+		            	rso_config.rif_lookup_cache_bits = opt.rif_lookup_cache_bits;
+
+
+		            if ( opt.require_satisfaction > 0 && rif_ptrs.back()->has_sat_data_slots() ) {
+		            	if ( ! tgt.donor_acceptors_from_file && opt.num_hotspots == 0 ) {
+		            		utility_exit_with_message("New error message to fix an old bug!!! You can fix this error!!!"
+		            			"\n1. If you are using hotspots, you need to add this flag (and convince Brian/TaYi to fix this)"
+		            			"\n    -rif_dock:num_hotspots <number of hotspots>"
+		            			"\n   Feel free to overestimate. 1000 is pretty safe if in doubt."
+		            			"\n2. Otherwise you need to add these two flags"
+		            			"\n    -rif_dock:target_donors    <target donors file .pdb.gz>"
+		            			"\n    -rif_dock:target_acceptors <target acceptors file .pdb.gz>"
+		            			"\n   These files are already in your rifgen folder. Type ls <rifgen folder> *donor* to find them."
+		            			);
+		            	}
+
+		            	if ( opt.num_hotspots != 0 ) {
+		            		rso_config.n_sat_groups = opt.num_hotspots;
+		            	} else {
+		            		rso_config.n_sat_groups = target_donors.size() + target_acceptors.size();
+		            	}
+
+
+		            } else {
+		            	rso_config.n_sat_groups = 0;
+		            }
             
-            if ( opt.pdbinfo_requirements.size() > 0 ) {
+		            if ( opt.pdbinfo_requirements.size() > 0 ) {
                 
-                for ( int ipdbinforeq = 0; ipdbinforeq < opt.pdbinfo_requirements.size(); ipdbinforeq++ ) {
+		                for ( int ipdbinforeq = 0; ipdbinforeq < opt.pdbinfo_requirements.size(); ipdbinforeq++ ) {
 
-                    std::vector<bool> active_positions( test_data_cache->scaffres_l2g_p->size(), false );
-                    std::vector<bool> active_requirements( rso_config.n_sat_groups, false );
+		                    std::vector<bool> active_positions( test_data_cache->scaffres_l2g_p->size(), false );
+		                    std::vector<bool> active_requirements( rso_config.n_sat_groups, false );
                     
-                    std::pair<std::string,std::vector<int>> pdbinfo_req = opt.pdbinfo_requirements[ipdbinforeq];
+		                    std::pair<std::string,std::vector<int>> pdbinfo_req = opt.pdbinfo_requirements[ipdbinforeq];
                     
-                    for ( int req : pdbinfo_req.second ) {
-                        active_requirements.at(req) = true;
-                    }
+		                    for ( int req : pdbinfo_req.second ) {
+		                        active_requirements.at(req) = true;
+		                    }
                     
-                    for ( core::Size seqpos : *(test_data_cache->scaffold_res_p) ) {
-                        if ( test_data_cache->scaffold_unmodified_p->pdb_info()->res_haslabel(seqpos, pdbinfo_req.first ) ) {
-                            int local_position = test_data_cache->scaffres_g2l_p->at( seqpos - 1 );
-                            active_positions.at(local_position) = true;
-                        }
-                    }
+		                    for ( core::Size seqpos : *(test_data_cache->scaffold_res_p) ) {
+		                        if ( test_data_cache->scaffold_unmodified_p->pdb_info()->res_haslabel(seqpos, pdbinfo_req.first ) ) {
+		                            int local_position = test_data_cache->scaffres_g2l_p->at( seqpos - 1 );
+		                            active_positions.at(local_position) = true;
+		                        }
+		                    }
                     
-                    rso_config.pdbinfo_req_active_positions.push_back( active_positions );
-                    rso_config.pdbinfo_req_active_requirements.push_back( active_requirements );
-                }
-                if ( opt.num_pdbinfo_requirements_required < 0 ) {
-                    rso_config.num_pdbinfo_requirements_required = rso_config.pdbinfo_req_active_positions.size();
-                } else {
-                    rso_config.num_pdbinfo_requirements_required = opt.num_pdbinfo_requirements_required;
-                }
-            }
+		                    rso_config.pdbinfo_req_active_positions.push_back( active_positions );
+		                    rso_config.pdbinfo_req_active_requirements.push_back( active_requirements );
+		                }
+		                if ( opt.num_pdbinfo_requirements_required < 0 ) {
+		                    rso_config.num_pdbinfo_requirements_required = rso_config.pdbinfo_req_active_positions.size();
+		                } else {
+		                    rso_config.num_pdbinfo_requirements_required = opt.num_pdbinfo_requirements_required;
+		                }
+		            }
 			
-            rso_config.sat_bonus = opt.sat_score_bonus;
-            rso_config.sat_bonus_override = opt.sat_score_override;
+		            rso_config.sat_bonus = opt.sat_score_bonus;
+		            rso_config.sat_bonus_override = opt.sat_score_override;
 				
 
-			ScenePtr scene_prototype;
-			std::vector< ObjectivePtr > objectives;
-			std::vector< ObjectivePtr > packing_objectives;
-			runtime_assert( rif_factory->create_objectives( rso_config, objectives, packing_objectives ) );
-			scene_prototype = rif_factory->create_scene();
-			if ( objectives.size() ) {
-				runtime_assert_msg( objectives.front()->is_compatible( *scene_prototype ), "objective and scene types not compatible!" );
-			}
+					ScenePtr scene_prototype;
+					std::vector< ObjectivePtr > objectives;
+					std::vector< ObjectivePtr > packing_objectives;
+					runtime_assert( rif_factory->create_objectives( rso_config, objectives, packing_objectives ) );
+					scene_prototype = rif_factory->create_scene();
+					if ( objectives.size() ) {
+						runtime_assert_msg( objectives.front()->is_compatible( *scene_prototype ), "objective and scene types not compatible!" );
+					}
 
 
 
-			ScenePtr scene_minimal( scene_prototype->clone_deep() );
-			scene_minimal->add_actor( 0, VoxelActor(target_bounding_by_atype) );
+					ScenePtr scene_minimal( scene_prototype->clone_deep() );
+					scene_minimal->add_actor( 0, VoxelActor(target_bounding_by_atype) );
 
 
-			///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			print_header( "setup director based on scaffold and target sizes" ); //////////////////////////////////////////////////////////////////////////////////////////////
-			///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			shared_ptr<RifDockNestDirector> nest_director;
+					///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+					print_header( "setup director based on scaffold and target sizes" ); //////////////////////////////////////////////////////////////////////////////////////////////
+					///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+					shared_ptr<RifDockNestDirector> nest_director;
 
 
-			DirectorBase director; {
-				F3 target_center = pose_center(target);
-				float body_radius = std::min( test_scaff_radius, rif_radius );
+					DirectorBase director; {
+						F3 target_center = pose_center(target);
+						float body_radius = std::min( test_scaff_radius, rif_radius );
 
-				double resl0 = opt.resl0;
-				double hsearch_scale_factor = opt.hsearch_scale_factor;
-				double search_diameter = opt.search_diameter;
+						double resl0 = opt.resl0;
+						double hsearch_scale_factor = opt.hsearch_scale_factor;
+						double search_diameter = opt.search_diameter;
 
-				// Ideally one could read these in from the xform file
-				if ( opt.xform_fname.length() > 0 ) {
-					target_center = F3(0, 0, 0);
-	                body_radius = 15.0;
-					resl0 = 1;
-	                hsearch_scale_factor = 1.2;
-	                search_diameter = 4.0;
-				}
+						// Ideally one could read these in from the xform file
+						if ( opt.xform_fname.length() > 0 ) {
+							target_center = F3(0, 0, 0);
+			                body_radius = 15.0;
+							resl0 = 1;
+			                hsearch_scale_factor = 1.2;
+			                search_diameter = 4.0;
+						}
 
-				double cart_grid = resl0*hsearch_scale_factor/sqrt(3); // 1.5 is a big hack here.... 2 would be more "correct"
-				double hackysin = std::min( 1.0, resl0*hsearch_scale_factor/2.0/ body_radius );
-
-				runtime_assert( hackysin > 0.0 );
-				double const rot_resl_deg0 = asin( hackysin ) * 180.0 / M_PI;
-				int nside = std::ceil( search_diameter / cart_grid );
-				std::cout << "search dia.    : " <<  search_diameter << std::endl;
-				std::cout << "nside          : " << nside        << std::endl;
-				std::cout << "resl0:           " << resl0 << std::endl;
-				std::cout << "body_radius:     " << body_radius << std::endl;
-				std::cout << "rif_radius:      " << rif_radius << std::endl;
-				std::cout << "scaffold_radius: " << test_scaff_radius << std::endl;
-				std::cout << "cart_grid:       " << cart_grid  << std::endl;
-				std::cout << "rot_resl_deg0:   " << rot_resl_deg0 << std::endl;
-				I3 nc( nside, nside, nside );
-				F3 lb = target_center + F3( -cart_grid*nside/2.0, -cart_grid*nside/2.0, -cart_grid*nside/2.0 );
-				F3 ub = target_center + F3(  cart_grid*nside/2.0,  cart_grid*nside/2.0,  cart_grid*nside/2.0 );
-				std::cout << "cart grid ub " << ub << std::endl;
-				std::cout << "cart grid lb " << lb << std::endl;
-				std::cout << "(ub-lb/nc) = " << ((ub-lb)/nc.template cast<float>()) << std::endl;
-				std::cout << "cartcen to corner (cart. covering radius): " << sqrt(3.0)*cart_grid/2.0 << std::endl;
-				nest_director = make_shared<RifDockNestDirector>( rot_resl_deg0, lb, ub, nc, 1 );
-				std::cout << "NestDirector:" << endl << *nest_director << endl;
-				std::cout << "nest size0:    " << nest_director->size(0, RifDockIndex()).nest_index << std::endl;
-				std::cout << "size of search space: ~" << float(nest_director->size(0, RifDockIndex()).nest_index)*1024.0*1024.0*1024.0 << " grid points" << std::endl;
-
-
-				std::vector<DirectorBase> director_list;
-				if ( needs_stored_nest_director ) {
-					director_list.push_back( make_shared<RifDockStoredNestDirector>( xform_positions, 1 ) );  // Nest director must come first!!!!
-				} else if ( needs_nest_director ) {
-					director_list.push_back( nest_director );  // Nest director must come first!!!!
-				} else {
-					director_list.emplace_back( make_shared<RifDockIdentityDirector>( 1 ) );
-				}
+						double cart_grid = resl0*hsearch_scale_factor/sqrt(3); // 1.5 is a big hack here.... 2 would be more "correct"
+						double hackysin = std::min( 1.0, resl0*hsearch_scale_factor/2.0/ body_radius );
+
+						runtime_assert( hackysin > 0.0 );
+						double const rot_resl_deg0 = asin( hackysin ) * 180.0 / M_PI;
+						int nside = std::ceil( search_diameter / cart_grid );
+						std::cout << "search dia.    : " <<  search_diameter << std::endl;
+						std::cout << "nside          : " << nside        << std::endl;
+						std::cout << "resl0:           " << resl0 << std::endl;
+						std::cout << "body_radius:     " << body_radius << std::endl;
+						std::cout << "rif_radius:      " << rif_radius << std::endl;
+						std::cout << "scaffold_radius: " << test_scaff_radius << std::endl;
+						std::cout << "cart_grid:       " << cart_grid  << std::endl;
+						std::cout << "rot_resl_deg0:   " << rot_resl_deg0 << std::endl;
+						I3 nc( nside, nside, nside );
+						F3 lb = target_center + F3( -cart_grid*nside/2.0, -cart_grid*nside/2.0, -cart_grid*nside/2.0 );
+						F3 ub = target_center + F3(  cart_grid*nside/2.0,  cart_grid*nside/2.0,  cart_grid*nside/2.0 );
+						std::cout << "cart grid ub " << ub << std::endl;
+						std::cout << "cart grid lb " << lb << std::endl;
+						std::cout << "(ub-lb/nc) = " << ((ub-lb)/nc.template cast<float>()) << std::endl;
+						std::cout << "cartcen to corner (cart. covering radius): " << sqrt(3.0)*cart_grid/2.0 << std::endl;
+						nest_director = make_shared<RifDockNestDirector>( rot_resl_deg0, lb, ub, nc, 1 );
+						std::cout << "NestDirector:" << endl << *nest_director << endl;
+						std::cout << "nest size0:    " << nest_director->size(0, RifDockIndex()).nest_index << std::endl;
+						std::cout << "size of search space: ~" << float(nest_director->size(0, RifDockIndex()).nest_index)*1024.0*1024.0*1024.0 << " grid points" << std::endl;
+
+
+						// Nest director must come first!!!! unused stages stay null
+						shared_ptr<RifDockNestDirector> search_nest_director;
+						shared_ptr<RifDockStoredNestDirector> stored_nest_director;
+						shared_ptr<RifDockIdentityDirector> identity_director;
+						shared_ptr<RifDockScaffoldDirector> scaffold_director;
+						shared_ptr<RifDockSeedingDirector> seeding_director;
+						if ( needs_stored_nest_director ) {
+							stored_nest_director = make_shared<RifDockStoredNestDirector>( xform_positions, 1 );
+						} else if ( needs_nest_director ) {
+							search_nest_director = nest_director;
+						} else {
+							identity_director = make_shared<RifDockIdentityDirector>( 1 );
+						}
 
-				if ( needs_scaffold_director ) {
-					director_list.push_back( make_shared<RifDockScaffoldDirector>(scaffold_provider, 1 ) );
-				}
-				if ( seeding_positions ) {
-					director_list.push_back( make_shared<RifDockSeedingDirector>(seeding_positions, 1, -1 ) );
-				}
+						if ( needs_scaffold_director ) {
+							scaffold_director = make_shared<RifDockScaffoldDirector>(scaffold_provider, 1 );
+						}
+						if ( seeding_positions ) {
+							seeding_director = make_shared<RifDockSeedingDirector>(seeding_positions, 1, -1 );
+						}
 
-				director = make_shared<RifDockDirector>(director_list);
-			}
+						director = make_shared<RifDockDirector>(
+							search_nest_director,
+							stored_nest_director,
+							identity_director,
+							scaffold_director,
+							seeding_director );
+					}
 
 
-			std::vector< ScenePtr > scene_pt( omp_max_threads_1() );
-			BOOST_FOREACH( ScenePtr & s, scene_pt ) s = scene_minimal->clone_deep();
-
-			RifDockData rdd {
-						iscaff,
-						opt,
-						RESLS,
-						director,
-						scene_pt,
-						scene_minimal,
-						target_simple_atoms,
-						target_field_by_atype,
-						&target_bounding_by_atype,
-						&target_donors,
- 						&target_acceptors,
- 						rot_tgt_scorer,
- 						target_redundancy_filter_rg,
- 						target,
- 						rot_index_p,
- 						rotrf_table_manager,
- 						objectives,
- 						packing_objectives,
- 						packopts,
- 						rif_ptrs,
- 						rso_config,
- 						rif_factory,
- 						nest_director->nest(),
-    					#ifdef USE_OPENMP
- 							dump_lock,
- 						#endif
- 						dokout,
- 						scaffold_provider,
- 						burial_manager,
- 						unsat_manager,
- 						hydrophobic_manager
+					std::vector< ScenePtr > scene_pt( omp_max_threads_1() );
+					BOOST_FOREACH( ScenePtr & s, scene_pt ) s = scene_minimal->clone_deep();
+
+					RifDockData rdd {
+								iscaff,
+								tgt.opt,
+								RESLS,
+								director,
+								scene_pt,
+								scene_minimal,
+								target_simple_atoms,
+								target_field_by_atype,
+								&target_bounding_by_atype,
+								&target_donors,
+		 						&target_acceptors,
+		 						rot_tgt_scorer,
+		 						target_redundancy_filter_rg,
+		 						target,
+		 						rot_index_p,
+		 						rotrf_table_manager,
+		 						objectives,
+		 						packing_objectives,
+		 						packopts,
+		 						rif_ptrs,
+		 						rso_config,
+		 						rif_factory,
+		 						nest_director->nest(),
+		    					#ifdef USE_OPENMP
+		 							dump_lock,
+		 						#endif
+		 						*tgt.dokout,
+		 						scaffold_provider,
+		 						burial_manager,
+		 						unsat_manager,
+		 						tgt.hydrophobic_manager,
+		 						scaffold_data_cache_manager
 #ifdef USEGRIDSCORE
-    				,   grid_scorer
+		    				,   grid_scorer
 #endif
-			};
-
+					};
+					rdd.results_writer = results_writer;
+					rdd.results_store = tgt.results_store;
+					rdd.adaptive_beam = adaptive_beam;
+
+
+
+					///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+					print_header( "perform test with scaffold in original position" ); //////////////////////////////////////////////////////////////////////////////////////////////
+					///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+					global_set_fa_mode( false, rdd );
+		    		test_data_cache->setup_onebody_tables( rot_index_p, opt);
+					cout << std::endl;
+
+					cout << "scores for scaffold in original position: " << std::endl;
+					{
+						EigenXform x(EigenXform::Identity());
+						x.translation() = test_scaffold_center;
+						director->set_scene( RifDockIndex(), 0, *scene_minimal);
+						scene_minimal->set_position(1,x);
+						for(int i = 0; i < RESLS.size(); ++i){
+							if ( ! resl_load_map.at(i) ) continue;
+							std::vector<float> sc;
+							float score = objectives[i]->score(*scene_minimal, sc);
+							cout << "input bounding score " << i << " " << F(7,3,RESLS[i]) << " "
+							     << F( 7, 3, score ) << " "
+							     << F( 7, 3, sc[0]       ) << " "
+							     << F( 7, 3, sc[1]       ) << " "
+							     << F( 7, 3, sc[2]       ) << " "
+							     << F( 7, 3, sc[3]       ) << endl;
+							if ( opt.need_to_calculate_sasa ) {
+								std::cout << "Sasa: " << (uint16_t) ( sc[3] / SASA_SUBVERT_MULTIPLIER ) << std::endl;
+							}
 
+						}
+						if ( opt.test_hackpack ) {
+							scaffold_provider->setup_twobody_tables( ScaffoldIndex() );
 
-			///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-			print_header( "perform test with scaffold in original position" ); //////////////////////////////////////////////////////////////////////////////////////////////
-			///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-			global_set_fa_mode( false, rdd );
-    		test_data_cache->setup_onebody_tables( rot_index_p, opt);
-			cout << std::endl;
+							SearchPointWithRots result;
 
-			cout << "scores for scaffold in original position: " << std::endl;
-			{
-				EigenXform x(EigenXform::Identity());
-				x.translation() = test_scaffold_center;
-				director->set_scene( RifDockIndex(), 0, *scene_minimal);
-				scene_minimal->set_position(1,x);
-				for(int i = 0; i < RESLS.size(); ++i){
-					if ( ! resl_load_map.at(i) ) continue;
-					std::vector<float> sc;
-					float score = objectives[i]->score(*scene_minimal, sc);
-					cout << "input bounding score " << i << " " << F(7,3,RESLS[i]) << " "
-					     << F( 7, 3, score ) << " "
-					     << F( 7, 3, sc[0]       ) << " "
-					     << F( 7, 3, sc[1]       ) << " "
-					     << F( 7, 3, sc[2]       ) << " "
-					     << F( 7, 3, sc[3]       ) << endl;
-					if ( opt.need_to_calculate_sasa ) {
-						std::cout << "Sasa: " << (uint16_t) ( sc[3] / SASA_SUBVERT_MULTIPLIER ) << std::endl;
-					}
+							if ( packing_objectives.size() ) {
+								float score = packing_objectives.back()->score_with_rotamers(*scene_minimal, result.rotamers());
+								std::cout << "Packing score: " << score << std::endl;
 
-				}
-				if ( opt.test_hackpack ) {
-					scaffold_provider->setup_twobody_tables( ScaffoldIndex() );
-					if ( unsat_manager ) {
-						scaffold_provider->setup_twobody_tables_per_thread( ScaffoldIndex() );
-					}
+								std::cout << "Packing rotamers: " << std::endl;
+								for ( std::pair<intRot,intRot> pair : result.rotamers() ) {
+									int l_ires = pair.first;
+									int irot = pair.second;
+									int g_ires = test_data_cache->scaffres_l2g_p->at( l_ires );
+									std::string oneletter = rdd.rot_index_p->oneletter(irot);
+									float one_body = test_data_cache->scaffold_onebody_glob0_p->at( g_ires ).at( irot );
+									BBActor bba = rdd.scene_minimal->template get_actor<BBActor>(1,l_ires);
 
+									int resat1 = -1, resat2 = -1, rehbcount = 0;
+			                		float const rescore = rdd.rot_tgt_scorer.score_rotamer_v_target_sat( 
+			                										irot, bba.position(), resat1, resat2, true, rehbcount, 10.0, 4 );
 
-					SearchPointWithRots result;
+									std::cout << "*seqpos: " << I(3, g_ires+1);
+									std::cout << " " << oneletter;
+									std::cout << " irot:" << I(3, irot);
+									std::cout << " 1body:" << F(7, 2, one_body);
+									std::cout << " rescore:" << F(7, 2, rescore);
+									std::cout << " resats: " << I(3, resat1) << " " << I(3, resat2);
+									std::cout << std::endl;
 
-					if ( packing_objectives.size() ) {
-						float score = packing_objectives.back()->score_with_rotamers(*scene_minimal, result.rotamers());
-						std::cout << "Packing score: " << score << std::endl;
+								}
+							}
 
-						std::cout << "Packing rotamers: " << std::endl;
-						for ( std::pair<intRot,intRot> pair : result.rotamers() ) {
-							int l_ires = pair.first;
-							int irot = pair.second;
-							int g_ires = test_data_cache->scaffres_l2g_p->at( l_ires );
-							std::string oneletter = rdd.rot_index_p->oneletter(irot);
-							float one_body = test_data_cache->scaffold_onebody_glob0_p->at( g_ires ).at( irot );
-							BBActor bba = rdd.scene_minimal->template get_actor<BBActor>(1,l_ires);
+							if ( unsat_manager ) {
 
-							int resat1 = -1, resat2 = -1, rehbcount = 0;
-	                		float const rescore = rdd.rot_tgt_scorer.score_rotamer_v_target_sat( 
-	                										irot, bba.position(), resat1, resat2, true, rehbcount, 10.0, 4 );
+								std::cout << "Input position buried unsats:" << std::endl;
 
-							std::cout << "*seqpos: " << I(3, g_ires+1);
-							std::cout << " " << oneletter;
-							std::cout << " irot:" << I(3, irot);
-							std::cout << " 1body:" << F(7, 2, one_body);
-							std::cout << " rescore:" << F(7, 2, rescore);
-							std::cout << " resats: " << I(3, resat1) << " " << I(3, resat2);
-							std::cout << std::endl;
+								std::vector<float> initial_burial = burial_manager->get_burial_weights( scene_minimal->position(1), test_data_cache->burial_grid );
 
-						}
-					}
+								std::vector<EigenXform> bb_positions;
+								for ( int i_actor = 0; i_actor < scene_minimal->template num_actors<BBActor>(1); i_actor++ ) {
+									bb_positions.push_back( scene_minimal->template get_actor<BBActor>(1,i_actor).position() );
+								}
 
-					if ( unsat_manager ) {
+								std::vector<float> unsat_scores = unsat_manager->get_buried_unsats( initial_burial, result.rotamers(), bb_positions, rot_tgt_scorer );
+								unsat_manager->print_buried_unsats( unsat_scores );
 
-						std::cout << "Input position buried unsats:" << std::endl;
 
-						std::vector<float> initial_burial = burial_manager->get_burial_weights( scene_minimal->position(1), test_data_cache->burial_grid );
+								burial_manager->dump_burial_grid( scafftag + boost::str(boost::format("_burial_nb_%i_dst_%.1f.pdb")%opt.burial_target_neighbor_cut%opt.burial_target_distance_cut), 
+																scene_minimal->position(1), test_data_cache->burial_grid );
+							}
 
-						std::vector<EigenXform> bb_positions;
-						for ( int i_actor = 0; i_actor < scene_minimal->template num_actors<BBActor>(1); i_actor++ ) {
-							bb_positions.push_back( scene_minimal->template get_actor<BBActor>(1,i_actor).position() );
 						}
 
-						std::vector<float> unsat_scores = unsat_manager->get_buried_unsats( initial_burial, result.rotamers(), bb_positions, rot_tgt_scorer );
-						unsat_manager->print_buried_unsats( unsat_scores );
 
 
-						burial_manager->dump_burial_grid( scafftag + boost::str(boost::format("_burial_nb_%i_dst_%.1f.pdb")%opt.burial_target_neighbor_cut%opt.burial_target_distance_cut), 
-														scene_minimal->position(1), test_data_cache->burial_grid );
 					}
 
-				}
-
+					// If this option is set, we skip everything below
+					if (opt.only_score_input_pos) continue;
 
+					// std::cout << "scores for scaffold in original position: " << std::endl;
+		   //          {
 
-			}
+		   //  			test_data_cache->setup_twobody_tables( rot_index_p, opt, make2bopts, rotrf_table_manager);
+		   //              // EigenXform x(EigenXform::Identity());
+		   //              // x.translation() = test_scaffold_center;
+		   //              director->set_scene( RifDockIndex(4361221, 269, ScaffoldIndex()), 0, *scene_minimal);
+		   //              // scene_minimal->set_position(1,x);
+		   //              for(int i = 5; i < RESLS.size(); ++i){
+		   //                  std::vector<float> sc = packing_objectives.back()->scores(*scene_minimal);
+		   //                  std::cout << "input bounding score " << i << " " << F(7,3,RESLS[i]) << " "
+		   //                       << F( 7, 3, sc[0]+sc[1] ) << " "
+		   //                       << F( 7, 3, sc[0]       ) << " "
+		   //                       << F( 7, 3, sc[1]       ) << std::endl;
 
-			// If this option is set, we skip everything below
-			if (opt.only_score_input_pos) continue;
+		   //              }
 
-			// std::cout << "scores for scaffold in original position: " << std::endl;
-   //          {
+		   //                  devel::scheme::ScoreRotamerVsTarget<
+		   //      VoxelArrayPtr, ::scheme::chemical::HBondRay, ::devel::scheme::RotamerIndex
+		   //  > rot_tgt_scorer;
+		   //  rot_tgt_scorer.rot_index_p_ = rot_index_p;
+		   //  rot_tgt_scorer.target_field_by_atype_ = target_field_by_atype;
+		   //  rot_tgt_scorer.target_donors_ = target_donors;
+		   //  rot_tgt_scorer.target_acceptors_ = target_acceptors;
+		   //  rot_tgt_scorer.hbond_weight_ = packopts.hbond_weight;
+		   //  rot_tgt_scorer.upweight_iface_ = packopts.upweight_iface;
+		   //  rot_tgt_scorer.upweight_multi_hbond_ = packopts.upweight_multi_hbond;
+					// 	BBActor bb = scene_minimal->template get_actor<BBActor>(1,6);
+					// 	float const recalc_rot_v_tgt = rot_tgt_scorer.score_rotamer_v_target( 277, bb.position(), 10.0, 4 );
+					// 	std::cout << recalc_rot_v_tgt << std::endl;
 
-   //  			test_data_cache->setup_twobody_tables( rot_index_p, opt, make2bopts, rotrf_table_manager);
-   //              // EigenXform x(EigenXform::Identity());
-   //              // x.translation() = test_scaffold_center;
-   //              director->set_scene( RifDockIndex(4361221, 269, ScaffoldIndex()), 0, *scene_minimal);
-   //              // scene_minimal->set_position(1,x);
-   //              for(int i = 5; i < RESLS.size(); ++i){
-   //                  std::vector<float> sc = packing_objectives.back()->scores(*scene_minimal);
-   //                  std::cout << "input bounding score " << i << " " << F(7,3,RESLS[i]) << " "
-   //                       << F( 7, 3, sc[0]+sc[1] ) << " "
-   //                       << F( 7, 3, sc[0]       ) << " "
-   //                       << F( 7, 3, sc[1]       ) << std::endl;
+		   //          }
 
-   //              }
 
-   //                  devel::scheme::ScoreRotamerVsTarget<
-   //      VoxelArrayPtr, ::scheme::chemical::HBondRay, ::devel::scheme::RotamerIndex
-   //  > rot_tgt_scorer;
-   //  rot_tgt_scorer.rot_index_p_ = rot_index_p;
-   //  rot_tgt_scorer.target_field_by_atype_ = target_field_by_atype;
-   //  rot_tgt_scorer.target_donors_ = target_donors;
-   //  rot_tgt_scorer.target_acceptors_ = target_acceptors;
-   //  rot_tgt_scorer.hbond_weight_ = packopts.hbond_weight;
-   //  rot_tgt_scorer.upweight_iface_ = packopts.upweight_iface;
-   //  rot_tgt_scorer.upweight_multi_hbond_ = packopts.upweight_multi_hbond;
-			// 	BBActor bb = scene_minimal->template get_actor<BBActor>(1,6);
-			// 	float const recalc_rot_v_tgt = rot_tgt_scorer.score_rotamer_v_target( 277, bb.position(), 10.0, 4 );
-			// 	std::cout << recalc_rot_v_tgt << std::endl;
+					int final_resl = rdd.RESLS.size() - 1;
 
-   //          }
+					std::vector<shared_ptr<Task>> task_list;
 
 
-			int final_resl = rdd.RESLS.size() - 1;
-
-			std::vector<shared_ptr<Task>> task_list;
+					if (opt.scaff_search_mode == "morph" ) {
+		    			task_list.push_back(make_shared<TestMakeChildrenTask>( ));
+					}
 
+					if ( opt.xform_fname.length() > 0) {
+						create_rifine_task( task_list, rdd );
+					} else {
+						if ( opt.scaff_search_mode == "morph_dive_pop" ) {
+							create_dive_pop_hsearch_task( task_list, rdd); 
+						} else {
 
-			if (opt.scaff_search_mode == "morph" ) {
-    			task_list.push_back(make_shared<TestMakeChildrenTask>( ));
-			}
 
-			if ( opt.xform_fname.length() > 0) {
-				create_rifine_task( task_list, rdd );
-			} else {
-				if ( opt.scaff_search_mode == "morph_dive_pop" ) {
-					create_dive_pop_hsearch_task( task_list, rdd); 
-				} else {
+							task_list.push_back(make_shared<DiversifyBySeedingPositionsTask>()); // this is a no-op if there are no seeding positions
+							task_list.push_back(make_shared<DiversifyByNestTask>( 0 ));
 
+							task_list.push_back(make_shared<HSearchInit>( ));
+							if ( opt.fft_prescan_keep_frac > 0 ) {
+								task_list.push_back(make_shared<FFTPrescanTask>( tgt.fft_prescan_target, opt.fft_prescan_keep_frac, opt.fft_prescan_cell_size,
+								                                                 opt.fft_prescan_clash_weight ));
+							}
+							if ( opt.hsearch_bandb_nresults > 0 ) {
+								task_list.push_back(make_shared<HSearchBandBTask>( final_resl, opt.DIMPOW2, opt.hsearch_bandb_nresults,
+								                                                   opt.hsearch_bandb_max_queue_M * 1e6, opt.global_score_cut, opt.tether_to_input_position_cut ));
+							}
+							for ( int i = 0; i <= final_resl && opt.hsearch_bandb_nresults <= 0; i++ ) {
+								// in compact mode, stages after the first are scored by HSearchCompactScaleAndScoreTask
+								if ( ! opt.hsearch_compact_beam || i == 0 ) {
+									task_list.push_back(make_shared<HSearchScoreAtReslTask>( i, i, opt.tether_to_input_position_cut ));
+								}
 
-					task_list.push_back(make_shared<DiversifyBySeedingPositionsTask>()); // this is a no-op if there are no seeding positions
-					task_list.push_back(make_shared<DiversifyByNestTask>( 0 ));
+								if (opt.hack_pack_during_hsearch) {
+									task_list.push_back(make_shared<SortByScoreTask>( ));
+									task_list.push_back(make_shared<FilterForHackPackTask>( 1, rdd.packopts.pack_n_iters, rdd.packopts.pack_iter_mult, opt.global_score_cut ));
+									task_list.push_back(make_shared<HackPackTask>( i, i, opt.global_score_cut )); 
+								}
 
-					task_list.push_back(make_shared<HSearchInit>( ));
-					for ( int i = 0; i <= final_resl; i++ ) {
-						task_list.push_back(make_shared<HSearchScoreAtReslTask>( i, i, opt.tether_to_input_position_cut ));
+								task_list.push_back(make_shared<HSearchFilterSortTask>( i, opt.beam_size / opt.DIMPOW2, opt.global_score_cut, i < final_resl ));
 
-						if (opt.hack_pack_during_hsearch) {
-							task_list.push_back(make_shared<SortByScoreTask>( ));
-							task_list.push_back(make_shared<FilterForHackPackTask>( 1, rdd.packopts.pack_n_iters, rdd.packopts.pack_iter_mult, opt.global_score_cut ));
-							task_list.push_back(make_shared<HackPackTask>( i, i, opt.global_score_cut )); 
+								if (opt.dump_x_frames_per_resl > 0) {
+									task_list.push_back(make_shared<DumpHSearchFramesTask>( i, i, opt.dump_x_frames_per_resl, opt.dump_only_best_frames, opt.dump_only_best_stride, 
+										                                                    opt.dump_prefix + "_" + test_data_cache->scafftag + boost::str(boost::format("_resl%i")%i) ));
+								}
+								if ( i < final_resl ) {
+									if ( opt.hsearch_compact_beam ) {
+										task_list.push_back(make_shared<HSearchCompactScaleAndScoreTask>( i, i+1, opt.DIMPOW2, opt.global_score_cut, opt.beam_size / opt.DIMPOW2,
+										                                                                  i+1 < final_resl, opt.tether_to_input_position_cut ));
+									} else {
+										task_list.push_back(make_shared<HSearchScaleToReslTask>( i, i+1, opt.DIMPOW2, opt.global_score_cut )); 
+									}
+								} 
+							}
+							task_list.push_back(make_shared<HSearchFinishTask>( opt.global_score_cut )); 
 						}
 
-						task_list.push_back(make_shared<HSearchFilterSortTask>( i, opt.beam_size / opt.DIMPOW2, opt.global_score_cut, i < final_resl ));
-
-						if (opt.dump_x_frames_per_resl > 0) {
-							task_list.push_back(make_shared<DumpHSearchFramesTask>( i, i, opt.dump_x_frames_per_resl, opt.dump_only_best_frames, opt.dump_only_best_stride, 
-								                                                    opt.dump_prefix + "_" + test_data_cache->scafftag + boost::str(boost::format("_resl%i")%i) ));
+						if ( opt.sasa_cut > 0 ) {
+							task_list.push_back(make_shared<FilterBySasaTask>( opt.sasa_cut ));
 						}
-						if ( i < final_resl ) {
-							task_list.push_back(make_shared<HSearchScaleToReslTask>( i, i+1, opt.DIMPOW2, opt.global_score_cut )); 
-						} 
-					}
-					task_list.push_back(make_shared<HSearchFinishTask>( opt.global_score_cut )); 
-				}
-
-				if ( opt.sasa_cut > 0 ) {
-					task_list.push_back(make_shared<FilterBySasaTask>( opt.sasa_cut ));
-				}
 
-				task_list.push_back(make_shared<SetFaModeTask>( true ));
+						task_list.push_back(make_shared<SetFaModeTask>( true ));
 
-				if ( opt.hack_pack ) {
-					task_list.push_back(make_shared<FilterForHackPackTask>( opt.hack_pack_frac, rdd.packopts.pack_n_iters, rdd.packopts.pack_iter_mult, opt.global_score_cut ));
-					task_list.push_back(make_shared<HackPackTask>(  final_resl, final_resl, opt.hackpack_score_cut )); 
-				}
+						if ( opt.hack_pack ) {
+							task_list.push_back(make_shared<FilterForHackPackTask>( opt.hack_pack_frac, rdd.packopts.pack_n_iters, rdd.packopts.pack_iter_mult, opt.global_score_cut ));
+							task_list.push_back(make_shared<HackPackTask>(  final_resl, final_resl, opt.hackpack_score_cut )); 
+						}
 
-				bool do_rosetta_score = opt.rosetta_score_fraction > 0 || opt.rosetta_score_then_min_below_thresh > -9e8 || opt.rosetta_score_at_least > 0;
-				     do_rosetta_score = do_rosetta_score && opt.hack_pack;
-				bool do_rosetta_min   = rdd.opt.rosetta_min_fraction > 0.0 && do_rosetta_score;
-
-				if ( do_rosetta_score ) {
-					if (opt.rosetta_filter_before) {
-						task_list.push_back(make_shared<CompileAndFilterResultsTask>( final_resl, final_resl, opt.rosetta_filter_n_per_scaffold, opt.rosetta_filter_redundancy_mag, 
-																				      0, 0, opt.filter_seeding_positions_separately, opt.filter_scaffolds_separately )); 
-					} 
-					else {
-						task_list.push_back(make_shared<FilterForRosettaScoreTask>( opt.rosetta_score_fraction,  opt.rosetta_score_then_min_below_thresh, opt.rosetta_score_at_least, 
-							                                                        opt.rosetta_score_at_most, opt.rosetta_score_select_random )); 
-					}
+						bool do_rosetta_score = opt.rosetta_score_fraction > 0 || opt.rosetta_score_then_min_below_thresh > -9e8 || opt.rosetta_score_at_least > 0;
+						     do_rosetta_score = do_rosetta_score && opt.hack_pack;
+						bool do_rosetta_min   = rdd.opt.rosetta_min_fraction > 0.0 && do_rosetta_score;
+
+						if ( do_rosetta_score ) {
+							if (opt.rosetta_filter_before) {
+								task_list.push_back(make_shared<CompileAndFilterResultsTask>( final_resl, final_resl, opt.rosetta_filter_n_per_scaffold, opt.rosetta_filter_redundancy_mag, 
+																						      0, 0, opt.filter_seeding_positions_separately, opt.filter_scaffolds_separately )); 
+							} 
+							else {
+								task_list.push_back(make_shared<FilterForRosettaScoreTask>( opt.rosetta_score_fraction,  opt.rosetta_score_then_min_below_thresh, opt.rosetta_score_at_least, 
+									                                                        opt.rosetta_score_at_most, opt.rosetta_score_select_random )); 
+							}
 
-					if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpScoresTask>( "hackpack_scores.dat")); 
-					if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpRotScoresTask>( "hackpack_rot_scores.dat", false, final_resl)); 
+							if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpScoresTask>( "hackpack_scores.dat")); 
+							if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpRotScoresTask>( "hackpack_rot_scores.dat", false, final_resl)); 
 
-					task_list.push_back(make_shared<RosettaScoreTask>( final_resl, opt.rosetta_score_cut, do_rosetta_min, !do_rosetta_min)); 
+							task_list.push_back(make_shared<RosettaScoreTask>( final_resl, opt.rosetta_score_cut, do_rosetta_min, !do_rosetta_min)); 
 
-					if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpScoresTask>( "rosetta_scores.dat")); 
-				}
+							if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpScoresTask>( "rosetta_scores.dat")); 
+						}
 
-				if ( do_rosetta_min ) {
-					task_list.push_back(make_shared<FilterForRosettaMinTask>( opt.rosetta_min_fraction, opt.rosetta_min_at_least, opt.rosetta_min_at_most ));
-					task_list.push_back(make_shared<RosettaMinTask>( final_resl, opt.rosetta_score_cut, true )); 
+						if ( do_rosetta_min ) {
+							task_list.push_back(make_shared<FilterForRosettaMinTask>( opt.rosetta_min_fraction, opt.rosetta_min_at_least, opt.rosetta_min_at_most ));
+							task_list.push_back(make_shared<RosettaMinTask>( final_resl, opt.rosetta_score_cut, true )); 
 
-					if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpScoresTask>( "rosetta_min_scores.dat")); 
-				}
+							if (opt.rosetta_debug_dump_scores) task_list.push_back(make_shared<DumpScoresTask>( "rosetta_min_scores.dat")); 
+						}
 				
-				task_list.push_back(make_shared<CompileAndFilterResultsTask>( final_resl, final_resl, opt.n_pdb_out, opt.redundancy_filter_mag, opt.force_output_if_close_to_input_num, 
-					                                                          opt.force_output_if_close_to_input, opt.filter_seeding_positions_separately, 
-					                                                          opt.filter_scaffolds_separately ));
+						task_list.push_back(make_shared<CompileAndFilterResultsTask>( final_resl, final_resl, opt.n_pdb_out, opt.redundancy_filter_mag, opt.force_output_if_close_to_input_num, 
+							                                                          opt.force_output_if_close_to_input, opt.filter_seeding_positions_separately, 
+							                                                          opt.filter_scaffolds_separately ));
 
-				task_list.push_back(make_shared<SortByScoreTask>( ));
+						task_list.push_back(make_shared<SortByScoreTask>( ));
 
-			    if ( opt.n_pdb_out_global > -1 ) {
-			        task_list.push_back(make_shared<CompileAndFilterResultsTask>( final_resl, final_resl, opt.n_pdb_out_global, opt.redundancy_filter_mag, 0, 0, false, false )); 
+					    if ( opt.n_pdb_out_global > -1 ) {
+					        task_list.push_back(make_shared<CompileAndFilterResultsTask>( final_resl, final_resl, opt.n_pdb_out_global, opt.redundancy_filter_mag, 0, 0, false, false )); 
 			        
-			    }
-
-
-				task_list.push_back(make_shared<OutputResultsTask>( final_resl, final_resl));
-			}
-
+					    }
 
-			TaskProtocol protocol( task_list );
 
+						task_list.push_back(make_shared<OutputResultsTask>( final_resl, final_resl));
+					}
 
-			shared_ptr<std::vector<SearchPoint>> starting_point = make_shared<std::vector<SearchPoint>>( );
-			starting_point->push_back(SearchPoint(RifDockIndex()));
 
-			ThreePointVectors input;
-			input.search_points = starting_point;
-			std::cout << "RUN!" << std::endl;
-			ThreePointVectors results = protocol.run( input, rdd, pd );
+					TaskProtocol protocol( task_list );
 
-			time_rif += pd.time_rif;
-			time_pck += pd.time_pck;
-			time_ros += pd.time_ros;
 
+					shared_ptr<std::vector<SearchPoint>> starting_point = make_shared<std::vector<SearchPoint>>( );
+					starting_point->push_back(SearchPoint(RifDockIndex()));
 
+					ThreePointVectors input;
+					input.search_points = starting_point;
+					std::cout << "RUN!" << std::endl;
+					ThreePointVectors results = protocol.run( input, rdd, pd );
 
+					tgt.time_rif += pd.time_rif;
+					tgt.time_pck += pd.time_pck;
+					tgt.time_ros += pd.time_ros;
+					tgt.n_scaffolds++;
+					if ( results.rif_dock_results ) {
+						tgt.n_results += results.rif_dock_results->size();
+						for ( RifDockResult const & result : *results.rif_dock_results ) tgt.best_score = std::min( tgt.best_score, result.score );
+					}
+				} catch( std::exception const & ex ) {
+					tgt.n_errors++;
+					print_scaffold_error( dock_targets.size() > 1 ? " against target " + tgt.name : "", ex.what() );
+				} catch ( ... ) {
+					tgt.n_errors++;
+					print_scaffold_error( dock_targets.size() > 1 ? " against target " + tgt.name : "", nullptr );
+				}
+				tgt.time_dock += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start_dock ).count();
+			} // end target loop
 
 
 		} catch( std::exception const & ex ) {
-			std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-			std::cout << "error (below) on scaffold " << scaff_fname << " (will continue with others, if any)" << std::endl;
-			std::cout << ex.what() << std::endl;
-			std::cout << "scene residue numering (may help debug):" << std::endl;
-			for( int i = 1; i <= scaffold_res.size(); ++i ){
-				std::cout << "scene res numbering: " << i-1 << " " << scaffold_sequence_glob0.at(scaffold_res[i]-1) << " pose number: " << scaffold_res[i] << std::endl;
-			}
-			std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+			print_scaffold_error( "", ex.what() );
 		} catch ( ... ) {
-			std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-			std::cout << "unknown error on scaffold " << scaff_fname << ", will continue with others, if any." << std::endl;
-			std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+			print_scaffold_error( "", nullptr );
 		}
 
 
 	} // end scaffold loop
 
+	if ( scaffold_queue && scaffold_queue->leave() ) {
+		// the last process done, nobody attaches anymore
+		scaffold_queue->unlink();
+		for ( shared_ptr< ::scheme::util::SharedArena > const & arena : shared_arenas ) arena->unlink();
+		std::cout << "removed shared memory " << shared_memory_name << std::endl;
+	}
+
+	if ( results_writer ) {
+		bool writes_ok = results_writer->finish();
+		results_writer->print_stats( std::cout );
+		for ( std::string const & error : results_writer->errors() ) std::cout << "ERROR writing output: " << error << std::endl;
+		runtime_assert_msg( writes_ok, "some output files failed to write" );
+	}
+
+	for ( shared_ptr<DockTarget> const & t : dock_targets ) {
+		if ( t->results_store ) {
+			runtime_assert_msg( t->results_store->close(), "failed to write results store " + t->results_store->fname() );
+			std::cout << "wrote " << t->results_store->num_rows() << " results to " << t->results_store->fname() << std::endl;
+		}
+		t->dokout->close();
+	}
+
+	if ( dock_targets.size() > 1 ) {
+		print_header( "batch targets" );
+		print_dock_target_summary( std::cout, dock_targets, opt.scaffold_fnames.size(), time_scaffold_setup );
+	}
 
-	dokout.close();
+	print_header( "memory use" );
+	::scheme::util::mem_report( std::cout );
 
+	if ( opt.perf_counters ) {
+		::scheme::util::perf_counters_report( std::cout );
+		if ( opt.perf_counters_out.size() ) {
+			runtime_assert_msg( ::scheme::util::write_perf_counters_tsv( opt.perf_counters_out ), "can't write " + opt.perf_counters_out );
+		}
+	}
 
 
 
@@ -44,10 +44,33 @@ OPT_1GRP_KEY(     StringVector , rif_dock, scaffolds )
     OPT_1GRP_KEY(  Real        , rif_dock, max_beam_multiplier )
     OPT_1GRP_KEY(  Boolean     , rif_dock, multiply_beam_by_seeding_positions )
     OPT_1GRP_KEY(  Boolean     , rif_dock, multiply_beam_by_scaffolds )
+    OPT_1GRP_KEY(  Boolean     , rif_dock, hsearch_compact_beam )
+    OPT_1GRP_KEY(  Boolean     , rif_dock, adaptive_beam )
+    OPT_1GRP_KEY(  Real        , rif_dock, adaptive_beam_budget_M )
+    OPT_1GRP_KEY(  String      , rif_dock, adaptive_beam_log )
+    OPT_1GRP_KEY(  String      , rif_dock, adaptive_beam_replay )
+    OPT_1GRP_KEY(  Integer     , rif_dock, hsearch_bandb_nresults )
+    OPT_1GRP_KEY(  Real        , rif_dock, hsearch_bandb_max_queue_M )
+    OPT_1GRP_KEY(  Real        , rif_dock, fft_prescan_keep_frac )
+    OPT_1GRP_KEY(  Real        , rif_dock, fft_prescan_cell_size )
+    OPT_1GRP_KEY(  Real        , rif_dock, fft_prescan_clash_weight )
+    OPT_1GRP_KEY(  Integer     , rif_dock, rif_lookup_cache_bits )
 	OPT_1GRP_KEY(  Real        , rif_dock, search_diameter )
 	OPT_1GRP_KEY(  Real        , rif_dock, hsearch_scale_factor )
 
 	OPT_1GRP_KEY(  Real        , rif_dock, max_rf_bounding_ratio )
+    OPT_1GRP_KEY(  Boolean     , rif_dock, quantize_target_field )
+    OPT_1GRP_KEY(  Real        , rif_dock, quantize_target_field_max )
+    OPT_1GRP_KEY(  Integer     , rif_dock, rif_huge_pages )
+    OPT_1GRP_KEY(  String      , rif_dock, rif_numa_mode )
+    OPT_1GRP_KEY(  Real        , rif_dock, rif_bin_filter_bits_per_key )
+    OPT_1GRP_KEY(  Boolean     , rif_dock, perf_counters )
+    OPT_1GRP_KEY(  String      , rif_dock, perf_counters_out )
+    OPT_1GRP_KEY(  Real        , rif_dock, mem_budget_G )
+    OPT_1GRP_KEY(  String      , rif_dock, batch_targets )
+    OPT_1GRP_KEY(  String      , rif_dock, shared_memory_name )
+    OPT_1GRP_KEY(  Boolean     , rif_dock, shared_memory_loader )
+    OPT_1GRP_KEY(  Real        , rif_dock, shared_memory_wait )
 	OPT_1GRP_KEY(  Boolean     , rif_dock, make_bounding_plot_data )
 	OPT_1GRP_KEY(  Boolean     , rif_dock, align_output_to_scaffold )
 	OPT_1GRP_KEY(  Boolean     , rif_dock, output_scaffold_only )
@@ -55,6 +78,10 @@ OPT_1GRP_KEY(     StringVector , rif_dock, scaffolds )
 	OPT_1GRP_KEY(  Boolean     , rif_dock, output_full_scaffold )
     OPT_1GRP_KEY(  Boolean     , rif_dock, outputlite )
 	OPT_1GRP_KEY(  Boolean     , rif_dock, parallelwrite )
+    OPT_1GRP_KEY(  Integer     , rif_dock, output_writer_threads )
+    OPT_1GRP_KEY(  Real        , rif_dock, output_writer_queue_MB )
+    OPT_1GRP_KEY(  String      , rif_dock, results_store )
+    OPT_1GRP_KEY(  Boolean     , rif_dock, results_store_only )
 	OPT_1GRP_KEY(  Boolean     , rif_dock, outputsilent )
 	OPT_1GRP_KEY(  Integer     , rif_dock, n_pdb_out )
     OPT_1GRP_KEY(  Integer     , rif_dock, n_pdb_out_global )
@@ -137,6 +164,7 @@ OPT_1GRP_KEY(     StringVector , rif_dock, scaffolds )
     OPT_1GRP_KEY(  Boolean    , rif_dock, pdb_info_pssm )
 
 	OPT_1GRP_KEY(  Boolean    , rif_dock, cache_scaffold_data )
+    OPT_1GRP_KEY(  Real        , rif_dock, scaffold_data_cache_budget_MB )
 
 	OPT_1GRP_KEY(  Real        , rif_dock, tether_to_input_position )
 
@@ -323,7 +351,30 @@ OPT_1GRP_KEY(     StringVector , rif_dock, scaffolds )
 			NEW_OPT(  rif_dock::max_beam_multiplier, "Maximum beam multiplier", 1 );
 			NEW_OPT(  rif_dock::multiply_beam_by_seeding_positions, "Multiply beam size by number of seeding positions", false);
 			NEW_OPT(  rif_dock::multiply_beam_by_scaffolds, "Multiply beam size by number of scaffolds", true);
+            NEW_OPT(  rif_dock::hsearch_compact_beam, "Store the widest hsearch stages compactly (8 bytes per sample). Uses less memory, allows larger beams", false );
+            NEW_OPT(  rif_dock::adaptive_beam, "Size the hsearch beam at each resl from the score distribution and the parent/child score correlation of the stage, instead of keeping beam_size_M at every resl. Also caps how many children of one parent stay in the beam", false );
+            NEW_OPT(  rif_dock::adaptive_beam_budget_M, "With -adaptive_beam, samples scored past resl 0 per search, in millions, times the beam multiplier. 0 is the same total as the fixed beam", 0 );
+            NEW_OPT(  rif_dock::adaptive_beam_log, "With -adaptive_beam, write every beam decision to this file", "" );
+            NEW_OPT(  rif_dock::adaptive_beam_replay, "Use the beam decisions in this -adaptive_beam_log file instead of making new ones, to reproduce a run. Implies -adaptive_beam", "" );
+            NEW_OPT(  rif_dock::hsearch_bandb_nresults, "Replace the beam search with a best-first branch and bound that returns this many results. 0 is off", 0 );
+            NEW_OPT(  rif_dock::hsearch_bandb_max_queue_M, "Open branch and bound nodes kept in memory, in millions. The worst are dropped past this and the search is no longer exact", 100 );
+            NEW_OPT(  rif_dock::fft_prescan_keep_frac, "Before the hsearch, score all resl 0 translations of each orientation at once with an FFT and only keep this fraction of the samples. 0 is off", 0 );
+            NEW_OPT(  rif_dock::fft_prescan_cell_size, "Grid spacing of the FFT prescan", 1.5 );
+            NEW_OPT(  rif_dock::fft_prescan_clash_weight, "FFT prescan penalty for each scaffold backbone atom within 3A of a target heavy atom", 1.0 );
+            NEW_OPT(  rif_dock::rif_lookup_cache_bits, "log2 slots of the per-thread rif lookup cache used during hsearch. 0 to disable", 0 );
 			NEW_OPT(  rif_dock::max_rf_bounding_ratio, "" , 4 );
+            NEW_OPT(  rif_dock::quantize_target_field, "Store the target field grids used for rotamer scoring as 4x4x4 int8 bricks, several times smaller", false );
+            NEW_OPT(  rif_dock::quantize_target_field_max, "With -quantize_target_field, clamp target field values above this before quantizing", 10.0 );
+            NEW_OPT(  rif_dock::rif_huge_pages, "Back the loaded rif hash tables with huge pages: 0 no, 1 transparent, 2 explicit (hugetlbfs, falls back to transparent)", 0 );
+            NEW_OPT(  rif_dock::rif_numa_mode, "Where the rif hash tables live on multi socket machines: none, interleave (spread over all nodes) or replicate (one copy per node, each thread reads its own)", "none" );
+            NEW_OPT(  rif_dock::rif_bin_filter_bits_per_key, "Build a bloom filter of the occupied bins for loaded rifs that weren't saved with one, so lookups of empty bins skip the hash table. ~bits/8 bytes per bin, 10 gives ~1% false positives. 0 to only use filters saved in the rif files", 0.0 );
+            NEW_OPT(  rif_dock::perf_counters, "Count cycles, instructions, cache, TLB and branch misses per thread in rif loading, hsearch scoring and hack-pack with linux perf_event_open, and print them per region at the end. Needs perf_event_paranoid <= 2", false );
+            NEW_OPT(  rif_dock::perf_counters_out, "With -perf_counters, also write the per thread and per region counts to this tab separated file", "" );
+            NEW_OPT(  rif_dock::mem_budget_G, "Memory budget for the whole job. Rifs, target grids, scaffold tables and hsearch beams are counted against it; when it's tight the hsearch beam keeps only its best parents and scaffold tables are evicted as with -scaffold_data_cache_budget_MB. 0 for no limit", 0.0 );
+            NEW_OPT(  rif_dock::batch_targets, "Dock every scaffold against several targets, preparing each scaffold once. A file with one target per line of key=value fields: name (required, output goes to <outdir>/<name>), target_pdb, target_res, target_rif, target_bounding_xmaps (comma separated), target_rf_cache, target_donors, target_acceptors, output_tag. Fields left out are taken from the command line. All rifs must be the same type with the same number of bounding rifs", "" );
+            NEW_OPT(  rif_dock::shared_memory_name, "Run several rif_dock_test processes on one node against one copy of the rifs and target grids. One process with -shared_memory_loader loads them into POSIX shared memory named after this, the others attach read only, and all of them take scaffolds from one shared queue until it's empty. Every process needs the same scaffolds, targets and rifs, and its own -output_tag or -outdir. Rif huge page and numa placement don't apply to shared rifs", "" );
+            NEW_OPT(  rif_dock::shared_memory_loader, "With -shared_memory_name, this process loads and publishes the rifs and grids. Start exactly one", false );
+            NEW_OPT(  rif_dock::shared_memory_wait, "With -shared_memory_name, seconds the other processes wait for the loader", 3600.0 );
 			NEW_OPT(  rif_dock::make_bounding_plot_data, "" , false );
 			NEW_OPT(  rif_dock::align_output_to_scaffold, "" , false );
 			NEW_OPT(  rif_dock::output_scaffold_only, "" , false );
@@ -331,6 +382,10 @@ OPT_1GRP_KEY(     StringVector , rif_dock, scaffolds )
 			NEW_OPT(  rif_dock::output_full_scaffold, "", false );
             NEW_OPT(  rif_dock::outputlite, "Write the output structures as compressed silent files", false );
 	    NEW_OPT(  rif_dock::parallelwrite, "Write the output structures using all available threads", false );
+            NEW_OPT(  rif_dock::output_writer_threads, "Write output files from this many background threads so docking doesn't wait on compression and disk. 0 writes inline", 0 );
+            NEW_OPT(  rif_dock::output_writer_queue_MB, "Producers wait when this much output is queued for the background writers", 256.0 );
+            NEW_OPT(  rif_dock::results_store, "Also write every output result to this binary results store (see rif_results_extract). Empty for none", "" );
+            NEW_OPT(  rif_dock::results_store_only, "With -results_store, skip the pdb/silent output and write only the store", false );
 			NEW_OPT(  rif_dock::outputsilent, "", false );
 			NEW_OPT(  rif_dock::n_pdb_out, "" , 10 );
             NEW_OPT(  rif_dock::n_pdb_out_global, "Normally n_pdb_out applies to each seeding position, this caps the global", -1);
@@ -409,6 +464,7 @@ OPT_1GRP_KEY(     StringVector , rif_dock, scaffolds )
             NEW_OPT(  rif_dock::pdb_info_pssm, "Put a pssm into the pdb info", false );
 
 			NEW_OPT(  rif_dock::cache_scaffold_data, "", false );
+            NEW_OPT(  rif_dock::scaffold_data_cache_budget_MB, "Memory budget for onebody/twobody tables and burial grids of morphed scaffolds. Least recently used ones are freed and rebuilt when needed. 0 for no limit", 0 );
 
 			NEW_OPT(  rif_dock::tether_to_input_position, "", -1.0 );
 
@@ -574,6 +630,17 @@ struct RifDockOpt
     float       max_beam_multiplier                  ;
     bool        multiply_beam_by_seeding_positions   ;
     bool        multiply_beam_by_scaffolds           ;
+    bool        hsearch_compact_beam                 ;
+    bool        adaptive_beam                        ;
+    float       adaptive_beam_budget_M               ;
+    std::string adaptive_beam_log                    ;
+    std::string adaptive_beam_replay                 ;
+    int         hsearch_bandb_nresults               ;
+    float       hsearch_bandb_max_queue_M            ;
+    float       fft_prescan_keep_frac                ;
+    float       fft_prescan_cell_size                ;
+    float       fft_prescan_clash_weight             ;
+    int         rif_lookup_cache_bits                ;
 	bool        replace_all_with_ala_1bre            ;
 	bool        lowres_sterics_cbonly                ;
 	float       tether_to_input_position_cut         ;
@@ -636,6 +703,10 @@ struct RifDockOpt
 	bool        output_full_scaffold                 ;
     bool        outputlite                           ;
     bool 	parallelwrite				 ;	
+    int         output_writer_threads                ;
+    float       output_writer_queue_MB               ;
+    std::string results_store                        ;
+    bool        results_store_only                   ;
 	bool        outputsilent                         ;
 	bool        pdb_info_pikaa                       ;
     bool        pdb_info_pssm                        ;
@@ -643,6 +714,18 @@ struct RifDockOpt
 	std::string target_res_fname                     ;
 	int         target_rf_oversample                 ;
 	float       max_rf_bounding_ratio                ;
+    bool        quantize_target_field                ;
+    float       quantize_target_field_max            ;
+    int         rif_huge_pages                       ;
+    std::string rif_numa_mode                        ;
+    float       rif_bin_filter_bits_per_key          ;
+    bool        perf_counters                        ;
+    std::string perf_counters_out                    ;
+    float       mem_budget_G                         ;
+    std::string batch_targets                        ;
+    std::string shared_memory_name                   ;
+    bool        shared_memory_loader                 ;
+    float       shared_memory_wait                   ;
 	std::string target_rf_cache                      ;
 	std::string target_donors                        ;
 	std::string target_acceptors                     ;
@@ -662,6 +745,7 @@ struct RifDockOpt
     bool        dont_use_scaffold_helices            ;
     bool        dont_use_scaffold_strands            ;
 	bool        cache_scaffold_data                  ;
+    float       scaffold_data_cache_budget_MB        ;
 	float       rf_resl                              ;
 	bool        hack_pack                            ;
 	bool        hack_pack_during_hsearch             ;
@@ -826,7 +910,7 @@ struct RifDockOpt
 		using basic::options::option;
 		using namespace basic::options::OptionKeys;
 
-		runtime_assert( option[rif_dock::target_rif].user() );
+		runtime_assert( option[rif_dock::target_rif].user() || option[rif_dock::batch_targets].user() );
 
 		VERBOSE                                = false;
 		resl0                                  = option[rif_dock::resl0                              ]();
@@ -836,6 +920,17 @@ struct RifDockOpt
         max_beam_multiplier                    = option[rif_dock::max_beam_multiplier                ]();
 		multiply_beam_by_seeding_positions     = option[rif_dock::multiply_beam_by_seeding_positions ]();
 		multiply_beam_by_scaffolds             = option[rif_dock::multiply_beam_by_scaffolds         ]();        
+        hsearch_compact_beam                   = option[rif_dock::hsearch_compact_beam               ]();
+        adaptive_beam_replay                   = option[rif_dock::adaptive_beam_replay               ]();
+        adaptive_beam                          = option[rif_dock::adaptive_beam                      ]() || adaptive_beam_replay.size() > 0;
+        adaptive_beam_budget_M                 = option[rif_dock::adaptive_beam_budget_M             ]();
+        adaptive_beam_log                      = option[rif_dock::adaptive_beam_log                  ]();
+        hsearch_bandb_nresults                 = option[rif_dock::hsearch_bandb_nresults             ]();
+        hsearch_bandb_max_queue_M              = option[rif_dock::hsearch_bandb_max_queue_M          ]();
+        fft_prescan_keep_frac                  = option[rif_dock::fft_prescan_keep_frac              ]();
+        fft_prescan_cell_size                  = option[rif_dock::fft_prescan_cell_size              ]();
+        fft_prescan_clash_weight               = option[rif_dock::fft_prescan_clash_weight           ]();
+        rif_lookup_cache_bits                  = option[rif_dock::rif_lookup_cache_bits              ]();
 		replace_all_with_ala_1bre              = option[rif_dock::replace_all_with_ala_1bre          ]();
 
 		target_pdb                             = option[rif_dock::target_pdb                         ]();
@@ -895,6 +990,10 @@ struct RifDockOpt
 		output_full_scaffold                   = option[rif_dock::output_full_scaffold                  ]();
         outputlite                                     = option[rif_dock::outputlite                            ]();
 	parallelwrite                                  = option[rif_dock::parallelwrite                         ]();
+        output_writer_threads                  = option[rif_dock::output_writer_threads              ]();
+        output_writer_queue_MB                 = option[rif_dock::output_writer_queue_MB             ]();
+        results_store                          = option[rif_dock::results_store                      ]();
+        results_store_only                     = option[rif_dock::results_store_only                 ]();
 		outputsilent                           = option[rif_dock::outputsilent                          ]();
 		pdb_info_pikaa                         = option[rif_dock::pdb_info_pikaa                        ]();
         pdb_info_pssm                          = option[rif_dock::pdb_info_pssm                         ]();
@@ -902,6 +1001,18 @@ struct RifDockOpt
 		target_res_fname                       = option[rif_dock::target_res                            ]();
 		target_rf_oversample                   = option[rif_dock::target_rf_oversample                  ]();
 		max_rf_bounding_ratio                  = option[rif_dock::max_rf_bounding_ratio                 ]();
+        quantize_target_field                  = option[rif_dock::quantize_target_field              ]();
+        quantize_target_field_max              = option[rif_dock::quantize_target_field_max          ]();
+        rif_huge_pages                         = option[rif_dock::rif_huge_pages                     ]();
+        rif_numa_mode                          = option[rif_dock::rif_numa_mode                      ]();
+        rif_bin_filter_bits_per_key            = option[rif_dock::rif_bin_filter_bits_per_key        ]();
+        perf_counters                          = option[rif_dock::perf_counters                      ]();
+        perf_counters_out                      = option[rif_dock::perf_counters_out                  ]();
+        mem_budget_G                           = option[rif_dock::mem_budget_G                       ]();
+        batch_targets                          = option[rif_dock::batch_targets                      ]();
+        shared_memory_name                     = option[rif_dock::shared_memory_name                 ]();
+        shared_memory_loader                   = option[rif_dock::shared_memory_loader               ]();
+        shared_memory_wait                     = option[rif_dock::shared_memory_wait                 ]();
 		target_rf_cache                        = option[rif_dock::target_rf_cache                       ]();
 		target_donors                          = option[rif_dock::target_donors                         ]();
 		target_acceptors                       = option[rif_dock::target_acceptors                      ]();		
@@ -920,6 +1031,7 @@ struct RifDockOpt
         dont_use_scaffold_helices              = option[rif_dock::dont_use_scaffold_helices             ]();
         dont_use_scaffold_strands              = option[rif_dock::dont_use_scaffold_strands             ]();
 		cache_scaffold_data                    = option[rif_dock::cache_scaffold_data                   ]();
+        scaffold_data_cache_budget_MB          = option[rif_dock::scaffold_data_cache_budget_MB      ]();
 		rf_resl                                = option[rif_dock::rf_resl                               ]();
 		hack_pack                              = option[rif_dock::hack_pack                             ]();
 		hack_pack_during_hsearch               = option[rif_dock::hack_pack_during_hsearch              ]();
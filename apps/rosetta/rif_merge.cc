@@ -0,0 +1,138 @@
+// merges partial rifs, from rifgen runs split by residue type or hotspot group, into one rif plus
+// its bounding grids, the same files one rifgen run over everything writes. inputs are streamed in
+// parallel (RifFactory::create_rif_by_merging), so the inputs are never loaded whole. the merged
+// rif is sized from the input headers up front and filled in place, so memory is that table plus
+// -rif_merge:buffer_mem_M of staging
+//
+//    rif_merge -rif_merge:in part1.rif.gz part2.rif.gz ... -rif_merge:out merged.rif.gz \
+//        -rif_merge:hash_cart_resls 16 8 4 2 1 -rif_merge:hash_ang_resls 38.8 24.4 14.4 8.2 4.6 \
+//        -rif_merge:hash_cart_bounds 512 512 512 512 512 -rif_merge:lever_bounds 16 8 4 2 1 \
+//        -rif_merge:lever_radii 23.6 18.785 13.344 10.0 10.0
+
+#include <basic/options/option_macros.hh>
+#include <devel/init.hh>
+
+#include <boost/lexical_cast.hpp>
+
+#include <riflib/RifFactory.hh>
+#include <riflib/util.hh>
+
+#include <sstream>
+
+
+using std::cout;
+using std::endl;
+using devel::scheme::KMGT;
+
+OPT_1GRP_KEY( StringVector , rif_merge, in               )
+	OPT_1GRP_KEY( String       , rif_merge, out              )
+	OPT_1GRP_KEY( Real         , rif_merge, buffer_mem_M     )
+	OPT_1GRP_KEY( Boolean      , rif_merge, block_compress   )
+	OPT_1GRP_KEY( Real         , rif_merge, bin_filter_bits_per_key )
+	OPT_1GRP_KEY( RealVector   , rif_merge, hash_cart_resls  )
+	OPT_1GRP_KEY( RealVector   , rif_merge, hash_cart_bounds )
+	OPT_1GRP_KEY( RealVector   , rif_merge, hash_ang_resls   )
+	OPT_1GRP_KEY( RealVector   , rif_merge, lever_radii      )
+	OPT_1GRP_KEY( RealVector   , rif_merge, lever_bounds     )
+
+	void REGISTER_OPTIONS() {
+		using namespace basic::options;
+		using namespace basic::options::OptionKeys;
+		NEW_OPT( rif_merge::in, "rif files to merge, all from rifgen with the same rif_type and hash_cart_resl/hash_angle_resl", utility::vector1<std::string>() );
+		NEW_OPT( rif_merge::out, "merged rif, bounding grids are written next to it as with rifgen", "" );
+		NEW_OPT( rif_merge::buffer_mem_M, "memory for staging input bins before they are merged into the merged rif, on top of that table, which is sized for the summed input bin counts", 1000.0 );
+		NEW_OPT( rif_merge::block_compress, "write the block compressed format instead of gzip", false );
+		NEW_OPT( rif_merge::bin_filter_bits_per_key, "same as rifgen", 0.0 );
+		NEW_OPT( rif_merge::hash_cart_resls, "same as rifgen", utility::vector1<double>() );
+		NEW_OPT( rif_merge::hash_cart_bounds, "same as rifgen", utility::vector1<double>() );
+		NEW_OPT( rif_merge::hash_ang_resls, "same as rifgen", utility::vector1<double>() );
+		NEW_OPT( rif_merge::lever_radii, "same as rifgen", utility::vector1<double>() );
+		NEW_OPT( rif_merge::lever_bounds, "same as rifgen", utility::vector1<double>() );
+	}
+
+
+void
+merge_rifs(){
+
+	using namespace basic::options;
+	using namespace devel::scheme;
+	namespace mopt = basic::options::OptionKeys::rif_merge;
+
+	std::vector<std::string> fnames;
+	for( std::string const & fname : option[mopt::in]() ) fnames.push_back( fname );
+	std::string const outfile = option[mopt::out]();
+	runtime_assert_msg( fnames.size(), "-rif_merge:in is required" );
+	runtime_assert_msg( outfile.size(), "-rif_merge:out is required" );
+	int const nbound = option[mopt::lever_bounds]().size();
+	runtime_assert( option[mopt::lever_radii     ]().size() == nbound );
+	runtime_assert( option[mopt::hash_ang_resls  ]().size() == nbound );
+	runtime_assert( option[mopt::hash_cart_resls ]().size() == nbound );
+	runtime_assert( option[mopt::hash_cart_bounds]().size() == nbound );
+
+	std::string const rif_type = get_rif_type_from_file( fnames.front() );
+	cout << "rif type: " << rif_type << endl;
+	RifFactoryConfig rif_factory_config;
+	rif_factory_config.rif_type = rif_type;
+	shared_ptr<RifFactory> rif_factory = create_rif_factory( rif_factory_config );
+
+	print_header( "merging " + boost::lexical_cast<std::string>( fnames.size() ) + " rifs" );
+	std::vector<std::string> descriptions;
+	RifPtr rif = rif_factory->create_rif_by_merging( fnames, (size_t)( option[mopt::buffer_mem_M]() * 1000000.0 ), descriptions );
+	cout << "merged RIF cells: " << KMGT( rif->size() ) << " mem: " << KMGT( rif->mem_use() )
+	     << " load: " << rif->load_factor() << ", sizeof(value_type) " << rif->sizeof_value_type() << endl;
+
+	cout << "sorting rotamers in each hash entry" << endl;
+	rif->finalize_rif( option[mopt::bin_filter_bits_per_key]() );
+	rif->collision_analysis( cout );
+
+	std::ostringstream oss_description;
+	oss_description << "from rif_merge of " << fnames.size() << " rifs\n";
+	oss_description << "       RIF cells : " << KMGT( rif->size() ) << "\n";
+	for( size_t i = 0; i < fnames.size(); ++i ) oss_description << "      merged rif : " << fnames[i] << "\n";
+	oss_description << "==== description of " << fnames.front() << " ====\n" << descriptions.front();
+	// XformMap::load reads descriptions into a 9999 char buffer, bounding grids add a bit more
+	std::string description = oss_description.str().substr( 0, 8000 );
+
+	bool const block_compress = option[mopt::block_compress]();
+	cout << "writing rif file " << outfile << endl;
+	runtime_assert( write_binary_file( outfile, [&]( std::ostream & out ){ return rif->save( out, description ); }, block_compress ) );
+
+	// bounding grids as rifgen makes them, each from the merged rif, one at a time
+	for( int ibound = 1; ibound <= nbound; ++ibound ){
+		double const lever_radius    = option[mopt::lever_radii     ]().at( ibound );
+		double const lever_bound     = option[mopt::lever_bounds    ]().at( ibound );
+		double const hash_cart_bound = option[mopt::hash_cart_bounds]().at( ibound );
+		RifPtr bounding_rif = rif_factory->create_rif_from_rif( rif, option[mopt::hash_cart_resls]().at( ibound ),
+		                                                        option[mopt::hash_ang_resls]().at( ibound ), hash_cart_bound );
+		if( option[mopt::bin_filter_bits_per_key]() > 0 ) bounding_rif->build_bin_filter( option[mopt::bin_filter_bits_per_key]() );
+		cout << "bounding grid " << lever_bound << " size " << KMGT( bounding_rif->size() )
+		     << " ratio: " << (float)bounding_rif->size() / (float)rif->size() << endl;
+
+		std::string digits = boost::lexical_cast<std::string>( lever_bound );
+		if( digits.size() == 1 ) digits = "0" + digits;
+		std::ostringstream oss_bounding;
+		oss_bounding << "==== bounding xmap ====" << endl;
+		oss_bounding << "!!!!!!!!!!!!!!!!!!!!!!!!!!!! USING_HACKY_GRIDS !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << endl;
+		oss_bounding << "hash_cart_bound: " << hash_cart_bound << endl;
+		oss_bounding << "lever_radius:  " << lever_radius << endl;
+		oss_bounding << "lever_bound:   " << lever_bound << endl;
+		oss_bounding << "==== source oss_description ====\n" << description;
+		std::string bounding_description = oss_bounding.str();
+
+		std::string const fname = outfile + "_BOUNDING_RIF_" + digits + ( block_compress ? ".xmap.zblk" : ".xmap.gz" );
+		cout << "writing " << fname << endl;
+		runtime_assert( write_binary_file( fname, [&]( std::ostream & out ){ return bounding_rif->save( out, bounding_description ); }, block_compress ) );
+	}
+	cout << "done" << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+	REGISTER_OPTIONS();
+	devel::init(argc,argv);
+
+	merge_rifs();
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+// rebuilds chosen results from a rif_dock_test -results_store file (riflib/ResultsStore.hh)
+// as pdbs or a silent file, without rerunning docking or loading any rifs
+//
+//    rif_results_extract -rif_results:store out.rdstore -rif_results:list
+//    rif_results_extract -rif_results:store out.rdstore -rif_results:top 100 -rif_results:sort_by unsats
+//    rif_results_extract -rif_results:store out.rdstore -rif_results:rows 5 17 -rif_results:silent
+
+#include <basic/options/option_macros.hh>
+#include <devel/init.hh>
+
+#include <core/chemical/ChemicalManager.hh>
+#include <core/chemical/ResidueTypeSet.hh>
+#include <core/conformation/ResidueFactory.hh>
+#include <core/import_pose/import_pose.hh>
+#include <core/io/silent/SilentFileData.hh>
+#include <core/io/silent/SilentFileOptions.hh>
+#include <core/pose/PDBInfo.hh>
+#include <core/pose/Pose.hh>
+#include <core/pose/util.hh>
+
+#include <utility/io/ozstream.hh>
+#include <utility/file/file_sys_util.hh>
+#include <utility/string_util.hh>
+#include <ObjexxFCL/format.hh>
+
+#include <riflib/ResultsStore.hh>
+#include <riflib/util.hh>
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+
+using std::cout;
+using std::endl;
+
+OPT_1GRP_KEY( String        , rif_results, store         )
+	OPT_1GRP_KEY( IntegerVector , rif_results, rows          )
+	OPT_1GRP_KEY( Integer       , rif_results, top           )
+	OPT_1GRP_KEY( String        , rif_results, sort_by       )
+	OPT_1GRP_KEY( Boolean       , rif_results, list          )
+	OPT_1GRP_KEY( String        , rif_results, outdir        )
+	OPT_1GRP_KEY( Boolean       , rif_results, silent        )
+	OPT_1GRP_KEY( Boolean       , rif_results, scaffold_only )
+
+	void REGISTER_OPTIONS() {
+		using namespace basic::options;
+		using namespace basic::options::OptionKeys;
+		NEW_OPT( rif_results::store, "results store written by rif_dock_test -results_store", "" );
+		NEW_OPT( rif_results::rows, "rows to extract, 0 based", utility::vector1<int>() );
+		NEW_OPT( rif_results::top, "extract the best N rows by -sort_by", 0 );
+		NEW_OPT( rif_results::sort_by, "score column for -top, lowest first", "score" );
+		NEW_OPT( rif_results::list, "print the selected rows (all rows if none selected) instead of writing structures", false );
+		NEW_OPT( rif_results::outdir, "", "." );
+		NEW_OPT( rif_results::silent, "write one silent file instead of pdbs", false );
+		NEW_OPT( rif_results::scaffold_only, "leave out the target", false );
+	}
+
+
+// same residue placement as dump_rif_result_
+void
+place_stored_rotamer(
+	core::pose::Pose & pose,
+	devel::scheme::StoredRotamer const & rot,
+	core::chemical::ResidueTypeSetCOP rts
+){
+	core::conformation::ResidueOP newrsd;
+	if ( rot.l_resname[0] ) {
+		core::chemical::ResidueType const & rtype = rts->name_map( rot.l_resname );
+		newrsd = core::conformation::ResidueFactory::create_residue( rtype );
+		core::pose::Pose tmp;
+		tmp.append_residue_by_jump( *newrsd, 1 );
+		core::chemical::ResidueTypeSetCOP pose_rts = tmp.residue_type_set_for_pose();
+		core::chemical::ResidueTypeCOP pose_rt = core::pose::get_restype_for_pose( tmp, rot.l_resname );
+		newrsd = core::conformation::ResidueFactory::create_residue( *pose_rts->get_d_equivalent( pose_rt ) );
+	} else {
+		newrsd = core::conformation::ResidueFactory::create_residue( rts->name_map( rot.resname ) );
+	}
+	pose.replace_residue( rot.seqpos, *newrsd, true );
+	for( int ichi = 0; ichi < rot.nchi; ++ichi ){
+		pose.set_chi( ichi+1, rot.seqpos, rot.chi[ichi] );
+	}
+}
+
+
+void
+extract_results(){
+
+	using namespace basic::options;
+	using namespace devel::scheme;
+	using ObjexxFCL::format::F;
+	using ObjexxFCL::format::I;
+	namespace ropt = basic::options::OptionKeys::rif_results;
+
+	std::string const store_fname = option[ropt::store]();
+	runtime_assert_msg( store_fname.size(), "-rif_results:store is required" );
+	ResultsStoreReader store( store_fname );
+	runtime_assert_msg( store.ok(), "can't read results store " + store_fname + ": " + store.error() );
+	cout << "read results store " << store_fname << ": " << store.num_rows() << " results from "
+	     << store.scaffold_fnames().size() << " scaffolds" << endl;
+
+	// selection, reading only the score column for -top
+	std::vector<uint64_t> rows;
+	for( int row : option[ropt::rows]() ){
+		runtime_assert_msg( row >= 0 && row < store.num_rows(), "row out of range: " + utility::to_string( row ) );
+		rows.push_back( row );
+	}
+	if( option[ropt::top]() > 0 ){
+		std::vector<float> sort_scores = store.read_score_column( option[ropt::sort_by]() );
+		std::vector<uint64_t> order( sort_scores.size() );
+		std::iota( order.begin(), order.end(), 0 );
+		size_t ntop = std::min<size_t>( option[ropt::top](), order.size() );
+		std::partial_sort( order.begin(), order.begin() + ntop, order.end(),
+			[&]( uint64_t a, uint64_t b ){ return sort_scores[a] < sort_scores[b]; } );
+		rows.insert( rows.end(), order.begin(), order.begin() + ntop );
+	}
+
+	if( option[ropt::list]() ){
+		if( rows.empty() ){
+			rows.resize( store.num_rows() );
+			std::iota( rows.begin(), rows.end(), 0 );
+		}
+		cout << "      row   score  nopack   dist0 steric rifrank  sasa";
+		for( std::string const & name : store.extra_score_names() ) cout << " " << name;
+		cout << "  tag" << endl;
+		for( uint64_t row : rows ){
+			StoredResult r = store.read( row );
+			cout << I(9,row) << " " << F(7,3,r.score) << " " << F(7,3,r.nopackscore) << " " << F(7,2,r.dist0)
+			     << " " << F(6,2,r.stericscore) << " " << I(7,r.prepack_rank) << " " << I(5,r.sasa);
+			for( size_t i = 0; i < r.extra_scores.size(); ++i ) cout << " " << F(std::max<int>(store.extra_score_names()[i].size(),6),2,r.extra_scores[i]);
+			cout << "  " << r.tag << endl;
+		}
+		return;
+	}
+	runtime_assert_msg( rows.size(), "nothing selected, use -rif_results:rows or -rif_results:top" );
+
+
+	core::chemical::ResidueTypeSetCOP rts = core::chemical::ChemicalManager::get_instance()->residue_type_set( "fa_standard" );
+
+	core::pose::Pose target;
+	if( ! option[ropt::scaffold_only]() ){
+		core::import_pose::pose_from_file( target, store.meta( "target_pdb" ) );
+	}
+	std::map< uint32_t, core::pose::PoseOP > scaffolds;
+
+	std::string const outdir = option[ropt::outdir]();
+	utility::io::ozstream silent_out;
+	if( option[ropt::silent]() ){
+		silent_out.open( outdir + "/" + utility::file_basename( store_fname ) + ".silent" );
+	}
+
+	for( uint64_t row : rows ){
+		StoredResult r = store.read( row );
+
+		core::pose::PoseOP & scaffold = scaffolds[ r.scaffold_id ];
+		if( ! scaffold ){
+			scaffold = make_shared< core::pose::Pose >();
+			core::import_pose::pose_from_file( *scaffold, store.scaffold_fnames().at( r.scaffold_id ) );
+		}
+
+		core::pose::Pose pose = *scaffold;
+		xform_pose( pose, eigen2xyz( r.scaffold_xform ) );
+		std::vector<int> rifres;
+		for( StoredRotamer const & rot : r.rotamers ){
+			place_stored_rotamer( pose, rot, rts );
+			rifres.push_back( rot.seqpos );
+		}
+		if( ! option[ropt::scaffold_only]() ){
+			core::pose::Pose target_out = target;
+			xform_pose( target_out, eigen2xyz( r.target_xform ) );
+			append_pose_to_pose( pose, target_out );
+		}
+		if( ! pose.pdb_info() ) pose.pdb_info( make_shared< core::pose::PDBInfo >( pose ) );
+		std::sort( rifres.begin(), rifres.end() );
+		for( int seqpos : rifres ) pose.pdb_info()->add_reslabel( seqpos, "RIFRES" );
+
+		std::string const tag = r.tag.size() ? r.tag : "row_" + utility::to_string( row );
+		if( option[ropt::silent]() ){
+			core::io::silent::SilentFileOptions sf_option;
+			sf_option.read_from_global_options();
+			core::io::silent::SilentFileData sfd( "", false, false, "binary", sf_option );
+			core::io::silent::SilentStructOP ss = sfd.create_SilentStructOP();
+			ss->fill_struct( pose, tag );
+			sfd._write_silent_struct( *ss, silent_out );
+		} else {
+			std::string const pdbfname = outdir + "/" + tag + ".pdb.gz";
+			utility::io::ozstream out( pdbfname );
+			pose.dump_pdb( out );
+			out.close();
+		}
+		cout << "row " << I(9,row) << " score " << F(7,3,r.score) << " -> " << tag << endl;
+	}
+	if( option[ropt::silent]() ) silent_out.close();
+}
+
+
+int main(int argc, char *argv[])
+{
+	REGISTER_OPTIONS();
+	devel::init(argc,argv);
+
+	extract_results();
+
+	return 0;
+}
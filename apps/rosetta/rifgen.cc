@@ -56,6 +56,8 @@ remove some or all modifications to residues, and/or remap res numbers? fix hbon
 	#include <scheme/objective/hash/XformMap.hh>
 	#include <scheme/objective/storage/RotamerScores.hh>
 	#include <scheme/actor/BackboneActor.hh>
+	#include <scheme/util/perf_counters.hh>
+	#include <scheme/util/mem_budget.hh>
 
 	#include <utility/file/file_sys_util.hh>
 	#include <utility/io/izstream.hh>
@@ -77,6 +79,11 @@ OPT_1GRP_KEY( StringVector, rifgen, donres )
 	OPT_1GRP_KEY( File          , rifgen, target )
 	OPT_1GRP_KEY( File          , rifgen, target_res )
 	OPT_1GRP_KEY( Boolean       , rifgen, rif_append_mode )
+	OPT_1GRP_KEY( Boolean       , rifgen, block_compress_rif )
+	OPT_1GRP_KEY( Real          , rifgen, bin_filter_bits_per_key )
+	OPT_1GRP_KEY( Boolean       , rifgen, perf_counters )
+	OPT_1GRP_KEY( String        , rifgen, perf_counters_out )
+	OPT_1GRP_KEY( Real          , rifgen, mem_budget_G )
 	OPT_1GRP_KEY( Boolean       , rifgen, append_mode_clear_sats )
 	OPT_1GRP_KEY( Real          , rifgen, rif_hbond_dump_fraction )
 	OPT_1GRP_KEY( Real          , rifgen, rif_apo_dump_fraction )
@@ -165,6 +172,11 @@ OPT_1GRP_KEY( StringVector, rifgen, donres )
 		NEW_OPT(  rifgen::target                           , "" , "" );
 		NEW_OPT(  rifgen::target_res                       , "" , "" );
 		NEW_OPT(  rifgen::rif_append_mode                  , "Add to an already existing rif. Modifies in place.", false );
+		NEW_OPT(  rifgen::block_compress_rif               , "write rif and bounding xmaps block compressed so rif_dock_test loads them on all threads. readers detect the format from the file contents, so name -rifgen:outfile to suit (e.g. .rif.zblk)", false );
+		NEW_OPT(  rifgen::bin_filter_bits_per_key          , "save a bloom filter of the occupied bins with the rif and bounding xmaps, rif_dock_test checks it before the hash table. ~bits/8 bytes per bin, 10 gives ~1% false positives. 0 for none", 0.0 );
+		NEW_OPT(  rifgen::perf_counters                    , "count cycles, instructions, cache, TLB and branch misses per thread in rif loading and the rif generators with linux perf_event_open, printed per region at the end", false );
+		NEW_OPT(  rifgen::perf_counters_out                , "with -perf_counters, also write the per thread and per region counts to this tab separated file", "" );
+		NEW_OPT(  rifgen::mem_budget_G                     , "memory budget for the whole job, the rif accumulator condenses early to stay under it. 0 for no limit", 0.0 );
 		NEW_OPT(  rifgen::append_mode_clear_sats           , "Clear all previous sats when adding to rif", false );
 		NEW_OPT(  rifgen::rif_hbond_dump_fraction          , "" , 0.0001 );
 		NEW_OPT(  rifgen::rif_apo_dump_fraction            , "" , 0.0001 );
@@ -290,6 +302,7 @@ make_bounding_grids(
 		double const  ang_bound = ang_bound_rad * 180.0 / M_PI;
 
 		RifPtr new_rif = rif_factory->create_rif_from_rif( ref_rif, hash_cart_resl, hash_ang_resl, hash_cart_bound );
+		if( option[ons::bin_filter_bits_per_key]() > 0 ) new_rif->build_bin_filter( option[ons::bin_filter_bits_per_key]() );
 
 		#pragma omp critical
 		{
@@ -316,10 +329,9 @@ make_bounding_grids(
 		oss_description << "==== source oss_description ====\n" << ref_description;
 		std::string description = oss_description.str();
 
-		fname = fname_base+tag+"RIF_"+digits + ".xmap.gz";
-		utility::io::ozstream out( fname );
-		new_rif->save( out, description );
-		out.close();
+		bool const block_compress = option[ons::block_compress_rif]();
+		fname = fname_base+tag+"RIF_"+digits + ( block_compress ? ".xmap.zblk" : ".xmap.gz" );
+		runtime_assert( write_binary_file( fname, [&]( std::ostream & out ){ return new_rif->save( out, description ); }, block_compress ) );
 
 	return fname;
 }
@@ -355,9 +367,8 @@ std::shared_ptr<::devel::scheme::RifBase> init_rif_and_generators(
 		std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
 		std::cout << "!!!!! RIF file already exists: " << outfile << " !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
 		std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-		utility::io::izstream infile( outfile , std::ios::binary );
 		std::string tmp;
-		runtime_assert( rif->load( infile, tmp ) );
+		runtime_assert( read_binary_file( outfile, [&]( std::istream & in ){ return rif->load( in, tmp ); } ) );
 		std::cout << "   done loading: " << outfile << std::endl;
 		cout << "RIF size: " << KMGT( rif->mem_use() ) << " load: " << rif->load_factor()
 			  << ", sizeof(value_type) " << rif->sizeof_value_type() << endl;
@@ -498,6 +509,8 @@ int main(int argc, char *argv[]) {
 
 	devel::scheme::fix_omp_max_threads();
 	std::cout << "Rifdock thinks there are " << devel::scheme::omp_max_threads() << " threads." << std::endl;
+	if( basic::options::option[basic::options::OptionKeys::rifgen::perf_counters]() ) ::scheme::util::enable_perf_counters();
+	::scheme::util::set_mem_budget( (int64_t)( basic::options::option[basic::options::OptionKeys::rifgen::mem_budget_G]() * 1024.0 * 1024.0 * 1024.0 ) );
 
 	using basic::options::option;
 		using namespace basic::options::OptionKeys;
@@ -910,7 +923,7 @@ int main(int argc, char *argv[]) {
 		     << ", sizeof(value_type) " << rif->sizeof_value_type() << endl;
 
 		cout << "sorting rotamers in each hash entry" << endl;
-		rif->finalize_rif();
+		rif->finalize_rif( option[rifgen::bin_filter_bits_per_key]() );
 		// __gnu_parallel::for_each( rif.map_.begin(), rif.map_.end(), call_sort_rotamers<XMap::Map::value_type> );
 		// __gnu_parallel::for_each( rif.map_.begin(), rif.map_.end(), assert_is_sorted  <XMap::Map::value_type> );
 
@@ -978,9 +991,8 @@ int main(int argc, char *argv[]) {
 			#endif
 			for( int ibound = 0; ibound <= option[rifgen::lever_bounds]().size(); ++ibound ){
 				if( ibound == 0 ){
-					utility::io::ozstream out( fname , std::ios::binary );
-					rif->save( out, description );
-					out.close();
+					runtime_assert( write_binary_file( fname, [&]( std::ostream & out ){ return rif->save( out, description ); },
+					                                   option[rifgen::block_compress_rif]() ) );
 				} else {
 					std::string bgfn = make_bounding_grids( rif_factory, rif, description, fname, ibound );
 					#ifdef USE_OPENMP
@@ -1156,6 +1168,14 @@ int main(int argc, char *argv[]) {
 	std::cout <<     "-rif_dock:rot_spec_fname        " << rot_spec_fname << std::endl;
 	std::cout << "#################################################################################################################" << std::endl;
 
+	::scheme::util::mem_report( std::cout );
+
+	if( option[rifgen::perf_counters]() ){
+		::scheme::util::perf_counters_report( std::cout );
+		std::string const perf_out = option[rifgen::perf_counters_out]();
+		if( perf_out.size() ) runtime_assert_msg( ::scheme::util::write_perf_counters_tsv( perf_out ), "can't write " + perf_out );
+	}
+
 	return 0;
  }
 
@@ -0,0 +1,225 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://www.rosettacommons.org. Questions about this can be
+// (c) addressed to University of Washington UW TechTransfer, email: license@u.washington.edu.
+
+
+#include <riflib/ResultsStore.hh>
+
+#include <utility/exit.hh>
+
+#include <array>
+#include <sstream>
+
+
+namespace devel {
+namespace scheme {
+
+using ::scheme::io::ColumnSpec;
+
+namespace {
+
+typedef std::array<float,12> StoredXform; // rotation row major, then translation
+
+StoredXform
+pack_xform( EigenXform const & x ) {
+    StoredXform s;
+    for ( int i = 0; i < 3; i++ ) for ( int j = 0; j < 3; j++ ) s[i*3+j] = x.linear()(i,j);
+    for ( int i = 0; i < 3; i++ ) s[9+i] = x.translation()[i];
+    return s;
+}
+
+EigenXform
+unpack_xform( StoredXform const & s ) {
+    EigenXform x = EigenXform::Identity();
+    for ( int i = 0; i < 3; i++ ) for ( int j = 0; j < 3; j++ ) x.linear()(i,j) = s[i*3+j];
+    for ( int i = 0; i < 3; i++ ) x.translation()[i] = s[9+i];
+    return x;
+}
+
+// float members stored under their own names
+typedef float StoredResult::* FloatMember;
+std::vector< std::pair< std::string, FloatMember > > const &
+float_columns() {
+    static std::vector< std::pair< std::string, FloatMember > > const cols {
+        { "dist0",          &StoredResult::dist0 },
+        { "nopackscore",    &StoredResult::nopackscore },
+        { "rifscore",       &StoredResult::rifscore },
+        { "stericscore",    &StoredResult::stericscore },
+        { "score",          &StoredResult::score },
+        { "scaff_bb_hbond", &StoredResult::scaff_bb_hbond },
+        { "cluster_score",  &StoredResult::cluster_score }
+    };
+    return cols;
+}
+
+std::string const EXTRA_PREFIX = "extra:";
+
+std::string
+join_lines( std::vector<std::string> const & strs ) {
+    std::string joined;
+    for ( std::string const & s : strs ) joined += ( joined.size() ? "\n" : "" ) + s;
+    return joined;
+}
+
+std::vector<std::string>
+split_lines( std::string const & joined ) {
+    std::vector<std::string> strs;
+    std::istringstream iss( joined );
+    std::string line;
+    while ( std::getline( iss, line ) ) strs.push_back( line );
+    return strs;
+}
+
+std::vector<ColumnSpec>
+make_schema( std::vector<std::string> const & extra_score_names ) {
+    std::vector<ColumnSpec> cols {
+        ColumnSpec( "nest_index", 8 ),
+        ColumnSpec( "seeding_index", 4 ),
+        ColumnSpec( "scaffold_depth", 2 ),
+        ColumnSpec( "scaffold_member", 2 ),
+        ColumnSpec( "scaffold_id", 4 ),
+        ColumnSpec( "sasa", 2 ),
+        ColumnSpec( "isamp", 8 ),
+        ColumnSpec( "prepack_rank", 4 ),
+        ColumnSpec( "scaffold_xform", sizeof(StoredXform) ),
+        ColumnSpec( "target_xform", sizeof(StoredXform) ),
+        ColumnSpec( "rotamers", 0 ),
+        ColumnSpec( "tag", 0 )
+    };
+    for ( auto const & fc : float_columns() ) cols.push_back( ColumnSpec( fc.first, 4 ) );
+    for ( std::string const & name : extra_score_names ) cols.push_back( ColumnSpec( EXTRA_PREFIX + name, 4 ) );
+    return cols;
+}
+
+}
+
+
+ResultsStoreWriter::ResultsStoreWriter(
+    std::string const & fname,
+    std::vector<std::string> const & extra_score_names,
+    std::map<std::string,std::string> const & meta
+) :
+    fname_( fname ),
+    out_( fname.c_str(), std::ios::binary ),
+    extra_score_names_( extra_score_names ),
+    meta_( meta ),
+    nrows_( 0 ),
+    closed_( false )
+{
+    if ( ! out_ ) utility_exit_with_message( "can't open results store for writing: " + fname );
+    writer_ = make_shared< ::scheme::io::ColumnStoreWriter >( out_, make_schema( extra_score_names ) );
+}
+
+ResultsStoreWriter::~ResultsStoreWriter() {
+    close();
+}
+
+uint32_t
+ResultsStoreWriter::scaffold_id( std::string const & scaffold_fname ) {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    for ( uint32_t i = 0; i < scaffold_fnames_.size(); i++ ) {
+        if ( scaffold_fnames_[i] == scaffold_fname ) return i;
+    }
+    scaffold_fnames_.push_back( scaffold_fname );
+    return scaffold_fnames_.size() - 1;
+}
+
+void
+ResultsStoreWriter::add( StoredResult const & r ) {
+    runtime_assert_msg( r.extra_scores.size() == extra_score_names_.size(), "ResultsStoreWriter::add wrong number of extra scores" );
+    std::lock_guard<std::mutex> lock( mutex_ );
+    runtime_assert_msg( ! closed_, "ResultsStoreWriter::add after close" );
+    ::scheme::io::ColumnStoreWriter & w = *writer_;
+    int icol = 0;
+    w.set( icol++, r.nest_index );
+    w.set( icol++, r.seeding_index );
+    w.set( icol++, r.scaffold_depth );
+    w.set( icol++, r.scaffold_member );
+    w.set( icol++, r.scaffold_id );
+    w.set( icol++, r.sasa );
+    w.set( icol++, r.isamp );
+    w.set( icol++, r.prepack_rank );
+    w.set( icol++, pack_xform( r.scaffold_xform ) );
+    w.set( icol++, pack_xform( r.target_xform ) );
+    w.set_ragged( icol++, r.rotamers );
+    w.set_ragged( icol++, r.tag.data(), r.tag.size() );
+    for ( auto const & fc : float_columns() ) w.set( icol++, r.*(fc.second) );
+    for ( float extra : r.extra_scores ) w.set( icol++, extra );
+    w.end_row();
+    nrows_++;
+}
+
+bool
+ResultsStoreWriter::close() {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    if ( closed_ ) return out_.good();
+    closed_ = true;
+    for ( auto const & kv : meta_ ) writer_->set_meta( kv.first, kv.second );
+    writer_->set_meta( "scaffold_fnames", join_lines( scaffold_fnames_ ) );
+    writer_->set_meta( "extra_score_names", join_lines( extra_score_names_ ) );
+    bool ok = writer_->close();
+    out_.close();
+    return ok && ! out_.fail();
+}
+
+
+ResultsStoreReader::ResultsStoreReader( std::string const & fname ) :
+    in_( fname.c_str(), std::ios::binary )
+{
+    if ( ! in_ ) return;
+    reader_ = make_shared< ::scheme::io::ColumnStoreReader >( in_ );
+    if ( ! reader_->ok() ) return;
+    scaffold_fnames_ = split_lines( reader_->meta( "scaffold_fnames" ) );
+    extra_score_names_ = split_lines( reader_->meta( "extra_score_names" ) );
+}
+
+StoredResult
+ResultsStoreReader::read( uint64_t row ) {
+    ::scheme::io::ColumnStoreReader & r = *reader_;
+    StoredResult s;
+    int icol = 0;
+    s.nest_index      = r.get<uint64_t>( row, icol++ );
+    s.seeding_index   = r.get<uint32_t>( row, icol++ );
+    s.scaffold_depth  = r.get<uint16_t>( row, icol++ );
+    s.scaffold_member = r.get<uint16_t>( row, icol++ );
+    s.scaffold_id     = r.get<uint32_t>( row, icol++ );
+    s.sasa            = r.get<uint16_t>( row, icol++ );
+    s.isamp           = r.get<uint64_t>( row, icol++ );
+    s.prepack_rank    = r.get<uint32_t>( row, icol++ );
+    s.scaffold_xform  = unpack_xform( r.get<StoredXform>( row, icol++ ) );
+    s.target_xform    = unpack_xform( r.get<StoredXform>( row, icol++ ) );
+    s.rotamers        = r.get_ragged_vector<StoredRotamer>( row, icol++ );
+    s.tag             = r.get_ragged( row, icol++ );
+    for ( auto const & fc : float_columns() ) s.*(fc.second) = r.get<float>( row, icol++ );
+    for ( size_t i = 0; i < extra_score_names_.size(); i++ ) s.extra_scores.push_back( r.get<float>( row, icol++ ) );
+    return s;
+}
+
+std::vector<std::string>
+ResultsStoreReader::score_names() const {
+    std::vector<std::string> names;
+    for ( auto const & fc : float_columns() ) names.push_back( fc.first );
+    for ( std::string const & name : extra_score_names_ ) names.push_back( name );
+    return names;
+}
+
+std::vector<float>
+ResultsStoreReader::read_score_column( std::string const & name ) {
+    int const first_score = reader_->column( float_columns().front().first );
+    int col = reader_->column( name );
+    if ( col < first_score ) col = reader_->column( EXTRA_PREFIX + name );
+    if ( col >= first_score ) return reader_->read_column<float>( col );
+
+    std::ostringstream names;
+    for ( std::string const & n : score_names() ) names << " " << n;
+    utility_exit_with_message( "no score column " + name + " in results store, have:" + names.str() );
+    return std::vector<float>();
+}
+
+
+}}
@@ -0,0 +1,121 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://www.rosettacommons.org. Questions about this can be
+// (c) addressed to University of Washington UW TechTransfer, email: license@u.washington.edu.
+
+
+#ifndef INCLUDED_riflib_ResultsStore_hh
+#define INCLUDED_riflib_ResultsStore_hh
+
+#include <riflib/types.hh>
+#include <scheme/io/column_store.hh>
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace devel {
+namespace scheme {
+
+// Binary store of docking results (scheme/io/column_store.hh), one row per output result.
+//   Everything needed to rebuild the output pose is kept: the scaffold and target pdb names, the
+//   xforms that put them in the output frame and each placed rotamer with its chis. Scores are
+//   fixed width columns so ranking a few million results reads only the score column.
+//   rif_results_extract turns chosen rows back into pdbs or silent structs.
+
+// one placed rotamer, enough to rebuild it without the rotamer spec
+struct StoredRotamer {
+    int32_t seqpos;       // 1-based scaffold residue
+    int32_t irot;         // in the rot_index used for docking
+    char resname[8];      // rot_index resname
+    char l_resname[8];    // for d amino acids the l residue type, empty otherwise
+    int32_t nchi;
+    float chi[6];
+};
+
+struct StoredResult {
+    uint64_t nest_index = 0;
+    uint32_t seeding_index = 0;
+    uint16_t scaffold_depth = 0;
+    uint16_t scaffold_member = 0;
+    uint32_t scaffold_id = 0;       // index into scaffold_fnames
+    float dist0 = 0, nopackscore = 0, rifscore = 0, stericscore = 0, score = 0, scaff_bb_hbond = 0, cluster_score = 0;
+    uint16_t sasa = 0;
+    uint64_t isamp = 0;
+    uint32_t prepack_rank = 0;
+    EigenXform scaffold_xform = EigenXform::Identity();   // scaffold pdb coords -> output coords
+    EigenXform target_xform = EigenXform::Identity();     // target pdb coords -> output coords
+    std::vector<StoredRotamer> rotamers;
+    std::vector<float> extra_scores;                      // matches extra_score_names
+    std::string tag;                                      // model tag of the normal output
+};
+
+class ResultsStoreWriter {
+public:
+    // extra_score_names become float columns, each add() must give that many extra_scores
+    ResultsStoreWriter(
+        std::string const & fname,
+        std::vector<std::string> const & extra_score_names,
+        std::map<std::string,std::string> const & meta );
+    ~ResultsStoreWriter();
+
+    // id to use for rows of this scaffold, thread safe
+    uint32_t scaffold_id( std::string const & scaffold_fname );
+
+    // thread safe
+    void add( StoredResult const & result );
+
+    // writes the index, rows added after this are an error
+    bool close();
+
+    uint64_t num_rows() const { return nrows_; }
+    std::string const & fname() const { return fname_; }
+
+private:
+    std::string fname_;
+    std::ofstream out_;
+    shared_ptr< ::scheme::io::ColumnStoreWriter > writer_;
+    std::vector<std::string> extra_score_names_;
+    std::vector<std::string> scaffold_fnames_;
+    std::map<std::string,std::string> meta_;
+    std::mutex mutex_;
+    uint64_t nrows_;
+    bool closed_;
+};
+
+class ResultsStoreReader {
+public:
+    ResultsStoreReader( std::string const & fname );
+
+    bool ok() const { return reader_ && reader_->ok(); }
+    std::string error() const { return reader_ ? reader_->error() : "can't open"; }
+    uint64_t num_rows() const { return reader_->num_rows(); }
+
+    StoredResult read( uint64_t row );
+
+    // any score column, fixed or extra, by name
+    std::vector<float> read_score_column( std::string const & name );
+    std::vector<std::string> score_names() const;
+
+    std::vector<std::string> const & scaffold_fnames() const { return scaffold_fnames_; }
+    std::vector<std::string> const & extra_score_names() const { return extra_score_names_; }
+    std::string meta( std::string const & key ) const { return reader_->meta( key ); }
+
+private:
+    std::ifstream in_;
+    shared_ptr< ::scheme::io::ColumnStoreReader > reader_;
+    std::vector<std::string> scaffold_fnames_;
+    std::vector<std::string> extra_score_names_;
+};
+
+
+}}
+
+#endif
@@ -23,6 +23,7 @@
 
 
 namespace scheme { namespace search { struct HackPackOpts; }}
+namespace scheme { namespace util { class SharedArena; }}
 
 namespace devel {
 namespace scheme {
@@ -68,6 +69,9 @@ struct RifBase
     virtual EigenXform get_bin_center( Key const & k) const = 0;
     virtual void get_rotamers_for_key( Key const & k, std::vector< std::pair< float, int > > & rotscores ) const = 0;
     virtual void get_rotamers_for_xform( EigenXform const & x, std::vector< std::pair< float, int > > & rotscores ) const = 0;
+    // bin key and first (best, once finalize_rif sorted the bins) rotamer for n xforms, score 0 and
+    // rotamer -1 for empty bins. any output may be null. serial, callers split batches between threads
+    virtual void get_best_rotamers( EigenXform const * xforms, int64_t n, Key * keys, float * scores, int32_t * rotamers ) const = 0;
 	virtual void get_rotamer_ids_in_use( std::vector<bool> & using_rot ) const = 0;
 	virtual void print( std::ostream & out ) const = 0;
     // virtual void super_print( std::ostream & out, shared_ptr< RotamerIndex > rot_index_p ) const = 0;
@@ -95,10 +99,31 @@ struct RifBase
 	virtual bool get_xmap_ptr( boost::any * any_p ) = 0;
 	virtual bool get_xmap_const_ptr( boost::any * any_p ) const = 0;
 
+	// huge pages (0 none, 1 transparent, 2 explicit) and numa placement of the hash table
+	// numa_mode "interleave" spreads the table over all nodes, "replicate" makes one copy per node
+	virtual void set_memory_placement( int huge_pages, std::string const & numa_mode ) {}
+	virtual int num_numa_replicas() const { return 0; }
+	// the copy on numa_node if there are replicas, otherwise the same as above
+	virtual bool get_xmap_const_ptr( boost::any * any_p, int numa_node ) const { return get_xmap_const_ptr( any_p ); }
+	template< class XMap > bool get_xmap_const_ptr( shared_ptr<XMap const> & xmap_ptr, int numa_node ) const;
+
+	// the hash table as one block of a shared memory arena, so other processes on the node can use
+	// it in place, read only, instead of loading their own copy (-rif_dock:shared_memory_name).
+	// attach_shared drops this rif's own table. shared_bytes is the size of the block
+	virtual size_t shared_bytes() const { return 0; }
+	virtual bool export_shared( ::scheme::util::SharedArena & arena, std::string const & block ) const { return false; }
+	virtual bool attach_shared( ::scheme::util::SharedArena const & arena, std::string const & block ) { return false; }
+	virtual bool is_shared() const { return false; }
+
 	virtual bool load( std::istream & in , std::string & description ) = 0;
 	virtual bool save( std::ostream & out, std::string & description ) = 0;
 
-	virtual void finalize_rif() = 0;
+	// sorts the rotamers in each bin, best first. bin_filter_bits_per_key > 0 also builds the bin filter
+	virtual void finalize_rif( float bin_filter_bits_per_key = 0 ) = 0;
+	// membership filter the xmap checks before its table, so lookups of empty bins are cheap. saved
+	// and loaded with the rif. ~bits_per_key/8 bytes per bin, 10 gives ~1% false positives
+	virtual void build_bin_filter( float bits_per_key ) = 0;
+	virtual bool has_bin_filter() const = 0;
 
     virtual RifBaseKeyRange key_range() const = 0;
     
@@ -159,6 +184,16 @@ bool RifBase::get_xmap_const_ptr( shared_ptr<XMap const> & xmap_ptr ) const
 	return false;
 }
 template< class XMap >
+bool RifBase::get_xmap_const_ptr( shared_ptr<XMap const> & xmap_ptr, int numa_node ) const
+{
+	boost::any any = static_cast< shared_ptr<XMap const> const>( xmap_ptr );
+	if( get_xmap_const_ptr( &any, numa_node ) ){
+		xmap_ptr = boost::any_cast< shared_ptr<XMap const> const>( any );
+		return true;
+	}
+	return false;
+}
+template< class XMap >
 bool RifBase::set_xmap_ptr( shared_ptr<XMap> const & xmap_ptr )
 {
 	boost::any any = static_cast< shared_ptr<XMap> >( xmap_ptr );
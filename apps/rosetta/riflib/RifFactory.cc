@@ -24,7 +24,12 @@
 
 
 #include <scheme/objective/hash/XformMap.hh>
+#include <scheme/objective/hash/XformMapLookupCache.hh>
+#include <scheme/objective/hash/XformMapMerge.hh>
 #include <scheme/objective/storage/RotamerScores.hh>
+#include <scheme/util/numa.hh>
+#include <scheme/util/perf_counters.hh>
+#include <scheme/util/shared_arena.hh>
 
 #include <scheme/actor/Atom.hh>
 #include <scheme/actor/BackboneActor.hh>
@@ -69,6 +74,7 @@ template< class XMap >
 class RifWrapper : public RifBase {
 
 	shared_ptr<XMap> xmap_ptr_;
+	std::vector< shared_ptr<XMap> > numa_replicas_; // empty unless set_memory_placement replicated
 
 public:
 
@@ -79,6 +85,9 @@ public:
 
 	virtual bool load( std::istream & in , std::string & description )
 	{
+		// counts this thread only: gzip is inflated here, but the other threads inflating a
+		// block compressed file are not in it
+		::scheme::util::PerfRegion perf_region( "rif_load" );
 		size_t s;
 		in.read((char*)&s,sizeof(size_t));
 		char buf[9999];
@@ -86,13 +95,13 @@ public:
 		in.read(buf,s);
 		std::string type_in(buf);
 		runtime_assert_msg( type_in == type_, "mismatched rif_types, expected: '" + type_ + "' , got: '" + type_in + "'" );
-		return xmap_ptr_->load( in , description );
+		return xmap_ptr_->load( in , description ) && xmap_ptr_->load_filter( in );
 	}
 	virtual bool save( std::ostream & out, std::string & description ) {
 		size_t s = type_.size();
 		out.write((char*)&s,sizeof(size_t));
 		out.write(type_.c_str(),s);
-		return xmap_ptr_->save( out, description );
+		return xmap_ptr_->save( out, description ) && xmap_ptr_->save_filter( out );
 	}
 
 	virtual bool get_xmap_ptr( boost::any * any_p )	{
@@ -109,8 +118,71 @@ public:
 		shared_ptr<XMap> const * tmp = boost::any_cast< shared_ptr<XMap> >( any_p );
 		if( !tmp ) return false;
 		xmap_ptr_ = *tmp;
+		numa_replicas_.clear();
 		return true;
 	}
+	bool get_xmap_const_ptr( boost::any * any_p, int numa_node ) const override {
+		if( numa_node < 0 || numa_node >= numa_replicas_.size() ) return get_xmap_const_ptr( any_p );
+		bool is_compatible_type =     boost::any_cast< shared_ptr<XMap const> const>( any_p );
+		if( is_compatible_type ) *any_p = static_cast< shared_ptr<XMap const> const>( numa_replicas_[numa_node] );
+		return is_compatible_type;
+	}
+	int num_numa_replicas() const override { return numa_replicas_.size(); }
+
+	size_t shared_bytes() const override { return xmap_ptr_->shared_bytes(); }
+	bool export_shared( ::scheme::util::SharedArena & arena, std::string const & block ) const override {
+		void * out = arena.allocate( block, xmap_ptr_->shared_bytes() );
+		if( !out ) return false;
+		xmap_ptr_->export_shared( out );
+		return true;
+	}
+	bool attach_shared( ::scheme::util::SharedArena const & arena, std::string const & block ) override {
+		size_t bytes = 0;
+		void const * data = arena.find( block, &bytes );
+		if( !data || !xmap_ptr_->attach_shared( data, bytes ) ) return false;
+		numa_replicas_.clear();
+		return true;
+	}
+	bool is_shared() const override { return xmap_ptr_->is_shared(); }
+
+	// the table is copied into memory placed as asked, the copy allocates through
+	//  XformMap's PlacedAllocator which follows the ScopedMemPlacement of the copying thread
+	void set_memory_placement( int huge_pages, std::string const & numa_mode ) override {
+		using namespace ::scheme::util;
+		if( xmap_ptr_->is_shared() ) return; // lives where the shared memory is
+		runtime_assert_msg( numa_mode == "none" || numa_mode == "interleave" || numa_mode == "replicate",
+			"unknown rif numa mode: '" + numa_mode + "'" );
+		runtime_assert_msg( huge_pages >= HUGE_NONE && huge_pages <= HUGE_EXPLICIT, "rif huge pages must be 0, 1 or 2" );
+		HugePages const huge = (HugePages)huge_pages;
+		numa_replicas_.clear();
+		if( numa_mode == "replicate" && numa_num_nodes() > 1 ){
+			numa_replicas_.resize( numa_num_nodes() );
+			std::exception_ptr exception = nullptr;
+			#ifdef USE_OPENMP
+			#pragma omp parallel for schedule(static,1)
+			#endif
+			for( int node = 0; node < numa_replicas_.size(); ++node ){
+				if( exception ) continue;
+				try {
+					ScopedMemPlacement placement( MemPlacement( huge, MEM_BIND, node ) );
+					numa_replicas_[node] = make_shared<XMap>( *xmap_ptr_ );
+				} catch( ... ) {
+					#ifdef USE_OPENMP
+					#pragma omp critical
+					#endif
+					exception = std::current_exception();
+				}
+			}
+			if( exception ) std::rethrow_exception(exception);
+			// xmap_ptr_ keeps its identity for anyone already holding it, it becomes the node 0 copy
+			xmap_ptr_->map_.swap( numa_replicas_[0]->map_ );
+			numa_replicas_[0] = xmap_ptr_;
+		} else if( huge != HUGE_NONE || numa_mode == "interleave" ){
+			ScopedMemPlacement placement( MemPlacement( huge, numa_mode == "interleave" ? MEM_INTERLEAVE : MEM_DEFAULT ) );
+			typename XMap::Map placed( xmap_ptr_->map_ );
+			xmap_ptr_->map_.swap( placed );
+		}
+	}
 
 
     void clear_sats() override {
@@ -156,7 +228,7 @@ public:
     }
 
 	size_t size() const override { return xmap_ptr_->size(); }
-	float load_factor() const override { return xmap_ptr_->map_.size()*1.f/xmap_ptr_->map_.bucket_count(); }
+	float load_factor() const override { return xmap_ptr_->size()*1.f/xmap_ptr_->bucket_count(); }
 	size_t mem_use()    const override { return xmap_ptr_->mem_use(); }
 	float cart_resl()   const override { return xmap_ptr_->cart_resl_; }
 	float ang_resl()    const override { return xmap_ptr_->ang_resl_; }
@@ -168,15 +240,14 @@ public:
 	{
 		typedef typename XMap::Map::value_type MapPair;
 		typedef typename MapPair::second_type RotScores;
-		for( auto const & v : xmap_ptr_->map_ ){
-			RotScores const & xmrot( v.second );
+		xmap_ptr_->for_each( [&]( Key, RotScores const & xmrot ){
 			for( int i = 0; i < RotScores::N; ++i ){
 				if( xmrot.empty(i) ) break;
 				if( xmrot.rotamer(i) >= using_rot.size() ) using_rot.resize( xmrot.rotamer(i)+1 , false );
 
 				using_rot[ xmrot.rotamer(i) ] = true;
 			}
-		}
+		});
 
 	}
 
@@ -206,11 +277,30 @@ public:
         get_rotamers_for_key(k, rotscores);
 	}
 
-	void finalize_rif() override {
+	void get_best_rotamers( EigenXform const * xforms, int64_t n, Key * keys, float * scores, int32_t * rotamers ) const override {
+		for( int64_t i = 0; i < n; ++i ){
+			Key const k = xmap_ptr_->get_key( xforms[i] );
+			typename XMap::Value const * rs = xmap_ptr_->find_ptr( k );
+			bool const empty = !rs || rs->empty(0);
+			if( keys ) keys[i] = k;
+			if( scores ) scores[i] = empty ? 0.0f : rs->score(0);
+			if( rotamers ) rotamers[i] = empty ? -1 : (int32_t)rs->rotamer(0);
+		}
+	}
+
+	void finalize_rif( float bin_filter_bits_per_key = 0 ) override {
 		// sort the rotamers in each cell so best scoring is first
 		__gnu_parallel::for_each( xmap_ptr_->map_.begin(), xmap_ptr_->map_.end(), call_sort_rotamers<typename XMap::Map::value_type> );
+		if( bin_filter_bits_per_key > 0 ) build_bin_filter( bin_filter_bits_per_key );
 	}
 
+	// replicas made by set_memory_placement copy the filter, build it before placing
+	void build_bin_filter( float bits_per_key ) override {
+		runtime_assert_msg( numa_replicas_.empty(), "build_bin_filter after set_memory_placement replicated the rif" );
+		xmap_ptr_->build_filter( bits_per_key );
+	}
+	bool has_bin_filter() const override { return xmap_ptr_->has_filter(); }
+
 	// void super_print( std::ostream & out, shared_ptr< RotamerIndex > rot_index_p ) const override { xmap_ptr_->super_print( out, rot_index_p  ); }
 	void print( std::ostream & out ) const override { out << (*xmap_ptr_) << std::endl; }
 	std::string value_name() const override { return XMap::Value::name(); }
@@ -944,13 +1034,13 @@ public:
 std::string get_rif_type_from_file( std::string fname )
 {
 	runtime_assert( utility::file::file_exists(fname) );
-	utility::io::izstream in( fname );
-	runtime_assert( in.good() );
-	size_t s;
-	in.read((char*)&s,sizeof(size_t));
 	char buf[9999];
 	for(int i = 0; i < 9999; ++i) buf[i] = 0;
-	in.read(buf,s);
+	runtime_assert( read_binary_file( fname, [&]( std::istream & in ){
+		size_t s;
+		in.read((char*)&s,sizeof(size_t));
+		return in.good() && s < 9999 && in.read(buf,s);
+	} ) );
 	return std::string(buf);
 }
 
@@ -996,7 +1086,6 @@ std::string get_rif_type_from_file( std::string fname )
 		shared_ptr< BurialManager > burial_manager_;
 		shared_ptr< UnsatManager > unsat_manager_;
         shared_ptr< BurialVoxelArray > scaff_burial_grid_;
-		shared_ptr<::scheme::objective::storage::TwoBodyTable<float> const> reference_twobody_;
         //std::vector<std::vector<bool>> allowed_irots_;
         shared_ptr<std::vector<std::vector<bool>>> allowed_irots_;
 		// sat group vector goes here
@@ -1037,6 +1126,11 @@ std::string get_rif_type_from_file( std::string fname )
         std::vector< int > requirements_;
 	private:
 		shared_ptr<RIF const> rif_ = nullptr;
+		std::vector< shared_ptr<RIF const> > rif_per_node_; // numa replicas of rif_, if any
+		typedef ::scheme::objective::hash::XformMapLookupCache<RIF> LookupCache;
+		std::vector< shared_ptr< LookupCache > > lookupcacheperthread_;
+		int lookup_cache_bits_ = 0;
+		typename RIF::Value empty_rotscores_; // what XformMap::operator[] returns on a miss
 	public:
 		VoxelArrayPtr target_proximity_test_grid_ = nullptr;
 		RifScoreRotamerVsTarget rot_tgt_scorer_;
@@ -1052,6 +1146,55 @@ std::string get_rif_type_from_file( std::string fname )
 
 		void set_rif( shared_ptr< ::devel::scheme::RifBase const> rif_ptr ){
 			rif_ptr->get_xmap_const_ptr( rif_ );
+			rif_per_node_.clear();
+			for( int node = 0; node < rif_ptr->num_numa_replicas(); ++node ){
+				rif_per_node_.push_back( nullptr );
+				rif_ptr->get_xmap_const_ptr( rif_per_node_.back(), node );
+			}
+			lookupcacheperthread_.clear();
+		}
+
+		// the replica on this thread's numa node
+		RIF const & local_rif() const {
+			if( rif_per_node_.size() == 0 ) return *rif_;
+			return *rif_per_node_[ ::scheme::util::numa_current_node() % rif_per_node_.size() ];
+		}
+
+		// Per-thread direct-mapped cache of rif lookups, 2^lg_size slots each. Children of
+		//  one parent mostly land in the same rif bins, and each thread scores them together.
+		//  A thread's cache is set up on its first lookup, over local_rif() of the node it is on
+		//  then, so the cache and the replica it points into are on that node
+		void init_lookup_cache( int lg_size ){
+			runtime_assert( rif_ );
+			lookupcacheperthread_.clear();
+			lookup_cache_bits_ = lg_size;
+			if ( lg_size <= 0 ) return;
+			for( int i  = 0; i < ::devel::scheme::omp_max_threads_1(); ++i ){
+				lookupcacheperthread_.push_back( make_shared<LookupCache>() );
+			}
+		}
+
+		bool lookup_cache_stats( uint64_t & hits, uint64_t & misses, bool reset ) const {
+			hits = misses = 0;
+			for ( shared_ptr<LookupCache> const & cache : lookupcacheperthread_ ) {
+				hits += cache->hits_;
+				misses += cache->misses_;
+				if ( reset ) cache->reset_counts();
+			}
+			return lookupcacheperthread_.size() > 0;
+		}
+
+		typename RIF::Value const &
+		lookup_rotscores( typename RIF::Xform const & x ) const {
+			typename RIF::Key const key = rif_->get_key( x );
+			if( lookupcacheperthread_.size() == 0 ){
+				typename RIF::Value const * val = local_rif().find_ptr( key );
+				return val ? *val : empty_rotscores_;
+			}
+			LookupCache & cache = *lookupcacheperthread_[ ::devel::scheme::omp_thread_num() ];
+			if( ! cache.xmap_ ) cache.init( local_rif(), lookup_cache_bits_ );
+			typename RIF::Value const * val = cache.find( key );
+			return val ? *val : empty_rotscores_;
 		}
 
 		void init_for_packing(
@@ -1157,12 +1300,8 @@ std::string get_rif_type_from_file( std::string fname )
 			runtime_assert( rot_tgt_scorer_.target_field_by_atype_.size() == 22 );
 			scratch.hackpack_ = packperthread_.at( ::devel::scheme::omp_thread_num() );
 
-			if ( ! scratch.burial_manager_ ) {
-				scratch.hackpack_->reinitialize( data_cache->local_twobody_p );
-			} else {
-				scratch.hackpack_->reinitialize( data_cache->local_twobody_per_thread.at(::devel::scheme::omp_thread_num()) );
-				scratch.reference_twobody_ = data_cache->local_twobody_p;
-			}
+			// unsat penalties go in as a per-pack overlay, the table itself is shared by all threads
+			scratch.hackpack_->reinitialize( data_cache->local_twobody_p );
 
 		}
 
@@ -1176,7 +1315,7 @@ std::string get_rif_type_from_file( std::string fname )
 
 			const bool want_sats = scratch.burial_manager_;
 
-			typename RIF::Value const & rotscores = rif_->operator[]( bb.position() );
+			typename RIF::Value const & rotscores = lookup_rotscores( bb.position() );
 			static int const Nrots = RIF::Value::N;
 			int const ires = bb.index_;
 			float bestsc = 0.0;
@@ -1366,10 +1505,6 @@ std::string get_rif_type_from_file( std::string fname )
 				result.val_ = packer.pack( result.rotamers_ );
 				result.val_ += unsat_zerobody;
 
-				if ( scratch.burial_manager_ ) {scratch.unsat_manager_->fix_packer( packer, scratch.reference_twobody_ );
-					// runtime_assert(scratch.reference_twobody_->check_equal(*packer.twob_));
-				}
-				
 
                 if ( hydrophobic_manager_ ) {
                     std::vector<std::pair<intRot, EigenXform>> irot_and_bbpos;
@@ -1408,7 +1543,7 @@ std::string get_rif_type_from_file( std::string fname )
                     
                     for( int ii = 0; ii < result.rotamers_.size(); ++ii ){
                         BBActor const & bb = scene.template get_actor<BBActor>( 1, result.rotamers_[ii].first );
-                        typename RIF::Value const & rotscores = rif_->operator[]( bb.position() );
+                        typename RIF::Value const & rotscores = local_rif()[ bb.position() ];
                         static int const Nrots = RIF::Value::N;
                         for( int i_rs = 0; i_rs < Nrots; ++i_rs ){
                             if( rotscores.rotamer(i_rs) == result.rotamers_[ii].second ){
@@ -1428,7 +1563,7 @@ std::string get_rif_type_from_file( std::string fname )
                         int ires = result.rotamers_[ii].first;
                         int irot = result.rotamers_[ii].second;
                         BBActor const & bb = scene.template get_actor<BBActor>( 1, ires );
-                        typename RIF::Value const & rotscores = rif_->operator[]( bb.position() );
+                        typename RIF::Value const & rotscores = local_rif()[ bb.position() ];
                         static int const Nrots = RIF::Value::N;
                         for( int i_rs = 0; i_rs < Nrots; ++i_rs ){
                             if( rotscores.rotamer(i_rs) == irot ){
@@ -1846,23 +1981,7 @@ struct RifFactoryImpl :
 		// std::cout << "create rif progress "; std::cout.flush();
 
 
-		// old
-		int progress0 = 0;
-		for( auto const & v : from->map_ ){
-			// if( ++progress0 % std::max((size_t)1,(from->size()/100)) == 0 ){
-				// std::cout << '*'; std::cout.flush();
-			// }
-			EigenXform x = from->hasher_.get_center( v.first );
-
-			uint64_t k = to->hasher_.get_key(x);
-			typename XMap::Map::iterator iter = to->map_.find(k);
-			if( iter == to->map_.end() ){
-				to->map_.insert( std::make_pair(k,v.second) );
-			} else {
-				iter->second.merge( v.second );
-
-			}
-		}
+		to->merge_from_finer( *from );
 		// // std::cout << std::endl;
 
 		// new
@@ -1905,14 +2024,85 @@ struct RifFactoryImpl :
 		if( ! utility::file::file_exists(fname) ){
 			utility_exit_with_message("create_rif_from_file missing file: " + fname );
 		}
-		utility::io::izstream in( fname );
-		if( !in.good() ) return nullptr;
-		bool success = rif->load( in, description );
-		in.close();
+		bool success = read_binary_file( fname, [&]( std::istream & in ){ return rif->load( in, description ); } );
 		if( success ) return rif;
 		else return nullptr;
 	}
 
+	virtual RifPtr
+	create_rif_by_merging(
+		std::vector<std::string> const & fnames,
+		size_t buffer_bytes,
+		std::vector<std::string> & descriptions
+	) const {
+		RifPtr rif = this->create_rif();
+		shared_ptr<XMap> xmap;
+		runtime_assert( rif->get_xmap_ptr( xmap ) );
+		typedef ::scheme::objective::hash::XformMapMerger<XMap> Merger;
+		Merger merger( *xmap, buffer_bytes );
+
+		// same type header as RifWrapper::save
+		auto read_rif_type = [&]( std::istream & in, std::string & error ){
+			size_t s;
+			char buf[9999];
+			for( int j = 0; j < 9999; ++j ) buf[j] = 0;
+			in.read( (char*)&s, sizeof(size_t) );
+			if( ! in.good() || s >= 9999 || ! in.read( buf, s ) ){
+				error = "can't read rif type";
+				return false;
+			}
+			if( std::string(buf) != this->config().rif_type ){
+				error = "rif type is '" + std::string(buf) + "', expected '" + this->config().rif_type + "'";
+				return false;
+			}
+			return true;
+		};
+
+		descriptions.resize( fnames.size() );
+		std::vector<std::string> errors( fnames.size() );
+		auto check_errors = [&](){
+			for( int i = 0; i < fnames.size(); ++i ){
+				if( errors[i].size() ) utility_exit_with_message( "create_rif_by_merging: " + fnames[i] + ": " + errors[i] );
+			}
+		};
+
+		// the headers first, so the merged table is sized once for everything and never rehashed
+		std::vector<uint64_t> num_elements( fnames.size(), 0 );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1)
+		#endif
+		for( int i = 0; i < fnames.size(); ++i ){
+			if( ! utility::file::file_exists( fnames[i] ) ){
+				errors[i] = "missing file";
+				continue;
+			}
+			bool ok = read_binary_file( fnames[i], [&]( std::istream & in ){
+				if( ! read_rif_type( in, errors[i] ) ) return false;
+				if( Merger::count_elements( in, num_elements[i] ) ) return true;
+				errors[i] = "can't read header";
+				return false;
+			} );
+			if( ! ok && errors[i].empty() ) errors[i] = "read failed";
+		}
+		check_errors();
+		uint64_t total = 0;
+		for( uint64_t n : num_elements ) total += n;
+		merger.reserve( total );
+
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1)
+		#endif
+		for( int i = 0; i < fnames.size(); ++i ){
+			bool ok = read_binary_file( fnames[i], [&]( std::istream & in ){
+				return read_rif_type( in, errors[i] ) && merger.add_stream( in, descriptions[i], errors[i] );
+			} );
+			if( ! ok && errors[i].empty() ) errors[i] = "read failed";
+		}
+		check_errors();
+		merger.finish();
+		return rif;
+	}
+
 	virtual ScenePtr
 	create_scene() const {
 		ScenePtr s = make_shared<ParametricScene>(2);
@@ -2075,6 +2265,14 @@ struct RifFactoryImpl :
             }
         }
 
+        // Only the hsearch objectives, packing is dominated by other things
+        if ( config.rif_lookup_cache_bits > 0 ) {
+            for ( ObjectivePtr & op : objectives ) {
+                dynamic_cast<MySceneObjectiveRIF&>(*op).objective.template get_objective<MyScoreBBActorRIF>()
+                                .init_lookup_cache( config.rif_lookup_cache_bits );
+            }
+        }
+
 		return true;
 
 	}
@@ -2099,6 +2297,12 @@ struct RifFactoryImpl :
         return dynamic_cast<MySceneObjectiveRIF&>(*objective).objective.template get_objective<MyScoreBBActorRIF>().unsatperthread_;
     }
 
+    bool
+    get_rif_lookup_cache_stats( ObjectivePtr & objective, uint64_t & hits, uint64_t & misses, bool reset ) const override {
+        return dynamic_cast<MySceneObjectiveRIF&>(*objective).objective.template get_objective<MyScoreBBActorRIF>()
+                                .lookup_cache_stats( hits, misses, reset );
+    }
+
 
 };
 
@@ -67,6 +67,18 @@ struct RifFactory
 	virtual	RifPtr
 	create_rif_from_file( std::string const & fname, std::string & description ) const = 0;
 
+	// Merges rif files made with the same rif_type and hash resolutions into one, keeping the best
+	//  rotamers per bin as RotamerScores::merge does. Files are streamed in parallel, not loaded.
+	//  The merged table is sized from the summed bin counts in the file headers and filled in place,
+	//  so memory is that table plus about buffer_bytes of staging. Rotamers are not sorted, call
+	//  finalize_rif() before saving. descriptions gets the description of each file
+	virtual RifPtr
+	create_rif_by_merging(
+		std::vector<std::string> const & fnames,
+		size_t buffer_bytes,
+		std::vector<std::string> & descriptions
+	) const = 0;
+
 	virtual	ScenePtr
 	create_scene() const = 0;
 
@@ -101,6 +113,10 @@ struct RifFactory
 	// This should not be in here. Only here because of the typedefs
 	virtual std::vector<shared_ptr<UnsatManager>> &
 	get_unsatperthread( ObjectivePtr & objective ) const = 0;
+
+	// hits and misses of the per-thread rif lookup caches, false if the objective has none
+	virtual bool
+	get_rif_lookup_cache_stats( ObjectivePtr & objective, uint64_t & hits, uint64_t & misses, bool reset ) const = 0;
 };
 
 
@@ -139,6 +155,7 @@ struct RifSceneObjectiveConfig
     std::vector< std::vector<bool> > pdbinfo_req_active_requirements;
     std::vector<float> sat_bonus;
     std::vector<bool> sat_bonus_override;
+    int rif_lookup_cache_bits = 0; // 0 disables the per-thread rif lookup cache
 
 };
 
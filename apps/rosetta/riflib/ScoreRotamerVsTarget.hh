@@ -100,6 +100,8 @@ template< class VoxelArrayPtr, class HBondRay, class RotamerIndex >
 struct ScoreRotamerVsTarget {
     ::scheme::shared_ptr< RotamerIndex const > rot_index_p_ = nullptr;
     std::vector<VoxelArrayPtr> target_field_by_atype_;
+    // if filled by quantize_target_fields, used instead of target_field_by_atype_
+    std::vector< shared_ptr< QuantizedVoxelArray const > > target_field_quantized_by_atype_;
     std::vector< HBondRay > target_donors_, target_acceptors_;
 
     // Ok, the names shouldn't be here, but it's convenient
@@ -121,6 +123,21 @@ struct ScoreRotamerVsTarget {
 
     ScoreRotamerVsTarget(){}
 
+    // 4x4x4 int8 bricks, values above clamp_hi are all just a clash
+    // returns the largest per atom error
+    float quantize_target_fields( float clamp_hi ){
+        target_field_quantized_by_atype_.clear();
+        target_field_quantized_by_atype_.resize( target_field_by_atype_.size() );
+        float max_error = 0;
+        for( int i = 0; i < target_field_by_atype_.size(); ++i ){
+            if( ! target_field_by_atype_[i] ) continue;
+            target_field_quantized_by_atype_[i] = make_shared< QuantizedVoxelArray >(
+                *target_field_by_atype_[i], -std::numeric_limits<float>::max(), clamp_hi );
+            max_error = std::max( max_error, target_field_quantized_by_atype_[i]->max_error() );
+        }
+        return max_error;
+    }
+
     template< class Xform, class Int >
     float
     score_rotamer_v_target(
@@ -170,7 +187,10 @@ struct ScoreRotamerVsTarget {
             {
                 Atom const & atom = rot_index_p_->rotamer(irot).atoms_.at(iatom);
                 typename Atom::Position pos = rbpos * atom.position();
-                score += target_field_by_atype_.at(atom.type())->at( pos );
+                if( target_field_quantized_by_atype_.size() )
+                    score += target_field_quantized_by_atype_[atom.type()]->at( pos );
+                else
+                    score += target_field_by_atype_.at(atom.type())->at( pos );
             }
         }
 
@@ -227,8 +227,6 @@ UnsatManager::reset() {
     to_pack_rots_.clear();  // this supposedly doesn't mess with the memory
     to_pack_rots_.reserve(512);
 
-    modified_edges_.clear();
-    modified_edges_.reserve(1024);
 }
 
 
@@ -1202,23 +1200,13 @@ UnsatManager::handle_twobody( int satisfier1, int satisfier2, float penalty, ::s
     ToPackRot const & pack1 = to_pack_rots_[ satisfier1 ];
     ToPackRot const & pack2 = to_pack_rots_[ satisfier2 ];
 
-    packer.twob_->upweight_edge( pack1.ires, pack2.ires, pack1.irot, pack2.irot, penalty );
-    modified_edges_.push_back( std::array<int, 4> { pack1.ires, pack2.ires, pack1.irot, pack2.irot } );
+    // lives only until the packer is reinitialized, the shared twobody table is never touched
+    packer.add_twobody_overlay( pack1.ires, pack2.ires, pack1.irot, pack2.irot, penalty );
 
     return 0;
 
 }
 
-void
-UnsatManager::fix_packer( 
-    ::scheme::search::HackPack & packer, 
-    shared_ptr<::scheme::objective::storage::TwoBodyTable<float> const> reference_twobody
-) {
-    for ( std::array<int, 4> const & arr : modified_edges_ ) {
-        packer.twob_->restore_edge( arr[0], arr[1], arr[2], arr[3], reference_twobody );
-    }
-}
-
 
 
 }}
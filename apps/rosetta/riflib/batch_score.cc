@@ -0,0 +1,112 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://www.rosettacommons.org. Questions about this can be
+// (c) addressed to University of Washington UW TechTransfer, email: license@u.washington.edu.
+
+#include <riflib/batch_score.hh>
+#include <riflib/util.hh>
+
+#include <Eigen/StdVector>
+
+#include <algorithm>
+#include <istream>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace devel {
+namespace scheme {
+
+// big enough to amortize the omp dispatch and the RifBase virtual call, small enough to stay in L1
+static int64_t const BATCH_CHUNK = 1024;
+
+void
+rif_batch_lookup(
+	RifBase const & rif,
+	double const * stubs,
+	int64_t n,
+	uint64_t * keys,
+	float * best_scores,
+	int32_t * best_rotamers
+){
+	int64_t const nchunks = ( n + BATCH_CHUNK - 1 ) / BATCH_CHUNK;
+	#ifdef USE_OPENMP
+	#pragma omp parallel
+	#endif
+	{
+		std::vector< EigenXform, Eigen::aligned_allocator<EigenXform> > xforms( BATCH_CHUNK );
+		#ifdef USE_OPENMP
+		#pragma omp for schedule(dynamic,4)
+		#endif
+		for( int64_t ichunk = 0; ichunk < nchunks; ++ichunk ){
+			int64_t const beg = ichunk * BATCH_CHUNK;
+			int64_t const num = std::min( BATCH_CHUNK, n - beg );
+			for( int64_t i = 0; i < num; ++i ){
+				double const * m = stubs + 16 * ( beg + i );
+				EigenXform & x = xforms[i];
+				for( int r = 0; r < 3; ++r ){
+					for( int c = 0; c < 3; ++c ) x.linear()( r, c ) = m[ 4*r + c ];
+					x.translation()[r] = m[ 4*r + 3 ];
+				}
+			}
+			rif.get_best_rotamers( &xforms[0], num,
+				keys          ? keys          + beg : nullptr,
+				best_scores   ? best_scores   + beg : nullptr,
+				best_rotamers ? best_rotamers + beg : nullptr );
+		}
+	}
+}
+
+void
+voxel_batch_energies(
+	VoxelArray const & field,
+	double const * xyz,
+	int64_t n,
+	float * energies
+){
+	#ifdef USE_OPENMP
+	#pragma omp parallel for schedule(static) if( n > BATCH_CHUNK )
+	#endif
+	for( int64_t i = 0; i < n; ++i ){
+		energies[i] = field.at( (float)xyz[3*i], (float)xyz[3*i+1], (float)xyz[3*i+2] );
+	}
+}
+
+void
+atype_batch_energies(
+	std::vector< VoxelArrayPtr > const & field_by_atype,
+	double const * xyz,
+	int32_t const * atypes,
+	int64_t n,
+	float * energies
+){
+	int64_t const ntypes = field_by_atype.size();
+	#ifdef USE_OPENMP
+	#pragma omp parallel for schedule(static) if( n > BATCH_CHUNK )
+	#endif
+	for( int64_t i = 0; i < n; ++i ){
+		int32_t const atype = atypes[i];
+		VoxelArray const * field = ( atype > 0 && atype < ntypes ) ? field_by_atype[atype] : nullptr;
+		energies[i] = field ? field->at( (float)xyz[3*i], (float)xyz[3*i+1], (float)xyz[3*i+2] ) : 0.0f;
+	}
+}
+
+shared_ptr< VoxelArray >
+load_voxel_array( std::string const & fname )
+{
+	shared_ptr< VoxelArray > field = make_shared< VoxelArray >();
+	bool ok = read_binary_file( fname, [&]( std::istream & in ){
+		field->load( in );
+		return !in.fail();
+	});
+	return ok ? field : nullptr;
+}
+
+
+}
+}
@@ -0,0 +1,68 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://www.rosettacommons.org. Questions about this can be
+// (c) addressed to University of Washington UW TechTransfer, email: license@u.washington.edu.
+
+#ifndef INCLUDED_riflib_batch_score_hh
+#define INCLUDED_riflib_batch_score_hh
+
+#include <riflib/types.hh>
+#include <riflib/RifBase.hh>
+
+#include <string>
+#include <vector>
+
+namespace devel {
+namespace scheme {
+
+// batch lookups over flat arrays, for callers that hold their coordinates in numpy arrays or other
+// plain buffers (python/pysetta/_pysetta_rif.cc). all of them split the batch over omp threads,
+// write only to the output arrays, and don't touch anything global, so they are safe to call with
+// the python GIL released. outputs must hold n elements, null outputs are skipped
+
+/// stubs are n row major 4x4 homogeneous transforms, rif frame. per stub the rif bin key and the
+/// best rotamer in it and its score, -1 and 0 for empty bins
+void
+rif_batch_lookup(
+	RifBase const & rif,
+	double const * stubs,
+	int64_t n,
+	uint64_t * keys,
+	float * best_scores,
+	int32_t * best_rotamers
+);
+
+/// grid value at each of n xyz points, 0 outside the grid
+void
+voxel_batch_energies(
+	VoxelArray const & field,
+	double const * xyz,
+	int64_t n,
+	float * energies
+);
+
+/// per atom energies from the grid of each atom's rosetta atom type, field_by_atype as filled by
+/// get_rosetta_fields (indexed by atype, 1 based). unknown atypes or null grids score 0
+void
+atype_batch_energies(
+	std::vector< VoxelArrayPtr > const & field_by_atype,
+	double const * xyz,
+	int32_t const * atypes,
+	int64_t n,
+	float * energies
+);
+
+/// one grid from a rosetta_field cache file, as written by get_rosetta_fields.
+/// null if fname can't be read
+shared_ptr< VoxelArray >
+load_voxel_array( std::string const & fname );
+
+
+}
+}
+
+#endif
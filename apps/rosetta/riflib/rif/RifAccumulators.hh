@@ -15,17 +15,22 @@
 #include <riflib/rif/RifGenerator.hh>
 #include <riflib/RifFactory.hh>
 
+#include <scheme/objective/hash/XformMapConcurrent.hh>
+#include <scheme/util/mem_budget.hh>
+
 namespace devel {
 namespace scheme {
 namespace rif {
 
 
+// all threads insert into one XformMapConcurrent, condense moves it into the rif
 template<class XMap>
 struct RIFAccumulatorMapThreaded : public RifAccumulator {
 
 	typedef typename XMap::Map Map;
+	typedef ::scheme::objective::hash::XformMapConcurrent<XMap> ConcurrentMap;
 	shared_ptr<RifFactory const> rif_factory_;
-	std::vector< Map > to_insert_;
+	shared_ptr<ConcurrentMap> to_insert_;
 	std::vector<int64_t> nsamp_;
 	float scratch_size_M_;
 	uint64_t N_motifs_found_;
@@ -43,12 +48,15 @@ struct RIFAccumulatorMapThreaded : public RifAccumulator {
 		, scratch_size_M_(scratch_size_M)
 	 	, N_motifs_found_(0)
 	{
-		clear();
 		xmap_ptr_ = make_shared<XMap>( cart_resl, ang_resl );
+		to_insert_ = make_shared<ConcurrentMap>( *xmap_ptr_ );
+		clear();
 	}
 
 	bool initialize_with_rif( shared_ptr<RifBase> & rif ) override {
-		return rif->get_xmap_ptr( xmap_ptr_ );
+		if( ! rif->get_xmap_ptr( xmap_ptr_ ) ) return false;
+		to_insert_ = make_shared<ConcurrentMap>( *xmap_ptr_ );
+		return true;
 	}
 
 	uint64_t n_motifs_found() const override { return N_motifs_found_ + total_samples(); }
@@ -62,30 +70,20 @@ struct RIFAccumulatorMapThreaded : public RifAccumulator {
 	void insert( devel::scheme::EigenXform const & x, float score, int32_t rot, int sat1, int sat2, bool force, bool single_thread ) override {
 		if( score > 0.0 ) return;
 		uint64_t const key = xmap_ptr_->hasher_.get_key( x );
-		typename XMap::Map & map_for_this_thread( single_thread ? xmap_ptr_->map_ : to_insert_[ omp_get_thread_num() ] );
-		// std::cerr << "INSERT mapsize: " << map_for_this_thread.size() << " thread: " << omp_get_thread_num() << " nmaps: " << to_insert_.size() << std::endl;
-		typename XMap::Map::iterator iter = map_for_this_thread.find(key);
-		if( iter == map_for_this_thread.end() ){
-			typename XMap::Value value;
-			value.add_rotamer( rot, score, sat1, sat2, force );
-
-
-         //    std::vector<int> sats;
-        	// value.rotamer_sat_groups( rot, sats );
-        	// std::stringstream ss;
-        	// ss << "sats: "
-        	// for (auto val : sats) {
-        	// 	ss << " : " << val;
-        	// }
-        	// ss << std::endl;
-        	// std::cout << ss.str();
-			// runtime_assert( value.score(0) > -9.0 );
-			map_for_this_thread.insert( std::make_pair( key, value ) );
+		if( single_thread ){
+			// straight into the rif, so get_sats_of_this_irot sees it
+			typename XMap::Map::iterator iter = xmap_ptr_->map_.find(key);
+			if( iter == xmap_ptr_->map_.end() ){
+				typename XMap::Value value;
+				value.add_rotamer( rot, score, sat1, sat2, force );
+				xmap_ptr_->map_.insert( std::make_pair( key, value ) );
+			} else {
+				iter->second.add_rotamer( rot, score, sat1, sat2, force );
+			}
 		} else {
-			// for( int i = 0; i < iter->second.maxsize(); ++i ) runtime_assert( iter->second.score(i) > -9.0 );
-			// std::cout << score << std::endl;
-			iter->second.add_rotamer( rot, score, sat1, sat2, force );
-			// for( int i = 0; i < iter->second.maxsize(); ++i ) runtime_assert( iter->second.score(i) > -9.0 );
+			to_insert_->update( key, [&]( typename XMap::Value & value, bool ){
+				value.add_rotamer( rot, score, sat1, sat2, force );
+			} );
 		}
 		++nsamp_[ omp_get_thread_num() ];
 	}
@@ -96,32 +94,21 @@ struct RIFAccumulatorMapThreaded : public RifAccumulator {
 		return tot;
 	}
 
+	// also early when the job is over -rifgen:mem_budget_G, merging duplicates into the rif frees the scratch table
 	bool need_to_condense() const override {
-		return mem_use() > uint64_t(scratch_size_M_)*uint64_t(1024*1024);
+		uint64_t const m = mem_use();
+		::scheme::util::mem_category( "rif_accumulator" ).set( m );
+		return m > uint64_t(scratch_size_M_)*uint64_t(1024*1024)
+		    || ( m > uint64_t(256)*uint64_t(1024*1024) && ::scheme::util::mem_over_budget() );
 	}
 
 	void condense(bool force_override/*=false*/) override {
-		using ObjexxFCL::format::I;
-		for( int i = 0; i < to_insert_.size(); ++i ){
-			// std::cout << I(3,i+1) << " of " << to_insert_.size() << " progress: ";
-			int64_t const out_interval = std::max<int64_t>(1,to_insert_[i].size()/100);
-			int64_t count = 0;
-			BOOST_FOREACH( typename XMap::Map::value_type const & value, to_insert_[i] ){
-				// if( ++count%out_interval == 0 ){ std::cout << '*'; std::cout.flush(); }
-				typename XMap::Key const key = value.first;
-				typename XMap::Value const & rotsc = value.second;
-				typename XMap::Map::iterator iter = xmap_ptr_->map_.find(key);
-				if( iter == xmap_ptr_->map_.end() ){
-					xmap_ptr_->map_.insert( std::make_pair( key, rotsc ) );
-					// for( int i = 0; i < rotsc.maxsize(); ++i ) runtime_assert( rotsc.score(i) > -9.0 );
-				} else {
-					iter->second.merge( rotsc, force_override );
-					// for( int i = 0; i < iter->second.maxsize(); ++i ) runtime_assert( iter->second.score(i) > -9.0 );
-				}
-
-			}
-			// std::cout << std::endl;
-		}
+		// move_into clears the bin filter a rif loaded for append mode may have, finalize_rif rebuilds it
+		to_insert_->move_into( *xmap_ptr_, [&]( typename XMap::Value & to, typename XMap::Value const & from ){
+			to.merge( from, force_override );
+		} );
+		::scheme::util::mem_category( "rif_accumulator" ).set( mem_use() );
+		::scheme::util::mem_category( "rif" ).set( xmap_ptr_->mem_use() );
 	}
 
 	void report( std::ostream & out ) const override {
@@ -185,25 +172,13 @@ struct RIFAccumulatorMapThreaded : public RifAccumulator {
 	}
 
 	uint64_t mem_use() const {
-		uint64_t mem = 0;
-		for( int i = 0; i < to_insert_.size(); ++i ){
-			mem += to_insert_[i].bucket_count()*(sizeof(typename XMap::Map::value_type));
-		}
-		return mem;
+		return to_insert_->mem_use();
 	}
 
 
 	void clear() override {
-		for( int i = 0; i < to_insert_.size(); ++i ) to_insert_[i].clear();
-		to_insert_.clear();
+		to_insert_->clear();
 		nsamp_.clear();
-
-		to_insert_.reserve( devel::scheme::omp_max_threads_1() );
-		for( int i = 0; i < devel::scheme::omp_max_threads_1(); ++i ){
-			Map m;
-			m.set_empty_key( std::numeric_limits<uint64_t>::max() );
-			to_insert_.push_back(m);
-		}
 		nsamp_.resize( devel::scheme::omp_max_threads_1(), 0 );
 	}
 
@@ -47,6 +47,7 @@
 	// #include <scheme/objective/voxel/VoxelArray.hh>
 	#include <scheme/rosetta/score/RosettaField.hh>
 	#include <scheme/util/StoragePolicy.hh>
+	#include <scheme/util/perf_counters.hh>
 	#include <scheme/chemical/stub.hh>
 	#include <scheme/io/dump_pdb_atom.hh>
 
@@ -730,6 +731,7 @@ namespace rif {
 								cout << '*'; cout.flush();// (float)i/samples[r].size()*100.0 << "% "; cout.flush();
 							}
 							if( samples[r-1][i].score > final_score_cut ) continue;
+							::scheme::util::PerfRegion perf_region( "rifgen_apo_final" );
 							uint64_t isamp0 = samples[r-1][i].index;
 							for( uint64_t j = 0; j < DIMPOW2; ++j ){
 								uint64_t isamp = isamp0 * DIMPOW2 + j;
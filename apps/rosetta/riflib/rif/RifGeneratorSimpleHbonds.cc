@@ -53,6 +53,7 @@
 	// #include <scheme/objective/voxel/VoxelArray.hh>
 	#include <scheme/rosetta/score/RosettaField.hh>
 	#include <scheme/util/StoragePolicy.hh>
+	#include <scheme/util/perf_counters.hh>
 
 	#include <utility/file/file_sys_util.hh>
 	#include <utility/io/izstream.hh>
@@ -841,6 +842,7 @@ RifGeneratorSimpleHbonds::prepare_hbgeoms(
 			for( int i = 1; i <= hbond_geoms.size(); ++i ){
 				if(exception) continue;
 				try {
+					::scheme::util::PerfRegion perf_region( "rifgen_simple_hbonds" );
 					RelRotPos const & rel_rot_pos( hbond_geoms[i] );
 					// if( ++rrpcount%100000==0 ){ cout << (float)rrpcount/hbond_geoms.size()*100.0 << "%(t"<<omp_thread_num_1()<<") "; cout.flush(); }
 
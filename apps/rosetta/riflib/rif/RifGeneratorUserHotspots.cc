@@ -48,6 +48,7 @@
 
 	#include <scheme/objective/hash/XformMap.hh>
 	#include <scheme/objective/storage/RotamerScores.hh>
+	#include <scheme/util/perf_counters.hh>
 	#include <scheme/actor/BackboneActor.hh>
 	#include <vector>
 	#include <utility/vector1.hh>
@@ -439,6 +440,7 @@ namespace rif {
 								#pragma omp parallel for schedule(dynamic,16)
 								#endif
 								for(int a = 0; a < NSAMP; ++a){
+									::scheme::util::PerfRegion perf_region( "rifgen_user_hotspots" );
 									EigenXform const & x_perturb = perturb_xforms[a];
                                     // auto & this_rng = rng_per_thread.at(::devel::scheme::omp_thread_num());
 									// ::scheme::numeric::rand_xform_sphere(this_rng,x_perturb,radius_bound,radians_bound);
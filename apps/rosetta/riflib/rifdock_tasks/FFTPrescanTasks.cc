@@ -0,0 +1,295 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://wsic_dockosettacommons.org. Questions about this casic_dock
+// (c) addressed to University of Waprotocolsgton UW TechTransfer, email: license@u.washington.eprotocols
+
+
+#include <riflib/rifdock_tasks/FFTPrescanTasks.hh>
+
+#include <riflib/types.hh>
+#include <riflib/util.hh>
+#include <riflib/RifBase.hh>
+#include <riflib/scaffold/ScaffoldDataCache.hh>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ObjexxFCL/format.hh>
+
+
+
+namespace devel {
+namespace scheme {
+
+typedef Eigen::Vector3f V3f;
+
+enum FFTPrescanChannel {
+    PRESCAN_CLASH = 0,
+    PRESCAN_RIF,
+    PRESCAN_NUM_CHANNELS
+};
+
+// Voxels closer than this to a target heavy atom are clashes
+static float const PRESCAN_CLASH_DIST = 3.0;
+
+
+// Fill target.scan for the box lb, ub
+static void
+build_prescan_target(
+    FFTPrescanTarget & target,
+    V3f const & lb,
+    V3f const & ub,
+    float cell_size,
+    RifDockData & rdd ) {
+
+    ::scheme::dock::FFTTranslationScan<float> & scan = target.scan;
+    size_t n[3];
+    for ( int d = 0; d < 3; d++ ) n[d] = scan.grid_size_for( ub[d] - lb[d], cell_size );
+    scan.init( lb, cell_size, n[0], n[1], n[2] );
+
+    std::cout << "FFT prescan grid " << n[0] << "x" << n[1] << "x" << n[2] << " at " << cell_size << "A" << std::endl;
+
+    auto voxel_index = [&]( V3f const & p, int64_t & idx ) -> bool {
+        int64_t ijk[3];
+        for ( int d = 0; d < 3; d++ ) {
+            ijk[d] = std::floor( ( p[d] - lb[d] ) / cell_size );
+            if ( ijk[d] < 0 || ijk[d] >= (int64_t)n[d] ) return false;
+        }
+        idx = ( ijk[0]*n[1] + ijk[1] )*n[2] + ijk[2];
+        return true;
+    };
+
+    // clash channel, stamp a sphere around every target heavy atom
+    std::vector<float> grid( n[0]*n[1]*n[2], 0 );
+    int const reach = std::ceil( PRESCAN_CLASH_DIST / cell_size );
+    for ( core::Size ir = 1; ir <= rdd.target.size(); ir++ ) {
+        core::conformation::Residue const & res = rdd.target.residue(ir);
+        for ( core::Size ia = 1; ia <= res.nheavyatoms(); ia++ ) {
+            V3f atom( res.xyz(ia)[0], res.xyz(ia)[1], res.xyz(ia)[2] );
+            for ( int i = -reach; i <= reach; i++ ) {
+            for ( int j = -reach; j <= reach; j++ ) {
+            for ( int k = -reach; k <= reach; k++ ) {
+                V3f p = atom + V3f( i, j, k ) * cell_size;
+                int64_t idx;
+                if ( ( p - atom ).norm() > PRESCAN_CLASH_DIST ) continue;
+                if ( ! voxel_index( p, idx ) ) continue;
+                grid[idx] = 1;
+            }}}
+        }
+    }
+    scan.add_target_channel( [&]( V3f const & c ) -> float {
+        int64_t idx;
+        return voxel_index( c, idx ) ? grid[idx] : 0;
+    });
+
+    // rif channel, the best score of any rif bin centered in the voxel
+    shared_ptr<RifBase> rif;
+    for ( shared_ptr<RifBase> const & r : rdd.rif_ptrs ) {
+        if ( r ) {
+            rif = r;
+            break;
+        }
+    }
+    runtime_assert( rif );
+
+    std::fill( grid.begin(), grid.end(), 0 );
+    std::vector< std::pair< float, int > > rotscores;
+    uint64_t nkeys = 0;
+    for ( RifBase::Key key : rif->key_range() ) {
+        int64_t idx;
+        if ( ! voxel_index( rif->get_bin_center( key ).translation(), idx ) ) continue;
+        rotscores.clear();
+        rif->get_rotamers_for_key( key, rotscores );
+        for ( std::pair< float, int > const & rs : rotscores ) {
+            grid[idx] = std::min( grid[idx], rs.first );
+        }
+        nkeys++;
+    }
+    scan.add_target_channel( [&]( V3f const & c ) -> float {
+        int64_t idx;
+        return voxel_index( c, idx ) ? grid[idx] : 0;
+    });
+
+    std::cout << "FFT prescan used " << KMGT( nkeys ) << " rif bins" << std::endl;
+
+    target.initialized = true;
+}
+
+
+// The scaffold points for each channel, in the scaffold frame
+static void
+get_prescan_scaffold_points(
+    ScaffoldDataCacheOP sdc,
+    std::vector<std::vector<V3f>> & points ) {
+
+    points.resize( PRESCAN_NUM_CHANNELS );
+
+    for ( SimpleAtom const & sa : *sdc->scaffold_simple_atoms_p ) {
+        points[PRESCAN_CLASH].push_back( sa.position() );
+    }
+
+    core::pose::Pose const & scaffold = *sdc->scaffold_centered_p;
+    for ( core::Size ir : *sdc->scaffold_res_p ) {
+        BBActor bba( scaffold.residue(ir) );
+        points[PRESCAN_RIF].push_back( bba.position().translation() );
+    }
+}
+
+
+
+shared_ptr<std::vector<SearchPoint>>
+FFTPrescanTask::return_search_points(
+    shared_ptr<std::vector<SearchPoint>> search_points_p,
+    RifDockData & rdd,
+    ProtocolData & pd ) {
+
+    using ObjexxFCL::format::F;
+    using std::cout;
+    using std::endl;
+
+    std::vector<SearchPoint> & search_points = *search_points_p;
+    if ( search_points.size() == 0 ) return search_points_p;
+
+    std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+
+    // where each point puts the scaffold
+    std::vector<EigenXform> xforms( search_points.size() );
+    std::vector<bool> valid( search_points.size() );
+    std::exception_ptr exception = nullptr;
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(dynamic,64)
+    #endif
+    for( int64_t i = 0; i < search_points.size(); ++i ){
+        if( exception ) continue;
+        try {
+            ScenePtr tscene( rdd.scene_pt[omp_get_thread_num()] );
+            valid[i] = rdd.director->set_scene( search_points[i].index, 0, *tscene );
+            if ( valid[i] ) xforms[i] = tscene->position(1);
+        } catch( std::exception const & ex ) {
+            #ifdef USE_OPENMP
+            #pragma omp critical
+            #endif
+            exception = std::current_exception();
+        }
+    }
+    if( exception ) std::rethrow_exception(exception);
+
+    // group the points by scaffold and orientation
+    typedef std::array<int64_t, 11> GroupKey;
+    std::map<GroupKey, std::vector<size_t>> groups;
+    for ( size_t i = 0; i < search_points.size(); i++ ) {
+        if ( ! valid[i] ) continue;
+        GroupKey key;
+        key[0] = search_points[i].index.scaffold_index.depth;
+        key[1] = search_points[i].index.scaffold_index.member;
+        for ( int j = 0; j < 9; j++ ) key[j+2] = std::round( xforms[i].linear().data()[j] * 10000 );
+        groups[key].push_back( i );
+    }
+
+    // the scaffold points and the box that all translations + scaffold fit in
+    std::map<std::pair<int64_t, int64_t>, std::vector<std::vector<V3f>>> scaffold_points;
+    float radius = 0;
+    V3f lb( 9e9, 9e9, 9e9 ), ub( -9e9, -9e9, -9e9 );
+    for ( std::pair<GroupKey const, std::vector<size_t>> const & group : groups ) {
+        std::pair<int64_t, int64_t> skey( group.first[0], group.first[1] );
+        if ( scaffold_points.count( skey ) == 0 ) {
+            ScaffoldIndex si = search_points[group.second.front()].index.scaffold_index;
+            get_prescan_scaffold_points( rdd.scaffold_provider->get_data_cache_slow( si ), scaffold_points[skey] );
+            for ( std::vector<V3f> const & pts : scaffold_points[skey] ) {
+                for ( V3f const & p : pts ) radius = std::max( radius, p.norm() );
+            }
+        }
+        for ( size_t i : group.second ) {
+            lb = lb.cwiseMin( xforms[i].translation() );
+            ub = ub.cwiseMax( xforms[i].translation() );
+        }
+    }
+
+    V3f const cell_width( rdd.nest.trans_map_.cell_width()[0], rdd.nest.trans_map_.cell_width()[1],
+                          rdd.nest.trans_map_.cell_width()[2] );
+    float const pad = radius + cell_width.maxCoeff() + cell_size_;
+    lb -= V3f( pad, pad, pad );
+    ub += V3f( pad, pad, pad );
+
+    FFTPrescanTarget & target = *target_;
+    bool fits = target.initialized && target.scan.cell_size_ == cell_size_;
+    for ( int d = 0; d < 3; d++ ) {
+        fits &= target.scan.lb_[d] <= lb[d] && ub[d] <= target.scan.ub()[d];
+    }
+    if ( ! fits ) {
+        if ( target.initialized ) {
+            lb = lb.cwiseMin( target.scan.lb_ );
+            ub = ub.cwiseMax( target.scan.ub() );
+        }
+        build_prescan_target( target, lb, ub, cell_size_, rdd );
+    }
+
+    // one scan per orientation, the ffts themselves are threaded
+    std::vector<float> weights( PRESCAN_NUM_CHANNELS );
+    weights[PRESCAN_CLASH] = clash_weight_;
+    weights[PRESCAN_RIF] = 1.0;
+
+    std::vector<float> prescan_scores( search_points.size(), 9e9 );
+    ::scheme::dock::FFTTranslationScores<float> scores;
+    std::vector<std::vector<V3f>> rotated( PRESCAN_NUM_CHANNELS );
+
+    cout << "FFT prescan of " << KMGT(search_points.size()) << " samples in " << groups.size() << " orientations: ";
+    int64_t const out_interval = std::max<int64_t>( groups.size()/50, 1 );
+    int64_t igroup = 0;
+    for ( std::pair<GroupKey const, std::vector<size_t>> const & group : groups ) {
+        if( igroup++ % out_interval == 0 ){ cout << '*'; cout.flush(); }
+
+        Eigen::Matrix3f const rot = xforms[group.second.front()].linear();
+        std::vector<std::vector<V3f>> const & pts = scaffold_points.at( std::make_pair( group.first[0], group.first[1] ) );
+        for ( int c = 0; c < PRESCAN_NUM_CHANNELS; c++ ) {
+            rotated[c].resize( pts[c].size() );
+            for ( size_t ip = 0; ip < pts[c].size(); ip++ ) rotated[c][ip] = rot * pts[c][ip];
+        }
+
+        target.scan.scan( rotated, weights, scores );
+
+        std::vector<size_t> const & members = group.second;
+        #ifdef USE_OPENMP
+        #pragma omp parallel for schedule(static)
+        #endif
+        for ( int64_t im = 0; im < members.size(); im++ ) {
+            V3f const t = xforms[members[im]].translation();
+            prescan_scores[members[im]] = scores.min_score( t - cell_width*0.5f, t + cell_width*0.5f );
+        }
+    }
+    cout << endl;
+
+    // keep the best keep_frac_
+    size_t num_keep = std::max<size_t>( 1, std::ceil( keep_frac_ * search_points.size() ) );
+    num_keep = std::min( num_keep, search_points.size() );
+    std::vector<float> sorted_scores = prescan_scores;
+    std::nth_element( sorted_scores.begin(), sorted_scores.begin() + num_keep - 1, sorted_scores.end() );
+    float const cut = sorted_scores[num_keep - 1];
+
+    shared_ptr<std::vector<SearchPoint>> out_points_p = make_shared<std::vector<SearchPoint>>();
+    out_points_p->reserve( num_keep );
+    for ( size_t i = 0; i < search_points.size(); i++ ) {
+        if ( prescan_scores[i] > cut || prescan_scores[i] >= 9e9 ) continue;
+        if ( out_points_p->size() >= num_keep ) break;
+        out_points_p->push_back( search_points[i] );
+        out_points_p->back().score = prescan_scores[i];
+    }
+
+    std::chrono::duration<double> elapsed_seconds = std::chrono::high_resolution_clock::now() - start;
+    cout << "FFT prescan kept " << KMGT(out_points_p->size()) << " of " << KMGT(search_points.size()) << " samples, score cut "
+         << F(7,3,cut) << ", " << F(7,2,elapsed_seconds.count()) << "s" << endl;
+
+    return out_points_p;
+}
+
+
+
+}}
@@ -0,0 +1,74 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://wsic_dockosettacommons.org. Questions about this casic_dock
+// (c) addressed to University of Waprotocolsgton UW TechTransfer, email: license@u.washington.eprotocols
+
+#ifndef INCLUDED_riflib_rifdock_tasks_FFTPrescanTasks_hh
+#define INCLUDED_riflib_rifdock_tasks_FFTPrescanTasks_hh
+
+#include <riflib/types.hh>
+#include <riflib/task/SearchPointTask.hh>
+
+#include <scheme/dock/fftdock.hh>
+
+#include <string>
+#include <vector>
+
+
+
+namespace devel {
+namespace scheme {
+
+// The target side of FFTPrescanTask: a clash grid around the target heavy atoms and the best
+//  rif score at each point in space. Built by the first scaffold that needs it and reused by
+//  the later ones as long as their search fits inside the grid.
+struct FFTPrescanTarget {
+    ::scheme::dock::FFTTranslationScan<float> scan;
+    bool initialized = false;
+};
+typedef shared_ptr<FFTPrescanTarget> FFTPrescanTargetOP;
+
+
+// Goes between HSearchInit and the first HSearchScoreAtReslTask.
+//
+// The resl 0 points that share an orientation only differ by a translation, so all of them are
+//  scored at once by correlating the rotated scaffold against the target grids with an FFT.
+//  The scaffold N CA C CB atoms count clash_weight each when they are inside the target and
+//  every scaffold_res residue adds the best rif score found where its backbone frame lands.
+//  Only the best keep_frac of the points are passed on to the normal hsearch.
+struct FFTPrescanTask : public SearchPointTask {
+
+    FFTPrescanTask(
+        FFTPrescanTargetOP target,
+        float keep_frac,
+        float cell_size,
+        float clash_weight
+        ) :
+        target_( target ),
+        keep_frac_( keep_frac ),
+        cell_size_( cell_size ),
+        clash_weight_( clash_weight )
+        {}
+
+    shared_ptr<std::vector<SearchPoint>>
+    return_search_points(
+        shared_ptr<std::vector<SearchPoint>> search_points,
+        RifDockData & rdd,
+        ProtocolData & pd ) override;
+
+private:
+    FFTPrescanTargetOP target_;
+    float keep_frac_;
+    float cell_size_;
+    float clash_weight_;
+
+};
+
+
+}}
+
+#endif
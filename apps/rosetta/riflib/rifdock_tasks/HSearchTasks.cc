@@ -13,6 +13,12 @@
 #include <riflib/types.hh>
 #include <riflib/scaffold/ScaffoldDataCache.hh>
 #include <riflib/rifdock_tasks/OutputResultsTasks.hh>
+#include <riflib/task/CompactSearchPoints.hh>
+#include <riflib/task/AdaptiveBeam.hh>
+
+#include <scheme/search/SpatialBandB.hh>
+#include <scheme/util/mem_budget.hh>
+#include <scheme/util/perf_counters.hh>
 
 
 #include <string>
@@ -96,6 +102,9 @@ HSearchInit::return_search_points(
         uniq_scaffolds[ sp.index ] = true;
     }
 
+    // scaffold data from earlier searches may be evicted from here on
+    if ( rdd.scaffold_data_cache_manager ) rdd.scaffold_data_cache_manager->new_epoch();
+
     pd.unique_scaffolds.clear();
     for ( std::pair<RifDockIndex, bool> pair : uniq_scaffolds ) {
         ScaffoldIndex si = pair.first.scaffold_index;
@@ -108,6 +117,12 @@ HSearchInit::return_search_points(
         }
     }
 
+    if ( rdd.scaffold_data_cache_manager ) {
+        std::cout << "Scaffold data: " << KMGT( rdd.scaffold_data_cache_manager->mem_use() ) << "B of "
+                  << KMGT( rdd.scaffold_data_cache_manager->budget() ) << "B budget, "
+                  << rdd.scaffold_data_cache_manager->num_evictions() << " evictions so far" << std::endl;
+    }
+
 
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     print_header( "perform hierarchical search" ); ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -124,10 +139,126 @@ HSearchInit::return_search_points(
 
     std::cout << "Beam size multiplier: " << pd.beam_multiplier << std::endl;
 
+    if ( rdd.adaptive_beam ) {
+        int final_resl = rdd.RESLS.size() - 1;
+        std::string tag = "search";
+        if ( pd.unique_scaffolds.size() > 0 ) {
+            tag = rdd.scaffold_provider->get_data_cache_slow( pd.unique_scaffolds.front() )->scafftag;
+        }
+        // by default the same total as the fixed beam, which scores beam_size children at every resl past 0
+        double budget = rdd.opt.adaptive_beam_budget_M > 0 ? rdd.opt.adaptive_beam_budget_M * 1e6 : (double)final_resl * rdd.opt.beam_size;
+        rdd.adaptive_beam->begin( tag, final_resl, rdd.opt.DIMPOW2, budget * pd.beam_multiplier );
+    }
+
     return search_points;
 }
 
 
+// Returns true if constraints are in use for this resolution
+static bool
+prepare_hsearch_constraints(
+    RifDockData & rdd,
+    ProtocolData & pd,
+    int rif_resl ) {
+
+    bool using_csts = false;
+    for ( ScaffoldIndex si : pd.unique_scaffolds ) {
+        ScaffoldDataCacheOP sdc = rdd.scaffold_provider->get_data_cache_slow(si);
+        using_csts |= sdc->prepare_contraints( rdd.target, rdd.RESLS[rif_resl] );
+    }
+    return using_csts;
+}
+
+// Score a hsearch sample already placed in tscene by the director. 9e9 means rejected.
+static float
+hsearch_score_placed_sample(
+    RifDockIndex const & isamp,
+    int director_resl,
+    int rif_resl,
+    float tether_to_input_position_cut,
+    bool need_sdc,
+    bool using_csts,
+    RifDockData & rdd,
+    ScenePtr const & tscene,
+    uint16_t & sasa ) {
+
+    if ( need_sdc ) {
+        ScaffoldIndex si = isamp.scaffold_index;
+        ScaffoldDataCacheOP sdc = rdd.scaffold_provider->get_data_cache_slow(si);
+
+        if( tether_to_input_position_cut > 0 ){
+            float redundancy_filter_rg = sdc->get_redundancy_filter_rg( rdd.target_redundancy_filter_rg );
+
+            EigenXform x;// = tscene->position(1);
+            rdd.nest.get_state( isamp.nest_index, director_resl, x );
+            x.translation() -= sdc->scaffold_center;
+            float xmag =  xform_magnitude( x, redundancy_filter_rg );
+            if( xmag > tether_to_input_position_cut + rdd.RESLS[rif_resl] ){
+                return 9e9;
+            } 
+        }
+
+        /////////////////////////////////////////////////////
+        /////// Longxing' code  ////////////////////////////
+        ////////////////////////////////////////////////////
+        if (using_csts) {
+            EigenXform x = tscene->position(1);
+            bool pass_all = true;
+            for(CstBaseOP p : sdc->csts) {
+                if (!p->apply( x )) {
+                    pass_all = false;
+                    break;
+                }
+            }
+            if (!pass_all) {
+                return 9e9;
+            }
+        }
+    }
+
+    // the real rif score!!!!!!
+    std::vector<float> scores;
+    float score = rdd.objectives[rif_resl]->score( *tscene, scores );
+
+    sasa = (uint16_t) ( scores[3] / SASA_SUBVERT_MULTIPLIER );
+
+    // score = rdd.objectives[rif_resl]->score( *tscene );// + tot_sym_score;
+
+    return score;
+}
+
+// Score a single hsearch sample with the thread's scene. 9e9 means rejected.
+static float
+hsearch_score_sample(
+    RifDockIndex const & isamp,
+    int director_resl,
+    int rif_resl,
+    float tether_to_input_position_cut,
+    bool need_sdc,
+    bool using_csts,
+    RifDockData & rdd,
+    uint16_t & sasa ) {
+
+    ScenePtr tscene( rdd.scene_pt[omp_get_thread_num()] );
+    bool director_success = rdd.director->set_scene( isamp, director_resl, *tscene );
+    if ( ! director_success ) {
+        return 9e9;
+    }
+    return hsearch_score_placed_sample( isamp, director_resl, rif_resl, tether_to_input_position_cut,
+                                        need_sdc, using_csts, rdd, tscene, sasa );
+}
+
+// Print and reset the hit rate of the rif lookup caches, if -rif_lookup_cache_bits is on
+static void
+report_rif_lookup_cache( RifDockData & rdd, int rif_resl ) {
+    uint64_t hits = 0, misses = 0;
+    if ( ! rdd.rif_factory->get_rif_lookup_cache_stats( rdd.objectives[rif_resl], hits, misses, true ) ) return;
+    if ( hits + misses == 0 ) return;
+    std::cout << "rif lookup cache: " << KMGT(hits) << " hits, " << KMGT(misses) << " misses, hit rate "
+              << ObjexxFCL::format::F(5,3,(double)hits / (hits + misses)) << std::endl;
+}
+
+
 shared_ptr<std::vector<SearchPoint>> 
 HSearchScoreAtReslTask::return_search_points( 
     shared_ptr<std::vector<SearchPoint>> search_points_p, 
@@ -142,11 +273,7 @@ HSearchScoreAtReslTask::return_search_points(
 
     std::vector<SearchPoint> & search_points = *search_points_p;
 
-    bool using_csts = false;
-    for ( ScaffoldIndex si : pd.unique_scaffolds ) {
-        ScaffoldDataCacheOP sdc = rdd.scaffold_provider->get_data_cache_slow(si);
-        using_csts |= sdc->prepare_contraints( rdd.target, rdd.RESLS[rif_resl_] );
-    }
+    bool using_csts = prepare_hsearch_constraints( rdd, pd, rif_resl_ );
 
     bool need_sdc = using_csts || tether_to_input_position_cut_ != 0;
 
@@ -158,66 +285,35 @@ HSearchScoreAtReslTask::return_search_points(
     start = std::chrono::high_resolution_clock::now();
     pd.total_search_effort += search_points.size();
 
+    // the director places whole chunks, consecutive samples are mostly siblings
+    // so the scaffold and the orientation part of the nest xform carry over
+    int64_t const CHUNK = 64;
+    int64_t const nchunks = ( search_points.size() + CHUNK - 1 ) / CHUNK;
+    // through the concrete type set_scene_many calls the stages directly, not set_scene per sample
+    RifDockDirector const * static_director = dynamic_cast< RifDockDirector const * >( rdd.director.get() );
+
     #ifdef USE_OPENMP
-    #pragma omp parallel for schedule(dynamic,64)
+    #pragma omp parallel for schedule(dynamic,1)
     #endif
-    for( int64_t i = 0; i < search_points.size(); ++i ){
+    for( int64_t ichunk = 0; ichunk < nchunks; ++ichunk ){
         if( exception ) continue;
         try {
-            if( i%out_interval==0 ){ cout << '*'; cout.flush(); }
-            RifDockIndex const isamp = search_points[i].index;
+            ::scheme::util::PerfRegion perf_region( "hsearch_score" );
+            int64_t const begin = ichunk * CHUNK;
+            int64_t const n = std::min<int64_t>( CHUNK, search_points.size() - begin );
+            RifDockIndex indices[CHUNK];
+            for( int64_t k = 0; k < n; ++k ) indices[k] = search_points[begin+k].index;
 
             ScenePtr tscene( rdd.scene_pt[omp_get_thread_num()] );
-            bool director_success = rdd.director->set_scene( isamp, director_resl_, *tscene );
-            if ( ! director_success ) {
-                search_points[i].score = 9e9;
-                continue;
-            }
-
-            if ( need_sdc ) {
-                ScaffoldIndex si = isamp.scaffold_index;
-                ScaffoldDataCacheOP sdc = rdd.scaffold_provider->get_data_cache_slow(si);
-
-                if( tether_to_input_position_cut_ > 0 ){
-                    float redundancy_filter_rg = sdc->get_redundancy_filter_rg( rdd.target_redundancy_filter_rg );
-
-                    EigenXform x;// = tscene->position(1);
-                    rdd.nest.get_state( isamp.nest_index, director_resl_, x );
-                    x.translation() -= sdc->scaffold_center;
-                    float xmag =  xform_magnitude( x, redundancy_filter_rg );
-                    if( xmag > tether_to_input_position_cut_ + rdd.RESLS[rif_resl_] ){
-                        search_points[i].score = 9e9;
-                        continue;
-                    } 
-                }
-
-                /////////////////////////////////////////////////////
-                /////// Longxing' code  ////////////////////////////
-                ////////////////////////////////////////////////////
-                if (using_csts) {
-                    EigenXform x = tscene->position(1);
-                    bool pass_all = true;
-                    for(CstBaseOP p : sdc->csts) {
-                        if (!p->apply( x )) {
-                            pass_all = false;
-                            break;
-                        }
-                    }
-                    if (!pass_all) {
-                        search_points[i].score = 9e9;
-                        continue;
-                    }
-                }
-            }
-
-            // the real rif score!!!!!!
-            std::vector<float> scores;
-            search_points[i].score = rdd.objectives[rif_resl_]->score( *tscene, scores );
-
-            search_points[i].sasa = (uint16_t) ( scores[3] / SASA_SUBVERT_MULTIPLIER );
-
-            // search_points[i].score = rdd.objectives[rif_resl_]->score( *tscene );// + tot_sym_score;
-
+            auto score_placed = [&]( size_t k, bool director_success ){
+                int64_t const i = begin + k;
+                if( i%out_interval==0 ){ cout << '*'; cout.flush(); }
+                search_points[i].score = ! director_success ? 9e9 :
+                    hsearch_score_placed_sample( indices[k], director_resl_, rif_resl_, tether_to_input_position_cut_,
+                                                 need_sdc, using_csts, rdd, tscene, search_points[i].sasa );
+            };
+            if( static_director ) static_director->set_scene_many( indices, n, director_resl_, *tscene, score_placed );
+            else rdd.director->set_scene_many( indices, n, director_resl_, *tscene, score_placed );
 
         } catch( std::exception const & ex ) {
             #ifdef USE_OPENMP
@@ -231,6 +327,7 @@ HSearchScoreAtReslTask::return_search_points(
     std::chrono::duration<double> elapsed_seconds_rif = end-start;
     pd.hsearch_rate = (double)search_points.size()/ elapsed_seconds_rif.count()/omp_max_threads();
     cout << endl;// << "done threaded sampling, partitioning data..." << endl;
+    report_rif_lookup_cache( rdd, rif_resl_ );
 
 
     return search_points_p;
@@ -251,7 +348,15 @@ HSearchFilterSortTask::return_search_points(
     SearchPoint max_pt, min_pt;
     int64_t len = search_points.size();
     uint64_t keeping = num_to_keep_ * pd.beam_multiplier;
-    if( search_points.size() > keeping ){
+    if ( rdd.adaptive_beam && rdd.adaptive_beam->active() && prune_extra_ ) {
+        if ( ! rdd.adaptive_beam->observed( resl_ ) ) rdd.adaptive_beam->observe( resl_, search_points, global_score_cut_ );
+        AdaptiveBeamStage const & stage = rdd.adaptive_beam->decide( resl_, pd.total_search_effort, keeping );
+        len = rdd.adaptive_beam->select( stage, search_points );
+        if ( len > 0 ) {
+            min_pt = search_points.front();
+            max_pt = search_points[len-1];
+        }
+    } else if( search_points.size() > keeping ){
         __gnu_parallel::nth_element( search_points.begin(), search_points.begin()+ keeping, search_points.end() );
         len = keeping;
         min_pt = *__gnu_parallel::min_element( search_points.begin(), search_points.begin()+len );
@@ -272,6 +377,20 @@ HSearchFilterSortTask::return_search_points(
     return search_points_p;
 }
 
+// Parents are sorted best first. Under -mem_budget_G, drop the worst ones until their children fit in
+//  the memory left, but always keep a few thousand so the search goes on
+static size_t
+cap_parents_to_mem_budget( size_t parents, uint64_t children_per_parent, size_t bytes_per_child ) {
+    int64_t const headroom = ::scheme::util::mem_headroom();
+    uint64_t const bytes_per_parent = children_per_parent * bytes_per_child;
+    if ( (double)parents * bytes_per_parent <= (double)headroom ) return parents;
+    size_t const fit = std::max<int64_t>( headroom, 0 ) / bytes_per_parent;
+    size_t const capped = std::min( parents, std::max<size_t>( fit, 4096 ) );
+    std::cout << "memory budget: expanding only the best " << KMGT(capped) << " of " << KMGT(parents) << " parents, "
+              << KMGT( std::max<int64_t>( headroom, 0 ) ) << "B left" << std::endl;
+    return capped;
+}
+
 shared_ptr<std::vector<SearchPoint>> 
 HSearchScaleToReslTask::return_search_points( 
     shared_ptr<std::vector<SearchPoint>> search_points_p, 
@@ -300,7 +419,10 @@ HSearchScaleToReslTask::return_search_points(
 
         if( current_resl_ == 0 ) pd.non0_space_size += good_points;
 
+        good_points = cap_parents_to_mem_budget( good_points, use_pow2, sizeof(SearchPoint) );
+        if ( rdd.adaptive_beam && rdd.adaptive_beam->active() ) rdd.adaptive_beam->expanding( current_resl_, search_points, good_points );
         out_points.resize( use_pow2 * good_points );
+        ::scheme::util::mem_category( "hsearch_beam" ).set( out_points.size() * sizeof(SearchPoint) );
 
         #ifdef USE_OPENMP
         #pragma omp parallel for schedule(dynamic,64)
@@ -351,6 +473,193 @@ HSearchScaleToReslTask::return_search_points(
 
 }
 
+shared_ptr<std::vector<SearchPoint>> 
+HSearchCompactScaleAndScoreTask::return_search_points( 
+    shared_ptr<std::vector<SearchPoint>> search_points_p, 
+    RifDockData & rdd, 
+    ProtocolData & pd ) {
+
+    using ObjexxFCL::format::F;
+    using std::cout;
+    using std::endl;
+
+    runtime_assert( target_resl_ > current_resl_ );
+
+    std::vector<SearchPoint> & search_points = *search_points_p;
+
+    uint64_t use_pow2 = 1;
+    for ( int i = current_resl_; i < target_resl_; i++ ) {
+        use_pow2 *= DIMPOW2_;
+    }
+
+    // same parent selection as HSearchScaleToReslTask
+    __gnu_parallel::sort( search_points.begin(), search_points.end() );
+    size_t good_points = 0;
+    for ( good_points = 0; good_points < search_points.size(); good_points++ ) {
+        if ( search_points[good_points].score >= global_score_cut_ ) break;
+    }
+    if( current_resl_ == 0 ) pd.non0_space_size += good_points;
+
+    good_points = cap_parents_to_mem_budget( good_points, use_pow2, sizeof(CompactSearchPointEntry) );
+    bool const adaptive = rdd.adaptive_beam && rdd.adaptive_beam->active();
+    if ( adaptive ) rdd.adaptive_beam->expanding( current_resl_, search_points, good_points );
+    search_points.resize( good_points );
+
+    CompactSearchPoints compact;
+    compact.expand_parents( search_points, use_pow2 );
+    search_points.clear();
+    search_points.shrink_to_fit();
+    ::scheme::util::mem_category( "hsearch_beam" ).set( compact.mem_use() );
+
+    std::vector<CompactSearchPointEntry> & entries = compact.entries;
+
+    bool using_csts = prepare_hsearch_constraints( rdd, pd, target_resl_ );
+    bool need_sdc = using_csts || tether_to_input_position_cut_ != 0;
+
+    cout << "HSearsh stage " << target_resl_+1 << " resl " << F(5,2,rdd.RESLS[target_resl_]) << " begin compact threaded sampling, "
+         << KMGT(entries.size()) << " samples in " << KMGT(compact.blocks.size()) << " blocks, "
+         << KMGT(compact.mem_use()) << "B (vs " << KMGT(entries.size()*sizeof(SearchPoint)) << "B): ";
+
+    // Work on contiguous chunks so that the block lookup only happens once per chunk
+    uint64_t const chunk_size = 1024;
+    int64_t const num_chunks = ( entries.size() + chunk_size - 1 ) / chunk_size;
+    int64_t const out_interval = std::max<int64_t>(num_chunks/50, 1);
+    std::exception_ptr exception = nullptr;
+    std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
+    start = std::chrono::high_resolution_clock::now();
+    pd.total_search_effort += entries.size();
+
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(dynamic,1)
+    #endif
+    for( int64_t ichunk = 0; ichunk < num_chunks; ++ichunk ){
+        if( exception ) continue;
+        try {
+            if( ichunk%out_interval==0 ){ cout << '*'; cout.flush(); }
+            uint64_t lb = ichunk * chunk_size;
+            uint64_t ub = std::min<uint64_t>( lb + chunk_size, entries.size() );
+            size_t iblock = compact.block_of( lb );
+            for ( uint64_t i = lb; i < ub; i++ ) {
+                while ( i >= compact.block_end( iblock ) ) iblock++;
+                CompactSearchPointEntry & entry = entries[i];
+                entry.score = hsearch_score_sample( compact.index( iblock, i ), target_resl_, target_resl_, tether_to_input_position_cut_,
+                                                    need_sdc, using_csts, rdd, entry.sasa );
+            }
+
+        } catch( std::exception const & ex ) {
+            #ifdef USE_OPENMP
+            #pragma omp critical
+            #endif
+            exception = std::current_exception();
+        }
+    }
+    if( exception ) std::rethrow_exception(exception);
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed_seconds_rif = end-start;
+    pd.hsearch_rate = (double)entries.size()/ elapsed_seconds_rif.count()/omp_max_threads();
+    cout << endl;
+    report_rif_lookup_cache( rdd, target_resl_ );
+
+    // Only the survivors of HSearchFilterSortTask (or HSearchFinishTask at the last stage) get expanded
+    shared_ptr<std::vector<SearchPoint>> out_points_p;
+    if ( prune_extra_ && adaptive ) {
+        // HSearchFilterSortTask picks the beam out of these
+        rdd.adaptive_beam->observe( target_resl_, compact, global_score_cut_ );
+        AdaptiveBeamStage const & stage = rdd.adaptive_beam->decide( target_resl_, pd.total_search_effort, num_to_keep_ * pd.beam_multiplier );
+        out_points_p = compact.decode_best( rdd.adaptive_beam->candidates( stage ), 9e9 );
+    } else if ( prune_extra_ ) {
+        out_points_p = compact.decode_best( num_to_keep_ * pd.beam_multiplier, 9e9 );
+    } else {
+        out_points_p = compact.decode_best( entries.size(), 0 );
+    }
+
+    std::cout << "Compact stage kept " << KMGT(out_points_p->size()) << " of " << KMGT(entries.size()) << " samples" << std::endl;
+    ::scheme::util::mem_category( "hsearch_beam" ).set( out_points_p->size() * sizeof(SearchPoint) );
+
+    return out_points_p;
+}
+
+shared_ptr<std::vector<SearchPoint>> 
+HSearchBandBTask::return_search_points( 
+    shared_ptr<std::vector<SearchPoint>> search_points_p, 
+    RifDockData & rdd, 
+    ProtocolData & pd ) {
+
+    using ObjexxFCL::format::F;
+    using std::cout;
+    using std::endl;
+
+    std::vector<SearchPoint> & search_points = *search_points_p;
+
+    // the constraints are set up for one resl at a time and this visits all of them at once
+    bool using_csts = false;
+    for ( int resl = 0; resl <= final_resl_; resl++ ) {
+        using_csts |= prepare_hsearch_constraints( rdd, pd, resl );
+    }
+    if ( using_csts ) {
+        utility_exit_with_message( "-hsearch_bandb_nresults can't be used with scaffold constraints" );
+    }
+
+    bool need_sdc = tether_to_input_position_cut_ != 0;
+
+    std::vector<RifDockIndex> roots( search_points.size() );
+    for ( size_t i = 0; i < search_points.size(); i++ ) roots[i] = search_points[i].index;
+
+    ::scheme::search::SpatialBandB<EigenXform, RifDockIndex> bandb;
+    bandb.opts_.max_resl = final_resl_;
+    bandb.opts_.num_results = num_results_;
+    bandb.opts_.children_per_node = DIMPOW2_;
+    bandb.opts_.score_cut = global_score_cut_;
+    bandb.opts_.max_queue_size = max_queue_size_;
+
+    auto bound = [&]( RifDockIndex const & index, int resl ) -> float {
+        uint16_t sasa;
+        return hsearch_score_sample( index, resl, resl, tether_to_input_position_cut_, need_sdc, false, rdd, sasa );
+    };
+
+    cout << "HSearch branch and bound from " << KMGT(roots.size()) << " samples for the best " << KMGT(num_results_) << endl;
+    std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+
+    auto result = bandb.search( roots, 0, bound );
+
+    std::chrono::duration<double> elapsed_seconds = std::chrono::high_resolution_clock::now() - start;
+    pd.total_search_effort += result->bounds_evaluated;
+    pd.non0_space_size += result->roots_under_cut;
+    pd.hsearch_rate = (double)result->bounds_evaluated / elapsed_seconds.count() / omp_max_threads();
+
+    cout << "Branch and bound evaluated " << KMGT(result->bounds_evaluated) << " samples, expanded " << KMGT(result->nodes_expanded)
+         << ", largest queue " << KMGT(result->max_queue_size) << ", found " << KMGT(result->results.size()) << endl;
+    if ( ! result->exact ) {
+        cout << "WARNING: branch and bound dropped " << KMGT(result->nodes_dropped) << " open samples scoring as low as "
+             << F(7,3,result->best_dropped_bound) << ". Raise -hsearch_bandb_max_queue_M for an exact search" << endl;
+    }
+    report_rif_lookup_cache( rdd, final_resl_ );
+
+    // the final score is known, fill in the sasa
+    search_points.resize( result->results.size() );
+    std::exception_ptr exception = nullptr;
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(dynamic,64)
+    #endif
+    for( int64_t i = 0; i < search_points.size(); ++i ){
+        if( exception ) continue;
+        try {
+            SearchPoint & sp = search_points[i];
+            sp.index = result->results[i].second;
+            sp.score = hsearch_score_sample( sp.index, final_resl_, final_resl_, tether_to_input_position_cut_,
+                                             need_sdc, false, rdd, sp.sasa );
+        } catch( std::exception const & ex ) {
+            #ifdef USE_OPENMP
+            #pragma omp critical
+            #endif
+            exception = std::current_exception();
+        }
+    }
+    if( exception ) std::rethrow_exception(exception);
+
+    return search_points_p;
+}
+
 shared_ptr<std::vector<SearchPoint>> 
 HSearchFinishTask::return_search_points( 
     shared_ptr<std::vector<SearchPoint>> search_points_p, 
@@ -368,8 +677,10 @@ HSearchFinishTask::return_search_points(
     }
 
     search_points.resize(good_points);
+    ::scheme::util::mem_category( "hsearch_beam" ).set( search_points.size() * sizeof(SearchPoint) );
 
     pd.beam_multiplier = 1;
+    if ( rdd.adaptive_beam ) rdd.adaptive_beam->end();
 
     std::cout << "total non-0 space size was approx " << float(pd.non0_space_size)*1024.0*1024.0*1024.0 << " grid points" << std::endl;
     std::cout << "total search effort " << KMGT(pd.total_search_effort) << std::endl;
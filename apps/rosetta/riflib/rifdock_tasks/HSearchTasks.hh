@@ -152,6 +152,86 @@ private:
 
 };
 
+// Replaces HSearchScaleToReslTask followed by HSearchScoreAtReslTask at target_resl.
+//  The children are held in a CompactSearchPoints while they are scored and only
+//  the points that HSearchFilterSortTask would keep are decoded. If prune_extra is
+//  false (the last stage), every point that HSearchFinishTask would keep is decoded.
+struct HSearchCompactScaleAndScoreTask : public SearchPointTask {
+
+    HSearchCompactScaleAndScoreTask(
+        int current_resl,
+        int target_resl,
+        int DIMPOW2,
+        float global_score_cut,
+        uint64_t num_to_keep,
+        bool prune_extra,
+        float tether_to_input_position_cut
+         ) :
+        current_resl_( current_resl ),
+        target_resl_( target_resl ),
+        DIMPOW2_( DIMPOW2 ),
+        global_score_cut_( global_score_cut ),
+        num_to_keep_( num_to_keep ),
+        prune_extra_( prune_extra ),
+        tether_to_input_position_cut_( tether_to_input_position_cut )
+        {}
+
+    shared_ptr<std::vector<SearchPoint>> 
+    return_search_points( 
+        shared_ptr<std::vector<SearchPoint>> search_points, 
+        RifDockData & rdd, 
+        ProtocolData & pd ) override;
+
+private:
+    int current_resl_;
+    int target_resl_;
+    int DIMPOW2_;
+    float global_score_cut_;
+    uint64_t num_to_keep_;
+    bool prune_extra_;
+    float tether_to_input_position_cut_;
+
+};
+
+// Replaces the whole beam search. Starting from the resl 0 points, the cell with the best
+//  score is always refined first and a cell is only refined if its score is below both
+//  global_score_cut and the score of the num_results-th best final point found so far.
+//  The coarse rif scores act as the bounds, so the result is only as exact as the rifs
+//  are bounding. Leaves the num_results best points at final_resl.
+struct HSearchBandBTask : public SearchPointTask {
+
+    HSearchBandBTask(
+        int final_resl,
+        int DIMPOW2,
+        uint64_t num_results,
+        uint64_t max_queue_size,
+        float global_score_cut,
+        float tether_to_input_position_cut
+         ) :
+        final_resl_( final_resl ),
+        DIMPOW2_( DIMPOW2 ),
+        num_results_( num_results ),
+        max_queue_size_( max_queue_size ),
+        global_score_cut_( global_score_cut ),
+        tether_to_input_position_cut_( tether_to_input_position_cut )
+        {}
+
+    shared_ptr<std::vector<SearchPoint>> 
+    return_search_points( 
+        shared_ptr<std::vector<SearchPoint>> search_points, 
+        RifDockData & rdd, 
+        ProtocolData & pd ) override;
+
+private:
+    int final_resl_;
+    int DIMPOW2_;
+    uint64_t num_results_;
+    uint64_t max_queue_size_;
+    float global_score_cut_;
+    float tether_to_input_position_cut_;
+
+};
+
 struct HSearchFinishTask : public SearchPointTask {
 
     HSearchFinishTask(
@@ -14,6 +14,8 @@
 #include <riflib/util.hh>
 #include <riflib/ScoreRotamerVsTarget.hh>
 
+#include <scheme/util/perf_counters.hh>
+
 
 #include <string>
 #include <vector>
@@ -86,17 +88,10 @@ HackPackTask::return_search_point_with_rotss(
     std::cout << "Building twobody tables before hack-pack" << std::endl;
     for( int ipack = 0; ipack < pd.npack; ++ipack ) {
         ScaffoldIndex si = packed_results[ipack].index.scaffold_index;
+        rdd.scaffold_provider->get_data_cache_slow( si )->restore_evicted( rdd.rot_index_p, rdd.opt, rdd.burial_manager );
         rdd.scaffold_provider->setup_twobody_tables( si );
     }
 
-    if ( rdd.unsat_manager ) {
-        std::cout << "Building twobody tables per thread for unsats" << std::endl;
-        for( int ipack = 0; ipack < pd.npack; ++ipack ) {
-            ScaffoldIndex si = packed_results[ipack].index.scaffold_index;
-            rdd.scaffold_provider->setup_twobody_tables_per_thread( si );
-        }
-    }
-
     print_header( "hack-packing top " + KMGT(pd.npack) );
 
     std::cout << "packing options: " << rdd.packopts << std::endl;
@@ -135,6 +130,7 @@ HackPackTask::return_search_point_with_rotss(
                 continue;
             }
 
+            ::scheme::util::PerfRegion perf_region( "hackpack" );
             std::vector<float> scores;
             packed_results[ ipack ].score = rdd.packing_objectives[rif_resl_]->score_with_rotamers( *tscene, scores, packed_results[ ipack ].rotamers() );
             packed_results[ ipack ].sasa = (uint16_t) ( scores[3] / SASA_SUBVERT_MULTIPLIER );
@@ -30,6 +30,7 @@
 
 #include <sys/param.h>
 #include <algorithm>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -59,6 +60,14 @@ OutputResultsTask::return_rif_dock_results(
 
     std::cout << " selected_results.size(): " << selected_results.size() << std::endl;
 
+    // the dumping below is threaded, so bring back evicted scaffold data first
+    if ( rdd.scaffold_data_cache_manager ) {
+        for ( RifDockResult const & result : selected_results ) {
+            rdd.scaffold_provider->get_data_cache_slow( result.index.scaffold_index )
+                                    ->restore_evicted( rdd.rot_index_p, rdd.opt, rdd.burial_manager );
+        }
+    }
+
     ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     print_header( "timing info" ); //////////////////////////////////////////////////////////////////////////////////////////////
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -88,13 +97,43 @@ OutputResultsTask::return_rif_dock_results(
 
     if( rdd.opt.align_to_scaffold ) std::cout << "ALIGN TO SCAFFOLD" << std::endl;
     else                        std::cout << "ALIGN TO TARGET"   << std::endl;
+    std::string silent_fname;
     utility::io::ozstream out_silent_stream; // Final stream to write to
     if ( rdd.opt.outputsilent || rdd.opt.outputlite ) {
         ScaffoldDataCacheOP example_data_cache = rdd.scaffold_provider->get_data_cache_slow( ScaffoldIndex() );
-        out_silent_stream.open_append( rdd.opt.outdir + "/" + example_data_cache->scafftag + ".silent" );
+        silent_fname = rdd.opt.outdir + "/" + example_data_cache->scafftag + ".silent";
+        if ( ! rdd.results_writer ) out_silent_stream.open_append( silent_fname );
     }
 
-    if ( rdd.opt.parallelwrite ) {
+    if ( rdd.results_writer ) {
+        // each result is formatted into its own buffer and handed to the background writers, which
+        // append it to the silent file and compress and write the pdbs while the next scaffold runs
+        std::exception_ptr exception = nullptr;
+
+        #ifdef USE_OPENMP
+        #pragma omp parallel for schedule(dynamic,1) if( rdd.opt.parallelwrite )
+        #endif
+        for( int i_selected_result = 0; i_selected_result < selected_results.size(); ++i_selected_result ) {
+
+            try {
+
+                int const ithread = rdd.opt.parallelwrite ? omp_get_thread_num() : 0;
+                RifDockResult const & selected_result = selected_results.at( i_selected_result );
+
+                std::ostringstream silent;
+                write_selected_result( selected_result, rdd.scene_pt[ ithread ], silent, rdd, pd, i_selected_result );
+                if ( silent_fname.size() ) rdd.results_writer->append( silent_fname, silent.str() );
+
+            } catch(...) {
+                #pragma omp critical
+                exception = std::current_exception();
+            }
+        } // end of OMP loop
+        // done with this silent file, don't hold it open until the writer finishes
+        if ( silent_fname.size() ) rdd.results_writer->close( silent_fname );
+        if( exception ) std::rethrow_exception( exception );
+
+    } else if ( rdd.opt.parallelwrite ) {
         std::vector< std::stringstream > iostreams;
         iostreams.resize( ::devel::scheme::omp_max_threads() );
 
@@ -241,12 +280,100 @@ OutputResultsTask::write_selected_result(
     std::cout << oss.str();
     rdd.dokout << oss.str(); rdd.dokout.flush();
 
-    dump_rif_result_(rdd, selected_result, pdboutfile, director_resl_, rif_resl_, out_silent_stream, rdd.scene_pt.front(), false, resfileoutfile, allrifrotsoutfile, unsat_scores);
+    if ( rdd.results_store ) {
+        std::vector<float> extra_scores { (float)buried, (float)unsats,
+                                          rdd.hydrophobic_manager ? (float)hydrophobic_residue_contacts : -1.0f, hydrophobic_ddg };
+        store_rif_result_( rdd, selected_result, s_ptr, pdb_name( pdboutfile ), extra_scores );
+    }
+
+    if ( ! rdd.opt.results_store_only ) {
+        dump_rif_result_(rdd, selected_result, pdboutfile, director_resl_, rif_resl_, out_silent_stream, s_ptr, false, resfileoutfile, allrifrotsoutfile, unsat_scores);
+    }
 
     std::cout << extra_output.str() << std::flush;
 }
 
 
+std::vector<std::string> const &
+results_store_extra_score_names() {
+    static std::vector<std::string> const names { "buried", "unsats", "hyd_contacts", "hyd_ddg" };
+    return names;
+}
+
+void
+store_rif_result_(
+    RifDockData & rdd,
+    RifDockResult const & selected_result,
+    ScenePtr s_ptr,
+    std::string const & tag,
+    std::vector<float> const & extra_scores ) {
+
+    ScaffoldDataCacheOP sdc = rdd.scaffold_provider->get_data_cache_slow( selected_result.index.scaffold_index );
+    std::vector<int> const & scaffres_l2g = *(sdc->scaffres_l2g_p);
+
+    // same output frame as dump_rif_result_, but from the scaffold pdb rather than the centered scaffold
+    EigenXform xposition1 = s_ptr->position(1);
+    EigenXform xalignout = EigenXform::Identity();
+    if( rdd.opt.align_to_scaffold ){
+        xalignout = xposition1.inverse();
+    }
+    EigenXform scaffold_xform = xalignout * xposition1;
+    scaffold_xform.translate( -1 * sdc->scaffold_center );
+
+    StoredResult stored;
+    stored.nest_index      = selected_result.index.nest_index;
+    stored.seeding_index   = selected_result.index.seeding_index;
+    stored.scaffold_depth  = selected_result.index.scaffold_index.depth;
+    stored.scaffold_member = selected_result.index.scaffold_index.member;
+    stored.scaffold_id     = rdd.results_store->scaffold_id( absolute_path( sdc->scaff_fname ) );
+    stored.dist0           = selected_result.dist0;
+    stored.nopackscore     = selected_result.nopackscore;
+    stored.rifscore        = selected_result.rifscore;
+    stored.stericscore     = selected_result.stericscore;
+    stored.score           = selected_result.score;
+    stored.scaff_bb_hbond  = selected_result.scaff_bb_hbond;
+    stored.cluster_score   = selected_result.cluster_score;
+    stored.sasa            = selected_result.sasa;
+    stored.isamp           = selected_result.isamp;
+    stored.prepack_rank    = selected_result.prepack_rank;
+    stored.scaffold_xform  = scaffold_xform;
+    stored.target_xform    = xalignout;
+    stored.extra_scores    = extra_scores;
+    stored.tag             = tag;
+
+    for( int ipr = 0; ipr < selected_result.numrots(); ++ipr ){
+        int irot = selected_result.rotamers().at(ipr).second;
+        std::string const resname = rdd.rot_index_p->resname(irot);
+        auto d_to_l = rdd.rot_index_p->d_l_map_.find( resname );
+        runtime_assert( rdd.rot_index_p->nchi(irot) <= 6 );
+
+        StoredRotamer rot;
+        std::memset( &rot, 0, sizeof(rot) );
+        rot.seqpos = scaffres_l2g.at( selected_result.rotamers().at(ipr).first ) + 1;
+        rot.irot = irot;
+        std::strncpy( rot.resname, resname.c_str(), sizeof(rot.resname)-1 );
+        if ( d_to_l != rdd.rot_index_p->d_l_map_.end() ) {
+            std::strncpy( rot.l_resname, d_to_l->second.c_str(), sizeof(rot.l_resname)-1 );
+        }
+        rot.nchi = rdd.rot_index_p->nchi(irot);
+        for( int ichi = 0; ichi < rot.nchi; ++ichi ) rot.chi[ichi] = rdd.rot_index_p->chi( irot, ichi );
+        stored.rotamers.push_back( rot );
+    }
+
+    rdd.results_store->add( stored );
+}
+
+void
+write_output_file( RifDockData & rdd, std::string const & fname, std::string const & contents ) {
+    if ( rdd.results_writer ) {
+        rdd.results_writer->write_file( fname, contents );
+    } else {
+        utility::io::ozstream out( fname );
+        out << contents;
+        out.close();
+    }
+}
+
 void
 dump_rif_result_(
     RifDockData & rdd,
@@ -529,27 +656,23 @@ dump_rif_result_(
 
     // Dump the main output
     if ( !rdd.opt.outputsilent && !rdd.opt.outputlite ) {
-        utility::io::ozstream out1( pdboutfile );
+        std::ostringstream out1;
         out1 << expdb.str() << std::endl;
         pose_to_dump.dump_pdb(out1);
         if ( rdd.opt.dump_all_rif_rots_into_output ) {
             if ( rdd.opt.rif_rots_as_chains ) out1 << "TER" << endl;
             out1 << allout.str();
         }
-        out1.close();
+        write_output_file( rdd, pdboutfile, out1.str() );
     }
     // Dump a resfile
     if( rdd.opt.dump_resfile ){
-        utility::io::ozstream out1res( resfileoutfile );
-        out1res << resfile.str();
-        out1res.close();
+        write_output_file( rdd, resfileoutfile, resfile.str() );
     }
 
     // Dump the rif rots
     if( rdd.opt.dump_all_rif_rots ){
-        utility::io::ozstream out2( allrifrotsoutfile );
-        out2 << allout.str();
-        out2.close();
+        write_output_file( rdd, allrifrotsoutfile, allout.str() );
     }
 
     // Dump silent file
@@ -54,6 +54,10 @@ private:
 
 };
 
+// hands contents to rdd.results_writer if there is one, otherwise writes fname (gzipped if .gz) now
+void
+write_output_file( RifDockData & rdd, std::string const & fname, std::string const & contents );
+
 void
 dump_rif_result_(
     RifDockData & rdd,
@@ -69,6 +73,19 @@ dump_rif_result_(
     std::vector<float> const & unsat_scores = std::vector<float>()
     );
 
+// names of the extra_scores store_rif_result_ gives the results store, in order
+std::vector<std::string> const &
+results_store_extra_score_names();
+
+// adds the result to rdd.results_store, the scene must already be set to it
+void
+store_rif_result_(
+    RifDockData & rdd,
+    RifDockResult const & selected_result,
+    ScenePtr s_ptr,
+    std::string const & tag,
+    std::vector<float> const & extra_scores );
+
 // You would think that it would be easier to get the absolute path but it's not
 // It's easy with C++17 but that requires gcc7 which I don't think works with rifdock
 // There is a boost::filesystem library but that is known to generate linker issues - NRB
@@ -64,10 +64,13 @@ global_set_fa_mode( bool fa_mode, RifDockData & rdd ) {
     rdd.scaffold_provider->set_fa_mode(fa_mode);
 
     RifDockScaffoldDirector scaffold_director(rdd.scaffold_provider, 1 );
-    
+
+    // same scaffold index, new conformation
+    rdd.scene_minimal->clear_body_tags();
     scaffold_director.set_scene( RifDockIndex(), 0, *rdd.scene_minimal );
 
     for ( ScenePtr & scene : rdd.scene_pt ) {
+        scene->clear_body_tags();
         scaffold_director.set_scene( RifDockIndex(), 0, *scene );
     }
 
@@ -605,6 +605,7 @@ DumpRotScoresTask::return_search_point_with_rotss(
 
             ScaffoldDataCacheOP sdc = rdd.scaffold_provider->get_data_cache_slow(sp.index.scaffold_index);
             runtime_assert( sdc );
+            sdc->restore_evicted( rdd.rot_index_p, rdd.opt, rdd.burial_manager );
             std::vector<std::vector<float> > const * rotamer_energies_1b = sdc->local_onebody_p.get();
 
 
@@ -166,7 +166,14 @@ typedef ::scheme::kinematics::ScaffoldDirector< EigenXform, ScaffoldProvider, Ri
 
 typedef ::scheme::kinematics::SeedingDirector< EigenXform, std::vector<EigenXform>, RifDockIndex > RifDockSeedingDirector;
 
-typedef ::scheme::kinematics::CompositeDirector< EigenXform, RifDockIndex > RifDockDirector;
+// first stage is one of nest, stored nest or identity, the unused ones are null
+typedef ::scheme::kinematics::StaticCompositeDirector< EigenXform, RifDockIndex,
+            RifDockNestDirector,
+            RifDockStoredNestDirector,
+            RifDockIdentityDirector,
+            RifDockScaffoldDirector,
+            RifDockSeedingDirector
+            > RifDockDirector;
 
 typedef shared_ptr<::scheme::kinematics::Director<EigenXform, RifDockIndex>> DirectorBase;
 
@@ -52,6 +52,8 @@
 
 #include <boost/multi_array.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <exception>
 #include <stdexcept>
 
@@ -578,6 +580,104 @@ void get_per_rotamer_rf_tables(
 
 
 
+namespace {
+
+// Per rotamer data for make_twobody_tables, laid out so the inner loops are flat float arrays:
+//   atoms beyond the CB as x/y/z/type columns (SoA) for the rotamer rf lookups
+//   a bounding sphere around those atoms, to skip rotamer pairs that can't touch the rf table
+//   a bounding sphere around the hbond ray ends, to skip pairs that can't hbond
+struct TwobodyRotamerData {
+	std::vector<float> x, y, z;
+	std::vector<int> type;
+	std::vector<int> begin; // atoms of irot are [ begin[irot], begin[irot+1] )
+	std::vector<Eigen::Vector3f> atom_cen, hbond_cen;
+	std::vector<float> atom_rad, hbond_rad;
+
+	TwobodyRotamerData( devel::scheme::RotamerIndex const & rot_index ) {
+		int const nrot = rot_index.size();
+		begin.resize( nrot+1, 0 );
+		atom_cen.resize( nrot, Eigen::Vector3f(0,0,0) ); atom_rad.resize( nrot, -1 );
+		hbond_cen.resize( nrot, Eigen::Vector3f(0,0,0) ); hbond_rad.resize( nrot, -1 );
+		for( int irot = 0; irot < nrot; ++irot ){
+			begin[irot] = x.size();
+			std::vector<Eigen::Vector3f> pts;
+			for( int ia = 4; ia < rot_index.nheavyatoms(irot); ++ia ){ // use only heavy atoms beyond the CB (which is #3 here)
+				Eigen::Vector3f const & pos = rot_index.rotamers_[irot].atoms_[ia].position();
+				x.push_back( pos[0] );
+				y.push_back( pos[1] );
+				z.push_back( pos[2] );
+				type.push_back( rot_index.rotamers_[irot].atoms_[ia].type() );
+				pts.push_back( pos );
+			}
+			bounding_sphere( pts, atom_cen[irot], atom_rad[irot] );
+			// acceptor score is measured from the acceptor atom, not the orbital
+			pts.clear();
+			for( HBondRay const & hr : rot_index.rotamer(irot).donors_ ) pts.push_back( hr.horb_cen );
+			for( HBondRay const & hr : rot_index.rotamer(irot).acceptors_ ) pts.push_back( hr.horb_cen - hr.direction*::scheme::chemical::ORBLEN );
+			bounding_sphere( pts, hbond_cen[irot], hbond_rad[irot] );
+		}
+		begin[nrot] = x.size();
+	}
+
+	// not minimal, just centroid and max distance. empty is radius -1
+	static void bounding_sphere( std::vector<Eigen::Vector3f> const & pts, Eigen::Vector3f & cen, float & rad ) {
+		if( pts.empty() ) return;
+		cen = Eigen::Vector3f(0,0,0);
+		for( auto const & p : pts ) cen += p;
+		cen /= pts.size();
+		rad = 0;
+		for( auto const & p : pts ) rad = std::max( rad, ( p - cen ).norm() );
+		rad += 0.001;
+	}
+};
+
+// true if nothing within rad of cen can get a nonzero value from field.at()
+// at() truncates toward zero, so positions up to one cell below lb still land in the first cell
+template< class VoxelArray >
+bool
+sphere_misses_field( VoxelArray const & field, Eigen::Vector3f const & cen, float rad ) {
+	for( int k = 0; k < 3; ++k ){
+		if( cen[k] + rad < field.lb_[k] - field.cs_[k] ) return true;
+		if( cen[k] - rad > field.ub_[k] + 2*field.cs_[k] ) return true;
+	}
+	return false;
+}
+
+// neighboring protein residue pairs ( ir > jr, 0 based ) by CA distance
+std::vector< std::pair<int,int> >
+twobody_residue_pairs( core::pose::Pose const & scaffold, double distance_cut ) {
+	core::conformation::PointGraphOP point_graph( new core::conformation::PointGraph );
+	point_graph->set_num_vertices( scaffold.size() );
+	for( int ir = 1; ir <= scaffold.size(); ++ir ){
+		point_graph->get_vertex( ir ).data().xyz() = scaffold.residue(ir).is_protein()
+		       ? scaffold.residue(ir).xyz("CA") : scaffold.residue(ir).nbr_atom_xyz();
+	}
+	// slightly larger, the exact cut is below
+	core::conformation::find_neighbors<core::conformation::PointGraphVertexData,core::conformation::PointGraphEdgeData>(
+		point_graph, distance_cut + 0.1 );
+
+	double const dthresh2 = distance_cut * distance_cut;
+	std::vector< std::pair<int,int> > pairs;
+	for( int jr = 1; jr <= scaffold.size(); ++jr ){
+		if( !scaffold.residue(jr).is_protein() ) continue;
+		for ( auto
+				iter = point_graph->get_vertex( jr ).const_upper_edge_list_begin(),
+				iter_end = point_graph->get_vertex( jr ).const_upper_edge_list_end();
+				iter != iter_end; ++iter ) {
+			int ir = iter->upper_vertex();
+			if( !scaffold.residue(ir).is_protein() ) continue;
+			double dis2 = scaffold.residue(ir).xyz("CA").distance_squared( scaffold.residue(jr).xyz("CA") );
+			if( dis2 > dthresh2 ) continue;
+			pairs.push_back( std::make_pair( ir-1, jr-1 ) );
+		}
+	}
+	std::sort( pairs.begin(), pairs.end() );
+	return pairs;
+}
+
+}
+
+
 void
 make_twobody_tables(
 	core::pose::Pose const & scaffold,
@@ -618,152 +718,173 @@ make_twobody_tables(
 
 	twob.init_onebody_filter( opts.onebody_threshold );
 
-	double const dthresh2 = opts.distance_cut * opts.distance_cut;
+	TwobodyRotamerData const rotdat( rot_index );
+	std::vector< std::pair<int,int> > const respairs = twobody_residue_pairs( scaffold, opts.distance_cut );
+
+	// (ir,jr) pairs split into tiles of irotsel rows, scheduled dynamically
+	// so a few big core pairs don't hold up one thread. a pair's table is allocated by its first
+	// tile and dropped by its last if it never interacts, so only the pairs in progress and the
+	// interacting ones are held at once
+	int const TILE = 16;
+	struct Tile { int ipair, irotsel_begin, irotsel_end; };
+	std::vector<Tile> tiles;
+	std::vector<int> pair_first_tile( respairs.size() );
+	std::vector< std::atomic<int> > pair_tiles_left( respairs.size() );
+	std::vector< std::atomic<bool> > pair_allocated( respairs.size() );
+	for( int ipair = 0; ipair < respairs.size(); ++ipair ){
+		int const ir = respairs[ipair].first;
+		pair_first_tile[ipair] = tiles.size();
+		for( int b = 0; b < twob.nsel_[ir]; b += TILE ){
+			tiles.push_back( Tile{ ipair, b, std::min( b+TILE, twob.nsel_[ir] ) } );
+		}
+		pair_tiles_left[ipair] = tiles.size() - pair_first_tile[ipair];
+		pair_allocated[ipair] = false;
+	}
+	std::vector<float> tile_min( tiles.size(), 9e9 ), tile_max( tiles.size(), -9e9 );
+
+	auto const & to_sp( rot_index.to_structural_parent_frame_ );
 
 	std::exception_ptr exception = nullptr;
 	#ifdef USE_OPENMP
 	#pragma omp parallel for schedule(dynamic,1)
 	#endif
-	for( int ir = 0; ir < scaffold.size(); ++ir ){
+	for( int itile = 0; itile < tiles.size(); ++itile ){
 		if( exception ) continue;
 		try {
-			if( !scaffold.residue(ir+1).is_protein() ) continue;
+			int const ipair = tiles[itile].ipair;
+			int const ir = respairs[ipair].first;
+			int const jr = respairs[ipair].second;
+			if( ! pair_allocated[ipair] ){
+				#ifdef USE_OPENMP
+				#pragma omp critical(make_twobody_tables_init)
+				#endif
+				if( ! pair_allocated[ipair] ){
+					twob.init_twobody(ir,jr);
+					pair_allocated[ipair] = true;
+				}
+			}
 			BackboneActor bbi( scaffold.residue(ir+1).xyz("N"), scaffold.residue(ir+1).xyz("CA"), scaffold.residue(ir+1).xyz("C") );
-
-			// #ifdef USE_OPENMP
-			// #pragma omp critical
-			// #endif
-			// std::cout << "compute twobody for ir-* " << ir << std::endl;
-
-			for( int jr = 0; jr < ir; ++jr ){
-				if( !scaffold.residue(jr+1).is_protein() ) continue;
-
-				double dis2 = scaffold.residue(ir+1).xyz("CA").distance_squared( scaffold.residue(jr+1).xyz("CA") );
-				// double dthr = scaffold.residue(ir).nbr_radius() +                   scaffold.residue(jr+1).nbr_radius();
-
-				if( dis2 > dthresh2 ){
-					// twob.clear_twobody(ir,jr); // no need
-					continue;
+			BackboneActor bbj( scaffold.residue(jr+1).xyz("N"), scaffold.residue(jr+1).xyz("CA"), scaffold.residue(jr+1).xyz("C") );
+
+			EigenXform X2i = bbi.position().inverse() * bbj.position();
+			EigenXform X2j = bbj.position().inverse() * bbi.position();
+
+			std::vector<float> px, py, pz;
+			std::vector<HBondRay> irot_acceptors, irot_donors;
+
+			float minscore=9e9, maxscore=-9e9;
+			for( int irotsel = tiles[itile].irotsel_begin; irotsel < tiles[itile].irotsel_end; ++irotsel ){
+				int irot = twob.sel2all_[ir][irotsel];
+				runtime_assert( irot >= 0 );
+
+				// irot hbond rays in the frame of jr, same for every jrot
+				irot_acceptors = rot_index.rotamer(irot).acceptors_;
+				irot_donors    = rot_index.rotamer(irot).donors_;
+				for( HBondRay & hr : irot_acceptors ){
+					Eigen::Vector3f dirpos = hr.horb_cen + hr.direction;
+					hr.horb_cen  = X2j * hr.horb_cen;
+					hr.direction = X2j * dirpos - hr.horb_cen;
 				}
-
-				BackboneActor bbj( scaffold.residue(jr+1).xyz("N"), scaffold.residue(jr+1).xyz("CA"), scaffold.residue(jr+1).xyz("C") );
-
-				twob.init_twobody(ir,jr);
-
-				EigenXform X2i = bbi.position().inverse() * bbj.position();
-				EigenXform X2j = bbj.position().inverse() * bbi.position();
-				auto const & to_sp( rot_index.to_structural_parent_frame_ );
-
-				float minscore=9e9, maxscore=-9e9;
-				std::vector<int> randirotsel( twob.nsel_[ir] );
-				for( int q=0; q<randirotsel.size(); ++q ) randirotsel[q] = randirotsel.size()-1-q;
-				// this is fucked somehow... random would be better, reversed helps some
-				// random_permutation( randirotsel, numeric::random::rg() );
-				for( int irotsel_irand = 0; irotsel_irand < twob.nsel_[ir]; ++irotsel_irand ){
-					int irotsel = randirotsel[ irotsel_irand ];
-					int irot = twob.sel2all_[ir][irotsel];
-					runtime_assert( irot >= 0 );
-					for( int jrotsel = 0; jrotsel < twob.nsel_[jr]; ++jrotsel ){
-						int jrot = twob.sel2all_[jr][jrotsel];
-						runtime_assert( jrot >= 0 );
-
-						twob.twobody_[ir][jr][irotsel][jrotsel] = 0.0; // set to 0
-
-						// get lj, sol
-						if( rot_index.nheavyatoms(irot) > rot_index.nheavyatoms(jrot) ){ // irot is bigger
-							if( rotrfmanager.get_rotamer_rf_tables(irot)[ 1 ] ){
-								for( int ja = 4; ja < rot_index.nheavyatoms(jrot); ++ja ){ // use only heavy atoms beyond the CB (which is #3 here)
-									int jatype = rot_index.rotamers_[ jrot ].atoms_[ja].type();
-									runtime_assert( jatype > 0 && jatype < 22 );
-									Eigen::Vector3f pos_ja = to_sp.at(irot) * X2i * rot_index.rotamers_[ jrot ].atoms_[ja].position();
-									// runtime_assert( rotrfmanager.get_rotamer_rf_tables(irot).size() );
-									float const atomscore = rotrfmanager.get_rotamer_rf_tables(irot).at( jatype )->at( pos_ja );
-									runtime_assert_msg( atomscore < 9999.0, "very high atomscore" );
-									twob.twobody_[ir][jr][irotsel][jrotsel] += atomscore;
-								}
-							} else {
-								if( rot_index.resname(irot)!="ALA"&&rot_index.resname(irot)!="GLY" && rot_index.resname(irot)!="DAL"){
-									utility_exit_with_message( "no rotrf table for "+str(irot)+" / "+ str(ir)+rot_index.resname(irot)
-									    + " other is" + str(jr)+rot_index.resname(jrot) );
-								}
+				for( HBondRay & hr : irot_donors ){
+					Eigen::Vector3f dirpos = hr.horb_cen + hr.direction;
+					hr.horb_cen  = X2j * hr.horb_cen;
+					hr.direction = X2j * dirpos - hr.horb_cen;
+				}
+				Eigen::Vector3f const irot_hbond_cen = X2j * rotdat.hbond_cen[irot];
+
+				for( int jrotsel = 0; jrotsel < twob.nsel_[jr]; ++jrotsel ){
+					int jrot = twob.sel2all_[jr][jrotsel];
+					runtime_assert( jrot >= 0 );
+
+					float score = 0.0;
+
+					// get lj, sol from the rf table of the bigger rotamer
+					bool const i_is_bigger = rot_index.nheavyatoms(irot) > rot_index.nheavyatoms(jrot);
+					int const bigrot   = i_is_bigger ? irot : jrot;
+					int const smallrot = i_is_bigger ? jrot : irot;
+					auto const & tables = rotrfmanager.get_rotamer_rf_tables(bigrot);
+					if( tables[ 1 ] ){
+						int const abeg = rotdat.begin[smallrot], aend = rotdat.begin[smallrot+1];
+						EigenXform const xsmall = to_sp.at(bigrot) * ( i_is_bigger ? X2i : X2j );
+						if( aend > abeg && ! sphere_misses_field( *tables[1], xsmall * rotdat.atom_cen[smallrot], rotdat.atom_rad[smallrot] ) ){
+							int const n = aend - abeg;
+							px.resize( n ); py.resize( n ); pz.resize( n );
+							float const * x = &rotdat.x[abeg], * y = &rotdat.y[abeg], * z = &rotdat.z[abeg];
+							auto const & R = xsmall.linear();
+							auto const & t = xsmall.translation();
+							// plain SoA loop, the compiler vectorizes this
+							for( int k = 0; k < n; ++k ){
+								px[k] = R(0,0)*x[k] + R(0,1)*y[k] + R(0,2)*z[k] + t[0];
+								py[k] = R(1,0)*x[k] + R(1,1)*y[k] + R(1,2)*z[k] + t[1];
+								pz[k] = R(2,0)*x[k] + R(2,1)*y[k] + R(2,2)*z[k] + t[2];
 							}
-						} else {
-							if( rotrfmanager.get_rotamer_rf_tables(jrot)[ 1 ] ){
-								for( int ia = 4; ia < rot_index.nheavyatoms(irot); ++ia ){ // use only heavy atoms beyond the CB (which is #3 here)
-									int iatype = rot_index.rotamers_[ irot ].atoms_[ia].type();
-									if( iatype > 21 ){
-										std::cout << iatype << " " << irot << " " << ia << " " << rot_index.rotamers_[irot].atoms_[ia].data().atomname << " "
-										          << rot_index.rotamers_[irot].resname_ << " " << rot_index.nheavyatoms(irot) << std::endl;
-									}
-									runtime_assert( iatype > 0 && iatype < 22 );
-									Eigen::Vector3f pos_ia = to_sp.at(jrot) * X2j * rot_index.rotamers_[ irot ].atoms_[ia].position();
-									// runtime_assert( rotrfmanager.get_rotamer_rf_tables(jrot).size() );
-									float const atomscore = rotrfmanager.get_rotamer_rf_tables(jrot).at( iatype )->at( pos_ia );
-									runtime_assert_msg( atomscore < 9999.0, "very high atomscore" );
-									twob.twobody_[ir][jr][irotsel][jrotsel] += atomscore;
-								}
-							} else {
-								if( rot_index.resname(jrot)!="ALA"&&rot_index.resname(jrot)!="GLY" && rot_index.resname(jrot)!="DAL"){
-									utility_exit_with_message( "no rotrf table for "+str(jrot)+" / "+str(jr)+rot_index.resname(jrot)
-									    + " other is" + str(ir)+rot_index.resname(irot) );
+							for( int k = 0; k < n; ++k ){
+								int const atype = rotdat.type[abeg+k];
+								if( atype > 21 ){
+									std::cout << atype << " " << smallrot << " " << k+4 << " " << rot_index.rotamers_[smallrot].resname_
+									          << " " << rot_index.nheavyatoms(smallrot) << std::endl;
 								}
+								runtime_assert( atype > 0 && atype < 22 );
+								float const atomscore = tables[ atype ]->at( px[k], py[k], pz[k] );
+								runtime_assert_msg( atomscore < 9999.0, "very high atomscore" );
+								score += atomscore;
 							}
 						}
+					} else {
+						if( rot_index.resname(bigrot)!="ALA"&&rot_index.resname(bigrot)!="GLY" && rot_index.resname(bigrot)!="DAL"){
+							int const bigres = i_is_bigger ? ir : jr, smallres = i_is_bigger ? jr : ir;
+							utility_exit_with_message( "no rotrf table for "+str(bigrot)+" / "+ str(bigres)+rot_index.resname(bigrot)
+							    + " other is" + str(smallres)+rot_index.resname(smallrot) );
+						}
+					}
 
-						// this is basically a copy of what's in ScoreRotamerVsTarget, without the multidentate stuff
-						if( rot_index.rotamer(irot).acceptors_.size() > 0 ||
-							rot_index.rotamer(irot).donors_   .size() > 0 )
+					// this is basically a copy of what's in ScoreRotamerVsTarget, without the multidentate stuff
+					// skipped when no donor can reach an acceptor: score_hbond_rays is 0 past 2.8A
+					if( irot_acceptors.size() > 0 || irot_donors.size() > 0 )
+					{
+						float hbscore = 0.0;
+						if( rotdat.hbond_rad[jrot] >= 0 &&
+						    ( irot_hbond_cen - rotdat.hbond_cen[jrot] ).norm() < rotdat.hbond_rad[irot] + rotdat.hbond_rad[jrot] + 2.81 )
 						{
-							float hbscore = 0.0;
-							for( int i_hr_rot_acc = 0; i_hr_rot_acc < rot_index.rotamer(irot).acceptors_.size(); ++i_hr_rot_acc )
-							{
-								HBondRay hr_rot_acc = rot_index.rotamer(irot).acceptors_[i_hr_rot_acc];
-								Eigen::Vector3f dirpos = hr_rot_acc.horb_cen + hr_rot_acc.direction;
-								hr_rot_acc.horb_cen  = X2j * hr_rot_acc.horb_cen;
-								hr_rot_acc.direction = X2j * dirpos - hr_rot_acc.horb_cen;
-								for( int i_hr_tgt_don = 0; i_hr_tgt_don < rot_index.rotamer(jrot).donors_.size(); ++i_hr_tgt_don )
-								{
-									HBondRay const & hr_tgt_don = rot_index.rotamer(jrot).donors_[i_hr_tgt_don];
+							for( HBondRay const & hr_rot_acc : irot_acceptors ){
+								for( HBondRay const & hr_tgt_don : rot_index.rotamer(jrot).donors_ ){
 									float const thishb = score_hbond_rays( hr_tgt_don, hr_rot_acc );
 									hbscore += thishb * opts.hbond_weight;
 								}
 							}
-							for( int i_hr_rot_don = 0; i_hr_rot_don < rot_index.rotamer(irot).donors_.size(); ++i_hr_rot_don )
-							{
-								HBondRay hr_rot_don = rot_index.rotamer(irot).donors_[i_hr_rot_don];
-								Eigen::Vector3f dirpos = hr_rot_don.horb_cen + hr_rot_don.direction;
-								hr_rot_don.horb_cen  = X2j * hr_rot_don.horb_cen;
-								hr_rot_don.direction = X2j * dirpos - hr_rot_don.horb_cen;
-								for( int i_hr_tgt_acc = 0; i_hr_tgt_acc < rot_index.rotamer(jrot).acceptors_.size(); ++i_hr_tgt_acc )
-								{
-									HBondRay const & hr_tgt_acc = rot_index.rotamer(jrot).acceptors_[i_hr_tgt_acc];
+							for( HBondRay const & hr_rot_don : irot_donors ){
+								for( HBondRay const & hr_tgt_acc : rot_index.rotamer(jrot).acceptors_ ){
 									float const thishb = score_hbond_rays( hr_rot_don, hr_tgt_acc );
 									hbscore += thishb * opts.hbond_weight;
 								}
 							}
-							twob.twobody_[ir][jr][irotsel][jrotsel] += hbscore;
-						}
-
-
-
-						if( twob.twobody_[ir][jr][irotsel][jrotsel] > 12345.0 ){
-							twob.twobody_[ir][jr][irotsel][jrotsel] = 12345.0;
 						}
+						score += hbscore;
+					}
 
-						minscore = std::min( minscore, twob.twobody_[ir][jr][irotsel][jrotsel] );
-						maxscore = std::max( maxscore, twob.twobody_[ir][jr][irotsel][jrotsel] );
+					if( score > 12345.0 ){
+						score = 12345.0;
 					}
-				}
+					twob.twobody_[ir][jr][irotsel][jrotsel] = score;
 
-				if( minscore > -0.01 && maxscore < 0.01 ){
-					twob.clear_twobody( ir, jr );
-				} else {
-					// using namespace ObjexxFCL::format;
-					// #pragma omp critical
-					// std::cout << I(3,ir) << " " << I(3,jr) << " " << F(9,1,maxscore) << std::endl;
+					minscore = std::min( minscore, score );
+					maxscore = std::max( maxscore, score );
 				}
-
 			}
+			tile_min[itile] = minscore;
+			tile_max[itile] = maxscore;
+
+			// last tile of the pair, drop it if it never interacts
+			if( --pair_tiles_left[ipair] == 0 ){
+				int const end = ipair+1 < respairs.size() ? pair_first_tile[ipair+1] : tiles.size();
+				float pair_min = 9e9, pair_max = -9e9;
+				for( int jtile = pair_first_tile[ipair]; jtile < end; ++jtile ){
+					pair_min = std::min( pair_min, tile_min[jtile] );
+					pair_max = std::max( pair_max, tile_max[jtile] );
+				}
+				if( pair_min > -0.01 && pair_max < 0.01 ) twob.clear_twobody( ir, jr );
+			}
+
 		} catch( ... ) {
 			#ifdef USE_OPENMP
 			#pragma omp critical
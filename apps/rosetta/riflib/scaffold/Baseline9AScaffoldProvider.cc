@@ -92,10 +92,6 @@ Baseline9AScaffoldProvider::setup_twobody_tables( ::scheme::scaffold::TreeIndex
     get_data_cache_slow( i )->setup_twobody_tables( rot_index_p, opt, make2bopts, rotrf_table_manager);
 }
 
-void 
-Baseline9AScaffoldProvider::setup_twobody_tables_per_thread( ::scheme::scaffold::TreeIndex i ) {
-    get_data_cache_slow( i )->setup_twobody_tables_per_thread();
-}
 
 
 
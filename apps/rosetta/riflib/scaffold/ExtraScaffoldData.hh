@@ -15,6 +15,7 @@
 #include <scheme/types.hh>
 
 #include <riflib/HSearchConstraints.hh>
+#include <riflib/scaffold/ScaffoldDataCacheManager.hh>
 
 #include <vector>
 
@@ -26,13 +27,15 @@ struct ExtraScaffoldData {
     ExtraScaffoldData () :
         csts(),
         force_scaffold_center( Eigen::Vector3f {std::numeric_limits<double>::quiet_NaN(), 0, 0} ),
-        rotboltz_data_p( nullptr )
+        rotboltz_data_p( nullptr ),
+        cache_manager( nullptr )
     {}
 
 
     std::vector<CstBaseOP> csts;
     Eigen::Vector3f force_scaffold_center;
     std::shared_ptr< std::vector< std::vector<float> > > rotboltz_data_p;
+    ScaffoldDataCacheManagerOP cache_manager;
 };
 
 
@@ -35,12 +35,14 @@ MorphingScaffoldProvider::MorphingScaffoldProvider(
     shared_ptr< RotamerIndex > rot_index_p_in, 
     RifDockOpt const & opt_in,
     MakeTwobodyOpts const & make2bopts_in,
-    ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager_in ) :
+    ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager_in,
+    ScaffoldDataCacheManagerOP cache_manager_in ) :
 
     rot_index_p( rot_index_p_in), 
     opt(opt_in),
     make2bopts(make2bopts_in),
-    rotrf_table_manager(rotrf_table_manager_in) {
+    rotrf_table_manager(rotrf_table_manager_in),
+    cache_manager(cache_manager_in) {
 
 
     std::string scafftag;
@@ -53,6 +55,7 @@ MorphingScaffoldProvider::MorphingScaffoldProvider(
 
 
     get_info_for_iscaff( iscaff, opt, scafftag, scaffold, scaffold_res, scaffold_perturb, morph_rules, extra_data, rot_index_p, scaff_fname);
+    extra_data.cache_manager = cache_manager;
 
     ScaffoldDataCacheOP temp_data_cache_ = make_shared<ScaffoldDataCache>(
         scaffold,
@@ -95,6 +98,7 @@ MorphingScaffoldProvider::test_make_children(TreeIndex ti) {
 
 
     get_info_for_iscaff( 0, opt, scafftag, _scaffold, scaffold_res, scaffold_perturb, morph_rules, extra_data, rot_index_p, scaff_fname );
+    extra_data.cache_manager = cache_manager;
 
 
 
@@ -393,10 +397,6 @@ void
 MorphingScaffoldProvider::setup_twobody_tables( ::scheme::scaffold::TreeIndex i ) {
     get_data_cache_slow( i )->setup_twobody_tables( rot_index_p, opt, make2bopts, rotrf_table_manager);
 }
-void 
-MorphingScaffoldProvider::setup_twobody_tables_per_thread( ::scheme::scaffold::TreeIndex i ) {
-    get_data_cache_slow( i )->setup_twobody_tables_per_thread( );
-}
 
 
 void 
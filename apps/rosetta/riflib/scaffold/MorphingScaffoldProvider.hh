@@ -45,7 +45,8 @@ struct MorphingScaffoldProvider :
         shared_ptr< RotamerIndex > rot_index_p_in, 
         RifDockOpt const & opt_in,
         MakeTwobodyOpts const & make2bopts_in,
-        ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager_in );
+        ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager_in,
+        ScaffoldDataCacheManagerOP cache_manager_in = nullptr );
 
 
     ParametricSceneConformationCOP get_scaffold(::scheme::scaffold::TreeIndex i) override;
@@ -57,7 +58,6 @@ struct MorphingScaffoldProvider :
     void set_fa_mode( bool fa ) override;
 
     void setup_twobody_tables( ::scheme::scaffold::TreeIndex i ) override;
-    void setup_twobody_tables_per_thread( ::scheme::scaffold::TreeIndex i ) override;
 
     void modify_pose_for_output( ::scheme::scaffold::TreeIndex i, core::pose::Pose & pose ) override;
 
@@ -81,6 +81,7 @@ private:
     RifDockOpt const & opt;
     MakeTwobodyOpts const & make2bopts;
     ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager ;
+    ScaffoldDataCacheManagerOP cache_manager;                   // null means keep everything
 
 };
 
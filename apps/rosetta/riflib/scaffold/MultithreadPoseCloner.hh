@@ -123,6 +123,16 @@ struct MultithreadPoseCloner {
         return poses_.size();
     }
 
+    // Drop every copy. Not safe while other threads are in get_pose()
+    void
+    clear() {
+        std::lock_guard<std::mutex> guard( vector_mutex_ );
+        poses_.clear();
+        pose_mutexes_.clear();
+        std::lock_guard<std::mutex> guard2( lock_need_more_poses_ );
+        need_more_poses_ = 0;
+    }
+
     static
     core::pose::PoseCOP
     clone_a_pose( core::pose::PoseCOP pose ) {
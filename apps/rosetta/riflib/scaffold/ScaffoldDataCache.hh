@@ -25,6 +25,7 @@
 #include <riflib/scaffold/MultithreadPoseCloner.hh>
 #include <riflib/scaffold/util.hh>
 #include <riflib/scaffold/ExtraScaffoldData.hh>
+#include <riflib/scaffold/ScaffoldDataCacheManager.hh>
 #include <riflib/HSearchConstraints.hh>
 #include <riflib/BurialManager.hh>
 
@@ -87,9 +88,7 @@ struct ScaffoldDataCache {
     typedef ::scheme::objective::storage::TwoBodyTable<float> TBT;
 
     shared_ptr<TBT> scaffold_twobody_p;                                        // twobody_rotamer_energies using global_seqpos
-    shared_ptr<TBT> local_twobody_p;                                           // twobody_rotamer_energies using local_seqpos
-
-    std::vector<shared_ptr<TBT>> local_twobody_per_thread;                     // Used with BuriedUnsats, these can momentarily change but must be reset
+    shared_ptr<TBT> local_twobody_p;                                           // twobody_rotamer_energies using local_seqpos, read only once built
 
 
     MultithreadPoseCloner mpc_both_pose;                                       // scaffold_centered_p + target
@@ -107,10 +106,17 @@ struct ScaffoldDataCache {
     bool make_bbhbond_actors;                                                  // needed in make_conformation_from_data_cache
     bool make_bbsasa_actors;                                                   // needed in make_conformation_from_data_cache
 
+// Memory budget
+    ScaffoldDataCacheManagerOP cache_manager;                                  // may be null, see ScaffoldDataCacheManager
+
 
 
     ScaffoldDataCache() {}
 
+    ~ScaffoldDataCache() {
+        if ( cache_manager ) cache_manager->forget_all( this );
+    }
+
     ScaffoldDataCache( core::pose::Pose & pose, 
         utility::vector1<core::Size> const & scaffold_res_in, 
         std::string const &scafftag_in,
@@ -279,6 +285,8 @@ struct ScaffoldDataCache {
 
         rotboltz_data_p = extra_data.rotboltz_data_p;
 
+        cache_manager = extra_data.cache_manager;
+
     }
 
     // returns true if there are more than 0 constraints
@@ -340,7 +348,10 @@ struct ScaffoldDataCache {
         shared_ptr< RotamerIndex > rot_index_p,
         RifDockOpt const & opt ) {
 
-        if (local_onebody_p) return;
+        if (local_onebody_p) {
+            note_component_used( SDC_ONEBODY );
+            return;
+        }
 
         scaffold_onebody_glob0_p = make_shared<std::vector<std::vector<float> >>();
 
@@ -392,6 +403,8 @@ struct ScaffoldDataCache {
                 BOOST_FOREACH( float & f, (*scaffold_onebody_glob0_p)[i] ) f = 9e9;
             }
         }
+
+        note_component_used( SDC_ONEBODY, component_mem_use( SDC_ONEBODY ) );
     }
 
     // setup scaffold_twobody_p and local_twobody_p
@@ -402,7 +415,13 @@ struct ScaffoldDataCache {
         MakeTwobodyOpts const & make2bopts,
         ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager) {
 
-        if (local_twobody_p) return;
+        if (local_twobody_p) {
+            note_component_used( SDC_TWOBODY );
+            return;
+        }
+
+        // may have been evicted
+        setup_onebody_tables( rot_index_p, opt );
 
         scaffold_twobody_p = make_shared<TBT>( scaffold_centered_p->size(), rot_index_p->size()  );
 
@@ -436,37 +455,10 @@ struct ScaffoldDataCache {
         }
         std::cout << "rifdock: onebody Nallowed: " << onebody_n_allowed << std::endl;
         std::cout << "filt_2b memuse: " << (float)local_twobody_p->twobody_mem_use()/1000.0/1000.0 << "M" << std::endl;
-    }
-
 
-
-    // setup scaffold_twobody_p and local_twobody_p
-    void
-    setup_twobody_tables_per_thread( ) {
-        runtime_assert( local_twobody_p );
-
-        if ( local_twobody_per_thread.size() > 0 ) return;
-
-        local_twobody_per_thread.resize(::devel::scheme::omp_max_threads_1());
-
-        for ( int i = 0; i < local_twobody_per_thread.size(); i++ ) {
-            local_twobody_per_thread[i] = local_twobody_p->clone();
-        }
+        note_component_used( SDC_TWOBODY, component_mem_use( SDC_TWOBODY ) );
     }
 
-    bool
-    check_twobody_tables_per_thread_integrity( ) {
-        runtime_assert( local_twobody_per_thread.size() > 0 );
-
-        local_twobody_per_thread.resize(::devel::scheme::omp_max_threads_1());
-
-        for ( int i = 0; i < local_twobody_per_thread.size(); i++ ) {
-            if ( ! local_twobody_per_thread[i]->check_equal( *local_twobody_p) ) {
-                return false;
-            }
-        }
-        return true;
-    }
 
 
     float
@@ -511,7 +503,82 @@ struct ScaffoldDataCache {
 
     void
     setup_burial_grids( shared_ptr<BurialManager> const & burial_manager ) {
+        if ( burial_grid ) {
+            note_component_used( SDC_BURIAL_GRID );
+            return;
+        }
         burial_grid = burial_manager->get_scaffold_neighbors( *scaffold_centered_p );
+        note_component_used( SDC_BURIAL_GRID, component_mem_use( SDC_BURIAL_GRID ) );
+    }
+
+    // Throw away everything that was built against the current target: the burial grid (its bounds
+    //  come from the target) and the scaffold+target poses. Onebody and twobody tables only depend
+    //  on the scaffold and stay. For -batch_targets, call serially before docking the next target.
+    void
+    clear_target_data() {
+        if ( burial_grid && cache_manager ) cache_manager->forget( this, SDC_BURIAL_GRID );
+        burial_grid = nullptr;
+        mpc_both_pose.clear();
+        mpc_both_full_pose.clear();
+    }
+
+    // Rebuild anything that the scoring functions read directly but the cache manager threw away.
+    //  Call this serially before scoring scaffolds that may not have been used in the current epoch.
+    void
+    restore_evicted(
+        shared_ptr< RotamerIndex > rot_index_p,
+        RifDockOpt const & opt,
+        shared_ptr<BurialManager> const & burial_manager ) {
+        if ( ! cache_manager ) return;
+        setup_onebody_tables( rot_index_p, opt );
+        if ( burial_manager ) setup_burial_grids( burial_manager );
+    }
+
+
+    size_t
+    component_mem_use( ScaffoldDataComponent c ) const {
+        size_t bytes = 0;
+        switch ( c ) {
+            case SDC_ONEBODY:
+                if ( scaffold_onebody_glob0_p ) for ( auto const & v : *scaffold_onebody_glob0_p ) bytes += v.capacity()*sizeof(float);
+                if ( local_onebody_p ) for ( auto const & v : *local_onebody_p ) bytes += v.capacity()*sizeof(float);
+                break;
+            case SDC_TWOBODY:
+                if ( scaffold_twobody_p ) bytes += (size_t)scaffold_twobody_p->twobody_mem_use();
+                if ( local_twobody_p ) bytes += (size_t)local_twobody_p->twobody_mem_use();
+                break;
+            case SDC_BURIAL_GRID:
+                if ( burial_grid ) bytes += burial_grid->num_elements()*sizeof(float);
+                break;
+            default:
+                break;
+        }
+        return bytes;
+    }
+
+    // Only called by ScaffoldDataCacheManager
+    void
+    evict_component( ScaffoldDataComponent c ) {
+        switch ( c ) {
+            case SDC_ONEBODY:
+                scaffold_onebody_glob0_p = nullptr;
+                local_onebody_p = nullptr;
+                break;
+            case SDC_TWOBODY:
+                scaffold_twobody_p = nullptr;
+                local_twobody_p = nullptr;
+                break;
+            case SDC_BURIAL_GRID:
+                burial_grid = nullptr;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void
+    note_component_used( ScaffoldDataComponent c, size_t built_bytes = 0 ) {
+        if ( cache_manager ) cache_manager->touch( this, c, built_bytes );
     }
 
 
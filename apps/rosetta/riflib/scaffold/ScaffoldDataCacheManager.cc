@@ -0,0 +1,134 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://www.rosettacommons.org. Questions about this can be
+// (c) addressed to University of Washington UW TechTransfer, email: license@u.washington.edu.
+
+
+#include <riflib/types.hh>
+#include <riflib/util.hh>
+#include <riflib/scaffold/ScaffoldDataCacheManager.hh>
+#include <riflib/scaffold/ScaffoldDataCache.hh>
+
+#include <scheme/util/mem_budget.hh>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+
+
+namespace devel {
+namespace scheme {
+
+
+std::string
+scaffold_data_component_name( ScaffoldDataComponent c ) {
+    switch ( c ) {
+        case SDC_ONEBODY: return "onebody";
+        case SDC_TWOBODY: return "twobody";
+        case SDC_BURIAL_GRID: return "burial_grid";
+        default: return "unknown";
+    }
+}
+
+
+void
+ScaffoldDataCacheManager::new_epoch() {
+    std::lock_guard<std::mutex> guard( mutex_ );
+    epoch_++;
+    warned_over_budget_ = false;
+}
+
+
+void
+ScaffoldDataCacheManager::touch( ScaffoldDataCache * sdc, ScaffoldDataComponent c, size_t bytes ) {
+    std::lock_guard<std::mutex> guard( mutex_ );
+
+    EntryKey key( sdc, c );
+    std::map<EntryKey, Entry>::iterator iter = entries_.find( key );
+
+    if ( iter == entries_.end() ) {
+        // only track things that this cache built itself
+        if ( bytes == 0 ) return;
+        Entry entry;
+        entry.bytes = 0;
+        iter = entries_.insert( std::make_pair( key, entry ) ).first;
+    }
+
+    Entry & entry = iter->second;
+    entry.last_use = ++clock_;
+    entry.epoch = epoch_;
+
+    if ( bytes == 0 ) return;
+
+    mem_use_ -= entry.bytes;
+    entry.bytes = bytes;
+    mem_use_ += bytes;
+    ::scheme::util::mem_category( "scaffold_data" ).set( mem_use_ );
+
+    evict_to_budget();
+}
+
+
+void
+ScaffoldDataCacheManager::forget( ScaffoldDataCache * sdc, ScaffoldDataComponent c ) {
+    std::lock_guard<std::mutex> guard( mutex_ );
+
+    std::map<EntryKey, Entry>::iterator iter = entries_.find( EntryKey( sdc, c ) );
+    if ( iter == entries_.end() ) return;
+    mem_use_ -= iter->second.bytes;
+    entries_.erase( iter );
+    ::scheme::util::mem_category( "scaffold_data" ).set( mem_use_ );
+}
+
+
+void
+ScaffoldDataCacheManager::forget_all( ScaffoldDataCache * sdc ) {
+    std::lock_guard<std::mutex> guard( mutex_ );
+
+    for ( int c = 0; c < SDC_NUM_COMPONENTS; c++ ) {
+        std::map<EntryKey, Entry>::iterator iter = entries_.find( EntryKey( sdc, c ) );
+        if ( iter == entries_.end() ) continue;
+        mem_use_ -= iter->second.bytes;
+        entries_.erase( iter );
+    }
+    ::scheme::util::mem_category( "scaffold_data" ).set( mem_use_ );
+}
+
+
+// mutex_ must be held. Also evicts while the whole job is over -mem_budget_G
+void
+ScaffoldDataCacheManager::evict_to_budget() {
+    if ( mem_use_ <= budget_ && ! ::scheme::util::mem_over_budget() ) return;
+
+    std::vector<std::pair<uint64_t, EntryKey>> candidates;
+    for ( std::pair<EntryKey const, Entry> const & pair : entries_ ) {
+        if ( pair.second.epoch == epoch_ ) continue;
+        candidates.push_back( std::make_pair( pair.second.last_use, pair.first ) );
+    }
+    std::sort( candidates.begin(), candidates.end() );
+
+    for ( std::pair<uint64_t, EntryKey> const & cand : candidates ) {
+        if ( mem_use_ <= budget_ && ! ::scheme::util::mem_over_budget() ) break;
+        EntryKey const & key = cand.second;
+        key.first->evict_component( (ScaffoldDataComponent)key.second );
+        mem_use_ -= entries_.at( key ).bytes;
+        ::scheme::util::mem_category( "scaffold_data" ).set( mem_use_ );
+        entries_.erase( key );
+        num_evictions_++;
+    }
+
+    if ( mem_use_ > budget_ && ! warned_over_budget_ ) {
+        warned_over_budget_ = true;
+        std::cout << "WARNING: scaffold data in use by the current search is " << KMGT( mem_use_ ) << "B, over the "
+                  << KMGT( budget_ ) << "B budget" << std::endl;
+    }
+}
+
+
+
+}}
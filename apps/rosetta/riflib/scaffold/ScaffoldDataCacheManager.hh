@@ -0,0 +1,104 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+//
+// (c) Copyright Rosetta Commons Member Institutions.
+// (c) This file is part of the Rosetta software suite and is made available under license.
+// (c) The Rosetta software is developed by the contributing members of the Rosetta Commons.
+// (c) For more information, see http://www.rosettacommons.org. Questions about this can be
+// (c) addressed to University of Washington UW TechTransfer, email: license@u.washington.edu.
+
+
+
+#ifndef INCLUDED_riflib_scaffold_ScaffoldDataCacheManager_hh
+#define INCLUDED_riflib_scaffold_ScaffoldDataCacheManager_hh
+
+
+#include <riflib/types.hh>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+
+
+namespace devel {
+namespace scheme {
+
+struct ScaffoldDataCache;
+
+// The parts of a ScaffoldDataCache that are big and can be rebuilt by their setup_* function
+enum ScaffoldDataComponent {
+    SDC_ONEBODY = 0,            // scaffold_onebody_glob0_p, local_onebody_p
+    SDC_TWOBODY,                // scaffold_twobody_p, local_twobody_p
+    SDC_BURIAL_GRID,            // burial_grid
+    SDC_NUM_COMPONENTS
+};
+
+std::string
+scaffold_data_component_name( ScaffoldDataComponent c );
+
+
+// Keeps track of the memory used by the heavy parts of every ScaffoldDataCache and
+//  throws away the least recently used ones once the total goes over budget.
+//
+// Anything used since the last new_epoch() is never evicted. HSearchInit starts a new
+//  epoch, so the scaffolds of the current search stay put. Evicted parts come back through
+//  the normal setup_* calls, which reread the __1BE_/__2BE_ files if -cache_scaffold_data is on.
+//
+// Tables shared between caches (-use_parent_body_energies) are only tracked by the cache
+//  that built them.
+struct ScaffoldDataCacheManager {
+
+    ScaffoldDataCacheManager( size_t budget_bytes ) : budget_(budget_bytes) {}
+
+    // Everything used before this point may be evicted
+    void
+    new_epoch();
+
+    // Call whenever a component is used. bytes > 0 means it was (re)built and may trigger evictions
+    void
+    touch( ScaffoldDataCache * sdc, ScaffoldDataComponent c, size_t bytes = 0 );
+
+    // The cache dropped this component itself
+    void
+    forget( ScaffoldDataCache * sdc, ScaffoldDataComponent c );
+
+    // The cache is going away
+    void
+    forget_all( ScaffoldDataCache * sdc );
+
+    size_t mem_use() const { return mem_use_; }
+    size_t budget() const { return budget_; }
+    uint64_t num_evictions() const { return num_evictions_; }
+
+private:
+
+    struct Entry {
+        size_t bytes;
+        uint64_t last_use;
+        uint64_t epoch;
+    };
+    typedef std::pair<ScaffoldDataCache *, int> EntryKey;
+
+    void
+    evict_to_budget();
+
+    std::map<EntryKey, Entry> entries_;
+    size_t budget_;
+    size_t mem_use_ = 0;
+    uint64_t clock_ = 0;
+    uint64_t epoch_ = 0;
+    uint64_t num_evictions_ = 0;
+    bool warned_over_budget_ = false;
+    std::mutex mutex_;
+
+};
+
+typedef shared_ptr<ScaffoldDataCacheManager> ScaffoldDataCacheManagerOP;
+
+
+}}
+
+
+
+#endif
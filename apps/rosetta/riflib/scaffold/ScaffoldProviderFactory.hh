@@ -28,6 +28,7 @@ get_scaffold_provider(
         RifDockOpt const & opt,
         MakeTwobodyOpts const & make2bopts,
         ::devel::scheme::RotamerRFTablesManager & rotrf_table_manager,
+        ScaffoldDataCacheManagerOP cache_manager,
         bool & needs_scaffold_director ) {
 
 
@@ -48,7 +49,8 @@ get_scaffold_provider(
                 rot_index_p,
                 opt,
                 make2bopts,
-                rotrf_table_manager);
+                rotrf_table_manager,
+                cache_manager);
 
     } else if (opt.scaff_search_mode == "morph_dive_pop") {
 
@@ -58,7 +60,8 @@ get_scaffold_provider(
                 rot_index_p,
                 opt,
                 make2bopts,
-                rotrf_table_manager);
+                rotrf_table_manager,
+                cache_manager);
 
     } else if (opt.scaff_search_mode == "nineA_baseline") {
 
@@ -0,0 +1,367 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+
+
+
+#include <riflib/types.hh>
+#include <riflib/util.hh>
+
+#include <riflib/task/AdaptiveBeam.hh>
+#include <riflib/task/CompactSearchPoints.hh>
+
+#include <ObjexxFCL/format.hh>
+
+#include <parallel/algorithm>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+
+
+namespace devel {
+namespace scheme {
+
+
+// scores are sampled down to about this many for the quantiles
+static uint64_t const QUANTILE_SAMPLES = 1 << 16;
+// expanded parents remembered for the correlation
+static uint64_t const PARENT_SAMPLES = 4096;
+// fewer parent/child pairs than this and the correlation isn't used
+static uint64_t const MIN_RHO_PAIRS = 32;
+// what's assumed before there's a measurement
+static float const PRIOR_RHO = 0.5;
+
+
+// ranks starting at 0, ties get the mean of their ranks
+static std::vector<double>
+ranks_of( std::vector<float> const & values ) {
+    std::vector<size_t> order( values.size() );
+    for ( size_t i = 0; i < order.size(); i++ ) order[i] = i;
+    std::sort( order.begin(), order.end(), [&]( size_t a, size_t b ){ return values[a] < values[b]; } );
+    std::vector<double> ranks( values.size() );
+    for ( size_t lb = 0; lb < order.size(); ) {
+        size_t ub = lb + 1;
+        while ( ub < order.size() && values[order[ub]] == values[order[lb]] ) ub++;
+        for ( size_t i = lb; i < ub; i++ ) ranks[order[i]] = 0.5 * ( lb + ub - 1 );
+        lb = ub;
+    }
+    return ranks;
+}
+
+static float
+spearman( std::vector<float> const & x, std::vector<float> const & y ) {
+    std::vector<double> rx = ranks_of( x ), ry = ranks_of( y );
+    double const n = rx.size();
+    double const mean = ( n - 1 ) / 2;
+    double sxy = 0, sxx = 0, syy = 0;
+    for ( size_t i = 0; i < rx.size(); i++ ) {
+        sxy += ( rx[i] - mean ) * ( ry[i] - mean );
+        sxx += ( rx[i] - mean ) * ( rx[i] - mean );
+        syy += ( ry[i] - mean ) * ( ry[i] - mean );
+    }
+    if ( sxx == 0 || syy == 0 ) return 0;
+    return sxy / std::sqrt( sxx * syy );
+}
+
+
+AdaptiveBeam::AdaptiveBeam( std::string const & log_fname, std::string const & replay_fname ) :
+    active_( false ),
+    final_resl_( 0 ),
+    children_per_parent_( 1 ),
+    budget_( 0 ),
+    effort_at_resl0_( -1 ),
+    parents_( PARENT_SAMPLES, SelectiveRifDockIndexHasher( true, true, true ), SelectiveRifDockIndexEquater( true, true, true ) ),
+    parents_resl_( -1 ),
+    replaying_( false )
+{
+    // before the log is opened, they may be the same file
+    if ( replay_fname.size() ) load_replay( replay_fname );
+    if ( log_fname.size() ) {
+        log_.open( log_fname );
+        runtime_assert_msg( log_.good(), "can't write -adaptive_beam_log " + log_fname );
+        log_ << "# search resl keep per_parent samples under_cut best q01 q10 q50 rho rho_pairs spent budget" << std::endl;
+    }
+}
+
+void
+AdaptiveBeam::load_replay( std::string const & fname ) {
+    std::ifstream in( fname );
+    runtime_assert_msg( in.good(), "can't read -adaptive_beam_replay " + fname );
+    std::string line;
+    while ( std::getline( in, line ) ) {
+        if ( line.empty() || line[0] == '#' ) continue;
+        std::istringstream fields( line );
+        std::string search;
+        int resl;
+        uint64_t keep, per_parent;
+        runtime_assert_msg( bool( fields >> search >> resl >> keep >> per_parent ), "bad line in -adaptive_beam_replay " + fname + ": " + line );
+        replay_[ std::make_pair( search, resl ) ] = std::make_pair( keep, per_parent );
+    }
+    replaying_ = true;
+    std::cout << "adaptive beam: replaying " << replay_.size() << " decisions from " << fname << std::endl;
+}
+
+void
+AdaptiveBeam::begin(
+    std::string const & search_tag,
+    int final_resl,
+    uint64_t children_per_parent,
+    int64_t budget ) {
+
+    int const seen = ++times_seen_[ search_tag ];
+    search_ = seen == 1 ? search_tag : search_tag + "#" + std::to_string( seen );
+    final_resl_ = final_resl;
+    children_per_parent_ = std::max<uint64_t>( children_per_parent, 1 );
+    budget_ = budget;
+    effort_at_resl0_ = -1;
+    observed_.clear();
+    decided_.clear();
+    parents_.clear();
+    parents_resl_ = -1;
+    active_ = true;
+
+    std::cout << "adaptive beam: search " << search_ << ", " << KMGT( budget_ ) << " child evaluations past resl 0" << std::endl;
+}
+
+
+// The points observe_points reads, in blocks that are scored by one thread each.
+//  for_each_in_block( ib, f ) calls f( position, RifDockIndex, score ) for the points of block ib
+struct SearchPointBlocks {
+    static uint64_t const BLOCK = 1 << 14;
+    std::vector<SearchPoint> const & points;
+    uint64_t size() const { return points.size(); }
+    int64_t num_blocks() const { return ( points.size() + BLOCK - 1 ) / BLOCK; }
+    template<class F>
+    void for_each_in_block( int64_t ib, F & f ) const {
+        uint64_t const end = std::min<uint64_t>( ( ib + 1 ) * BLOCK, points.size() );
+        for ( uint64_t i = ib * BLOCK; i < end; i++ ) f( i, points[i].index, points[i].score );
+    }
+};
+
+struct CompactSearchPointBlocks {
+    CompactSearchPoints const & compact;
+    uint64_t size() const { return compact.size(); }
+    int64_t num_blocks() const { return compact.blocks.size(); }
+    template<class F>
+    void for_each_in_block( int64_t ib, F & f ) const {
+        for ( uint64_t i = compact.block_begin( ib ); i < compact.block_end( ib ); i++ ) {
+            f( i, compact.index( ib, i ), compact.entries[i].score );
+        }
+    }
+};
+
+
+template<class Points>
+void
+AdaptiveBeam::observe_points( int resl, Points const & points, float global_score_cut ) {
+
+    uint64_t const n = points.size();
+    AdaptiveBeamStage stage;
+    stage.search = search_;
+    stage.resl = resl;
+    stage.samples = n;
+
+    bool const measure_rho = parents_resl_ == resl - 1 && parents_.size() > 0;
+    ParentScores best_child( parents_.size() + 1, SelectiveRifDockIndexHasher( true, true, true ), SelectiveRifDockIndexEquater( true, true, true ) );
+
+    // every stride-th point by position, so the sample doesn't depend on the threads
+    uint64_t const stride = std::max<uint64_t>( n / QUANTILE_SAMPLES, 1 );
+    std::vector<float> sampled;
+    sampled.reserve( n / stride + 1 );
+    uint64_t under_cut = 0;
+    float best = stage.best;
+
+    #ifdef USE_OPENMP
+    #pragma omp parallel reduction(+:under_cut) reduction(min:best)
+    #endif
+    {
+        std::vector<float> my_sampled;
+        ParentScores my_best_child( best_child.bucket_count(), SelectiveRifDockIndexHasher( true, true, true ), SelectiveRifDockIndexEquater( true, true, true ) );
+        auto observe = [&]( uint64_t i, RifDockIndex const & index, float score ) {
+            if ( i % stride == 0 ) my_sampled.push_back( score );
+            if ( score < global_score_cut ) under_cut++;
+            best = std::min( best, score );
+            if ( ! measure_rho ) return;
+            RifDockIndex const parent = parent_of( index );
+            if ( parents_.count( parent ) == 0 ) return;
+            auto inserted = my_best_child.insert( std::make_pair( parent, score ) );
+            if ( ! inserted.second ) inserted.first->second = std::min( inserted.first->second, score );
+        };
+
+        #ifdef USE_OPENMP
+        #pragma omp for schedule(dynamic,1)
+        #endif
+        for ( int64_t ib = 0; ib < points.num_blocks(); ib++ ) points.for_each_in_block( ib, observe );
+
+        #ifdef USE_OPENMP
+        #pragma omp critical
+        #endif
+        {
+            sampled.insert( sampled.end(), my_sampled.begin(), my_sampled.end() );
+            for ( auto const & pair : my_best_child ) {
+                auto inserted = best_child.insert( pair );
+                if ( ! inserted.second ) inserted.first->second = std::min( inserted.first->second, pair.second );
+            }
+        }
+    }
+    stage.under_cut = under_cut;
+    stage.best = best;
+
+    std::sort( sampled.begin(), sampled.end() );
+    auto quantile = [&]( double f ) -> float {
+        if ( sampled.empty() ) return 9e9;
+        return sampled[ std::min<size_t>( sampled.size() - 1, f * sampled.size() ) ];
+    };
+    stage.q01 = quantile( 0.01 );
+    stage.q10 = quantile( 0.10 );
+    stage.q50 = quantile( 0.50 );
+
+    if ( measure_rho ) {
+        std::vector<float> parent_scores, child_scores;
+        for ( auto const & pair : best_child ) {
+            parent_scores.push_back( parents_.at( pair.first ) );
+            child_scores.push_back( pair.second );
+        }
+        stage.rho_pairs = parent_scores.size();
+        if ( stage.rho_pairs >= MIN_RHO_PAIRS ) stage.rho = spearman( parent_scores, child_scores );
+    }
+
+    observed_[ resl ] = stage;
+}
+
+void
+AdaptiveBeam::observe( int resl, std::vector<SearchPoint> const & points, float global_score_cut ) {
+    observe_points( resl, SearchPointBlocks{ points }, global_score_cut );
+}
+
+void
+AdaptiveBeam::observe( int resl, CompactSearchPoints const & compact, float global_score_cut ) {
+    observe_points( resl, CompactSearchPointBlocks{ compact }, global_score_cut );
+}
+
+
+AdaptiveBeamStage const &
+AdaptiveBeam::decide( int resl, int64_t total_search_effort, uint64_t static_keep ) {
+
+    using ObjexxFCL::format::F;
+
+    auto done = decided_.find( resl );
+    if ( done != decided_.end() ) return done->second;
+
+    AdaptiveBeamStage stage;
+    if ( observed( resl ) ) stage = observed_.at( resl );
+    stage.search = search_;
+    stage.resl = resl;
+
+    // everything scored from here on counts against the budget
+    if ( effort_at_resl0_ < 0 ) effort_at_resl0_ = total_search_effort;
+    stage.spent = total_search_effort - effort_at_resl0_;
+    stage.budget = budget_;
+
+    uint64_t const P = children_per_parent_;
+    bool const have_rho = stage.rho_pairs >= MIN_RHO_PAIRS;
+
+    if ( replaying_ ) {
+        auto it = replay_.find( std::make_pair( search_, resl ) );
+        if ( it != replay_.end() ) {
+            stage.keep = it->second.first;
+            stage.per_parent = it->second.second;
+            stage.replayed = true;
+        } else {
+            std::cout << "WARNING: adaptive beam: no replayed decision for " << search_ << " resl " << resl << ", using the fixed beam" << std::endl;
+            stage.keep = static_keep;
+            stage.per_parent = P;
+        }
+    } else {
+        // in parents, each of which costs P evaluations at the next resl
+        uint64_t const stages_left = std::max( final_resl_ - resl, 1 );
+        uint64_t const remaining = std::max<int64_t>( budget_ - stage.spent, 0 ) / P;
+        uint64_t const even = remaining / stages_left;
+        uint64_t const floor = std::max<uint64_t>( even / 4, 1 );
+        uint64_t const ceiling = std::max( remaining - std::min( remaining, ( stages_left - 1 ) * floor ), floor );
+
+        float const rho = std::max( 0.0f, std::min( 1.0f, have_rho ? stage.rho : PRIOR_RHO ) );
+        stage.keep = std::max( floor, std::min( ceiling, (uint64_t)( even * ( 1.5 - rho ) ) ) );
+        if ( observed( resl ) ) stage.keep = std::max<uint64_t>( std::min( stage.keep, stage.under_cut ), 1 );
+
+        stage.per_parent = P;
+        if ( have_rho ) {
+            stage.per_parent = std::llround( P * ( 1.25 - rho ) );
+            stage.per_parent = std::max( std::max<uint64_t>( P / 8, 1 ), std::min( P, stage.per_parent ) );
+        }
+    }
+    stage.per_parent = std::max<uint64_t>( stage.per_parent, 1 );
+
+    std::cout << "adaptive beam resl " << resl << ": keep " << KMGT( stage.keep ) << ", at most " << stage.per_parent << " per parent"
+              << ( stage.replayed ? " (replayed)" : "" ) << ", rho " << F(6,3,stage.rho) << " on " << stage.rho_pairs << " parents, "
+              << KMGT( stage.under_cut ) << " of " << KMGT( stage.samples ) << " under cut, best/1%/10%/50% "
+              << F(7,3,stage.best) << " " << F(7,3,stage.q01) << " " << F(7,3,stage.q10) << " " << F(7,3,stage.q50)
+              << ", spent " << KMGT( stage.spent ) << " of " << KMGT( stage.budget ) << std::endl;
+    log( stage );
+
+    return decided_[ resl ] = stage;
+}
+
+void
+AdaptiveBeam::log( AdaptiveBeamStage const & s ) {
+    if ( ! log_.is_open() ) return;
+    log_ << s.search << " " << s.resl << " " << s.keep << " " << s.per_parent << " " << s.samples << " " << s.under_cut << " "
+         << s.best << " " << s.q01 << " " << s.q10 << " " << s.q50 << " " << s.rho << " " << s.rho_pairs << " "
+         << s.spent << " " << s.budget << std::endl;
+}
+
+
+void
+AdaptiveBeam::expanding( int resl, std::vector<SearchPoint> const & parents, size_t nparents ) {
+    parents_.clear();
+    parents_resl_ = resl;
+    nparents = std::min( nparents, parents.size() );
+    uint64_t const stride = std::max<uint64_t>( nparents / PARENT_SAMPLES, 1 );
+    for ( size_t i = 0; i < nparents; i += stride ) {
+        parents_[ parents[i].index ] = parents[i].score;
+    }
+}
+
+
+uint64_t
+AdaptiveBeam::candidates( AdaptiveBeamStage const & stage ) const {
+    if ( stage.per_parent >= children_per_parent_ ) return stage.keep;
+    return stage.keep * ( ( children_per_parent_ + stage.per_parent - 1 ) / stage.per_parent );
+}
+
+uint64_t
+AdaptiveBeam::select( AdaptiveBeamStage const & stage, std::vector<SearchPoint> & points ) const {
+
+    uint64_t const pool = std::min<uint64_t>( points.size(), candidates( stage ) );
+    if ( pool < points.size() ) {
+        __gnu_parallel::nth_element( points.begin(), points.begin() + pool, points.end() );
+    }
+    __gnu_parallel::sort( points.begin(), points.begin() + pool );
+
+    if ( stage.per_parent >= children_per_parent_ ) return std::min( stage.keep, pool );
+
+    // best first, a point over its parent's quota goes behind the kept ones
+    std::unordered_map<RifDockIndex, uint64_t, SelectiveRifDockIndexHasher, SelectiveRifDockIndexEquater> taken(
+        2 * stage.keep + 1, SelectiveRifDockIndexHasher( true, true, true ), SelectiveRifDockIndexEquater( true, true, true ) );
+    std::vector<SearchPoint> passed;
+    uint64_t kept = 0;
+    for ( uint64_t i = 0; i < pool; i++ ) {
+        if ( kept < stage.keep ) {
+            uint64_t & count = taken[ parent_of( points[i].index ) ];
+            if ( count < stage.per_parent ) {
+                count++;
+                points[kept++] = points[i];
+                continue;
+            }
+        }
+        passed.push_back( points[i] );
+    }
+    std::copy( passed.begin(), passed.end(), points.begin() + kept );
+
+    return kept;
+}
+
+
+
+}}
@@ -0,0 +1,141 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+
+
+#ifndef INCLUDED_riflib_task_AdaptiveBeam_hh
+#define INCLUDED_riflib_task_AdaptiveBeam_hh
+
+
+#include <riflib/types.hh>
+#include <riflib/task/types.hh>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+
+namespace devel {
+namespace scheme {
+
+struct CompactSearchPoints;
+
+
+// One beam decision of AdaptiveBeam, and what it was based on
+struct AdaptiveBeamStage {
+    std::string search;        // search tag, see AdaptiveBeam::begin
+    int resl = -1;
+    uint64_t keep = 0;         // points of this resl kept, each one is expanded into the next resl
+    uint64_t per_parent = 0;   // at most this many of them from one parent of the resl before
+    bool replayed = false;
+
+    uint64_t samples = 0;      // scored at this resl
+    uint64_t under_cut = 0;    // of those, scoring below the global score cut
+    float best = 9e9, q01 = 9e9, q10 = 9e9, q50 = 9e9;
+    float rho = 0;             // rank correlation of parent score with best child score, this resl vs the one before
+    uint64_t rho_pairs = 0;    // parents it was measured on, 0 if it wasn't
+    int64_t spent = 0;         // children scored by the search so far, past resl 0
+    int64_t budget = 0;
+};
+
+
+// Beam width for the hierarchical search.
+//
+// The fixed beam keeps beam_size_M * beam_multiplier points at every resl. This one spends the same
+//  total (or -adaptive_beam_budget_M) of child evaluations past resl 0, but splits it by what each
+//  stage looked like:
+//
+//  - samples of the parents that get expanded are remembered and, once their children are scored,
+//     the spearman correlation of parent score with best child score is measured. High correlation
+//     means the coarse ranking holds up, so a narrower beam loses little. Low correlation widens it
+//  - with high correlation, the children of the best few parents would also crowd out everything
+//     else, so per_parent caps how many children of one parent stay in the beam
+//  - parents scoring above the global score cut are never expanded, budget they would have used
+//     goes to the later stages
+//
+// Each decision is printed and, with a log file, written one per line. The same file given as the
+//  replay file makes a later run use exactly those decisions (keyed by search tag and resl), which
+//  makes adaptive runs reproducible and lets a schedule be edited by hand.
+//
+// One per process, searches run one at a time. HSearchInit calls begin(), the scoring and filtering
+//  tasks call the rest.
+class AdaptiveBeam {
+public:
+
+    AdaptiveBeam( std::string const & log_fname, std::string const & replay_fname );
+
+    // budget is child evaluations past resl 0 for the whole search. search_tag is made unique
+    void
+    begin(
+        std::string const & search_tag,
+        int final_resl,
+        uint64_t children_per_parent,
+        int64_t budget );
+
+    bool active() const { return active_; }
+    void end() { active_ = false; }
+
+    // scores of everything scored at resl, call once per resl before decide()
+    void observe( int resl, std::vector<SearchPoint> const & points, float global_score_cut );
+    void observe( int resl, CompactSearchPoints const & compact, float global_score_cut );
+    bool observed( int resl ) const { return observed_.count( resl ) > 0; }
+
+    // Beam for resl < final_resl, decided the first time and the same after that.
+    //  total_search_effort is ProtocolData::total_search_effort, static_keep what the fixed beam would keep
+    AdaptiveBeamStage const &
+    decide( int resl, int64_t total_search_effort, uint64_t static_keep );
+
+    // parents sorted best first, the first nparents are expanded into resl+1
+    void expanding( int resl, std::vector<SearchPoint> const & parents, size_t nparents );
+
+    // How many of the best points to look at to keep stage.keep with at most stage.per_parent per parent
+    uint64_t
+    candidates( AdaptiveBeamStage const & stage ) const;
+
+    // Keeps stage.keep of points, best first with at most stage.per_parent per parent, and returns how
+    //  many were kept. Kept points end up at the front in score order
+    uint64_t
+    select( AdaptiveBeamStage const & stage, std::vector<SearchPoint> & points ) const;
+
+private:
+
+    typedef std::unordered_map<RifDockIndex, float, SelectiveRifDockIndexHasher, SelectiveRifDockIndexEquater> ParentScores;
+
+    RifDockIndex parent_of( RifDockIndex index ) const { index.nest_index /= children_per_parent_; return index; }
+
+    // Points is SearchPointBlocks or CompactSearchPointBlocks (AdaptiveBeam.cc), blocks are
+    //  observed in parallel and the per thread results merged
+    template<class Points>
+    void observe_points( int resl, Points const & points, float global_score_cut );
+
+    void load_replay( std::string const & fname );
+    void log( AdaptiveBeamStage const & stage );
+
+    bool active_;
+    std::string search_;
+    int final_resl_;
+    uint64_t children_per_parent_;
+    int64_t budget_;
+    int64_t effort_at_resl0_;
+
+    std::map<int, AdaptiveBeamStage> observed_;
+    std::map<int, AdaptiveBeamStage> decided_;
+    ParentScores parents_;      // sample of the last expanded parents
+    int parents_resl_;
+
+    std::map<std::string, int> times_seen_;
+    std::map<std::pair<std::string,int>, std::pair<uint64_t,uint64_t>> replay_;
+    bool replaying_;
+    std::ofstream log_;
+};
+
+
+
+}}
+
+
+
+#endif
@@ -0,0 +1,252 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+
+
+
+#include <riflib/types.hh>
+#include <riflib/util.hh>
+
+#include <riflib/task/CompactSearchPoints.hh>
+
+#include <parallel/algorithm>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+
+
+namespace devel {
+namespace scheme {
+
+
+// monotonic map from float to uint32 so that radix selection works on scores
+static inline uint32_t
+sortable_key( float f ) {
+    uint32_t u;
+    std::memcpy( &u, &f, sizeof(u) );
+    return ( u & 0x80000000u ) ? ~u : ( u | 0x80000000u );
+}
+
+static inline bool
+index_less( RifDockIndex const & a, RifDockIndex const & b ) {
+    if ( a.scaffold_index.depth != b.scaffold_index.depth ) return a.scaffold_index.depth < b.scaffold_index.depth;
+    if ( a.scaffold_index.member != b.scaffold_index.member ) return a.scaffold_index.member < b.scaffold_index.member;
+    if ( a.seeding_index != b.seeding_index ) return a.seeding_index < b.seeding_index;
+    return a.nest_index < b.nest_index;
+}
+
+static inline bool
+same_block_key( RifDockIndex const & a, RifDockIndex const & b ) {
+    return a.seeding_index == b.seeding_index && a.scaffold_index == b.scaffold_index;
+}
+
+
+size_t
+CompactSearchPoints::block_of( uint64_t ientry ) const {
+    runtime_assert( ientry < entries.size() );
+    size_t lo = 0, hi = blocks.size();
+    while ( hi - lo > 1 ) {
+        size_t mid = ( lo + hi ) / 2;
+        if ( blocks[mid].begin <= ientry ) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+
+void
+CompactSearchPoints::expand_parents( std::vector<SearchPoint> const & parents_in, uint64_t children_per_parent ) {
+
+    clear();
+    if ( parents_in.size() == 0 ) return;
+
+    std::vector<RifDockIndex> parents( parents_in.size() );
+    for ( size_t i = 0; i < parents_in.size(); i++ ) parents[i] = parents_in[i].index;
+    __gnu_parallel::sort( parents.begin(), parents.end(), index_less );
+
+
+    // Pass 1 (serial, one step per parent). Figure out which block each parent starts in.
+    //   A parent either fits entirely into the current block or it starts its own block(s)
+    //   aligned on its first child. In the second case, child j lives in block first + j / MAX_BLOCK_SPAN
+    std::vector<uint64_t> parent_block( parents.size() );
+    for ( size_t ip = 0; ip < parents.size(); ip++ ) {
+        RifDockIndex const & p = parents[ip];
+        uint64_t first_child = p.nest_index * children_per_parent;
+        uint64_t last_child = first_child + children_per_parent - 1;
+
+        bool fits = false;
+        if ( blocks.size() > 0 ) {
+            RifDockIndex const & base = blocks.back().base;
+            fits = same_block_key( base, p ) && first_child >= base.nest_index && last_child - base.nest_index < MAX_BLOCK_SPAN;
+        }
+
+        if ( fits ) {
+            parent_block[ip] = blocks.size() - 1;
+            continue;
+        }
+
+        parent_block[ip] = blocks.size();
+        for ( uint64_t j = 0; j < children_per_parent; j += MAX_BLOCK_SPAN ) {
+            CompactSearchPointBlock block;
+            block.base = p;
+            block.base.nest_index = first_child + j;
+            block.begin = ip * children_per_parent + j;
+            blocks.push_back( block );
+        }
+    }
+
+
+    // Pass 2 (parallel). Fill in the children.
+    entries.resize( parents.size() * children_per_parent );
+
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(dynamic,64)
+    #endif
+    for ( int64_t ip = 0; ip < (int64_t)parents.size(); ip++ ) {
+        uint64_t const first_child = parents[ip].nest_index * children_per_parent;
+        uint64_t const first_base = blocks[parent_block[ip]].base.nest_index;
+        uint64_t const array_offset = ip * children_per_parent;
+
+        for ( uint64_t j = 0; j < children_per_parent; j++ ) {
+            uint64_t from_base = first_child + j - first_base;
+            CompactSearchPointEntry & entry = entries[array_offset + j];
+            entry.score = 9e9;
+            entry.sasa = 0;
+            entry.offset = (uint16_t)( from_base % MAX_BLOCK_SPAN );
+        }
+    }
+}
+
+
+uint32_t
+CompactSearchPoints::kth_smallest_key( uint64_t k ) const {
+    runtime_assert( k < entries.size() );
+
+    uint32_t prefix = 0;
+    uint32_t mask = 0;
+
+    for ( int shift = 24; shift >= 0; shift -= 8 ) {
+
+        std::vector<uint64_t> hist( 256, 0 );
+
+        #ifdef USE_OPENMP
+        #pragma omp parallel
+        #endif
+        {
+            std::vector<uint64_t> my_hist( 256, 0 );
+
+            #ifdef USE_OPENMP
+            #pragma omp for schedule(static)
+            #endif
+            for ( int64_t i = 0; i < (int64_t)entries.size(); i++ ) {
+                uint32_t key = sortable_key( entries[i].score );
+                if ( ( key & mask ) != prefix ) continue;
+                my_hist[ ( key >> shift ) & 0xff ]++;
+            }
+
+            #ifdef USE_OPENMP
+            #pragma omp critical
+            #endif
+            for ( int b = 0; b < 256; b++ ) hist[b] += my_hist[b];
+        }
+
+        int bucket = 0;
+        for ( bucket = 0; bucket < 256; bucket++ ) {
+            if ( k < hist[bucket] ) break;
+            k -= hist[bucket];
+        }
+        runtime_assert( bucket < 256 );
+
+        prefix |= ( (uint32_t)bucket << shift );
+        mask |= ( 0xffu << shift );
+    }
+
+    return prefix;
+}
+
+
+shared_ptr<std::vector<SearchPoint>>
+CompactSearchPoints::decode_best( uint64_t num_to_keep, float max_score ) const {
+
+    shared_ptr<std::vector<SearchPoint>> out_p = make_shared<std::vector<SearchPoint>>();
+    if ( num_to_keep == 0 || entries.size() == 0 ) return out_p;
+
+    uint32_t const cut_key = sortable_key( max_score );
+
+    uint64_t num_under_cut = 0;
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:num_under_cut)
+    #endif
+    for ( int64_t i = 0; i < (int64_t)entries.size(); i++ ) {
+        if ( sortable_key( entries[i].score ) <= cut_key ) num_under_cut++;
+    }
+
+    // keep everything below threshold, and up to equal_allowed entries equal to it
+    uint32_t threshold = cut_key;
+    uint64_t equal_allowed = std::numeric_limits<uint64_t>::max();
+    if ( num_under_cut > num_to_keep ) {
+        threshold = kth_smallest_key( num_to_keep - 1 );
+        uint64_t num_less = 0;
+        #ifdef USE_OPENMP
+        #pragma omp parallel for schedule(static) reduction(+:num_less)
+        #endif
+        for ( int64_t i = 0; i < (int64_t)entries.size(); i++ ) {
+            if ( sortable_key( entries[i].score ) < threshold ) num_less++;
+        }
+        equal_allowed = num_to_keep - num_less;
+    }
+
+    // Per-block counts so that the output can be written in parallel and ties
+    //  are handed out in storage order
+    std::vector<uint64_t> block_less( blocks.size(), 0 );
+    std::vector<uint64_t> block_equal( blocks.size(), 0 );
+
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(dynamic,1)
+    #endif
+    for ( int64_t ib = 0; ib < (int64_t)blocks.size(); ib++ ) {
+        for ( uint64_t i = block_begin(ib); i < block_end(ib); i++ ) {
+            uint32_t key = sortable_key( entries[i].score );
+            if ( key < threshold ) block_less[ib]++;
+            else if ( key == threshold ) block_equal[ib]++;
+        }
+    }
+
+    std::vector<uint64_t> block_out_start( blocks.size(), 0 );
+    uint64_t total = 0;
+    for ( size_t ib = 0; ib < blocks.size(); ib++ ) {
+        block_out_start[ib] = total;
+        block_equal[ib] = std::min( block_equal[ib], equal_allowed );
+        equal_allowed -= block_equal[ib];
+        total += block_less[ib] + block_equal[ib];
+    }
+
+    out_p->resize( total );
+    std::vector<SearchPoint> & out = *out_p;
+
+    #ifdef USE_OPENMP
+    #pragma omp parallel for schedule(dynamic,1)
+    #endif
+    for ( int64_t ib = 0; ib < (int64_t)blocks.size(); ib++ ) {
+        uint64_t iout = block_out_start[ib];
+        uint64_t equal_left = block_equal[ib];
+        for ( uint64_t i = block_begin(ib); i < block_end(ib); i++ ) {
+            uint32_t key = sortable_key( entries[i].score );
+            if ( key > threshold ) continue;
+            if ( key == threshold ) {
+                if ( equal_left == 0 ) continue;
+                equal_left--;
+            }
+            SearchPoint & sp = out[iout++];
+            sp.index = index( ib, i );
+            sp.score = entries[i].score;
+            sp.sasa = entries[i].sasa;
+        }
+    }
+
+    return out_p;
+}
+
+
+
+}}
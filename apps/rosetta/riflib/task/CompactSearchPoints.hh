@@ -0,0 +1,104 @@
+// -*- mode:c++;tab-width:2;indent-tabs-mode:t;show-trailing-whitespace:t;rm-trailing-spaces:t -*-
+// vi: set ts=2 noet:
+
+
+#ifndef INCLUDED_riflib_task_CompactSearchPoints_hh
+#define INCLUDED_riflib_task_CompactSearchPoints_hh
+
+
+#include <riflib/types.hh>
+#include <riflib/task/types.hh>
+
+#include <vector>
+
+
+
+namespace devel {
+namespace scheme {
+
+
+// A compact encoding for one stage of the hierarchical search.
+//
+// Each SearchPoint carries a full RifDockIndex, but the children of one parent
+//  only differ in the nest index. Here, points are stored in blocks that share
+//  a seeding index, a scaffold index and a base nest index. Each point only stores
+//  its offset from the base.
+//
+//  CompactSearchPointEntry : 8 bytes per point
+//  CompactSearchPointBlock : 24 bytes per block of up to 65536 points
+//
+// A SearchPoint is 24 bytes, so the widest stage is roughly 3x smaller.
+
+#pragma pack (push, 4)
+struct CompactSearchPointEntry {
+    float score;
+    uint16_t sasa;
+    uint16_t offset;
+    CompactSearchPointEntry() : score(9e9), sasa(0), offset(0) {}
+};
+#pragma pack (pop)
+
+struct CompactSearchPointBlock {
+    RifDockIndex base;     // base.nest_index is the nest index of offset 0
+    uint64_t begin;        // index of the first entry of this block
+};
+
+struct CompactSearchPoints {
+
+    static uint64_t const MAX_BLOCK_SPAN = 1ull << 16;
+
+    std::vector<CompactSearchPointBlock> blocks;
+    std::vector<CompactSearchPointEntry> entries;
+
+    size_t size() const { return entries.size(); }
+
+    size_t
+    mem_use() const {
+        return blocks.size() * sizeof(CompactSearchPointBlock) + entries.size() * sizeof(CompactSearchPointEntry);
+    }
+
+    // entries [ block_begin(ib), block_end(ib) ) belong to block ib
+    uint64_t block_begin( size_t ib ) const { return blocks[ib].begin; }
+    uint64_t block_end( size_t ib ) const { return ib + 1 < blocks.size() ? blocks[ib+1].begin : entries.size(); }
+
+    // binary search for the block that owns this entry
+    size_t block_of( uint64_t ientry ) const;
+
+    RifDockIndex
+    index( size_t iblock, uint64_t ientry ) const {
+        RifDockIndex rdi = blocks[iblock].base;
+        rdi.nest_index += entries[ientry].offset;
+        return rdi;
+    }
+
+    // Replace the contents with the children_per_parent children of each parent.
+    //  Parents are sorted by index (a copy is made) so that neighbors can share blocks.
+    void
+    expand_parents( std::vector<SearchPoint> const & parents, uint64_t children_per_parent );
+
+    // Decode the best num_to_keep points that have score <= max_score.
+    //  Ties at the cutoff are broken by storage order.
+    shared_ptr<std::vector<SearchPoint>>
+    decode_best( uint64_t num_to_keep, float max_score ) const;
+
+    void
+    clear() {
+        std::vector<CompactSearchPointBlock>().swap( blocks );
+        std::vector<CompactSearchPointEntry>().swap( entries );
+    }
+
+private:
+
+    // radix select on the order-preserving integer form of the scores
+    uint32_t
+    kth_smallest_key( uint64_t k ) const;
+
+};
+
+
+
+}}
+
+
+
+#endif
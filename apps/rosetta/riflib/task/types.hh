@@ -16,8 +16,11 @@
 #include <scheme/search/HackPack.hh>
 #include <riflib/RifBase.hh>
 #include <riflib/RifFactory.hh>
+#include <riflib/scaffold/ScaffoldDataCacheManager.hh>
 
 #include <utility/io/ozstream.hh>
+#include <scheme/io/async_writer.hh>
+#include <riflib/ResultsStore.hh>
 
 #ifdef USEGRIDSCORE
 #include <protocols/ligand_docking/GALigandDock/GridScorer.hh>
@@ -37,6 +40,8 @@ namespace scheme {
 
 
 
+class AdaptiveBeam;
+
 template<class _DirectorBigIndex>
 struct tmplSearchPointWithRots;
 
@@ -218,10 +223,14 @@ struct RifDockData {
     shared_ptr<BurialManager> burial_manager;
     shared_ptr<UnsatManager> unsat_manager;
     shared_ptr<HydrophobicManager> hydrophobic_manager;
+    shared_ptr<ScaffoldDataCacheManager> scaffold_data_cache_manager;    // null unless -scaffold_data_cache_budget_MB
 
 #ifdef USEGRIDSCORE
     shared_ptr<protocols::ligand_docking::ga_ligand_dock::GridScorer> grid_scorer;
 #endif
+    shared_ptr< ::scheme::io::AsyncWriter > results_writer;    // null unless -output_writer_threads, set after construction
+    shared_ptr< ResultsStoreWriter > results_store;            // null unless -results_store, set after construction
+    shared_ptr< AdaptiveBeam > adaptive_beam;                  // null unless -adaptive_beam, set after construction
 };
 
 struct ProtocolData {
@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <Eigen/Geometry>
 #include <scheme/objective/voxel/VoxelArray.hh>
+#include <scheme/objective/voxel/BrickedVoxelArray.hh>
 
 namespace devel {
 namespace scheme {
@@ -23,6 +24,7 @@ namespace scheme {
 	typedef ::Eigen::Transform<float,3,Eigen::AffineCompact> EigenXform;
 	typedef ::scheme::objective::voxel::VoxelArray<3,float,float> VoxelArray;
 	typedef VoxelArray* VoxelArrayPtr;
+	typedef ::scheme::objective::voxel::BrickedVoxelArray<float,int8_t,2> QuantizedVoxelArray;
 	using ::scheme::shared_ptr;
 	using ::scheme::make_shared;
 	using ::scheme::enable_shared_from_this;
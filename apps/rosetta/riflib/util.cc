@@ -35,6 +35,7 @@
 #include <core/scoring/dssp/Dssp.hh>
 #include <utility/io/izstream.hh>
 #include <utility/io/ozstream.hh>
+#include <scheme/io/block_compress.hh>
 
 
 #include <core/scoring/rms_util.hh>
@@ -335,6 +336,47 @@ open_for_write_on_path(
 
 }
 
+bool
+read_binary_file(
+	std::string const & fname,
+	std::function< bool( std::istream & ) > const & reader
+){
+	if( ::scheme::io::is_block_compressed_file( fname ) ){
+		std::ifstream in( fname, std::ios::binary );
+		::scheme::io::BlockDecompressBuf buf( in );
+		std::istream bin( &buf );
+		bool success = buf.ok() && reader( bin );
+		if( !buf.ok() ) std::cout << "ERROR reading block compressed file " << fname << ": " << buf.error() << std::endl;
+		return success && buf.ok();
+	}
+	utility::io::izstream in( fname, std::ios::binary );
+	if( !in.good() ) return false;
+	bool success = reader( in );
+	in.close();
+	return success;
+}
+
+bool
+write_binary_file(
+	std::string const & fname,
+	std::function< bool( std::ostream & ) > const & writer,
+	bool block_compressed
+){
+	if( block_compressed ){
+		std::ofstream out( fname, std::ios::binary );
+		if( !out.good() ) return false;
+		::scheme::io::BlockCompressBuf buf( out );
+		std::ostream bout( &buf );
+		bool success = writer( bout );
+		return buf.close() && success;
+	}
+	utility::io::ozstream out( fname, std::ios::binary );
+	if( !out.good() ) return false;
+	bool success = writer( out );
+	out.close();
+	return success;
+}
+
 
 
 
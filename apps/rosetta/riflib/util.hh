@@ -21,6 +21,7 @@
 #include <boost/foreach.hpp>
 #include <numeric/xyzTransform.hh>
 #include <exception>
+#include <functional>
 
 #include <utility/io/ozstream.fwd.hh>
 #include <utility/io/izstream.fwd.hh>
@@ -247,6 +248,22 @@ open_for_write_on_path(
 	bool create_directorys = false
 );
 
+/// calls reader on fname, which may be plain, gzipped or block compressed (scheme/io/block_compress.hh).
+/// block compressed files are decompressed on all omp threads
+bool
+read_binary_file(
+	std::string const & fname,
+	std::function< bool( std::istream & ) > const & reader
+);
+
+/// writes fname as gzip, or in the block compressed format if block_compressed
+bool
+write_binary_file(
+	std::string const & fname,
+	std::function< bool( std::ostream & ) > const & writer,
+	bool block_compressed
+);
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// OMG! MOVE ME
@@ -243,11 +243,10 @@ make_bounding_grids_failed(){
 		runtime_assert( base_xmap_file.substr(base_xmap_file.size()-8) == ".xmap.gz" ||
 		                base_xmap_file.substr(base_xmap_file.size()-7) == ".rif.gz"  ||
 		                base_xmap_file.substr(base_xmap_file.size()-5) == ".xmap"  ||
-		                base_xmap_file.substr(base_xmap_file.size()-4) == ".rif"
+		                base_xmap_file.substr(base_xmap_file.size()-4) == ".rif"     ||
+		                base_xmap_file.substr(base_xmap_file.size()-5) == ".zblk"
 		                );
-		utility::io::izstream in( base_xmap_file );
-		runtime_assert( full_xmap.load( in, full_xmap_description ) );
-		in.close();
+		runtime_assert( read_binary_file( base_xmap_file, [&]( std::istream & in ){ return full_xmap.load( in, full_xmap_description ); } ) );
 		std::cout << "RIF size: " << KMGT( full_xmap.mem_use() ) << " load: " << full_xmap.map_.size()*1.f/full_xmap.map_.bucket_count() << std::endl;
 	} else if( option[sopt::test_structure].user() ) {
 		cout << "make artificial test RIF from: " << option[sopt::test_structure]() << endl;
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include "scheme/dock/fftdock.hh"
+
+#include <random>
+
+namespace scheme { namespace dock { namespace test {
+
+using std::cout;
+using std::endl;
+
+typedef Eigen::Matrix<double,3,1> V3;
+
+TEST( fftdock, radix2_matches_dft ){
+	typedef std::complex<double> C;
+	std::mt19937 rng(0);
+	std::normal_distribution<> rnorm;
+	for( size_t n : { 1, 2, 8, 64 } ){
+		std::vector<C> x( n ), f( n );
+		for( auto & c : x ) c = C( rnorm(rng), rnorm(rng) );
+		f = x;
+		fft_radix2( &f[0], n, 1, false );
+		for( size_t k = 0; k < n; ++k ){
+			C dft( 0 );
+			for( size_t j = 0; j < n; ++j ) dft += x[j] * std::polar( 1.0, -2.0*M_PI*j*k/n );
+			ASSERT_NEAR( dft.real(), f[k].real(), 1e-9 );
+			ASSERT_NEAR( dft.imag(), f[k].imag(), 1e-9 );
+		}
+		fft_radix2( &f[0], n, 1, true );
+		for( size_t k = 0; k < n; ++k ){
+			ASSERT_NEAR( x[k].real(), f[k].real() / n, 1e-9 );
+			ASSERT_NEAR( x[k].imag(), f[k].imag() / n, 1e-9 );
+		}
+	}
+}
+
+TEST( fftdock, grid_roundtrip ){
+	FFTGrid3<double> g;
+	g.init( 4, 8, 16 );
+	std::mt19937 rng(0);
+	std::normal_distribution<> rnorm;
+	std::vector<double> orig( g.size() );
+	for( size_t i = 0; i < g.size(); ++i ) g.data_[i] = orig[i] = rnorm(rng);
+	g.transform( false );
+	g.transform( true );
+	for( size_t i = 0; i < g.size(); ++i ){
+		ASSERT_NEAR( orig[i], g.data_[i].real(), 1e-9 );
+		ASSERT_NEAR( 0, g.data_[i].imag(), 1e-9 );
+	}
+}
+
+TEST( fftdock, translation_scan_matches_brute_force ){
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<> runif;
+	std::normal_distribution<> rnorm;
+
+	FFTTranslationScan<double> scan;
+	V3 lb( -8, -4, -16 );
+	scan.init( lb, 1.0, 16, 8, 32 );
+	ASSERT_EQ( scan.ub(), V3( 8, 4, 16 ) );
+
+	// two target channels, a clash-like sphere and a random field
+	auto sphere = []( V3 const & v ){ return v.norm() < 3.0 ? 1.0 : 0.0; };
+	std::vector<double> noise( 16*8*32 );
+	for( auto & x : noise ) x = rnorm(rng);
+	auto field = [&]( V3 const & v ){
+		int i = std::floor( v[0] - lb[0] ), j = std::floor( v[1] - lb[1] ), k = std::floor( v[2] - lb[2] );
+		return noise[ ( i*8 + j )*32 + k ];
+	};
+	scan.add_target_channel( sphere );
+	scan.add_target_channel( field );
+	ASSERT_EQ( scan.num_channels(), 2 );
+
+	// body points on the grid so snapping is exact
+	std::vector< std::vector<V3> > points( 2 );
+	for( int i = 0; i < 10; ++i ) points[0].push_back( V3( std::floor(runif(rng)*6-3), std::floor(runif(rng)*6-3), std::floor(runif(rng)*6-3) ) );
+	for( int i = 0; i < 5; ++i ) points[1].push_back( V3( std::floor(runif(rng)*4-2), std::floor(runif(rng)*4-2), std::floor(runif(rng)*4-2) ) );
+	std::vector<double> weights{ 3.0, -0.5 };
+
+	FFTTranslationScores<double> scores;
+	scan.scan( points, weights, scores );
+
+	for( int itest = 0; itest < 200; ++itest ){
+		V3 t( runif(rng)*16-8, runif(rng)*8-4, runif(rng)*32-16 );
+		V3 tcen;
+		for( int d = 0; d < 3; ++d ) tcen[d] = lb[d] + std::floor( t[d] - lb[d] ) + 0.5;
+		double brute = 0;
+		for( V3 const & p : points[0] ){
+			V3 q = p + tcen;
+			// wrap around like the correlation does
+			for( int d = 0; d < 3; ++d ){
+				double w = scan.ub()[d] - lb[d];
+				q[d] = q[d] - std::floor( ( q[d] - lb[d] ) / w ) * w;
+			}
+			brute += weights[0] * sphere( q );
+		}
+		for( V3 const & p : points[1] ){
+			V3 q = p + tcen;
+			for( int d = 0; d < 3; ++d ){
+				double w = scan.ub()[d] - lb[d];
+				q[d] = q[d] - std::floor( ( q[d] - lb[d] ) / w ) * w;
+			}
+			brute += weights[1] * field( q );
+		}
+		ASSERT_NEAR( brute, scores.score( t ), 1e-6 );
+	}
+
+	ASSERT_EQ( 0, scores.score( V3( 100, 0, 0 ) ) );
+
+	double best = 9e9;
+	for( double x = -2.5; x < 2; x += 1 )
+		for( double y = -1.5; y < 1; y += 1 )
+			for( double z = 4.5; z < 7; z += 1 )
+				best = std::min( best, scores.score( V3( x, y, z ) ) );
+	ASSERT_NEAR( best, scores.min_score( V3( -3, -2, 4 ), V3( 1.9, 0.9, 6.9 ) ), 1e-9 );
+}
+
+TEST( fftdock, grid_size_for ){
+	ASSERT_EQ( 1, FFTTranslationScan<float>::grid_size_for( 0.5, 1.0 ) );
+	ASSERT_EQ( 64, FFTTranslationScan<float>::grid_size_for( 64, 1.0 ) );
+	ASSERT_EQ( 64, FFTTranslationScan<float>::grid_size_for( 90, 1.5 ) );
+	ASSERT_EQ( 128, FFTTranslationScan<float>::grid_size_for( 97, 1.5 ) );
+}
+
+}}}
@@ -1,11 +1,247 @@
 #ifndef INCLUDED_scheme_dock_fftdock_HH
 #define INCLUDED_scheme_dock_fftdock_HH
 
-#include <fftw3.h>
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 namespace scheme {
 namespace dock {
 
+/// in place radix-2 fft of n elements spaced by stride, n must be a power of two
+/// the inverse is not scaled
+template< class Float >
+void fft_radix2( std::complex<Float> * data, size_t n, size_t stride, bool inverse ){
+	typedef std::complex<Float> Complex;
+	assert( n > 0 && ( n & (n-1) ) == 0 );
+	// bit reversal
+	for( size_t i = 1, j = 0; i < n; ++i ){
+		size_t bit = n >> 1;
+		for( ; j & bit; bit >>= 1 ) j ^= bit;
+		j ^= bit;
+		if( i < j ) std::swap( data[i*stride], data[j*stride] );
+	}
+	for( size_t len = 2; len <= n; len <<= 1 ){
+		double const ang = 2.0 * M_PI / len * ( inverse ? 1.0 : -1.0 );
+		Complex const wlen( std::cos(ang), std::sin(ang) );
+		for( size_t i = 0; i < n; i += len ){
+			Complex w( 1 );
+			for( size_t j = 0; j < len/2; ++j ){
+				Complex const u = data[ (i+j)*stride ];
+				Complex const v = data[ (i+j+len/2)*stride ] * w;
+				data[ (i+j)*stride ] = u + v;
+				data[ (i+j+len/2)*stride ] = u - v;
+				w *= wlen;
+			}
+		}
+	}
+}
+
+/// complex 3D grid, power of two dimensions, x slowest
+template< class Float >
+struct FFTGrid3 {
+	typedef std::complex<Float> Complex;
+
+	size_t n_[3];
+	std::vector<Complex> data_;
+
+	FFTGrid3(){ n_[0] = n_[1] = n_[2] = 0; }
+
+	void init( size_t nx, size_t ny, size_t nz ){
+		n_[0] = nx; n_[1] = ny; n_[2] = nz;
+		for( int d = 0; d < 3; ++d ) assert( n_[d] > 0 && ( n_[d] & (n_[d]-1) ) == 0 );
+		data_.assign( nx*ny*nz, Complex(0) );
+	}
+
+	size_t size() const { return data_.size(); }
+	size_t index( size_t i, size_t j, size_t k ) const { return ( i*n_[1] + j )*n_[2] + k; }
+	Complex & operator()( size_t i, size_t j, size_t k ){ return data_[ index(i,j,k) ]; }
+	Complex const & operator()( size_t i, size_t j, size_t k ) const { return data_[ index(i,j,k) ]; }
+
+	void clear(){ std::fill( data_.begin(), data_.end(), Complex(0) ); }
+
+	/// the inverse is scaled by 1/size so forward then inverse is the identity
+	void transform( bool inverse ){
+		size_t const nx = n_[0], ny = n_[1], nz = n_[2];
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(static)
+		#endif
+		for( int64_t ij = 0; ij < (int64_t)(nx*ny); ++ij ){
+			fft_radix2( &data_[ ij*nz ], nz, 1, inverse );
+		}
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(static)
+		#endif
+		for( int64_t ik = 0; ik < (int64_t)(nx*nz); ++ik ){
+			size_t i = ik / nz, k = ik % nz;
+			fft_radix2( &data_[ index(i,0,k) ], ny, nz, inverse );
+		}
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(static)
+		#endif
+		for( int64_t jk = 0; jk < (int64_t)(ny*nz); ++jk ){
+			fft_radix2( &data_[ jk ], nx, ny*nz, inverse );
+		}
+		if( inverse ){
+			Float const scale = 1.0 / size();
+			for( Complex & c : data_ ) c *= scale;
+		}
+	}
+};
+
+/// scores of every translation on the grid of an FFTTranslationScan, also holds the scratch
+/// space for the scan so one of these per thread can share the scan
+template< class Float >
+struct FFTTranslationScores {
+	typedef Eigen::Matrix<Float,3,1> V3;
+
+	V3 lb_;
+	Float cell_size_;
+	FFTGrid3<Float> body_, accum_;
+	std::vector<Float> scores_;
+
+	size_t index( int64_t i, int64_t j, int64_t k ) const { return accum_.index( i, j, k ); }
+	int64_t n( int d ) const { return accum_.n_[d]; }
+
+	/// score of translation t, 0 outside the grid
+	Float score( V3 const & t ) const {
+		int64_t idx[3];
+		for( int d = 0; d < 3; ++d ){
+			idx[d] = std::floor( ( t[d] - lb_[d] ) / cell_size_ );
+			if( idx[d] < 0 || idx[d] >= n(d) ) return 0;
+		}
+		return scores_[ index( idx[0], idx[1], idx[2] ) ];
+	}
+
+	/// lowest score of the translations in the box lb, ub, 0 if it's outside the grid
+	Float min_score( V3 const & lb, V3 const & ub ) const {
+		int64_t lo[3], hi[3];
+		for( int d = 0; d < 3; ++d ){
+			lo[d] = std::max<int64_t>( 0, std::floor( ( lb[d] - lb_[d] ) / cell_size_ ) );
+			hi[d] = std::min<int64_t>( n(d)-1, std::floor( ( ub[d] - lb_[d] ) / cell_size_ ) );
+			if( lo[d] > hi[d] ) return 0;
+		}
+		Float best = 9e9;
+		for( int64_t i = lo[0]; i <= hi[0]; ++i ){
+			for( int64_t j = lo[1]; j <= hi[1]; ++j ){
+				for( int64_t k = lo[2]; k <= hi[2]; ++k ){
+					best = std::min( best, scores_[ index(i,j,k) ] );
+				}
+			}
+		}
+		return best;
+	}
+};
+
+/// scores every translation of a rigid body against a target at once by fft correlation
+///
+/// score(t) = sum_c weight_c * sum_{p in points_c} target_c( p + t )
+///
+/// target_c is sampled at voxel centers and the points are snapped to the voxel grid, so
+/// translations are resolved to cell_size. translation lb + (k+0.5)*cell_size is voxel k.
+/// the correlation is circular: points wrap around the box, so the box must reach past the
+/// translations of interest by the radius of the body or target_c must be ~0 in that margin
+template< class Float >
+struct FFTTranslationScan {
+	typedef Eigen::Matrix<Float,3,1> V3;
+	typedef std::complex<Float> Complex;
+	typedef FFTTranslationScores<Float> Scores;
+
+	V3 lb_;
+	Float cell_size_;
+	size_t n_[3];
+	std::vector< FFTGrid3<Float> > target_ffts_;
+
+	FFTTranslationScan() : cell_size_(1) { n_[0] = n_[1] = n_[2] = 0; }
+
+	/// n must be powers of two
+	void init( V3 const & lb, Float cell_size, size_t nx, size_t ny, size_t nz ){
+		lb_ = lb;
+		cell_size_ = cell_size;
+		n_[0] = nx; n_[1] = ny; n_[2] = nz;
+		target_ffts_.clear();
+	}
+
+	/// smallest power of two >= extent/cell_size
+	static size_t grid_size_for( Float extent, Float cell_size ){
+		size_t n = 1;
+		while( n * cell_size < extent ) n <<= 1;
+		return n;
+	}
+
+	V3 ub() const { return lb_ + V3( n_[0], n_[1], n_[2] ) * cell_size_; }
+	size_t num_channels() const { return target_ffts_.size(); }
+	size_t num_voxels() const { return n_[0]*n_[1]*n_[2]; }
+
+	V3 center( size_t i, size_t j, size_t k ) const {
+		return lb_ + V3( i+0.5, j+0.5, k+0.5 ) * cell_size_;
+	}
+
+	/// f( V3 voxel_center ) -> Float, called once per voxel, in parallel
+	template< class Func >
+	void add_target_channel( Func const & f ){
+		target_ffts_.push_back( FFTGrid3<Float>() );
+		FFTGrid3<Float> & grid = target_ffts_.back();
+		grid.init( n_[0], n_[1], n_[2] );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1)
+		#endif
+		for( int64_t i = 0; i < (int64_t)n_[0]; ++i ){
+			for( size_t j = 0; j < n_[1]; ++j ){
+				for( size_t k = 0; k < n_[2]; ++k ){
+					grid(i,j,k) = Complex( f( center(i,j,k) ) );
+				}
+			}
+		}
+		grid.transform( false );
+	}
+
+	/// points_by_channel[c] are the body points scored against channel c, in the body frame
+	template< class Points >
+	void scan( std::vector<Points> const & points_by_channel, std::vector<Float> const & weights, Scores & out ) const {
+		assert( points_by_channel.size() == target_ffts_.size() );
+		assert( weights.size() == target_ffts_.size() );
+		out.lb_ = lb_;
+		out.cell_size_ = cell_size_;
+		if( out.accum_.n_[0] != n_[0] || out.accum_.n_[1] != n_[1] || out.accum_.n_[2] != n_[2] ){
+			out.body_.init( n_[0], n_[1], n_[2] );
+			out.accum_.init( n_[0], n_[1], n_[2] );
+		}
+		out.accum_.clear();
+		for( size_t ichan = 0; ichan < target_ffts_.size(); ++ichan ){
+			if( weights[ichan] == 0 || points_by_channel[ichan].size() == 0 ) continue;
+			out.body_.clear();
+			for( auto const & p : points_by_channel[ichan] ){
+				out.body_( wrap( p[0], 0 ), wrap( p[1], 1 ), wrap( p[2], 2 ) ) += Complex( 1 );
+			}
+			out.body_.transform( false );
+			FFTGrid3<Float> const & target = target_ffts_[ichan];
+			Float const w = weights[ichan];
+			// correlation: F(target) * conj(F(body))
+			for( size_t i = 0; i < out.accum_.size(); ++i ){
+				out.accum_.data_[i] += w * target.data_[i] * std::conj( out.body_.data_[i] );
+			}
+		}
+		out.accum_.transform( true );
+		out.scores_.resize( out.accum_.size() );
+		for( size_t i = 0; i < out.accum_.size(); ++i ) out.scores_[i] = out.accum_.data_[i].real();
+	}
+
+private:
+	size_t wrap( Float x, int d ) const {
+		int64_t i = std::floor( x / cell_size_ + 0.5 );
+		int64_t n = n_[d];
+		return ( ( i % n ) + n ) % n;
+	}
+};
 
 }
 }
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "scheme/io/async_writer.hh"
+
+#include <cstdio>
+#include <random>
+#include <sstream>
+
+namespace scheme { namespace io { namespace test_async_writer {
+
+using std::cout;
+using std::endl;
+
+static std::string read_file( std::string const & fname ){
+	std::ifstream in( fname, std::ios::binary );
+	std::ostringstream oss;
+	oss << in.rdbuf();
+	return oss.str();
+}
+
+static std::string read_gzip( std::string const & fname ){
+	gzFile f = gzopen( fname.c_str(), "rb" );
+	EXPECT_TRUE( f != nullptr );
+	std::string out;
+	char buf[4096];
+	int n;
+	while( ( n = gzread( f, buf, sizeof(buf) ) ) > 0 ) out.append( buf, n );
+	EXPECT_EQ( 0, n );
+	gzclose( f );
+	return out;
+}
+
+static std::string make_text( size_t n, std::mt19937 & rng ){
+	std::string s( n, ' ' );
+	for( size_t i = 0; i < n; ++i ) s[i] = "ATOM  CA 1.234\n"[ rng() % 15 ];
+	return s;
+}
+
+TEST( async_writer, gzip_chunks_make_one_member ){
+	std::mt19937 rng( 2837 );
+	std::string data = make_text( 100000, rng );
+	for( size_t chunk : { 1000ul, 4096ul, 1ul<<20 } ){
+		AsyncWriter writer( 4, 10000, chunk );
+		writer.write_file( "test_async_writer.txt.gz", data );
+		writer.write_file( "test_async_writer.txt", data );
+		writer.write_file( "test_async_writer_empty.gz", "" );
+		ASSERT_TRUE( writer.finish() );
+		ASSERT_EQ( data, read_gzip( "test_async_writer.txt.gz" ) );
+		ASSERT_EQ( data, read_file( "test_async_writer.txt" ) );
+		ASSERT_EQ( "", read_gzip( "test_async_writer_empty.gz" ) );
+		// single member: the trailer is at the very end and there is one header
+		std::string raw = read_file( "test_async_writer.txt.gz" );
+		ASSERT_EQ( std::string::npos, raw.find( async_writer::gzip_header(), 1 ) );
+		writer.print_stats( cout );
+		AsyncWriterStats stats = writer.stats();
+		ASSERT_EQ( 3, stats.files );
+		ASSERT_EQ( 2*data.size(), stats.bytes_in );
+		ASSERT_EQ( 2*( ( data.size() + chunk - 1 ) / chunk ) + 1, stats.chunks );
+	}
+	std::remove( "test_async_writer.txt.gz" );
+	std::remove( "test_async_writer.txt" );
+	std::remove( "test_async_writer_empty.gz" );
+}
+
+TEST( async_writer, appends_stay_in_order ){
+	std::mt19937 rng( 98234 );
+	std::remove( "test_async_writer.silent" );
+	std::remove( "test_async_writer.silent.gz" );
+	std::string expected;
+	{
+		AsyncWriter writer( 3, 5000, 700 );
+		for( int i = 0; i < 200; ++i ){
+			std::string s = "result " + std::to_string(i) + "\n" + make_text( rng() % 3000, rng );
+			writer.append( "test_async_writer.silent", s );
+			writer.append( "test_async_writer.silent.gz", s );
+			expected += s;
+		}
+		ASSERT_TRUE( writer.finish() );
+		ASSERT_EQ( expected, read_file( "test_async_writer.silent" ) );
+		ASSERT_EQ( expected, read_gzip( "test_async_writer.silent.gz" ) );
+		// reopening appends, gz gets a second member
+		writer.append( "test_async_writer.silent", "more\n" );
+		writer.append( "test_async_writer.silent.gz", "more\n" );
+	} // destructor finishes
+	ASSERT_EQ( expected + "more\n", read_file( "test_async_writer.silent" ) );
+	ASSERT_EQ( expected + "more\n", read_gzip( "test_async_writer.silent.gz" ) );
+	std::remove( "test_async_writer.silent" );
+	std::remove( "test_async_writer.silent.gz" );
+}
+
+TEST( async_writer, close_ends_an_append ){
+	std::mt19937 rng( 4471 );
+	std::remove( "test_async_writer_close.silent.gz" );
+	AsyncWriter writer( 4, 3000, 500 );
+	std::string first = make_text( 20000, rng ), second = make_text( 5000, rng );
+	writer.append( "test_async_writer_close.silent.gz", first );
+	writer.close( "test_async_writer_close.silent.gz" );
+	writer.close( "test_async_writer_close.silent.gz" ); // not open, nothing to do
+	writer.append( "test_async_writer_close.silent.gz", second );
+	ASSERT_TRUE( writer.finish() );
+	ASSERT_EQ( first + second, read_gzip( "test_async_writer_close.silent.gz" ) );
+	// closed once by close and once by finish, so two members
+	std::string raw = read_file( "test_async_writer_close.silent.gz" );
+	ASSERT_NE( std::string::npos, raw.find( async_writer::gzip_header(), 1 ) );
+	ASSERT_EQ( 2, writer.stats().files );
+	std::remove( "test_async_writer_close.silent.gz" );
+}
+
+TEST( async_writer, reports_write_errors ){
+	AsyncWriter writer( 2 );
+	writer.write_file( "no_such_dir_async_writer/foo.pdb.gz", "ATOM\n" );
+	ASSERT_FALSE( writer.finish() );
+	ASSERT_EQ( 1, writer.errors().size() );
+	cout << writer.errors().front() << endl;
+}
+
+}}}
@@ -0,0 +1,340 @@
+#ifndef INCLUDED_io_async_writer_HH
+#define INCLUDED_io_async_writer_HH
+
+#include <zlib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace scheme { namespace io {
+
+namespace async_writer {
+
+	/// raw deflate of one chunk, ending byte aligned but not final, so chunks compressed on
+	/// different threads can be concatenated into one gzip member (like pigz)
+	inline bool deflate_chunk( std::string const & in, std::string & out, int level, int flush = Z_FULL_FLUSH ){
+		z_stream zs;
+		zs.zalloc = Z_NULL; zs.zfree = Z_NULL; zs.opaque = Z_NULL;
+		if( Z_OK != deflateInit2( &zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) ) return false;
+		out.resize( deflateBound( &zs, in.size() ) + 16 );
+		zs.next_in = (Bytef*)in.data();
+		zs.avail_in = in.size();
+		zs.next_out = (Bytef*)&out[0];
+		zs.avail_out = out.size();
+		int const status = deflate( &zs, flush );
+		bool const ok = zs.avail_in == 0 && ( status == Z_OK || status == Z_STREAM_END || status == Z_BUF_ERROR );
+		out.resize( out.size() - zs.avail_out );
+		deflateEnd( &zs ); // Z_DATA_ERROR for an unfinished stream, that's fine
+		return ok;
+	}
+
+	inline std::string const & gzip_header(){
+		static std::string const h( "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10 ); // deflate, no name or mtime, unix
+		return h;
+	}
+
+	inline std::string const & deflate_final_block(){
+		static std::string const block = [](){ std::string b; deflate_chunk( "", b, 1, Z_FINISH ); return b; }();
+		return block;
+	}
+
+	inline bool ends_with( std::string const & s, std::string const & suffix ){
+		return s.size() >= suffix.size() && s.compare( s.size()-suffix.size(), suffix.size(), suffix ) == 0;
+	}
+}
+
+struct AsyncWriterStats {
+	uint64_t bytes_in = 0, bytes_out = 0, files = 0, chunks = 0, stalls = 0;
+	double stall_seconds = 0, seconds = 0;
+};
+
+/// writes files from background threads so the threads producing output don't wait on
+/// compression and disk. submitted data is cut into chunks that any writer thread compresses, and
+/// each file's chunks are written in submission order. files ending in .gz are a single gzip
+/// member, the chunks are deflated independently and stitched together with crc32_combine.
+///
+/// the queue is bounded by max_queued_bytes, producers block (a stall) when it is full. chunks
+/// compressed ahead of their turn count against it until they are written. write errors are
+/// reported by finish()
+class AsyncWriter {
+public:
+	AsyncWriter( int nthreads, size_t max_queued_bytes = 256ul<<20,
+	             size_t chunk_bytes = 1ul<<20, int gzip_level = Z_DEFAULT_COMPRESSION )
+		: max_queued_bytes_( std::max( max_queued_bytes, chunk_bytes ) ), chunk_bytes_( chunk_bytes ),
+		  gzip_level_( gzip_level ), queued_bytes_( 0 ), parked_bytes_( 0 ), in_flight_( 0 ), stop_( false ),
+		  start_( std::chrono::high_resolution_clock::now() )
+	{
+		for( int i = 0; i < std::max( 1, nthreads ); ++i ) threads_.emplace_back( &AsyncWriter::work, this );
+	}
+
+	~AsyncWriter(){
+		finish();
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stop_ = true;
+		}
+		not_empty_.notify_all();
+		for( std::thread & t : threads_ ) t.join();
+	}
+
+	/// write (truncate) fname with data
+	void write_file( std::string const & fname, std::string const & data ){
+		shared_ptr_stream s = std::make_shared<Stream>( fname, false );
+		submit( s, data, true );
+	}
+
+	/// append data to fname. everything appended to one fname goes to one open file, in order,
+	/// until close( fname ) or finish()
+	void append( std::string const & fname, std::string const & data ){
+		shared_ptr_stream s;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			shared_ptr_stream & open = append_streams_[ fname ];
+			if( !open ) open = std::make_shared<Stream>( fname, true );
+			s = open;
+		}
+		submit( s, data, false );
+	}
+
+	/// close an appended file once everything appended to it so far is written, doesn't wait.
+	/// appending to fname again reopens it, a .gz then gets another gzip member
+	void close( std::string const & fname ){
+		shared_ptr_stream s;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			auto it = append_streams_.find( fname );
+			if( it == append_streams_.end() ) return;
+			s = it->second;
+			append_streams_.erase( it );
+		}
+		close_when_written( s );
+	}
+
+	/// wait for everything to be written and close appended files. returns false if anything
+	/// failed, errors() has the messages. the writer can be used again afterwards
+	bool finish(){
+		std::map< std::string, shared_ptr_stream > streams;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			streams.swap( append_streams_ );
+		}
+		for( auto & s : streams ) close_when_written( s.second );
+		std::unique_lock<std::mutex> lock( mutex_ );
+		idle_.wait( lock, [this](){ return queue_.empty() && in_flight_ == 0; } );
+		stats_.seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start_ ).count();
+		return errors_.empty();
+	}
+
+	std::vector<std::string> errors() const {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		return errors_;
+	}
+
+	AsyncWriterStats stats() const {
+		std::lock_guard<std::mutex> lock( mutex_ );
+		AsyncWriterStats s = stats_;
+		s.seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start_ ).count();
+		return s;
+	}
+
+	void print_stats( std::ostream & out ) const {
+		AsyncWriterStats s = stats();
+		out << "AsyncWriter: " << s.files << " files, " << s.chunks << " chunks, "
+		    << s.bytes_in/1e6 << " MB in, " << s.bytes_out/1e6 << " MB out, "
+		    << s.bytes_in/1e6/std::max( s.seconds, 1e-9 ) << " MB/s over " << s.seconds << " s, "
+		    << s.stalls << " queue stalls (" << s.stall_seconds << " s)" << std::endl;
+	}
+
+private:
+	struct Ready {
+		std::string data;
+		uint32_t crc = 0;
+		uint64_t usize = 0;
+		bool close = false;
+	};
+
+	struct Stream {
+		std::string fname;
+		bool append, gzip;
+		std::ofstream out;
+		uint64_t nsubmitted = 0, nwritten = 0; // nsubmitted is guarded by the writer's mutex_
+		bool failed = false;
+		std::map< uint64_t, Ready > ready; // finished chunks waiting for their turn
+		uLong crc = 0;
+		uint64_t isize = 0;
+		std::mutex mutex; // ready, nwritten and the ofstream
+		Stream( std::string const & f, bool a ) : fname( f ), append( a ), gzip( async_writer::ends_with( f, ".gz" ) ) {
+			crc = crc32( 0, Z_NULL, 0 );
+		}
+	};
+	typedef std::shared_ptr<Stream> shared_ptr_stream;
+
+	struct Job {
+		shared_ptr_stream stream;
+		uint64_t seq;
+		std::string data;
+		bool close; // empty marker, close the file once everything before it is written
+	};
+
+	void submit( shared_ptr_stream s, std::string const & data, bool close ){
+		size_t const nchunks = std::max<size_t>( 1, ( data.size() + chunk_bytes_ - 1 ) / chunk_bytes_ );
+		uint64_t seq;
+		{ // reserve the sequence numbers up front so another thread appending to s can't interleave
+			std::lock_guard<std::mutex> lock( mutex_ );
+			seq = s->nsubmitted;
+			s->nsubmitted += nchunks + close;
+		}
+		for( size_t i = 0; i < nchunks; ++i ){
+			size_t const begin = std::min( i*chunk_bytes_, data.size() );
+			push( s, seq++, data.substr( begin, chunk_bytes_ ), false );
+		}
+		if( close ) push( s, seq, std::string(), true );
+	}
+
+	void close_when_written( shared_ptr_stream s ){
+		uint64_t seq;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			seq = s->nsubmitted++;
+		}
+		push( s, seq, std::string(), true );
+	}
+
+	void push( shared_ptr_stream s, uint64_t seq, std::string && data, bool close ){
+		std::unique_lock<std::mutex> lock( mutex_ );
+		// when everything counted is parked it may be waiting on this chunk, let it through
+		auto fits = [&](){ return queued_bytes_ == parked_bytes_ || queued_bytes_ + data.size() <= max_queued_bytes_; };
+		if( !fits() ){
+			auto t0 = std::chrono::high_resolution_clock::now();
+			++stats_.stalls;
+			not_full_.wait( lock, fits );
+			stats_.stall_seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count();
+		}
+		queued_bytes_ += data.size();
+		stats_.bytes_in += data.size();
+		if( !close ) ++stats_.chunks;
+		Job job;
+		job.stream = s;
+		job.seq = seq;
+		job.data.swap( data );
+		job.close = close;
+		queue_.push_back( std::move( job ) );
+		lock.unlock();
+		not_empty_.notify_one();
+	}
+
+	void work(){
+		while( true ){
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock( mutex_ );
+				not_empty_.wait( lock, [this](){ return stop_ || !queue_.empty(); } );
+				if( queue_.empty() ) return; // stop_
+				job = std::move( queue_.front() );
+				queue_.pop_front();
+				++in_flight_;
+			}
+			size_t const nbytes = job.data.size();
+			std::string out;
+			uint32_t crc = 0;
+			bool ok = true;
+			if( job.stream->gzip && !job.close ){
+				crc = crc32( crc32( 0, Z_NULL, 0 ), (Bytef const*)job.data.data(), job.data.size() );
+				ok = async_writer::deflate_chunk( job.data, out, gzip_level_ );
+			} else {
+				out.swap( job.data );
+			}
+			std::string error;
+			uint64_t nout = 0, nreleased = 0;
+			bool closed = false;
+			if( !ok ){ // keep the stream moving, the file is reported bad
+				error = "compression failed for " + job.stream->fname;
+				out.clear();
+			}
+			write_in_order( *job.stream, job.seq, nbytes, std::move( out ), crc, job.close, error, nout, nreleased, closed );
+			{
+				std::lock_guard<std::mutex> lock( mutex_ );
+				// this chunk is parked until written, written parked chunks are released
+				parked_bytes_ = parked_bytes_ + nbytes - nreleased;
+				queued_bytes_ -= nreleased;
+				stats_.bytes_out += nout;
+				if( closed ) ++stats_.files;
+				if( error.size() ) errors_.push_back( error );
+				--in_flight_;
+			}
+			not_full_.notify_all();
+			idle_.notify_all();
+		}
+	}
+
+	// nreleased is the input bytes written, of this chunk and of parked ones that were waiting on it
+	void write_in_order( Stream & s, uint64_t seq, size_t nbytes, std::string && data, uint32_t crc, bool close,
+	                     std::string & error, uint64_t & nout, uint64_t & nreleased, bool & closed ){
+		std::lock_guard<std::mutex> lock( s.mutex );
+		Ready & r = s.ready[seq];
+		r.data.swap( data );
+		r.crc = crc;
+		r.usize = nbytes;
+		r.close = close;
+		while( !s.ready.empty() && s.ready.begin()->first == s.nwritten ){
+			Ready const & chunk = s.ready.begin()->second;
+			if( !s.out.is_open() && !s.failed ){
+				s.out.open( s.fname, std::ios::binary | ( s.append ? std::ios::app : std::ios::trunc ) );
+				if( s.gzip ){
+					s.out.write( async_writer::gzip_header().data(), 10 );
+					nout += 10;
+				}
+			}
+			if( chunk.close ){
+				if( s.gzip ){
+					std::string const & final_block = async_writer::deflate_final_block();
+					uint32_t const trailer[2] = { (uint32_t)s.crc, (uint32_t)s.isize }; // little endian, like the host
+					s.out.write( final_block.data(), final_block.size() );
+					s.out.write( (char const*)trailer, 8 );
+					nout += final_block.size() + 8;
+				}
+				s.out.close();
+				closed = true;
+			} else {
+				if( s.gzip ) s.crc = crc32_combine( s.crc, chunk.crc, chunk.usize );
+				s.isize += chunk.usize;
+				s.out.write( chunk.data.data(), chunk.data.size() );
+				nout += chunk.data.size();
+			}
+			if( !s.failed && s.out.fail() ){
+				s.failed = true;
+				if( error.empty() ) error = "write failed for " + s.fname;
+			}
+			nreleased += chunk.usize;
+			s.ready.erase( s.ready.begin() );
+			++s.nwritten;
+		}
+	}
+
+	mutable std::mutex mutex_;
+	std::condition_variable not_empty_, not_full_, idle_;
+	std::deque<Job> queue_;
+	std::map< std::string, shared_ptr_stream > append_streams_;
+	std::vector<std::thread> threads_;
+	size_t max_queued_bytes_, chunk_bytes_;
+	int gzip_level_;
+	size_t queued_bytes_, parked_bytes_, in_flight_; // queued_bytes_ includes parked_bytes_
+	bool stop_;
+	std::chrono::time_point<std::chrono::high_resolution_clock> start_;
+	AsyncWriterStats stats_;
+	std::vector<std::string> errors_;
+};
+
+}}
+
+#endif
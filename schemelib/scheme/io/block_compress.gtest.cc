@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "scheme/io/block_compress.hh"
+#include "scheme/objective/hash/XformMap.hh"
+#include "scheme/numeric/rand_xform.hh"
+
+#include <random>
+#include <sstream>
+
+namespace scheme { namespace io { namespace test_block_compress {
+
+using std::cout;
+using std::endl;
+
+static std::string make_data( size_t n, std::mt19937 & rng ){
+	std::string s( n, ' ' );
+	for( size_t i = 0; i < n; ++i ) s[i] = 'a' + rng() % 4; // compressible
+	return s;
+}
+
+static std::string compress( std::string const & data, size_t block_size, int nthreads ){
+	std::ostringstream oss;
+	BlockCompressBuf buf( oss, block_size, Z_DEFAULT_COMPRESSION, nthreads );
+	std::ostream out( &buf );
+	out.write( data.data(), data.size() );
+	EXPECT_TRUE( buf.close() );
+	EXPECT_EQ( data.size(), buf.bytes_in() );
+	return oss.str();
+}
+
+static bool decompress( std::string const & file, std::string & data, int nthreads, std::string * error = nullptr ){
+	std::istringstream iss( file );
+	BlockDecompressBuf buf( iss, nthreads );
+	std::istream in( &buf );
+	std::ostringstream oss;
+	if( buf.ok() ) oss << in.rdbuf();
+	data = oss.str();
+	if( error ) *error = buf.error();
+	return buf.finished();
+}
+
+TEST( block_compress, roundtrip ){
+	std::mt19937 rng( 23498 );
+	for( size_t n : { 0ul, 1ul, 999ul, 4096ul, 4097ul, 100000ul } ){
+		std::string data = make_data( n, rng );
+		for( int nthreads : { 1, 3 } ){
+			std::string file = compress( data, 1024, nthreads );
+			std::istringstream iss( file );
+			ASSERT_TRUE( is_block_compressed( iss ) );
+			// reader threads don't have to match writer threads
+			for( int rthreads : { 1, 4 } ){
+				std::string back;
+				ASSERT_TRUE( decompress( file, back, rthreads ) );
+				ASSERT_EQ( data, back );
+			}
+		}
+	}
+	std::istringstream notblock( "\x1f\x8b not block compressed" );
+	ASSERT_FALSE( is_block_compressed( notblock ) );
+	std::string back, error;
+	ASSERT_FALSE( decompress( notblock.str(), back, 1, &error ) );
+}
+
+TEST( block_compress, detects_truncation_and_corruption ){
+	std::mt19937 rng( 9823 );
+	std::string data = make_data( 50000, rng );
+	std::string file = compress( data, 1000, 2 );
+	std::string back, error;
+
+	cout << "following errors are expected" << endl;
+	ASSERT_FALSE( decompress( file.substr( 0, file.size()/2 ), back, 2, &error ) );
+	ASSERT_NE( std::string::npos, error.find( "not finished" ) );
+	ASSERT_NE( std::string::npos, error.find( "complete blocks" ) );
+
+	std::string corrupt = file;
+	size_t const pos = file.size() / 2;
+	corrupt[ pos ] ^= 0x10;
+	ASSERT_FALSE( decompress( corrupt, back, 2, &error ) );
+	ASSERT_NE( std::string::npos, error.find( "in block " ) );
+	ASSERT_LT( back.size(), data.size() );
+	ASSERT_EQ( data.substr( 0, back.size() ), back ); // everything before the bad batch is good
+}
+
+TEST( block_compress, xform_map_roundtrip ){
+	typedef Eigen::Transform<double,3,Eigen::AffineCompact> Xform;
+	typedef objective::hash::XformMap< Xform, double > XMap;
+	std::mt19937 rng( 1234 );
+	std::uniform_real_distribution<> runif;
+	XMap xmap( 0.5, 10.0 );
+	for( int i = 0; i < 20000; ++i ){
+		Xform x;
+		numeric::rand_xform( rng, x, 64.0 );
+		xmap.insert( x, runif(rng) );
+	}
+	std::ostringstream oss;
+	{
+		BlockCompressBuf buf( oss, 64*1024 );
+		std::ostream out( &buf );
+		ASSERT_TRUE( xmap.save( out, "block compressed" ) );
+		ASSERT_TRUE( buf.close() );
+		cout << "XformMap " << buf.bytes_in() << " bytes in " << buf.num_blocks() << " blocks, compressed " << buf.bytes_out() << endl;
+	}
+	std::istringstream iss( oss.str() );
+	BlockDecompressBuf buf( iss );
+	std::istream in( &buf );
+	XMap loaded;
+	std::string description;
+	ASSERT_TRUE( loaded.load( in, description ) );
+	ASSERT_NE( std::string::npos, description.find( "User Description: block compressed" ) );
+	ASSERT_EQ( xmap.size(), loaded.size() );
+	for( auto const & v : xmap.map_ ) ASSERT_EQ( v.second, loaded.map_.find( v.first )->second );
+}
+
+}}}
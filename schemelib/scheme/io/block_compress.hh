@@ -0,0 +1,341 @@
+#ifndef INCLUDED_io_block_compress_HH
+#define INCLUDED_io_block_compress_HH
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace scheme { namespace io {
+
+/// Block compressed container, like BGZF. The byte stream is cut into fixed size blocks that are
+/// deflated independently, so a batch of blocks can be (de)compressed on all threads at once.
+///
+///   header:  "schmzblk" uint32 version, uint32 block_size
+///   blocks:  uint32 BLOCK_MAGIC, csize, usize, crc32 of the uncompressed data, then csize bytes
+///   index:   per block uint64 offset, uint32 csize, usize, crc32
+///   footer:  uint64 index_offset, nblocks, total_bytes, "schmzblk"
+///
+/// a file without a good footer was not finished (crashed writer, partial copy), and every block
+/// is checked against the index and its crc as it is read, so damage is reported by block
+namespace block_compress {
+	char const MAGIC[] = "schmzblk";
+	uint32_t const VERSION = 1;
+	uint32_t const BLOCK_MAGIC = 0x6b6c6273; // "sblk"
+	size_t const DEFAULT_BLOCK_SIZE = 4 << 20;
+	size_t const HEADER_BYTES = 8 + 4 + 4;
+	size_t const BLOCK_HEADER_BYTES = 4*4;
+	size_t const INDEX_ENTRY_BYTES = 8 + 4*3;
+	size_t const FOOTER_BYTES = 8*3 + 8;
+
+	struct IndexEntry {
+		uint64_t offset;
+		uint32_t csize, usize, crc;
+	};
+
+	inline int num_threads( int nthreads ){
+		if( nthreads > 0 ) return nthreads;
+		#ifdef USE_OPENMP
+		return omp_get_max_threads();
+		#else
+		return 1;
+		#endif
+	}
+
+	template< class T > void put( std::ostream & out, T const & t ){ out.write( (char const*)&t, sizeof(T) ); }
+	template< class T > bool get( std::istream & in, T & t ){ return (bool)in.read( (char*)&t, sizeof(T) ); }
+	template< class T > T get( char const * p ){ T t; std::memcpy( &t, p, sizeof(T) ); return t; }
+}
+
+/// streambuf writing the block format to out. bytes are buffered until there is a block for each
+/// thread, then compressed in parallel. close() writes the index, nothing is readable without it
+class BlockCompressBuf : public std::streambuf {
+public:
+	BlockCompressBuf( std::ostream & out, size_t block_size = block_compress::DEFAULT_BLOCK_SIZE,
+	                  int level = Z_DEFAULT_COMPRESSION, int nthreads = 0 )
+		: out_( out ), block_size_( block_size ), level_( level ),
+		  nthreads_( block_compress::num_threads( nthreads ) ), offset_( 0 ), total_( 0 ), closed_( false ), ok_( true )
+	{
+		if( block_size_ == 0 || block_size_ > ( 1u << 30 ) ) block_size_ = block_compress::DEFAULT_BLOCK_SIZE;
+		buf_.resize( block_size_ * nthreads_ );
+		setp( buf_.data(), buf_.data() + buf_.size() );
+		out_.write( block_compress::MAGIC, 8 );
+		block_compress::put( out_, block_compress::VERSION );
+		block_compress::put( out_, (uint32_t)block_size_ );
+		offset_ = block_compress::HEADER_BYTES;
+		ok_ = out_.good();
+	}
+
+	~BlockCompressBuf(){ close(); }
+
+	/// flush the last blocks and write index and footer. returns false on any compress or write error
+	bool close(){
+		if( closed_ ) return ok_;
+		closed_ = true;
+		flush_batch();
+		uint64_t const index_offset = offset_;
+		for( block_compress::IndexEntry const & e : index_ ){
+			block_compress::put( out_, e.offset );
+			block_compress::put( out_, e.csize );
+			block_compress::put( out_, e.usize );
+			block_compress::put( out_, e.crc );
+		}
+		block_compress::put( out_, index_offset );
+		block_compress::put( out_, (uint64_t)index_.size() );
+		block_compress::put( out_, total_ );
+		out_.write( block_compress::MAGIC, 8 );
+		out_.flush();
+		ok_ = ok_ && out_.good();
+		return ok_;
+	}
+
+	bool ok() const { return ok_; }
+	uint64_t bytes_in() const { return total_; }
+	uint64_t bytes_out() const { return offset_; }
+	size_t num_blocks() const { return index_.size(); }
+
+protected:
+	int_type overflow( int_type c ) override {
+		if( closed_ ) return traits_type::eof();
+		flush_batch();
+		if( !ok_ ) return traits_type::eof();
+		if( !traits_type::eq_int_type( c, traits_type::eof() ) ){
+			*pptr() = traits_type::to_char_type( c );
+			pbump( 1 );
+		}
+		return traits_type::not_eof( c );
+	}
+	// only whole blocks are written, flush() can't cut one short
+	int sync() override { return ok_ ? 0 : -1; }
+
+private:
+	void flush_batch(){
+		size_t const nbytes = pptr() - pbase();
+		setp( buf_.data(), buf_.data() + buf_.size() );
+		if( nbytes == 0 || !ok_ ) return;
+		int const nblocks = ( nbytes + block_size_ - 1 ) / block_size_;
+		std::vector<std::string> compressed( nblocks );
+		std::vector<uint32_t> usize( nblocks ), crc( nblocks );
+		std::vector<char> failed( nblocks, 0 );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1) num_threads(nthreads_)
+		#endif
+		for( int i = 0; i < nblocks; ++i ){
+			Bytef const * src = (Bytef const*)buf_.data() + i*block_size_;
+			usize[i] = std::min( block_size_, nbytes - i*block_size_ );
+			crc[i] = crc32( 0, src, usize[i] );
+			uLongf clen = compressBound( usize[i] );
+			compressed[i].resize( clen );
+			failed[i] = Z_OK != compress2( (Bytef*)&compressed[i][0], &clen, src, usize[i], level_ );
+			compressed[i].resize( clen );
+		}
+		for( int i = 0; i < nblocks; ++i ){
+			if( failed[i] ){
+				std::cerr << "BlockCompressBuf: zlib compress failed on block " << index_.size() << std::endl;
+				ok_ = false;
+				return;
+			}
+			block_compress::IndexEntry e;
+			e.offset = offset_;
+			e.csize = compressed[i].size();
+			e.usize = usize[i];
+			e.crc = crc[i];
+			block_compress::put( out_, block_compress::BLOCK_MAGIC );
+			block_compress::put( out_, e.csize );
+			block_compress::put( out_, e.usize );
+			block_compress::put( out_, e.crc );
+			out_.write( compressed[i].data(), e.csize );
+			offset_ += block_compress::BLOCK_HEADER_BYTES + e.csize;
+			total_ += e.usize;
+			index_.push_back( e );
+		}
+		ok_ = out_.good();
+	}
+
+	std::ostream & out_;
+	size_t block_size_;
+	int level_, nthreads_;
+	std::vector<char> buf_;
+	std::vector<block_compress::IndexEntry> index_;
+	uint64_t offset_, total_;
+	bool closed_, ok_;
+};
+
+/// streambuf reading the block format from a seekable in. the index is read up front, then each
+/// underflow decompresses and crc checks the next block for each thread in parallel. on damage
+/// reading stops (eof) and error() says which block
+class BlockDecompressBuf : public std::streambuf {
+public:
+	BlockDecompressBuf( std::istream & in, int nthreads = 0 )
+		: in_( in ), nthreads_( block_compress::num_threads( nthreads ) ), next_block_( 0 ), total_( 0 ), ok_( false )
+	{
+		setg( nullptr, nullptr, nullptr );
+		ok_ = read_index();
+	}
+
+	bool ok() const { return ok_; }
+	std::string const & error() const { return error_; }
+	size_t num_blocks() const { return index_.size(); }
+	uint64_t total_bytes() const { return total_; }
+	/// true once every block has been read and checked
+	bool finished() const { return ok_ && next_block_ == index_.size() && gptr() == egptr(); }
+
+protected:
+	int_type underflow() override {
+		if( gptr() < egptr() ) return traits_type::to_int_type( *gptr() );
+		if( !ok_ || next_block_ >= index_.size() || !fill_batch() ) return traits_type::eof();
+		return traits_type::to_int_type( *gptr() );
+	}
+
+private:
+	bool fail( std::string const & msg ){
+		error_ = msg;
+		std::cerr << "BlockDecompressBuf: " << msg << std::endl;
+		ok_ = false;
+		setg( nullptr, nullptr, nullptr );
+		return false;
+	}
+
+	bool read_index(){
+		using namespace block_compress;
+		char magic[8];
+		uint32_t version, block_size;
+		in_.seekg( 0, std::ios::beg );
+		if( !in_.read( magic, 8 ) || std::memcmp( magic, MAGIC, 8 ) ) return fail( "not a block compressed stream" );
+		if( !get( in_, version ) || version != VERSION ) return fail( "unsupported version" );
+		if( !get( in_, block_size ) ) return fail( "truncated header" );
+
+		in_.seekg( 0, std::ios::end );
+		uint64_t const file_size = in_.tellg();
+		uint64_t index_offset = 0, nblocks = 0;
+		bool footer_ok = file_size >= HEADER_BYTES + FOOTER_BYTES;
+		if( footer_ok ){
+			in_.seekg( file_size - FOOTER_BYTES, std::ios::beg );
+			footer_ok = get( in_, index_offset ) && get( in_, nblocks ) && get( in_, total_ ) && in_.read( magic, 8 )
+			         && !std::memcmp( magic, MAGIC, 8 )
+			         && index_offset + nblocks*INDEX_ENTRY_BYTES + FOOTER_BYTES == file_size;
+		}
+		if( !footer_ok ) return fail( "no index, file was not finished: " + scan_blocks( file_size ) );
+
+		in_.seekg( index_offset, std::ios::beg );
+		index_.resize( nblocks );
+		uint64_t expect_offset = HEADER_BYTES, expect_total = 0;
+		for( uint64_t i = 0; i < nblocks; ++i ){
+			IndexEntry & e = index_[i];
+			if( !get( in_, e.offset ) || !get( in_, e.csize ) || !get( in_, e.usize ) || !get( in_, e.crc ) )
+				return fail( "truncated index" );
+			if( e.offset != expect_offset || e.usize > block_size ){
+				std::ostringstream oss;
+				oss << "bad index entry for block " << i << " of " << nblocks;
+				return fail( oss.str() );
+			}
+			expect_offset += BLOCK_HEADER_BYTES + e.csize;
+			expect_total += e.usize;
+		}
+		if( expect_offset != index_offset || expect_total != total_ ) return fail( "index doesn't match footer" );
+		in_.clear();
+		return true;
+	}
+
+	// for the error message on an unfinished file
+	std::string scan_blocks( uint64_t file_size ){
+		using namespace block_compress;
+		in_.clear();
+		uint64_t offset = HEADER_BYTES, nblocks = 0, nbytes = 0;
+		while( offset + BLOCK_HEADER_BYTES <= file_size ){
+			in_.seekg( offset, std::ios::beg );
+			uint32_t magic, csize, usize, crc;
+			if( !get( in_, magic ) || !get( in_, csize ) || !get( in_, usize ) || !get( in_, crc ) ) break;
+			if( magic != BLOCK_MAGIC || offset + BLOCK_HEADER_BYTES + csize > file_size ) break;
+			offset += BLOCK_HEADER_BYTES + csize;
+			nbytes += usize;
+			++nblocks;
+		}
+		std::ostringstream oss;
+		oss << nblocks << " complete blocks (" << nbytes << " bytes) in " << file_size << " byte file";
+		return oss.str();
+	}
+
+	bool fill_batch(){
+		using namespace block_compress;
+		size_t const b0 = next_block_, b1 = std::min( index_.size(), b0 + nthreads_ );
+		uint64_t const begin = index_[b0].offset;
+		uint64_t const end = index_[b1-1].offset + BLOCK_HEADER_BYTES + index_[b1-1].csize;
+		cbuf_.resize( end - begin );
+		in_.seekg( begin, std::ios::beg );
+		if( !in_.read( cbuf_.data(), cbuf_.size() ) ){
+			std::ostringstream oss;
+			oss << "read failed in blocks " << b0 << "-" << b1-1 << " of " << index_.size();
+			return fail( oss.str() );
+		}
+		std::vector<uint64_t> uoffset( b1 - b0 + 1, 0 );
+		for( size_t b = b0; b < b1; ++b ) uoffset[b-b0+1] = uoffset[b-b0] + index_[b].usize;
+		ubuf_.resize( uoffset.back() );
+		std::vector<char> bad( b1 - b0, 0 );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1) num_threads(nthreads_)
+		#endif
+		for( int i = 0; i < (int)( b1 - b0 ); ++i ){
+			IndexEntry const & e = index_[b0+i];
+			char const * block = cbuf_.data() + ( e.offset - begin );
+			if( get<uint32_t>( block ) != BLOCK_MAGIC || get<uint32_t>( block+4 ) != e.csize
+			 || get<uint32_t>( block+8 ) != e.usize || get<uint32_t>( block+12 ) != e.crc ){
+				bad[i] = 1; continue;
+			}
+			Bytef * dest = (Bytef*)ubuf_.data() + uoffset[i];
+			uLongf ulen = e.usize;
+			if( Z_OK != uncompress( dest, &ulen, (Bytef const*)block + BLOCK_HEADER_BYTES, e.csize ) || ulen != e.usize ){
+				bad[i] = 2; continue;
+			}
+			if( crc32( 0, dest, e.usize ) != e.crc ) bad[i] = 3;
+		}
+		for( size_t i = 0; i < bad.size(); ++i ){
+			if( !bad[i] ) continue;
+			char const * what[] = { "", "bad block header", "decompress failed", "crc mismatch" };
+			std::ostringstream oss;
+			oss << what[(int)bad[i]] << " in block " << b0+i << " of " << index_.size() << " at byte " << index_[b0+i].offset;
+			return fail( oss.str() );
+		}
+		next_block_ = b1;
+		setg( ubuf_.data(), ubuf_.data(), ubuf_.data() + ubuf_.size() );
+		return true;
+	}
+
+	std::istream & in_;
+	int nthreads_;
+	std::vector<block_compress::IndexEntry> index_;
+	std::vector<char> cbuf_, ubuf_;
+	size_t next_block_;
+	uint64_t total_;
+	bool ok_;
+	std::string error_;
+};
+
+inline bool is_block_compressed( std::istream & in ){
+	char magic[8];
+	std::streampos pos = in.tellg();
+	bool is = in.read( magic, 8 ) && !std::memcmp( magic, block_compress::MAGIC, 8 );
+	in.clear();
+	in.seekg( pos );
+	return is;
+}
+
+inline bool is_block_compressed_file( std::string const & fname ){
+	std::ifstream in( fname, std::ios::binary );
+	return in.good() && is_block_compressed( in );
+}
+
+}}
+
+#endif
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include "scheme/io/column_store.hh"
+
+#include <array>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+namespace scheme { namespace io { namespace test_column_store {
+
+using std::cout;
+using std::endl;
+
+struct Pair { int32_t a, b; };
+
+TEST( column_store, roundtrip_random_access ){
+	std::vector<ColumnSpec> cols {
+		ColumnSpec( "id", 8 ), ColumnSpec( "score", 4 ), ColumnSpec( "pairs", 0 ),
+		ColumnSpec( "unset", 2 ), ColumnSpec( "xform", 48 ), ColumnSpec( "tag", 0 )
+	};
+	std::mt19937 rng( 7123 );
+	for( uint64_t nrows : { 0ul, 1ul, 100ul, 257ul } ){
+		std::vector<float> scores;
+		std::vector< std::vector<Pair> > pairs;
+		std::ostringstream oss;
+		{
+			ColumnStoreWriter w( oss, cols, 64 );
+			w.set_meta( "target", "foo.pdb" );
+			int const score = w.column( "score" ), id = w.column( "id" ), pair = w.column( "pairs" ), xform = w.column( "xform" );
+			for( uint64_t i = 0; i < nrows; ++i ){
+				scores.push_back( -(float)( rng() % 1000 ) / 10.0f );
+				pairs.push_back( std::vector<Pair>( rng() % 5 ) );
+				for( Pair & p : pairs.back() ){ p.a = rng() % 100; p.b = i; }
+				w.set( score, scores.back() ); // any order
+				w.set( id, i );
+				w.set_ragged( pair, pairs.back() );
+				std::array<float,12> x; x.fill( i );
+				w.set( xform, x );
+				if( i % 3 == 0 ) w.set_ragged( w.column( "tag" ), "abc", 3 );
+				w.end_row();
+			}
+			ASSERT_TRUE( w.close() );
+		}
+		std::istringstream iss( oss.str() );
+		ColumnStoreReader r( iss );
+		ASSERT_TRUE( r.ok() ) << r.error();
+		ASSERT_EQ( nrows, r.num_rows() );
+		ASSERT_EQ( "foo.pdb", r.meta( "target" ) );
+		ASSERT_EQ( "", r.meta( "nope" ) );
+		ASSERT_EQ( 6, r.columns().size() );
+		ASSERT_EQ( scores, r.read_column<float>( r.column( "score" ) ) );
+		for( uint64_t k = 0; k < nrows; ++k ){
+			uint64_t const i = rng() % nrows;
+			ASSERT_EQ( i, r.get<uint64_t>( i, r.column( "id" ) ) );
+			ASSERT_EQ( scores[i], r.get<float>( i, r.column( "score" ) ) );
+			ASSERT_EQ( 0, r.get<int16_t>( i, r.column( "unset" ) ) );
+			ASSERT_EQ( (float)i, ( r.get< std::array<float,12> >( i, r.column( "xform" ) )[11] ) );
+			std::vector<Pair> p = r.get_ragged_vector<Pair>( i, r.column( "pairs" ) );
+			ASSERT_EQ( pairs[i].size(), p.size() );
+			for( size_t j = 0; j < p.size(); ++j ){
+				ASSERT_EQ( pairs[i][j].a, p[j].a );
+				ASSERT_EQ( pairs[i][j].b, p[j].b );
+			}
+			ASSERT_EQ( i % 3 ? "" : "abc", r.get_ragged( i, r.column( "tag" ) ) );
+		}
+		if( nrows ) ASSERT_THROW( r.get<float>( 0, r.column( "id" ) ), std::logic_error );
+		ASSERT_THROW( r.get<float>( nrows, r.column( "score" ) ), std::out_of_range );
+		ASSERT_THROW( r.get<float>( nrows + 1, r.column( "score" ) ), std::out_of_range );
+	}
+}
+
+TEST( column_store, detects_unclosed_and_bad_files ){
+	std::vector<ColumnSpec> cols { ColumnSpec( "x", 4 ) };
+	std::ostringstream oss;
+	ColumnStoreWriter w( oss, cols, 10 );
+	ASSERT_THROW( w.set( 0, (double)1 ), std::logic_error );
+	for( int i = 0; i < 25; ++i ){ w.set( 0, i ); w.end_row(); }
+	{
+		std::istringstream iss( oss.str() ); // blocks flushed, not closed
+		ColumnStoreReader r( iss );
+		ASSERT_FALSE( r.ok() );
+		ASSERT_NE( std::string::npos, r.error().find( "not closed" ) );
+	}
+	ASSERT_TRUE( w.close() );
+	std::istringstream iss( oss.str() );
+	ColumnStoreReader r( iss );
+	ASSERT_TRUE( r.ok() );
+	ASSERT_EQ( 25, r.num_rows() );
+	ASSERT_EQ( 24, r.get<int>( 24, 0 ) );
+	std::istringstream junk( "not a column store at all, really not" );
+	ColumnStoreReader rj( junk );
+	ASSERT_FALSE( rj.ok() );
+}
+
+TEST( column_store, rejects_corrupt_index ){
+	std::vector<ColumnSpec> cols { ColumnSpec( "x", 4 ) };
+	std::ostringstream oss;
+	ColumnStoreWriter w( oss, cols, 10 );
+	for( int i = 0; i < 25; ++i ){ w.set( 0, i ); w.end_row(); }
+	ASSERT_TRUE( w.close() );
+	std::string const good = oss.str();
+	// index tail: nblocks, then per block offset and nrows (10, 10, 5), then the 24 byte footer
+	size_t const blocks_at = good.size() - 24 - 3*12, nblocks_at = blocks_at - 8;
+	auto read_bad = [&]( std::string const & bytes ){
+		std::istringstream iss( bytes );
+		ColumnStoreReader r( iss );
+		return r.ok() ? std::string() : r.error();
+	};
+	auto with_nrows = [&]( uint32_t n0, uint32_t n1, uint32_t n2 ){
+		std::string bad = good;
+		uint32_t const n[3] = { n0, n1, n2 };
+		for( int b = 0; b < 3; ++b ) std::memcpy( &bad[ blocks_at + 12*b + 8 ], &n[b], 4 );
+		return bad;
+	};
+	ASSERT_EQ( "", read_bad( with_nrows( 10, 10, 5 ) ) );
+	ASSERT_NE( "", read_bad( with_nrows( 5, 10, 10 ) ) ); // short block before the last
+	ASSERT_NE( "", read_bad( with_nrows( 10, 3, 12 ) ) ); // last block bigger than a block
+	std::string bad = good;
+	uint64_t const huge_nblocks = 1ull << 40;
+	std::memcpy( &bad[ nblocks_at ], &huge_nblocks, 8 );
+	ASSERT_NE( "", read_bad( bad ) );
+	bad = good;
+	bad.erase( blocks_at + 12, 12 ); // a block entry cut out of the index
+	ASSERT_NE( "", read_bad( bad ) );
+}
+
+}}}
@@ -0,0 +1,353 @@
+#ifndef INCLUDED_io_column_store_HH
+#define INCLUDED_io_column_store_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace scheme { namespace io {
+
+/// binary table of fixed width columns plus ragged (variable length bytes) columns, stored
+/// column-major in blocks of rows_per_block rows with an index at the end:
+///
+///   "schmcols" uint32 version
+///   blocks:  each fixed column's nrows*width bytes, then per ragged column nrows+1 uint64
+///            offsets and the payload
+///   index:   schema, metadata strings, rows_per_block, per block offset, nrows, ragged bytes
+///   footer:  uint64 index_offset, nrows, "schmcols"
+///
+/// every block but the last is full, so any cell is one seek away, and reading a whole column
+/// touches only that column's slice of each block. a file without its footer was not closed
+struct ColumnSpec {
+	std::string name;
+	uint32_t width; // bytes, 0 for ragged
+	ColumnSpec( std::string const & n = "", uint32_t w = 0 ) : name( n ), width( w ) {}
+	bool ragged() const { return width == 0; }
+};
+
+namespace column_store {
+	char const MAGIC[] = "schmcols";
+	uint32_t const VERSION = 1;
+
+	template< class T > void put( std::ostream & out, T const & t ){ out.write( (char const*)&t, sizeof(T) ); }
+	inline void put( std::ostream & out, std::string const & s ){
+		put( out, (uint64_t)s.size() );
+		out.write( s.data(), s.size() );
+	}
+	template< class T > bool get( std::istream & in, T & t ){ return (bool)in.read( (char*)&t, sizeof(T) ); }
+	inline bool get( std::istream & in, std::string & s ){
+		uint64_t n;
+		if( !get( in, n ) || n > ( 1ull << 32 ) ) return false;
+		s.resize( n );
+		return n == 0 || (bool)in.read( &s[0], n );
+	}
+
+	struct BlockInfo {
+		uint64_t offset;
+		uint32_t nrows;
+		std::vector<uint64_t> ragged_bytes; // per ragged column
+	};
+}
+
+class ColumnStoreWriter {
+public:
+	ColumnStoreWriter( std::ostream & out, std::vector<ColumnSpec> const & columns, uint32_t rows_per_block = 4096 )
+		: out_( out ), columns_( columns ), rows_per_block_( std::max( 1u, rows_per_block ) ),
+		  nrows_( 0 ), block_rows_( 0 ), offset_( 0 ), closed_( false ), row_set_( columns.size(), false )
+	{
+		fixed_.resize( columns_.size() );
+		ragged_offsets_.resize( columns_.size() );
+		ragged_data_.resize( columns_.size() );
+		for( size_t c = 0; c < columns_.size(); ++c ) ragged_offsets_[c].push_back( 0 );
+		out_.write( column_store::MAGIC, 8 );
+		column_store::put( out_, column_store::VERSION );
+		offset_ = 12;
+	}
+
+	~ColumnStoreWriter(){ close(); }
+
+	int column( std::string const & name ) const {
+		for( size_t c = 0; c < columns_.size(); ++c ) if( columns_[c].name == name ) return c;
+		return -1;
+	}
+
+	/// set a fixed width column of the current row, sizeof(T) must be the column width
+	template< class T >
+	void set( int col, T const & value ){
+		static_assert( std::is_trivially_copyable<T>::value, "ColumnStoreWriter::set needs a plain type" );
+		if( columns_.at( col ).width != sizeof(T) ) throw std::logic_error( "ColumnStoreWriter::set width mismatch for " + columns_[col].name );
+		set_bytes( col, &value, sizeof(T) );
+	}
+
+	/// set a ragged column of the current row
+	void set_ragged( int col, void const * data, size_t nbytes ){
+		if( !columns_.at( col ).ragged() ) throw std::logic_error( "ColumnStoreWriter::set_ragged on fixed column " + columns_[col].name );
+		set_bytes( col, data, nbytes );
+	}
+	template< class T >
+	void set_ragged( int col, std::vector<T> const & values ){
+		static_assert( std::is_trivially_copyable<T>::value, "ColumnStoreWriter::set_ragged needs a plain type" );
+		set_ragged( col, values.data(), values.size()*sizeof(T) );
+	}
+
+	/// unset columns of the row are zero / empty
+	void end_row(){
+		for( size_t c = 0; c < columns_.size(); ++c ){
+			if( !row_set_[c] ) set_bytes( c, nullptr, 0 );
+			if( columns_[c].ragged() ) ragged_offsets_[c].push_back( ragged_data_[c].size() );
+			row_set_[c] = false;
+		}
+		++block_rows_;
+		++nrows_;
+		if( block_rows_ == rows_per_block_ ) flush_block();
+	}
+
+	void set_meta( std::string const & key, std::string const & value ){ meta_[key] = value; }
+
+	uint64_t num_rows() const { return nrows_; }
+
+	bool close(){
+		if( closed_ ) return out_.good();
+		closed_ = true;
+		flush_block();
+		uint64_t const index_offset = offset_;
+		column_store::put( out_, (uint64_t)columns_.size() );
+		for( ColumnSpec const & c : columns_ ){
+			column_store::put( out_, c.name );
+			column_store::put( out_, c.width );
+		}
+		column_store::put( out_, (uint64_t)meta_.size() );
+		for( auto const & kv : meta_ ){
+			column_store::put( out_, kv.first );
+			column_store::put( out_, kv.second );
+		}
+		column_store::put( out_, rows_per_block_ );
+		column_store::put( out_, (uint64_t)blocks_.size() );
+		for( column_store::BlockInfo const & b : blocks_ ){
+			column_store::put( out_, b.offset );
+			column_store::put( out_, b.nrows );
+			for( uint64_t n : b.ragged_bytes ) column_store::put( out_, n );
+		}
+		column_store::put( out_, index_offset );
+		column_store::put( out_, nrows_ );
+		out_.write( column_store::MAGIC, 8 );
+		out_.flush();
+		return out_.good();
+	}
+
+private:
+	void set_bytes( int col, void const * data, size_t nbytes ){
+		if( row_set_.at( col ) ) throw std::logic_error( "ColumnStoreWriter: column set twice in one row: " + columns_[col].name );
+		row_set_[col] = true;
+		std::vector<char> & dest = columns_[col].ragged() ? ragged_data_[col] : fixed_[col];
+		size_t const n = columns_[col].ragged() ? nbytes : columns_[col].width;
+		size_t const old = dest.size();
+		dest.resize( old + n, 0 );
+		if( data ) std::memcpy( &dest[old], data, nbytes );
+	}
+
+	void flush_block(){
+		if( block_rows_ == 0 ) return;
+		column_store::BlockInfo info;
+		info.offset = offset_;
+		info.nrows = block_rows_;
+		for( size_t c = 0; c < columns_.size(); ++c ){
+			if( columns_[c].ragged() ) continue;
+			out_.write( fixed_[c].data(), fixed_[c].size() );
+			offset_ += fixed_[c].size();
+			fixed_[c].clear();
+		}
+		for( size_t c = 0; c < columns_.size(); ++c ){
+			if( !columns_[c].ragged() ) continue;
+			out_.write( (char const*)ragged_offsets_[c].data(), ragged_offsets_[c].size()*sizeof(uint64_t) );
+			out_.write( ragged_data_[c].data(), ragged_data_[c].size() );
+			offset_ += ragged_offsets_[c].size()*sizeof(uint64_t) + ragged_data_[c].size();
+			info.ragged_bytes.push_back( ragged_data_[c].size() );
+			ragged_offsets_[c].assign( 1, 0 );
+			ragged_data_[c].clear();
+		}
+		blocks_.push_back( info );
+		block_rows_ = 0;
+	}
+
+	std::ostream & out_;
+	std::vector<ColumnSpec> columns_;
+	uint32_t rows_per_block_;
+	uint64_t nrows_;
+	uint32_t block_rows_;
+	uint64_t offset_;
+	bool closed_;
+	std::vector<bool> row_set_;
+	std::vector< std::vector<char> > fixed_, ragged_data_;
+	std::vector< std::vector<uint64_t> > ragged_offsets_;
+	std::vector<column_store::BlockInfo> blocks_;
+	std::map<std::string,std::string> meta_;
+};
+
+/// random access reader for ColumnStoreWriter files. in must be seekable. not thread safe, open
+/// one reader per thread
+class ColumnStoreReader {
+public:
+	ColumnStoreReader( std::istream & in ) : in_( in ), nrows_( 0 ), rows_per_block_( 1 ) {
+		ok_ = read_index();
+	}
+
+	bool ok() const { return ok_; }
+	std::string const & error() const { return error_; }
+	uint64_t num_rows() const { return nrows_; }
+	std::vector<ColumnSpec> const & columns() const { return columns_; }
+	std::map<std::string,std::string> const & meta() const { return meta_; }
+	std::string meta( std::string const & key ) const {
+		auto i = meta_.find( key );
+		return i == meta_.end() ? std::string() : i->second;
+	}
+
+	int column( std::string const & name ) const {
+		for( size_t c = 0; c < columns_.size(); ++c ) if( columns_[c].name == name ) return c;
+		return -1;
+	}
+
+	template< class T >
+	T get( uint64_t row, int col ){
+		if( row >= nrows_ ) throw std::out_of_range( "ColumnStoreReader: bad row" );
+		check_column( col, sizeof(T) );
+		uint64_t const b = row / rows_per_block_, i = row % rows_per_block_;
+		T t;
+		in_.seekg( column_offset( b, col ) + i*sizeof(T) );
+		if( !column_store::get( in_, t ) ) throw std::runtime_error( "ColumnStoreReader: read failed" );
+		return t;
+	}
+
+	/// the whole column, one read per block
+	template< class T >
+	std::vector<T> read_column( int col ){
+		check_column( col, sizeof(T) );
+		std::vector<T> values( nrows_ );
+		for( uint64_t b = 0; b < blocks_.size(); ++b ){
+			in_.seekg( column_offset( b, col ) );
+			if( !in_.read( (char*)&values[ b*rows_per_block_ ], blocks_[b].nrows*sizeof(T) ) )
+				throw std::runtime_error( "ColumnStoreReader: read failed" );
+		}
+		return values;
+	}
+
+	std::string get_ragged( uint64_t row, int col ){
+		if( row >= nrows_ || col < 0 || col >= (int)columns_.size() || !columns_[col].ragged() )
+			throw std::out_of_range( "ColumnStoreReader::get_ragged" );
+		uint64_t const b = row / rows_per_block_, i = row % rows_per_block_;
+		uint64_t const base = column_offset( b, col );
+		uint64_t range[2];
+		in_.seekg( base + i*sizeof(uint64_t) );
+		if( !in_.read( (char*)range, sizeof(range) ) ) throw std::runtime_error( "ColumnStoreReader: read failed" );
+		std::string s( range[1] - range[0], '\0' );
+		in_.seekg( base + ( blocks_[b].nrows + 1 )*sizeof(uint64_t) + range[0] );
+		if( s.size() && !in_.read( &s[0], s.size() ) ) throw std::runtime_error( "ColumnStoreReader: read failed" );
+		return s;
+	}
+	template< class T >
+	std::vector<T> get_ragged_vector( uint64_t row, int col ){
+		std::string s = get_ragged( row, col );
+		std::vector<T> v( s.size() / sizeof(T) );
+		if( v.size() ) std::memcpy( v.data(), s.data(), v.size()*sizeof(T) );
+		return v;
+	}
+
+private:
+	void check_column( int col, size_t width ) const {
+		if( col < 0 || col >= (int)columns_.size() )
+			throw std::out_of_range( "ColumnStoreReader: bad column" );
+		if( columns_[col].width != width )
+			throw std::logic_error( "ColumnStoreReader: width mismatch for " + columns_[col].name );
+	}
+
+	uint64_t column_offset( uint64_t b, int col ) const {
+		column_store::BlockInfo const & info = blocks_[b];
+		uint64_t off = info.offset;
+		int iragged = 0;
+		for( int c = 0; c < (int)columns_.size(); ++c ){
+			if( columns_[c].ragged() ) continue;
+			if( c == col ) return off;
+			off += (uint64_t)info.nrows * columns_[c].width;
+		}
+		for( int c = 0; c < (int)columns_.size(); ++c ){
+			if( !columns_[c].ragged() ) continue;
+			if( c == col ) return off;
+			off += ( info.nrows + 1 )*sizeof(uint64_t) + info.ragged_bytes[iragged++];
+		}
+		return off;
+	}
+
+	bool fail( std::string const & msg ){
+		error_ = msg;
+		return false;
+	}
+
+	bool read_index(){
+		using column_store::MAGIC;
+		using column_store::VERSION;
+		using column_store::BlockInfo;
+		char magic[8];
+		uint32_t version;
+		in_.seekg( 0, std::ios::beg );
+		if( !in_.read( magic, 8 ) || std::memcmp( magic, MAGIC, 8 ) ) return fail( "not a column store" );
+		if( !column_store::get( in_, version ) || version != VERSION ) return fail( "unsupported column store version" );
+		in_.seekg( 0, std::ios::end );
+		uint64_t const file_size = in_.tellg();
+		uint64_t index_offset;
+		if( file_size < 12 + 24 ) return fail( "truncated column store" );
+		in_.seekg( file_size - 24 );
+		if( !column_store::get( in_, index_offset ) || !column_store::get( in_, nrows_ ) || !in_.read( magic, 8 ) || std::memcmp( magic, MAGIC, 8 )
+		    || index_offset >= file_size ){
+			return fail( "column store has no index, it was not closed" );
+		}
+		in_.seekg( index_offset );
+		uint64_t ncol, nmeta, nblocks;
+		if( !column_store::get( in_, ncol ) || ncol > 100000 ) return fail( "bad column store schema" );
+		int nragged = 0;
+		columns_.resize( ncol );
+		for( ColumnSpec & c : columns_ ){
+			if( !column_store::get( in_, c.name ) || !column_store::get( in_, c.width ) ) return fail( "bad column store schema" );
+			nragged += c.ragged();
+		}
+		if( !column_store::get( in_, nmeta ) ) return fail( "bad column store metadata" );
+		for( uint64_t i = 0; i < nmeta; ++i ){
+			std::string k, v;
+			if( !column_store::get( in_, k ) || !column_store::get( in_, v ) ) return fail( "bad column store metadata" );
+			meta_[k] = v;
+		}
+		if( !column_store::get( in_, rows_per_block_ ) || !column_store::get( in_, nblocks ) || rows_per_block_ == 0 ) return fail( "bad column store index" );
+		// the writer fills every block but the last, get and read_column rely on that
+		if( nblocks != nrows_ / rows_per_block_ + ( nrows_ % rows_per_block_ != 0 ) ) return fail( "column store index doesn't match footer" );
+		blocks_.resize( nblocks );
+		uint64_t rows = 0;
+		for( uint64_t ib = 0; ib < nblocks; ++ib ){
+			BlockInfo & b = blocks_[ib];
+			b.ragged_bytes.resize( nragged );
+			if( !column_store::get( in_, b.offset ) || !column_store::get( in_, b.nrows ) ) return fail( "bad column store index" );
+			for( uint64_t & n : b.ragged_bytes ) if( !column_store::get( in_, n ) ) return fail( "bad column store index" );
+			if( ib + 1 < nblocks ? b.nrows != rows_per_block_ : b.nrows > rows_per_block_ ) return fail( "bad column store block size" );
+			rows += b.nrows;
+		}
+		if( rows != nrows_ ) return fail( "column store index doesn't match footer" );
+		return true;
+	}
+
+	std::istream & in_;
+	bool ok_;
+	std::string error_;
+	uint64_t nrows_;
+	uint32_t rows_per_block_;
+	std::vector<ColumnSpec> columns_;
+	std::map<std::string,std::string> meta_;
+	std::vector<column_store::BlockInfo> blocks_;
+};
+
+}}
+
+#endif
@@ -2,10 +2,14 @@
 
 #include "scheme/nest/NEST.hh"
 #include "scheme/nest/pmap/ScaleMap.hh"
+#include "scheme/nest/pmap/OriTransMap.hh"
 #include "scheme/kinematics/Director.hh"
 #include "scheme/numeric/X1dim.hh"
 
 #include "scheme/util/Timer.hh"
+#include "scheme/util/StoragePolicy.hh"
+
+#include <random>
 
 namespace scheme { namespace kinematics { namespace test_director {
 
@@ -118,6 +122,132 @@ TEST( Director, test_TreeDirector ){
 	ASSERT_NE( test->position(0)[0] , scene.position(0)[0] );
 }
 
+
+typedef Eigen::Transform<float,3,Eigen::AffineCompact> Xform;
+
+struct TestScaffoldIndex {
+	uint16_t depth, member;
+	TestScaffoldIndex() : depth(0), member(0) {}
+};
+struct TestDockIndex {
+	typedef uint64_t NestIndex;
+	uint64_t nest_index;
+	uint32_t seeding_index;
+	TestScaffoldIndex scaffold_index;
+	TestDockIndex() : nest_index(0), seeding_index(0) {}
+};
+struct TestScaffoldProvider {
+	typedef TestScaffoldIndex ScaffoldIndex;
+	shared_ptr<ConformationBase const> get_scaffold( ScaffoldIndex ) { return nullptr; }
+};
+
+struct XformScene : public SceneBase<Xform>
+{
+	int nreplace = 0;
+	XformScene() : SceneBase<Xform>() {
+		for( int i = 0; i < 2; ++i ) this->positions_.push_back( Xform::Identity() );
+		update_symmetry(positions_.size());
+	}
+	virtual shared_ptr<SceneBase<Xform> > clone_deep() const { return make_shared<XformScene>(*this); }
+	virtual void replace_body( uint64_t ib, shared_ptr<ConformationBase const> ) {
+		++nreplace;
+		this->set_body_tag( ib, 0 ); // as Scene does
+	}
+};
+
+TEST( Director, static_composite_matches_composite ){
+	typedef scheme::nest::NEST< 6, Xform, scheme::nest::pmap::OriTransMap, scheme::util::StoreNothing, uint64_t, float, false > Nest6D;
+	typedef NestDirector< Nest6D, TestDockIndex > TNest;
+	typedef IdentityDirector< Xform, TestDockIndex > TIdentity;
+	typedef ScaffoldDirector< Xform, TestScaffoldProvider, TestDockIndex > TScaffold;
+	typedef SeedingDirector< Xform, std::vector<Xform>, TestDockIndex > TSeeding;
+	typedef StaticCompositeDirector< Xform, TestDockIndex, TNest, TIdentity, TScaffold, TSeeding > TStatic;
+	typedef Director< Xform, TestDockIndex > TBase;
+
+	auto nest = make_shared<TNest>( 30.0, Eigen::Vector3f(-8,-8,-8), Eigen::Vector3f(8,8,8), Eigen::Vector3i(4,4,4), 1 );
+	auto scaffold = make_shared<TScaffold>( make_shared<TestScaffoldProvider>(), 1 );
+	auto seeding_positions = make_shared< std::vector<Xform> >( 3, Xform::Identity() );
+	for( int i = 0; i < 3; ++i ) seeding_positions->at(i).translation()[i] = 1.0;
+	auto seeding = make_shared<TSeeding>( seeding_positions, 1, -1 );
+
+	CompositeDirector< Xform, TestDockIndex > dynamic( std::vector< shared_ptr<TBase> >{ nest, scaffold, seeding } );
+	TStatic fixed( nest, nullptr, scaffold, seeding );
+	ASSERT_EQ( dynamic.size( 2, TestDockIndex() ).nest_index, fixed.size( 2, TestDockIndex() ).nest_index );
+
+	// children of a few parents in order, as hsearch makes them, then shuffled
+	int const resl = 3;
+	std::mt19937 rng( 3452 );
+	std::vector<TestDockIndex> indices;
+	for( int iparent = 0; iparent < 50; ++iparent ){
+		uint64_t parent = rng() % nest->nest().size( resl-1 );
+		for( int ichild = 0; ichild < 64; ++ichild ){
+			TestDockIndex i;
+			i.nest_index = parent*64 + ichild;
+			i.seeding_index = rng() % 3;
+			i.scaffold_index.member = iparent / 10;
+			indices.push_back( i );
+		}
+	}
+	std::vector<TestDockIndex> shuffled = indices;
+	std::shuffle( shuffled.begin(), shuffled.end(), rng );
+
+	XformScene scene_a, scene_b;
+	for( auto const & order : { indices, shuffled } ){
+		for( TestDockIndex const & i : order ){
+			bool ok_a = dynamic.set_scene( i, resl, scene_a );
+			bool ok_b = fixed.set_scene( i, resl, scene_b );
+			ASSERT_EQ( ok_a, ok_b );
+			Xform ref;
+			ASSERT_EQ( ok_a, nest->nest().get_state( i.nest_index, resl, ref ) );
+			if( !ok_a ) continue;
+			ASSERT_TRUE( scene_a.position(1).isApprox( scene_b.position(1), 0 ) );
+		}
+	}
+	// in hsearch order the scaffold only changes 5 times
+	int const nreplace_shuffled = scene_b.nreplace;
+	scene_b.nreplace = 0;
+	scene_b.set_body_tag( 1, 0 );
+	int nvisit = 0;
+	fixed.set_scene_many( &indices[0], indices.size(), resl, scene_b, [&]( size_t k, bool ok ){
+		Xform ref;
+		ASSERT_EQ( k, nvisit++ );
+		ASSERT_EQ( ok, nest->nest().get_state( indices[k].nest_index, resl, ref ) );
+	} );
+	ASSERT_EQ( indices.size(), nvisit );
+	ASSERT_EQ( 5, scene_b.nreplace );
+	ASSERT_LT( 5, nreplace_shuffled );
+	// the generic one, one virtual set_scene per index
+	nvisit = 0;
+	dynamic.set_scene_many( &indices[0], indices.size(), resl, scene_a, [&]( size_t k, bool ok ){
+		ASSERT_EQ( k, nvisit++ );
+		ASSERT_EQ( ok, fixed.set_scene( indices[k], resl, scene_b ) );
+		if( ok ) ASSERT_TRUE( scene_a.position(1).isApprox( scene_b.position(1), 0 ) );
+	} );
+	ASSERT_EQ( indices.size(), nvisit );
+
+	util::Timer<> t_dynamic;
+	for( int rep = 0; rep < 20; ++rep ) for( TestDockIndex const & i : indices ) dynamic.set_scene( i, resl, scene_a );
+	double const rate_dynamic = 20.0 * indices.size() / t_dynamic.elapsed();
+	util::Timer<> t_static;
+	for( int rep = 0; rep < 20; ++rep ) for( TestDockIndex const & i : indices ) fixed.set_scene( i, resl, scene_b );
+	double const rate_static = 20.0 * indices.size() / t_static.elapsed();
+	cout << "set_scene rate CompositeDirector " << rate_dynamic << " / sec, StaticCompositeDirector " << rate_static << " / sec" << endl;
+}
+
+TEST( Director, scaffold_director_replaces_after_clear_body_tags ){
+	typedef ScaffoldDirector< Xform, TestScaffoldProvider, TestDockIndex > TScaffold;
+	TScaffold scaffold( make_shared<TestScaffoldProvider>(), 1 );
+	XformScene scene;
+	TestDockIndex i;
+	scaffold.set_scene( i, 0, scene );
+	scaffold.set_scene( i, 0, scene );
+	ASSERT_EQ( 1, scene.nreplace );
+	// as after a provider's set_fa_mode
+	scene.clear_body_tags();
+	scaffold.set_scene( i, 0, scene );
+	ASSERT_EQ( 2, scene.nreplace );
+}
+
 }
 }
 }
@@ -10,6 +10,9 @@
 
 #include <boost/any.hpp>
 
+#include <atomic>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 #include <Eigen/Dense>
 
@@ -54,6 +57,23 @@ struct Director
 
 	virtual BigIndex size(int resl, BigIndex sizes) const = 0;
 
+	///@brief set_scene for indices[0,n) in turn, calling visit( k, set_scene result ) after each.
+	///@brief one virtual set_scene per index here, StaticCompositeDirector::set_scene_many has none
+	///@brief when called through that type. keep indices with the same scaffold together
+	template< class Visitor >
+	void
+	set_scene_many(
+		BigIndex const * indices,
+		size_t n,
+		int resl,
+		Scene & scene,
+		Visitor const & visit
+	) const {
+		for( size_t k = 0; k < n; ++k ){
+			visit( k, set_scene( indices[k], resl, scene ) );
+		}
+	}
+
 };
 
 inline
@@ -68,6 +88,18 @@ set_nest_size(uint64_t set, RifDockIndex & sizes) {
 	sizes.nest_index = set;
 }
 
+inline
+void
+set_nest_index(uint64_t set, uint64_t & index) {
+	index = set;
+}
+
+template<class RifDockIndex>
+void
+set_nest_index(uint64_t set, RifDockIndex & index) {
+	index.nest_index = set;
+}
+
 inline
 uint64_t
 get_nest_index(uint64_t index) {
@@ -81,6 +113,39 @@ get_nest_index(RifDockIndex index) {
 }
 
 
+template< class T > struct VoidType { typedef void type; };
+
+// nests whose param map has a ValueCache (OriTransMap) keep one per thread, so consecutive
+// set_scene calls only recompute the part of the xform that changed. owner is a unique id of
+// the nest, a new nest never sees an old nest's cache
+inline uint64_t new_nest_cache_id(){
+	static std::atomic<uint64_t> next_id( 1 );
+	return next_id++;
+}
+
+template< class Nest, class Enable = void >
+struct NestStateCache {
+	typedef typename Nest::Index Index;
+	typedef typename Nest::Value Value;
+	static bool get_state( Nest const & nest, uint64_t owner, Index index, Index resl, Value & value ){
+		return nest.get_state( index, resl, value );
+	}
+};
+template< class Nest >
+struct NestStateCache< Nest, typename VoidType< typename Nest::ValueCache >::type > {
+	typedef typename Nest::Index Index;
+	typedef typename Nest::Value Value;
+	static bool get_state( Nest const & nest, uint64_t owner, Index index, Index resl, Value & value ){
+		static thread_local typename Nest::ValueCache cache;
+		static thread_local uint64_t cache_owner = 0;
+		if( cache_owner != owner ){
+			cache = typename Nest::ValueCache();
+			cache_owner = owner;
+		}
+		return nest.get_state_cached( index, resl, value, cache );
+	}
+};
+
 // This class is dumb, if used in a CompositeDirector, it must be first
 template< class _Nest, class _BigIndex >
 struct NestDirector
@@ -99,17 +164,18 @@ struct NestDirector
 
 	Index ibody_;
 	Nest nest_;
+	uint64_t cache_id_;
 
-	NestDirector() : ibody_(0),nest_() {}
-	NestDirector( Index ibody ) : ibody_(ibody),nest_() {}
+	NestDirector() : ibody_(0),nest_(),cache_id_(new_nest_cache_id()) {}
+	NestDirector( Index ibody ) : ibody_(ibody),nest_(),cache_id_(new_nest_cache_id()) {}
 	template<class A>
-	NestDirector( A const & a, Index ibody ) : ibody_(ibody),nest_(a) {}
+	NestDirector( A const & a, Index ibody ) : ibody_(ibody),nest_(a),cache_id_(new_nest_cache_id()) {}
 	template<class A, class B>
-	NestDirector( A const & a, B const & b, Index ibody ) : ibody_(ibody),nest_(a,b) {}
+	NestDirector( A const & a, B const & b, Index ibody ) : ibody_(ibody),nest_(a,b),cache_id_(new_nest_cache_id()) {}
 	template<class A, class B, class C>
-	NestDirector( A const & a, B const & b, C const & c, Index ibody ) : ibody_(ibody),nest_(a,b,c) {}
+	NestDirector( A const & a, B const & b, C const & c, Index ibody ) : ibody_(ibody),nest_(a,b,c),cache_id_(new_nest_cache_id()) {}
 	template<class A, class B, class C, class D>
-	NestDirector( A const & a, B const & b, C const & c, D const & d, Index ibody ) : ibody_(ibody),nest_(a,b,c,d) {}
+	NestDirector( A const & a, B const & b, C const & c, D const & d, Index ibody ) : ibody_(ibody),nest_(a,b,c,d),cache_id_(new_nest_cache_id()) {}
 
 	Nest const & nest() const { return nest_; }
 
@@ -123,7 +189,7 @@ struct NestDirector
 		Position p;
 
 		NestIndex ni = get_nest_index(i);
-		bool success = nest_.get_state( ni, resl, p );
+		bool success = NestStateCache<Nest>::get_state( nest_, cache_id_, ni, resl, p );
 		if( !success ) return false;
 		scene.set_position( ibody_, p );
 		return true;
@@ -373,6 +439,13 @@ std::ostream & operator << ( std::ostream & out, SeedingDirector<Position,Seedin
 
 
 
+// nonzero body tag for a scaffold index, ScaffoldIndex needs depth and member (TreeIndex)
+template< class ScaffoldIndex >
+uint64_t
+scaffold_body_tag( ScaffoldIndex const & si ){
+	return ( (uint64_t)si.depth << 32 | (uint64_t)si.member ) + 1;
+}
+
 // This must be used as part of a CompositeDirector
 template< 
 	class _Position,
@@ -412,7 +485,13 @@ struct ScaffoldDirector
 
 		ScaffoldIndex si = i.scaffold_index;
 
+		// nothing to do if this scaffold is already in the scene. the tag is the index, so a provider
+		// that swaps the conformation under an index (set_fa_mode) needs the scenes' tags cleared
+		uint64_t const tag = scaffold_body_tag( si );
+		if( scene.body_tag( ibody_ ) == tag ) return true;
+
 		scene.replace_body( ibody_, scaffold_provider_->get_scaffold( si ) );
+		scene.set_body_tag( ibody_, tag );
 
 		return true;
 	}
@@ -434,6 +513,91 @@ std::ostream & operator << ( std::ostream & out, ScaffoldDirector<Position,Scaff
 
 
 
+// CompositeDirector with the stage types fixed at compile time: set_scene is one virtual call and
+// the stages are called directly, in order. null stages are skipped, so one type covers the
+// runtime choices (nest, stored nest or identity first, then optional scaffold and seeding)
+template<
+	class _Position,
+	class _RifDockIndex,
+	class... Stages
+>
+struct StaticCompositeDirector
+ : 	public Director<
+ 		_Position,
+ 		_RifDockIndex
+ 	> {
+
+ 	typedef Director< _Position, _RifDockIndex> Base;
+	typedef typename Base::Position Position;
+	typedef typename Base::BigIndex BigIndex;
+	typedef typename Base::Index Index;
+	typedef typename Base::Scene Scene;
+
+	std::tuple< shared_ptr<Stages>... > stages_;
+
+	StaticCompositeDirector( shared_ptr<Stages>... stages ) :
+		stages_( stages... ) {}
+
+	virtual
+	bool
+	set_scene(
+		BigIndex const & i,
+		int resl,
+		Scene & scene
+	) const override {
+		return set_scene_stages<0>( i, resl, scene );
+	}
+
+	// hides Director::set_scene_many, the stages are called directly for every index
+	template< class Visitor >
+	void
+	set_scene_many(
+		BigIndex const * indices,
+		size_t n,
+		int resl,
+		Scene & scene,
+		Visitor const & visit
+	) const {
+		for( size_t k = 0; k < n; ++k ){
+			visit( k, set_scene_stages<0>( indices[k], resl, scene ) );
+		}
+	}
+
+	virtual BigIndex size(int resl, BigIndex sizes) const override {
+		return size_stages<0>( resl, sizes );
+	}
+
+private:
+
+	template< size_t I >
+	typename std::enable_if< I < sizeof...(Stages), bool >::type
+	set_scene_stages( BigIndex const & i, int resl, Scene & scene ) const {
+		typedef typename std::tuple_element< I, std::tuple<Stages...> >::type Stage;
+		Stage const * stage = std::get<I>( stages_ ).get();
+		// qualified call, no virtual dispatch
+		if( stage && ! stage->Stage::set_scene( i, resl, scene ) ) return false;
+		return set_scene_stages<I+1>( i, resl, scene );
+	}
+	template< size_t I >
+	typename std::enable_if< I == sizeof...(Stages), bool >::type
+	set_scene_stages( BigIndex const &, int, Scene & ) const { return true; }
+
+	template< size_t I >
+	typename std::enable_if< I < sizeof...(Stages), BigIndex >::type
+	size_stages( int resl, BigIndex sizes ) const {
+		typedef typename std::tuple_element< I, std::tuple<Stages...> >::type Stage;
+		Stage const * stage = std::get<I>( stages_ ).get();
+		if( stage ) sizes = stage->Stage::size( resl, sizes );
+		return size_stages<I+1>( resl, sizes );
+	}
+	template< size_t I >
+	typename std::enable_if< I == sizeof...(Stages), BigIndex >::type
+	size_stages( int, BigIndex sizes ) const { return sizes; }
+
+};
+
+
+
 class SymElem {};
 
 template<
@@ -426,12 +426,14 @@ namespace impl {
 			bodies_.at(i).replace_conformation(make_shared<ConformationConst>());
 			this->positions_.at(i) = Position::Identity();
 			this->update_symmetry( (Index)bodies_.size() );
+			this->set_body_tag( i, 0 );
 		}
 		// Replaces a body with another one
 		// Does not reset position
 		void replace_body(Index i, shared_ptr<ConformationConst> conformation) {
 			bodies_.at(i).replace_conformation(conformation);
 			this->update_symmetry( (Index)bodies_.size() );
+			this->set_body_tag( i, 0 );
 		}
 		virtual void replace_body( Index ib, shared_ptr<ConformationBase const> cb) {
 			replace_body(ib, std::dynamic_pointer_cast<ConformationConst>(cb));
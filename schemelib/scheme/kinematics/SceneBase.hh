@@ -6,6 +6,7 @@
 #include "scheme/kinematics/ConformationBase.hh"
 
 #include <boost/any.hpp>
+#include <algorithm>
 #include <vector>
 
 namespace scheme {
@@ -24,6 +25,7 @@ struct SceneBase {
 		std::vector<Position> symframes_; // include identity at first position
 		Index n_sym_bodies_, n_bodies_;
 		std::vector<Position> positions_;
+		std::vector<uint64_t> body_tags_; // see body_tag
 
 	SceneBase() : n_bodies_(0), n_sym_bodies_(0), symframes_(1,Position::Identity()) {}
 
@@ -113,6 +115,16 @@ struct SceneBase {
 
 	virtual void replace_body( Index ib, shared_ptr<ConformationBase const> cb) {}
 
+	///@brief directors record what they put in a body here (ScaffoldDirector the scaffold index),
+	///@brief so setting the same thing again can be skipped. 0 means unknown, replace_body resets it
+	uint64_t body_tag( Index ib ) const { return ib < body_tags_.size() ? body_tags_[ib] : 0; }
+	void set_body_tag( Index ib, uint64_t tag ){
+		if( ib >= body_tags_.size() ) body_tags_.resize( ib+1, 0 );
+		body_tags_[ib] = tag;
+	}
+	///@brief for whoever swaps what a tag stands for, e.g. a scaffold's conformation under the same index
+	void clear_body_tags(){ std::fill( body_tags_.begin(), body_tags_.end(), 0 ); }
+
 };
 
 
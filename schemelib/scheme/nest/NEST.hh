@@ -444,6 +444,24 @@ namespace nest {
 			return set_value( index, resl, v );
 		}
 
+		///@brief get_state for param maps with params_to_value_cached (OriTransMap), which can
+		///@brief reuse part of the work from earlier calls with the same cache
+		template< class Cache >
+		bool
+		get_state_cached( Index index, Index resl, Value & value, Cache & cache ) const {
+			assert(resl<=MAX_RESL_ONE_CELL); // not rigerous check if Ncells > 1
+			if(index >= size(resl)) return false;
+			Index cell_index = index >> (DIM*resl);
+			Index hier_index = index & ((ONE<<(DIM*resl))-1);
+			Float scale = 1.0 / Float(ONE<<resl);
+			Params params;
+			for(size_t i = 0; i < DIM; ++i){
+				Index undilated = util::undilate<DIM>(hier_index>>i);
+				params[i] = (static_cast<Float>(undilated) + 0.5 ) * scale;
+			}
+			return this->params_to_value_cached( params, cell_index, resl, value, cache );
+		}
+
 		///////////////////////////////////////
 		//// virtual interface functions
 		///////////////////////////////////////
@@ -10,6 +10,7 @@
 
 #include <boost/static_assert.hpp>
 #include <iostream>
+#include <limits>
 #include <vector>
 
 namespace scheme { namespace nest { namespace pmap {
@@ -94,6 +95,57 @@ namespace scheme { namespace nest { namespace pmap {
 			return true;
 		}
 
+		///@brief orientations params_to_value_cached computed recently. consecutive nest indices
+		///@brief change the orientation params fastest (they are the low z-order bits), so slots
+		///@brief are picked by the low bit of each orientation param: the 64 children of one
+		///@brief parent reuse 8 orientations
+		struct ValueCache {
+			struct Slot {
+				Index cori, resl;
+				Float p[3];
+				bool valid;
+				M m;
+				Slot() : cori( std::numeric_limits<Index>::max() ), resl( 0 ), valid( false ) {}
+			};
+			Slot slots[8];
+			Index nmiss;
+			ValueCache() : nmiss( 0 ) {}
+		};
+
+		///@brief same as params_to_value, but only computes the orientation when it isn't in cache
+		bool params_to_value_cached(
+			Params const & params,
+			Index cell_index,
+			Index resl,
+			Value & value,
+			ValueCache & cache
+		) const {
+			Index const ncori  = ori_map_.num_cells();
+			Index const cori   = cell_index % ncori;
+			Index const ctrans = cell_index / ncori;
+			P3 pori  ( params, 0 ); // offset 0
+			P3 ptrans( params, 3 ); // offset 3
+			Float const scale = (Float)( (Index)1 << resl );
+			int islot = 0;
+			for( int i = 0; i < 3; ++i ) islot |= ( (int64_t)( pori[i] * scale ) & 1 ) << i;
+			typename ValueCache::Slot & slot = cache.slots[islot];
+			if( slot.cori != cori || slot.resl != resl || slot.p[0] != pori[0] || slot.p[1] != pori[1] || slot.p[2] != pori[2] ){
+				slot.valid = ori_map_.params_to_value( pori, cori, resl, slot.m );
+				slot.cori = cori;
+				slot.resl = resl;
+				for( int i = 0; i < 3; ++i ) slot.p[i] = pori[i];
+				++cache.nmiss;
+			}
+			V v;
+			bool valid = trans_map_.params_to_value( ptrans, ctrans, resl, v );
+			if( !valid || !slot.valid ) return false;
+			value = Value( slot.m );
+			value.translation()[0] = v[0];
+			value.translation()[1] = v[1];
+			value.translation()[2] = v[2];
+			return true;
+		}
+
 		///@brief sets params/cell_index from value
 		///@note necessary for value lookup and neighbor lookup
 		bool value_to_params(
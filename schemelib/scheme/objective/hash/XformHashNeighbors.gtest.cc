@@ -538,6 +538,66 @@ TEST( XformHashNeighbors, Quat_BCC7_Zorder_check_general_neighbors ){
 
 
 
+
+TEST( XformHashNeighbors, table_matches_cache_and_roundtrips ){
+	typedef uint64_t Key;
+	typedef XformHash_Quat_BCC7_Zorder<Xform> XH;
+	std::mt19937 rng((unsigned int)time(0) + 3984756);
+	XH xh( Float(1.0), Float(15.0), Float(64.0) );
+	XformHashNeighbors<XH> nb( 2.0, 15.0, xh, 20.0 );
+
+	std::vector<Key> cached, extra;
+	for( int i = 0; i < 20; ++i ){
+		Xform x; numeric::rand_xform( rng, x, Float(32.0) );
+		cached.push_back( xh.get_key( x ) );
+		nb.get_ori_neighbors( cached.back() );
+		numeric::rand_xform( rng, x, Float(32.0) );
+		extra.push_back( xh.get_key( x ) );
+	}
+
+	XformHashNeighborTable<XH> table;
+	table.build( nb, extra );
+	for( Key k : cached ){
+		ASSERT_TRUE( table.contains( k ) );
+		std::vector<Key> const & ref = nb.get_ori_neighbors( k );
+		std::pair<Key const*,Key const*> r = table.get_ori_neighbors( k );
+		ASSERT_EQ( ref, std::vector<Key>( r.first, r.second ) );
+	}
+	for( Key k : extra ){
+		ASSERT_TRUE( table.contains( k ) );
+		std::pair<Key const*,Key const*> r = table.get_ori_neighbors( k );
+		ASSERT_LT( 0, r.second - r.first );
+		ASSERT_TRUE( std::is_sorted( r.first, r.second ) );
+	}
+
+	// the iterator walks the same neighbors as the cache version
+	std::vector<Key> from_cache, from_table;
+	for( auto i = nb.neighbors_begin( cached[0] ); i != nb.neighbors_end( cached[0] ); ++i ) from_cache.push_back( *i );
+	for( auto i = table.neighbors_begin( cached[0] ); i != table.neighbors_end( cached[0] ); ++i ) from_table.push_back( *i );
+	ASSERT_EQ( from_cache, from_table );
+
+	Key missing = 0;
+	for( Xform x; ; ){
+		numeric::rand_xform( rng, x, Float(32.0) );
+		missing = xh.get_key( x );
+		if( !table.contains( missing ) ) break;
+	}
+	ASSERT_THROW( table.get_ori_neighbors( missing ), std::out_of_range );
+
+	std::ostringstream out;
+	ASSERT_TRUE( table.save( out ) );
+	XformHashNeighborTable<XH> loaded;
+	std::istringstream in( out.str() );
+	ASSERT_TRUE( loaded.load( in, nb ) );
+	ASSERT_EQ( table.ori_keys_, loaded.ori_keys_ );
+	ASSERT_EQ( table.offsets_, loaded.offsets_ );
+	ASSERT_EQ( table.nbrs_, loaded.nbrs_ );
+
+	XformHashNeighbors<XH> other( 3.0, 15.0, xh, 20.0 );
+	std::istringstream in2( out.str() );
+	ASSERT_FALSE( loaded.load( in2, other ) );
+}
+
 }}}}
 
 
@@ -13,6 +13,9 @@
 #include <random>
 #include <set>
 #include <map>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/foreach.hpp>
 
@@ -37,16 +40,39 @@ struct XformHashNeighborCrappyIterator : boost::iterator_facade<
 	int i1, i2, i3, ix, iy, iz;
 	bool end;
 	XformHash const * xh;
-	std::vector<uint64_t> const * ori_nbrs_;
+	Key const * ori_nbrs_;
+	size_t n_ori_nbrs_;
 	std::vector< util::SimpleArray<3,int16_t> > const * shifts_;
 	// std::set<Key> seenit_;
 	// google::dense_hash_set<Key> seenit_;
 
 	XformHashNeighborCrappyIterator( XformHashNeighbors<XformHash,UNIQUE> & xhn, Key key, bool _end=false) : 
 		xh( &xhn.hasher_ ),
-		ori_nbrs_( &xhn.get_ori_neighbors( key ) ),
 		shifts_( &xhn.get_cart_shifts() )
 	{
+		std::vector<Key> const & ori_nbrs = xhn.get_ori_neighbors( key );
+		ori_nbrs_ = ori_nbrs.data();
+		n_ori_nbrs_ = ori_nbrs.size();
+		init( key, _end );
+	}
+	/// ori neighbors from somewhere else, like an XformHashNeighborTable
+	XformHashNeighborCrappyIterator(
+		XformHash const & hasher,
+		Key const * ori_nbrs,
+		size_t n_ori_nbrs,
+		std::vector< util::SimpleArray<3,int16_t> > const & shifts,
+		Key key,
+		bool _end=false
+	) :
+		xh( &hasher ),
+		ori_nbrs_( ori_nbrs ),
+		n_ori_nbrs_( n_ori_nbrs ),
+		shifts_( &shifts )
+	{
+		init( key, _end );
+	}
+private:
+	void init( Key key, bool _end ){
 		// if( UNIQUE ) seenit_.set_empty_key( std::numeric_limits<Key>::max() );
 		i1 = i2 = i3 = 0;
 		end = false;
@@ -55,17 +81,16 @@ struct XformHashNeighborCrappyIterator : boost::iterator_facade<
 		iz = (int)((util::undilate<7>( key>>3 ) & 63) | ((key>>43)&127)<<6);
 		end = _end;
 	}
-private:
     friend class boost::iterator_core_access;
     void increment(){
     	++i3;
     	if( i3 == 2                 ){ i3 = 0; ++i2; }
     	if( i2 == shifts_->size()   ){ i2 = 0; ++i1; }
-    	if( i1 == ori_nbrs_->size() ){ end = true; }
+    	if( i1 == n_ori_nbrs_       ){ end = true; }
     }
     Key dereference() const {
     	if( end ) return std::numeric_limits<Key>::max();
-		Key ori_key = (*ori_nbrs_)[i1];
+		Key ori_key = ori_nbrs_[i1];
 		ori_key = xh->cart_shift_key( ori_key, ix, iy, iz );
 		Key k = xh->cart_shift_key( ori_key, (*shifts_)[i2][0], (*shifts_)[i2][1], (*shifts_)[i2][2], i3 );
 		// if( UNIQUE ){
@@ -180,24 +205,12 @@ struct XformHashNeighbors {
 			// TODO: figure out how to get quat key symmetries working
 			if( true ){
 				// std::cout << "get_asym nbrs the hard way, store in " << ori_key << std::endl;
-				std::mt19937 rng((unsigned int)time(0) + 23058704);
-				Xform c = hasher_.get_center(key);
-				// c.translation()[0] = c.translation()[1] = c.translation()[2] = 0;
-				std::set<Key> keys;
-				for(int i = 0; i < nsamp_; ++i){
-					Xform p; numeric::rand_xform_quat(rng,p,cart_bound_,quat_bound_);
-					p.translation()[0] = p.translation()[1] = p.translation()[2] = 0;
-					Key nbkey = hasher_.get_key( p * c ) & XformHash::ORI_MASK;
-					// assert( ( nbkey & ~XformHash::ORI_MASK ) == 0 );
-					keys.insert(nbkey);
-				}
-				assert( keys.size() > 0 );
 				// #ifdef USE_OPENMP
 				// #pragma omp critical
 				// #endif
 				{
-					ori_cache_.insert( std::make_pair( ori_key, std::vector<Key>(keys.size()) ) );
-					std::copy(keys.begin(),keys.end(),ori_cache_[ori_key].begin());
+					std::vector<Key> & nbrs = ori_cache_.insert( std::make_pair( ori_key, std::vector<Key>() ) ).first->second;
+					sample_ori_neighbors( key, nbrs );
 				}
 
 				// std::ofstream out("nbrs_asym.pdb");
@@ -242,6 +255,23 @@ struct XformHashNeighbors {
 		return ori_cache_[ori_key];
 	}
 
+	/// sorted orientation keys within ang_bound of key's orientation, does not touch the cache
+	void sample_ori_neighbors( Key key, std::vector<Key> & nbrs ) const {
+		std::mt19937 rng((unsigned int)time(0) + 23058704);
+		Xform c = hasher_.get_center(key);
+		// c.translation()[0] = c.translation()[1] = c.translation()[2] = 0;
+		std::set<Key> keys;
+		for(int i = 0; i < nsamp_; ++i){
+			Xform p; numeric::rand_xform_quat(rng,p,cart_bound_,quat_bound_);
+			p.translation()[0] = p.translation()[1] = p.translation()[2] = 0;
+			Key nbkey = hasher_.get_key( p * c ) & XformHash::ORI_MASK;
+			// assert( ( nbkey & ~XformHash::ORI_MASK ) == 0 );
+			keys.insert(nbkey);
+		}
+		assert( keys.size() > 0 );
+		nbrs.assign( keys.begin(), keys.end() );
+	}
+
 	void merge( XformHashNeighbors<XformHash,UNIQUE> const & other ){
 		BOOST_FOREACH( typename OriCache::value_type const & v, other.ori_cache_ ){
 			if( ori_cache_.find( v.first ) == ori_cache_.end() ){
@@ -381,6 +411,183 @@ struct XformHashNeighbors {
 };
 
 
+/// read-only, flat version of the XformHashNeighbors orientation cache
+///
+/// orientation keys are sorted in ori_keys_ and the neighbors of ori_keys_[i] are
+/// nbrs_[ offsets_[i] .. offsets_[i+1] ), so a lookup is a binary search and one contiguous
+/// range. nothing is mutated after build/load, so one table can be shared by any number of
+/// threads without locks. every orientation that will be queried must be in the table
+template< class XformHash >
+struct XformHashNeighborTable {
+	typedef typename XformHash::Key Key;
+	typedef typename XformHash::Float Float;
+	typedef XformHashNeighborCrappyIterator<XformHash,false> crappy_iterator;
+
+	XformHash hasher_;
+	Float cart_bound_, ang_bound_;
+	std::vector<Key> ori_keys_;
+	std::vector<uint64_t> offsets_;
+	std::vector<Key> nbrs_;
+	std::vector< util::SimpleArray<3,int16_t> > cart_shifts_;
+
+	XformHashNeighborTable() : cart_bound_(0), ang_bound_(0) {}
+
+	/// everything already in nbcache's orientation cache
+	template< bool UNIQUE >
+	explicit XformHashNeighborTable( XformHashNeighbors<XformHash,UNIQUE> const & nbcache ){
+		build( nbcache, std::vector<Key>() );
+	}
+
+	/// the orientations of keys plus everything in nbcache's cache. orientations nbcache
+	/// doesn't have yet are sampled here, in parallel
+	template< bool UNIQUE >
+	void build( XformHashNeighbors<XformHash,UNIQUE> const & nbcache, std::vector<Key> keys ){
+		typedef typename XformHashNeighbors<XformHash,UNIQUE>::OriCache OriCache;
+		hasher_ = nbcache.hasher_;
+		cart_bound_ = nbcache.cart_bound_;
+		ang_bound_ = nbcache.ang_bound_;
+		cart_shifts_ = nbcache.get_cart_shifts();
+
+		for( Key & k : keys ) k &= XformHash::ORI_MASK;
+		for( typename OriCache::const_iterator i = nbcache.ori_cache_.begin(); i != nbcache.ori_cache_.end(); ++i ){
+			keys.push_back( i->first );
+		}
+		std::sort( keys.begin(), keys.end() );
+		keys.erase( std::unique( keys.begin(), keys.end() ), keys.end() );
+		ori_keys_.swap( keys );
+
+		std::vector< std::vector<Key> > nbrs( ori_keys_.size() );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,16)
+		#endif
+		for( int64_t i = 0; i < (int64_t)ori_keys_.size(); ++i ){
+			typename OriCache::const_iterator cached = nbcache.ori_cache_.find( ori_keys_[i] );
+			if( cached != nbcache.ori_cache_.end() ) nbrs[i] = cached->second;
+			else nbcache.sample_ori_neighbors( ori_keys_[i], nbrs[i] );
+		}
+
+		offsets_.resize( ori_keys_.size() + 1 );
+		offsets_[0] = 0;
+		for( size_t i = 0; i < nbrs.size(); ++i ) offsets_[i+1] = offsets_[i] + nbrs[i].size();
+		nbrs_.resize( offsets_.back() );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(static)
+		#endif
+		for( int64_t i = 0; i < (int64_t)nbrs.size(); ++i ){
+			std::copy( nbrs[i].begin(), nbrs[i].end(), nbrs_.begin() + offsets_[i] );
+		}
+	}
+
+	size_t size() const { return ori_keys_.size(); }
+	size_t num_neighbors() const { return nbrs_.size(); }
+	size_t mem_use() const {
+		return ori_keys_.size()*sizeof(Key) + offsets_.size()*sizeof(uint64_t) + nbrs_.size()*sizeof(Key);
+	}
+
+	bool contains( Key key ) const {
+		return std::binary_search( ori_keys_.begin(), ori_keys_.end(), key & XformHash::ORI_MASK );
+	}
+
+	/// the orientation neighbors of key as [begin,end), throws if key's orientation isn't in the table
+	std::pair<Key const*,Key const*> get_ori_neighbors( Key key ) const {
+		Key ori_key = key & XformHash::ORI_MASK;
+		typename std::vector<Key>::const_iterator i = std::lower_bound( ori_keys_.begin(), ori_keys_.end(), ori_key );
+		if( i == ori_keys_.end() || *i != ori_key ){
+			throw std::out_of_range("XformHashNeighborTable: orientation not in table");
+		}
+		size_t idx = i - ori_keys_.begin();
+		Key const * nbrs = nbrs_.data();
+		return std::make_pair( nbrs + offsets_[idx], nbrs + offsets_[idx+1] );
+	}
+
+	std::vector< util::SimpleArray<3,int16_t> > const & get_cart_shifts() const {
+		return cart_shifts_;
+	}
+
+	crappy_iterator neighbors_begin( Key key ) const {
+		std::pair<Key const*,Key const*> r = get_ori_neighbors( key );
+		return crappy_iterator( hasher_, r.first, r.second-r.first, cart_shifts_, key );
+	}
+	crappy_iterator neighbors_end( Key key ) const {
+		return crappy_iterator( hasher_, nullptr, 0, cart_shifts_, key, true );
+	}
+
+	bool save( std::ostream & out ) const {
+		std::ostringstream oss;
+		oss << std::endl;
+		oss << "=========== description ===========" << std::endl;
+		oss << "Scheme XformHashNeighborTable" << std::endl;
+		oss << "Hasher: " << hasher_.name() << std::endl;
+		oss << "Cart Bound: " << cart_bound_ << std::endl;
+		oss << "Angular Bound: " << ang_bound_ << std::endl;
+		oss << "Orientations: " << ori_keys_.size() << std::endl;
+		oss << "Neighbors: " << nbrs_.size() << std::endl;
+		oss << "=========== begin binary data ===========" << std::endl;
+		size_t s = oss.str().size();
+		out.write( (char*)&s, sizeof(size_t) );
+		out.write( oss.str().c_str(), s );
+		s = hasher_.name().size();
+		out.write( (char*)&s, sizeof(size_t) );
+		out.write( hasher_.name().c_str(), s );
+		out.write( (char*)&hasher_, sizeof(XformHash) );
+		out.write( (char*)&cart_bound_, sizeof(Float) );
+		out.write( (char*)&ang_bound_, sizeof(Float) );
+		s = ori_keys_.size();
+		out.write( (char*)&s, sizeof(size_t) );
+		out.write( (char*)ori_keys_.data(), s*sizeof(Key) );
+		out.write( (char*)offsets_.data(), (s+1)*sizeof(uint64_t) );
+		s = nbrs_.size();
+		out.write( (char*)&s, sizeof(size_t) );
+		out.write( (char*)nbrs_.data(), s*sizeof(Key) );
+		// cart_shifts_ are recomputed from the bounds on load
+		return out.good();
+	}
+
+	/// expected must have the same hasher and bounds as the table that was saved
+	template< bool UNIQUE >
+	bool load( std::istream & in, XformHashNeighbors<XformHash,UNIQUE> const & expected ){
+		size_t s;
+		in.read( (char*)&s, sizeof(size_t) );
+		std::string description( s, ' ' );
+		in.read( &description[0], s );
+		in.read( (char*)&s, sizeof(size_t) );
+		std::string name( s, ' ' );
+		in.read( &name[0], s );
+		if( expected.hasher_.name() != name ){
+			std::cerr << "XformHashNeighborTable::load, hasher type mismatch, expected " << expected.hasher_.name() << " got " << name << std::endl;
+			return false;
+		}
+		in.read( (char*)&hasher_, sizeof(XformHash) );
+		if( hasher_ != expected.hasher_ ){
+			std::cerr << "XformHashNeighborTable::load, hasher mismatch!" << std::endl;
+			return false;
+		}
+		in.read( (char*)&cart_bound_, sizeof(Float) );
+		in.read( (char*)&ang_bound_, sizeof(Float) );
+		if( cart_bound_ != expected.cart_bound_ || ang_bound_ != expected.ang_bound_ ){
+			std::cerr << "XformHashNeighborTable::load, bounds mismatch, expected " << expected.cart_bound_ << " " << expected.ang_bound_
+			          << " got " << cart_bound_ << " " << ang_bound_ << std::endl;
+			return false;
+		}
+		in.read( (char*)&s, sizeof(size_t) );
+		ori_keys_.resize( s );
+		offsets_.resize( s+1 );
+		in.read( (char*)ori_keys_.data(), s*sizeof(Key) );
+		in.read( (char*)offsets_.data(), (s+1)*sizeof(uint64_t) );
+		in.read( (char*)&s, sizeof(size_t) );
+		if( !in.good() || s != offsets_.back() ){
+			std::cerr << "XformHashNeighborTable::load, corrupt neighbor offsets" << std::endl;
+			return false;
+		}
+		nbrs_.resize( s );
+		in.read( (char*)nbrs_.data(), s*sizeof(Key) );
+		cart_shifts_ = expected.get_cart_shifts();
+		return in.good();
+	}
+
+};
+
+
 
 
 }}}
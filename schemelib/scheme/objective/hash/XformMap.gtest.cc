@@ -1,15 +1,21 @@
 #include <gtest/gtest.h>
 
 #include "scheme/objective/hash/XformMap.hh"
+#include "scheme/objective/hash/XformMapLookupCache.hh"
+#include "scheme/objective/hash/XformMapConcurrent.hh"
+#include "scheme/objective/hash/XformMapMerge.hh"
+#include "scheme/util/shared_arena.hh"
 #include "scheme/numeric/rand_xform.hh"
 #include <Eigen/Geometry>
 
 #include <sparsehash/dense_hash_set>
 
+#include <numeric>
 #include <random>
 #include "scheme/util/Timer.hh"
 
 #include <fstream>
+#include <sstream>
 
 namespace scheme { namespace objective { namespace hash { namespace xmtest {
 
@@ -164,6 +170,406 @@ TEST( XformMap, insert_sphere ){
 
 
 
+TEST( XformMap, insert_sphere_table_matches_cache ){
+	typedef XformMap< Xform, double > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 2938475);
+	double lever = 3.0, rad = 2.0;
+	double angrad = rad/lever*180.0/M_PI;
+	XMap xmap_cache( 1.0, 20.0 ), xmap_table( 1.0, 20.0 );
+	XformHashNeighbors< XMap::Hasher > nbcache( rad, angrad, xmap_cache.hasher_, 50.0 );
+
+	std::vector<Xform> xforms( 20 );
+	for( Xform & x : xforms ) numeric::rand_xform( rng, x, 64.0 );
+	for( size_t i = 0; i < xforms.size(); ++i ){
+		xmap_cache.insert_sphere( xforms[i], rad, lever, (double)i, nbcache );
+	}
+
+	XformHashNeighborTable< XMap::Hasher > nbtable( nbcache );
+	ASSERT_EQ( nbtable.size(), nbcache.ori_cache_.size() );
+
+	std::vector<XMap> per_thread( xforms.size(), XMap( 1.0, 20.0 ) );
+	#ifdef USE_OPENMP
+	#pragma omp parallel for schedule(dynamic,1)
+	#endif
+	for( int i = 0; i < (int)xforms.size(); ++i ){
+		per_thread[i].insert_sphere( xforms[i], rad, lever, (double)i, nbtable );
+	}
+	for( XMap const & m : per_thread ){
+		for( auto const & v : m.map_ ) xmap_table.insert( v.first, v.second );
+	}
+
+	ASSERT_EQ( xmap_cache.size(), xmap_table.size() );
+	for( auto const & v : xmap_cache.map_ ){
+		ASSERT_EQ( v.second, xmap_table.map_.find( v.first )->second );
+	}
+}
+
+TEST( XformMap, lookup_cache_matches_map ){
+	typedef XformMap< Xform, double > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 8723465);
+	std::uniform_real_distribution<> runif;
+
+	XMap xmap( 1.0, 15.0 );
+	std::vector<Xform> xforms;
+	for(int i = 0; i < 1000; ++i){
+		Xform x;
+		numeric::rand_xform( rng, x, 20.0 );
+		if( i%2 ) xmap.insert( x, runif(rng) );
+		xforms.push_back( x );
+	}
+
+	XformMapLookupCache< XMap > cache( xmap, 6 );
+	for(int rep = 0; rep < 3; ++rep){
+		for(int i = 0; i < xforms.size(); ++i){
+			XMap::Key k = xmap.get_key( xforms[i] );
+			double const * p = cache.find( k );
+			ASSERT_EQ( p, xmap.find_ptr( k ) );
+			if( p ) ASSERT_EQ( *p, xmap[k] );
+			else    ASSERT_EQ( xmap[k], 0.0 );
+			// immediate repeat always hits
+			uint64_t hits = cache.hits_;
+			ASSERT_EQ( cache.find( k ), p );
+			ASSERT_EQ( cache.hits_, hits+1 );
+		}
+	}
+	ASSERT_EQ( cache.hits_ + cache.misses_, 6000 );
+	ASSERT_GE( cache.hits_, 3000 );
+}
+
+TEST( XformMap, filter_matches_map ){
+	typedef XformMap< Xform, double > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 55123);
+	std::uniform_real_distribution<> runif;
+
+	XMap xmap( 1.0, 15.0 );
+	std::vector<Xform> xforms;
+	for(int i = 0; i < 20000; ++i){
+		Xform x;
+		numeric::rand_xform( rng, x, 20.0 );
+		if( i%4 == 0 ) xmap.insert( x, runif(rng)+0.1 );
+		xforms.push_back( x );
+	}
+	XMap nofilter = xmap;
+	xmap.build_filter( 10.0 );
+	ASSERT_TRUE( xmap.has_filter() );
+	ASSERT_FALSE( nofilter.has_filter() );
+	int nmiss = 0, nfilt = 0;
+	for( Xform const & x : xforms ){
+		XMap::Key k = xmap.get_key( x );
+		ASSERT_EQ( xmap[k], nofilter[k] );
+		ASSERT_EQ( xmap.find_ptr( k ) == nullptr, nofilter.find_ptr( k ) == nullptr );
+		if( !nofilter.find_ptr( k ) ){
+			++nmiss;
+			nfilt += !xmap.filter_.contains( k );
+		}
+	}
+	ASSERT_GT( nmiss, 10000 );
+	ASSERT_GT( nfilt, nmiss * 0.95 ); // ~1% false positives at 10 bits per key
+
+	// inserts after the build stay visible
+	Xform x;
+	numeric::rand_xform( rng, x, 30.0 );
+	xmap.insert( x, 7.0 );
+	ASSERT_EQ( xmap[x], 7.0 );
+
+	// saved after the map, files without one load with no filter
+	std::stringstream with, without;
+	std::string descr;
+	ASSERT_TRUE( xmap.save( with, "with" ) && xmap.save_filter( with ) );
+	ASSERT_TRUE( nofilter.save( without, "without" ) );
+	XMap loaded, loaded_old;
+	ASSERT_TRUE( loaded.load( with, descr ) && loaded.load_filter( with ) );
+	ASSERT_TRUE( loaded_old.load( without, descr ) && loaded_old.load_filter( without ) );
+	ASSERT_TRUE( loaded.has_filter() );
+	ASSERT_FALSE( loaded_old.has_filter() );
+	for( Xform const & x : xforms ){
+		ASSERT_EQ( loaded[x], xmap[x] );
+		ASSERT_EQ( loaded_old[x], nofilter[x] );
+	}
+}
+
+TEST( XformMap, shared_table_matches_map ){
+	typedef XformMap< Xform, double > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 91357);
+	std::uniform_real_distribution<> runif;
+
+	XMap xmap( 1.0, 15.0 );
+	std::vector<Xform> xforms;
+	for(int i = 0; i < 20000; ++i){
+		Xform x;
+		numeric::rand_xform( rng, x, 20.0 );
+		if( i%3 == 0 ) xmap.insert( x, runif(rng)+0.1 );
+		xforms.push_back( x );
+	}
+	xmap.build_filter( 10.0 );
+
+	// through shared memory, as rif_dock_test does it
+	std::string const name = "scheme_test_xmap_" + std::to_string( getpid() );
+	util::SharedArena arena, reader;
+	ASSERT_TRUE( arena.create( name, util::SharedArena::header_bytes() + util::SharedArena::round_up( xmap.shared_bytes() ) ) );
+	void * block = arena.allocate( "xmap", xmap.shared_bytes() );
+	ASSERT_TRUE( block );
+	xmap.export_shared( block );
+	arena.publish();
+	ASSERT_TRUE( reader.attach( name ) );
+	arena.unlink();
+
+	size_t bytes = 0;
+	void const * data = reader.find( "xmap", &bytes );
+	XMap shared;
+	ASSERT_FALSE( shared.attach_shared( data, 64 ) );
+	ASSERT_TRUE( shared.attach_shared( data, bytes ) );
+	ASSERT_TRUE( shared.is_shared() );
+	ASSERT_TRUE( shared.has_filter() );
+	ASSERT_TRUE( shared.map_.empty() );
+	ASSERT_EQ( xmap.size(), shared.size() );
+	ASSERT_EQ( xmap.mem_use(), shared.mem_use() );
+	ASSERT_EQ( xmap.cart_resl_, shared.cart_resl_ );
+	ASSERT_EQ( xmap.ang_resl_, shared.ang_resl_ );
+	for( Xform const & x : xforms ){
+		XMap::Key k = xmap.get_key( x );
+		ASSERT_EQ( shared.get_key( x ), k );
+		ASSERT_EQ( xmap[k], shared[k] );
+		ASSERT_EQ( xmap.find_ptr( k ) == nullptr, shared.find_ptr( k ) == nullptr );
+	}
+	size_t n = 0;
+	double sum = 0, shared_sum = 0;
+	xmap.for_each( [&]( XMap::Key, double v ){ sum += v; } );
+	shared.for_each( [&]( XMap::Key k, double v ){ shared_sum += v; ++n; ASSERT_EQ( xmap[k], v ); } );
+	ASSERT_EQ( xmap.size(), n );
+	ASSERT_EQ( sum, shared_sum );
+
+	// a shared map can be exported again, clear goes back to an empty private map
+	std::vector<uint64_t> again( shared.shared_bytes()/8 + 1 );
+	shared.export_shared( again.data() );
+	XMap twice;
+	ASSERT_TRUE( twice.attach_shared( again.data(), shared.shared_bytes() ) );
+	for( Xform const & x : xforms ) ASSERT_EQ( xmap[x], twice[x] );
+	shared.clear();
+	ASSERT_FALSE( shared.is_shared() );
+	ASSERT_FALSE( shared.has_filter() );
+	ASSERT_EQ( 0, shared.size() );
+}
+
+struct MergeTestValue {
+	double best;
+	int count;
+	MergeTestValue() : best(9e9), count(0) {}
+	MergeTestValue( double v ) : best(v), count(1) {}
+	void merge( MergeTestValue const & o ){ best = std::min( best, o.best ); count += o.count; }
+};
+
+TEST( XformMap, merge_from_finer_matches_serial ){
+	typedef XformMap< Xform, MergeTestValue > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 2134);
+	std::uniform_real_distribution<> runif;
+
+	XMap fine( 0.5, 10.0 );
+	for(int i = 0; i < 20000; ++i){
+		Xform x;
+		numeric::rand_xform( rng, x, 10.0 );
+		fine.insert( x, MergeTestValue( runif(rng) ) );
+	}
+
+	XMap serial( 2.0, 30.0 );
+	for( auto const & v : fine.map_ ){
+		XMap::Key k = serial.get_key( fine.get_center( v.first ) );
+		XMap::Map::iterator iter = serial.map_.find( k );
+		if( iter == serial.map_.end() ) serial.map_.insert( std::make_pair( k, v.second ) );
+		else iter->second.merge( v.second );
+	}
+	ASSERT_LT( serial.size(), fine.size() );
+
+	for( int nparts : { 1, 3, 8 } ){
+		XMap coarse( 2.0, 30.0 );
+		coarse.merge_from_finer( fine, nparts );
+		ASSERT_EQ( coarse.size(), serial.size() );
+		int total = 0;
+		for( auto const & v : serial.map_ ){
+			MergeTestValue const * p = coarse.find_ptr( v.first );
+			ASSERT_TRUE( p != nullptr );
+			ASSERT_EQ( p->best, v.second.best );
+			ASSERT_EQ( p->count, v.second.count );
+			total += p->count;
+		}
+		ASSERT_EQ( total, fine.size() );
+	}
+
+	// bucket ranges cover the map exactly once
+	size_t nb = fine.map_.bucket_count(), count = 0;
+	for( size_t lo = 0; lo < nb; lo += nb/7+1 ){
+		auto range = fine.bucket_range( lo, lo + nb/7+1 );
+		for( auto i = range.first; i != range.second; ++i ) ++count;
+	}
+	ASSERT_EQ( count, fine.size() );
+}
+
+TEST( XformMap, merge_streams_matches_serial ){
+	typedef XformMap< Xform, MergeTestValue > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 9134);
+	std::uniform_real_distribution<> runif;
+
+	// overlapping inputs, same hasher and resolutions
+	int const NIN = 5;
+	std::vector< XMap > inputs( NIN, XMap( 1.0, 15.0 ) );
+	XMap serial( 1.0, 15.0 );
+	for( int iin = 0; iin < NIN; ++iin ){
+		for( int i = 0; i < 5000; ++i ){
+			Xform x;
+			numeric::rand_xform( rng, x, 5.0 );
+			MergeTestValue v( runif(rng) );
+			XMap::Key k = inputs[iin].get_key( x );
+			XMap::Map::iterator iter = inputs[iin].map_.find( k );
+			if( iter == inputs[iin].map_.end() ) inputs[iin].map_.insert( std::make_pair( k, v ) );
+			else iter->second.merge( v );
+			iter = serial.map_.find( k );
+			if( iter == serial.map_.end() ) serial.map_.insert( std::make_pair( k, v ) );
+			else iter->second.merge( v );
+		}
+	}
+	std::vector< std::string > saved( NIN );
+	size_t total_in = 0;
+	for( int iin = 0; iin < NIN; ++iin ){
+		std::ostringstream out;
+		ASSERT_TRUE( inputs[iin].save( out, "input " + std::to_string(iin) ) );
+		saved[iin] = out.str();
+		total_in += inputs[iin].size();
+	}
+	ASSERT_LT( serial.size(), total_in );
+
+	for( size_t buffer_bytes : { (size_t)1, (size_t)10000, (size_t)100000000 } ){
+		XMap merged;
+		XformMapMerger<XMap> merger( merged, buffer_bytes );
+		uint64_t counted = 0;
+		for( int iin = 0; iin < NIN; ++iin ){
+			std::istringstream in( saved[iin] );
+			uint64_t n = 0;
+			ASSERT_TRUE( XformMapMerger<XMap>::count_elements( in, n ) );
+			counted += n;
+		}
+		ASSERT_EQ( total_in, counted );
+		merger.reserve( counted );
+		size_t const reserved_buckets = merged.bucket_count();
+		std::vector< int > ok( NIN, 0 );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1)
+		#endif
+		for( int iin = 0; iin < NIN; ++iin ){
+			std::istringstream in( saved[iin] );
+			std::string description, error;
+			ok[iin] = merger.add_stream( in, description, error );
+		}
+		for( int iin = 0; iin < NIN; ++iin ) ASSERT_TRUE( ok[iin] );
+		merger.finish();
+		ASSERT_EQ( reserved_buckets, merged.bucket_count() ); // merged in place, never rehashed
+		ASSERT_EQ( total_in, merger.num_elements_read() );
+		ASSERT_EQ( 1.0, merged.cart_resl_ );
+		ASSERT_EQ( 15.0, merged.ang_resl_ );
+		ASSERT_EQ( serial.size(), merged.size() );
+		for( auto const & v : serial.map_ ){
+			MergeTestValue const * p = merged.find_ptr( v.first );
+			ASSERT_TRUE( p != nullptr );
+			ASSERT_EQ( p->best, v.second.best );
+			ASSERT_EQ( p->count, v.second.count );
+		}
+	}
+
+	// resolution mismatch and truncated input are errors
+	XMap other( 2.0, 15.0 );
+	other.insert( Xform::Identity(), MergeTestValue( 1.0 ) );
+	std::ostringstream other_out;
+	ASSERT_TRUE( other.save( other_out, "other" ) );
+	XMap merged;
+	XformMapMerger<XMap> merger( merged, 1000 );
+	std::string description, error;
+	std::istringstream in0( saved[0] ), in1( other_out.str() ), in2( saved[1].substr( 0, saved[1].size()/2 ) );
+	ASSERT_TRUE( merger.add_stream( in0, description, error ) );
+	ASSERT_NE( std::string::npos, description.find( "User Description: input 0" ) );
+	ASSERT_FALSE( merger.add_stream( in1, description, error ) );
+	ASSERT_FALSE( merger.add_stream( in2, description, error ) );
+	ASSERT_TRUE( error.size() > 0 );
+}
+
+TEST( XformMap, concurrent_insert_matches_serial ){
+	typedef XformMap< Xform, MergeTestValue > XMap;
+	std::mt19937 rng((unsigned int)time(0) + 71923);
+	std::uniform_real_distribution<> runif;
+
+	// lots of repeated keys, and the table starts small so it grows while threads insert
+	int const N = 200000;
+	std::vector<Xform> xforms( N );
+	std::vector<double> vals( N );
+	for( int i = 0; i < N; ++i ){
+		numeric::rand_xform( rng, xforms[i], 5.0 );
+		vals[i] = runif(rng);
+	}
+	XMap serial( 1.0, 15.0 );
+	for( int i = 0; i < N; ++i ){
+		XMap::Key k = serial.get_key( xforms[i] );
+		XMap::Map::iterator iter = serial.map_.find( k );
+		if( iter == serial.map_.end() ) serial.map_.insert( std::make_pair( k, MergeTestValue( vals[i] ) ) );
+		else iter->second.merge( MergeTestValue( vals[i] ) );
+	}
+
+	XformMapConcurrent<XMap> concurrent( serial, 0, 4 );
+	std::vector<int> nnew( N, 0 );
+	#ifdef USE_OPENMP
+	#pragma omp parallel for schedule(dynamic,64)
+	#endif
+	for( int i = 0; i < N; ++i ){
+		MergeTestValue const v( vals[i] );
+		nnew[i] = concurrent.update( concurrent.hasher_.get_key( xforms[i] ), [&]( MergeTestValue & to, bool is_new ){
+			if( is_new ) to = v;
+			else to.merge( v );
+		} );
+	}
+	ASSERT_EQ( serial.size(), concurrent.size() );
+	ASSERT_EQ( serial.size(), std::accumulate( nnew.begin(), nnew.end(), (size_t)0 ) );
+	ASSERT_GT( concurrent.capacity(), 1024 );
+	for( auto const & v : serial.map_ ){
+		MergeTestValue found;
+		ASSERT_TRUE( concurrent.find( v.first, found ) );
+		ASSERT_EQ( v.second.best, found.best );
+		ASSERT_EQ( v.second.count, found.count );
+	}
+	MergeTestValue notfound;
+	ASSERT_FALSE( concurrent.find( Xform( Eigen::Translation<double,3>( 100, 100, 100 ) ), notfound ) );
+
+	// into a map that already has some of the keys
+	XMap out( 1.0, 15.0 );
+	for( int i = 0; i < 1000; ++i ) out.insert( xforms[i], MergeTestValue( -1.0 ) );
+	size_t const nout = out.size();
+	concurrent.move_into( out );
+	ASSERT_EQ( 0, concurrent.size() );
+	ASSERT_EQ( serial.size(), out.size() );
+	for( auto const & v : serial.map_ ){
+		MergeTestValue const * p = out.find_ptr( v.first );
+		ASSERT_TRUE( p != nullptr );
+		bool const was_in_out = p->best == -1.0;
+		ASSERT_EQ( was_in_out ? -1.0 : v.second.best, p->best );
+		ASSERT_EQ( v.second.count + was_in_out, p->count );
+	}
+
+	// insert_sphere from every thread covers the same bins as one thread on an XformMap
+	typedef XformMap< Xform, double > XMapD;
+	double lever = 3.0, rad = 2.0;
+	double angrad = rad/lever*180.0/M_PI;
+	XMapD xmap( 1.0, 20.0 ), fromconc( 1.0, 20.0 );
+	XformHashNeighbors< XMapD::Hasher > nbcache( rad, angrad, xmap.hasher_, 50.0 );
+	std::vector<Xform> centers( 20 );
+	for( Xform & x : centers ) numeric::rand_xform( rng, x, 64.0 );
+	for( size_t i = 0; i < centers.size(); ++i ) xmap.insert_sphere( centers[i], rad, lever, 1.0, nbcache );
+	XformHashNeighborTable< XMapD::Hasher > nbtable( nbcache );
+	XformMapConcurrent<XMapD> conc( xmap );
+	#ifdef USE_OPENMP
+	#pragma omp parallel for schedule(dynamic,1)
+	#endif
+	for( int i = 0; i < (int)centers.size(); ++i ) conc.insert_sphere( centers[i], rad, lever, 1.0, nbtable );
+	ASSERT_EQ( xmap.size(), conc.size() );
+	conc.move_into( fromconc, []( double & to, double const & from ){ to += from; } );
+	for( auto const & v : xmap.map_ ) ASSERT_EQ( 1.0, fromconc[ v.first ] );
+}
+
 TEST( XformMap, test_bt24_bcc6 ){
 	typedef Eigen::Transform<double,3,Eigen::AffineCompact> EigenXform;
 	typedef scheme::objective::hash::XformMap< EigenXform, double, XformHash_bt24_BCC6 > XMap;
@@ -8,6 +8,8 @@
 #include "scheme/numeric/bcc_lattice.hh"
 #include "scheme/objective/hash/XformHash.hh"
 #include "scheme/objective/hash/XformHashNeighbors.hh"
+#include "scheme/util/numa.hh"
+#include "scheme/util/bloom.hh"
 // #include <riflib/RotamerGenerator.hh>
 // #include <riflib/util.hh>
 
@@ -15,6 +17,8 @@
 
 #include <sparsehash/dense_hash_map>
 
+#include <cstring>
+
 #ifdef USE_OPENMP
 #include <omp.h>
 #endif
@@ -42,6 +46,47 @@ struct XfromMapSerializer {
 };
 
 
+/// calls f(key) for every bin of hasher within lever_bound (plus half a bin) of x in lever space,
+/// the bins insert_sphere fills. returns the number of bins f was called on
+template< class Hasher, class Xform, class Float, class Neighbors, class F >
+int for_keys_in_sphere(
+	Hasher const & hasher,
+	Float cart_resl,
+	Xform const & x,
+	Float lever_bound,
+	Float lever,
+	Neighbors & nbcache,
+	F f
+){
+	Float thresh2 = lever_bound + cart_resl/2.0;
+	thresh2 = thresh2 * thresh2;
+	uint64_t key = hasher.get_key( x );
+	util::SimpleArray<7,Float> x_lever_coord;
+	x_lever_coord[0] = x.translation()[0];
+	x_lever_coord[1] = x.translation()[1];
+	x_lever_coord[2] = x.translation()[2];
+	Eigen::Matrix<Float,3,3> rot;
+	get_transform_rotation( x, rot );
+	Eigen::Quaternion<Float> q(rot);
+	x_lever_coord[3] = q.w() * 2.0 * lever;
+	x_lever_coord[4] = q.x() * 2.0 * lever;
+	x_lever_coord[5] = q.y() * 2.0 * lever;
+	x_lever_coord[6] = q.z() * 2.0 * lever;
+	typename Neighbors::crappy_iterator itr = nbcache.neighbors_begin(key);
+	typename Neighbors::crappy_iterator end = nbcache.neighbors_end(key);
+	int nbcount=0;
+	for( ; itr != end; ++itr){
+		uint64_t nbkey = *itr;
+		util::SimpleArray<7,Float> nb_lever_coord = hasher.lever_coord( nbkey, lever, x_lever_coord );
+		if( (nb_lever_coord-x_lever_coord).squaredNorm() <= thresh2 ){
+			f( nbkey );
+			++nbcount;
+		}
+	}
+	return nbcount;
+}
+
+
 template<
 	class _Xform,
 	// class Value=numeric::FixedPoint<-17>,
@@ -61,21 +106,31 @@ struct XformMap {
 	typedef typename Xform::Scalar Float;
     // typedef util::SimpleArray< (1<<ArrayBits), Value >  ValArray;
     // typedef google::dense_hash_map<Key,ValArray> Map;
-    typedef google::dense_hash_map<Key,Value> Map;
+    // PlacedAllocator: the table goes where the current ScopedMemPlacement says, see util/numa.hh
+    typedef google::dense_hash_map< Key, Value, SPARSEHASH_HASH<Key>, std::equal_to<Key>,
+                                    util::PlacedAllocator< std::pair<Key const,Value> > > Map;
     Hasher hasher_;
     Map map_;
 	ElementSerializer element_serializer_;
     Float cart_resl_, ang_resl_, cart_bound_;
+    // optional prefilter so lookups of empty bins skip the table, see build_filter
+    util::BlockedBloomFilter filter_;
+    // set by attach_shared, a read only table this map doesn't own that lookups use instead of map_
+    typename Map::value_type const * shared_table_;
+    size_t shared_nbuckets_, shared_nkeys_;
 	// #ifdef USE_OPENMP
  //    omp_lock_t insert_lock;
 	// #endif
 
-	XformMap( Float cart_resl=-1.0, Float ang_resl=-1.0, Float cart_bound=512.0 ){
+	XformMap( Float cart_resl=-1.0, Float ang_resl=-1.0, Float cart_bound=512.0 )
+		: shared_table_( nullptr ), shared_nbuckets_( 0 ), shared_nkeys_( 0 )
+	{
 		init( cart_resl, ang_resl, cart_bound );
 	}
 
 	void init( Float cart_resl, Float ang_resl, Float cart_bound=512.0 ){
 		map_.set_empty_key( std::numeric_limits<Key>::max() );
+		detach_shared();
 		cart_resl_ = cart_resl;
 		ang_resl_ = ang_resl;
 		cart_bound_ = cart_bound;
@@ -94,10 +149,12 @@ struct XformMap {
 		// #endif
 	}
 
-	void clear() { map_.clear(); }
+	void clear() { map_.clear(); filter_.clear(); detach_shared(); }
 
 	bool insert( Key k, Value val ){
+		assert( !is_shared() );
 		map_.insert( std::make_pair(k,val) );
+		if( !filter_.empty() ) filter_.insert( k );
 		return true;
 		// Key k0 = k >> ArrayBits;
 		// Key k1 = k & (((Key)1<<ArrayBits)-1);
@@ -115,10 +172,12 @@ struct XformMap {
 		return this->insert( hasher_.get_key( x ), val );
 	}
 	bool insert_min( Xform const & x, Value const & val ){
+		assert( !is_shared() );
 		Key k = hasher_.get_key( x );
 		typename Map::iterator i = map_.find( k );
 		if( i == map_.end() ){
 			map_.insert( std::make_pair(k,val) );
+			if( !filter_.empty() ) filter_.insert( k );
 		} else {
 			i->second = std::min( i->second, val );
 		}
@@ -130,6 +189,11 @@ struct XformMap {
 		// typename Map::const_iterator iter = map_.find(k0);
 		// if( iter == map_.end() ){ return Value(); }
 		// return iter->second[k1];
+		if( !filter_.contains(k) ) return Value();
+		if( shared_table_ ){
+			Value const * v = shared_find( k );
+			return v ? *v : Value();
+		}
 		typename Map::const_iterator iter = map_.find(k);
 		if( iter == map_.end() ){ return Value(); }
 		return iter->second;
@@ -137,6 +201,45 @@ struct XformMap {
 	Value operator[]( Xform const & x ) const {
 		return this->operator[]( hasher_.get_key( x ) );
 	}
+	// pointer to the stored value or nullptr, valid until the map is modified
+	Value const * find_ptr( Key k ) const {
+		if( !filter_.contains(k) ) return nullptr;
+		if( shared_table_ ) return shared_find( k );
+		typename Map::const_iterator iter = map_.find(k);
+		if( iter == map_.end() ){ return nullptr; }
+		return &iter->second;
+	}
+
+	/// membership filter over the keys now in the map, checked by operator[] and find_ptr before the
+	/// table. insert keeps it current, anything writing map_ directly must clear_filter() or rebuild.
+	/// most lookups during search are misses, a miss the filter catches reads one cache line of a
+	/// table that is ~bits_per_key/8 bytes per entry instead of probing the multi-GB map
+	void build_filter( float bits_per_key ){
+		filter_.init( size(), bits_per_key );
+		for_each( [this]( Key k, Value const & ){ filter_.insert( k ); } );
+	}
+	void clear_filter() { filter_.clear(); }
+	bool has_filter() const { return !filter_.empty(); }
+
+	/// the filter goes after the map in rif files, tagged so files without one still load
+	bool save_filter( std::ostream & out ) const {
+		uint64_t const tag = has_filter() ? filter_tag() : 0;
+		out.write( (char*)&tag, sizeof(uint64_t) );
+		return has_filter() ? filter_.save( out ) : out.good();
+	}
+	/// true if there was no filter (end of stream or no tag), false only for a damaged one
+	bool load_filter( std::istream & in ){
+		filter_.clear();
+		uint64_t tag = 0;
+		if( !in.read( (char*)&tag, sizeof(uint64_t) ) || tag != filter_tag() ){
+			in.clear();
+			return true;
+		}
+		if( filter_.load( in ) ) return true;
+		std::cerr << "XformMap::load_filter: damaged filter" << std::endl;
+		filter_.clear();
+		return false;
+	}
 
     Key get_key( Xform const & x ) const {
         return hasher_.get_key(x);
@@ -146,6 +249,90 @@ struct XformMap {
         return hasher_.get_center(k);
     }
 
+	/// buckets [lo,hi) of the hash table as an iterator range, to split a walk over the map
+	/// between threads. relies on dense_hashtable iterators pointing into the bucket array
+	std::pair< typename Map::const_iterator, typename Map::const_iterator >
+	bucket_range( size_t lo, size_t hi ) const {
+		typename Map::const_iterator b = map_.begin();
+		typename Map::const_iterator::pointer table = b.end - map_.bucket_count();
+		hi = std::min( hi, (size_t)map_.bucket_count() );
+		lo = std::min( lo, hi );
+		return std::make_pair(
+			typename Map::const_iterator( b.ht, table+lo, table+hi, true ),
+			typename Map::const_iterator( b.ht, table+hi, table+hi, false ) );
+	}
+
+	/// merge every value of finer into the bin of this map holding its bin center, same as
+	///     for( v : finer.map_ ) (*this)[ get_key( finer.get_center(v.first) ) ].merge( v.second )
+	/// Value must have merge(). the buckets of finer are split into num_parts contiguous ranges,
+	/// each makes one partial map per key shard, then the shards are merged in parallel.
+	/// values landing in one bin are merged in the serial order, so an associative merge gives the same map
+	void merge_from_finer( XformMap const & finer, int num_parts = 0 ){
+		if( num_parts <= 0 ){
+			#ifdef USE_OPENMP
+			num_parts = omp_get_max_threads();
+			#else
+			num_parts = 1;
+			#endif
+		}
+		int const num_shards = num_parts;
+		Key const empty_key = std::numeric_limits<Key>::max();
+		filter_.clear();
+
+		// partial[ipart*num_shards+ishard]
+		std::vector<Map> partial( num_parts * num_shards );
+		for( Map & m : partial ) m.set_empty_key( empty_key );
+
+		size_t const nbuckets = finer.map_.bucket_count();
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(static,1)
+		#endif
+		for( int ipart = 0; ipart < num_parts; ++ipart ){
+			auto range = finer.bucket_range( nbuckets*ipart/num_parts, nbuckets*(ipart+1)/num_parts );
+			for( typename Map::const_iterator i = range.first; i != range.second; ++i ){
+				Key k = hasher_.get_key( finer.hasher_.get_center( i->first ) );
+				Map & m = partial[ ipart*num_shards + shard_of( k, num_shards ) ];
+				typename Map::iterator iter = m.find( k );
+				if( iter == m.end() ) m.insert( std::make_pair( k, i->second ) );
+				else iter->second.merge( i->second );
+			}
+		}
+
+		// fold the later parts of each shard into part 0
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,1)
+		#endif
+		for( int ishard = 0; ishard < num_shards; ++ishard ){
+			Map & to = partial[ ishard ];
+			for( int ipart = 1; ipart < num_parts; ++ipart ){
+				Map & from = partial[ ipart*num_shards + ishard ];
+				for( typename Map::const_iterator i = from.begin(); i != from.end(); ++i ){
+					typename Map::iterator iter = to.find( i->first );
+					if( iter == to.end() ) to.insert( *i );
+					else iter->second.merge( i->second );
+				}
+				Map empty;
+				empty.set_empty_key( empty_key );
+				from.swap( empty );
+			}
+		}
+
+		size_t total = map_.size();
+		for( int ishard = 0; ishard < num_shards; ++ishard ) total += partial[ishard].size();
+		map_.resize( total );
+		for( int ishard = 0; ishard < num_shards; ++ishard ){
+			Map & from = partial[ ishard ];
+			for( typename Map::const_iterator i = from.begin(); i != from.end(); ++i ){
+				typename Map::iterator iter = map_.find( i->first );
+				if( iter == map_.end() ) map_.insert( *i );
+				else iter->second.merge( i->second );
+			}
+			Map empty;
+			empty.set_empty_key( empty_key );
+			from.swap( empty );
+		}
+	}
+
 	int insert_sphere(
 		Xform const & x,
 		Float lever_bound,
@@ -153,53 +340,108 @@ struct XformMap {
 		Value value,
 		XformHashNeighbors<Hasher> & nbcache
 	){
-		Float thresh2 = lever_bound + cart_resl_/2.0;
-		thresh2 = thresh2 * thresh2;
-		Key key = hasher_.get_key( x );
-		util::SimpleArray<7,Float> x_lever_coord;
-		x_lever_coord[0] = x.translation()[0];
-		x_lever_coord[1] = x.translation()[1];
-		x_lever_coord[2] = x.translation()[2];
-		Eigen::Matrix<Float,3,3> rot;
-		get_transform_rotation( x, rot );
-		Eigen::Quaternion<Float> q(rot);
-		x_lever_coord[3] = q.w() * 2.0 * lever;
-		x_lever_coord[4] = q.x() * 2.0 * lever;
-		x_lever_coord[5] = q.y() * 2.0 * lever;
-		x_lever_coord[6] = q.z() * 2.0 * lever;
-		typename XformHashNeighbors<Hasher>::crappy_iterator itr = nbcache.neighbors_begin(key);
-		typename XformHashNeighbors<Hasher>::crappy_iterator end = nbcache.neighbors_end(key);
-		int nbcount=0, count=0;
-
-		for( ; itr != end; ++itr){
-			Key nbkey = *itr;
-			util::SimpleArray<7,Float> nb_lever_coord = hasher_.lever_coord( nbkey, lever, x_lever_coord );
-			// std::cerr << "NB_KEY " << nbkey << " " << (nb_lever_coord-x_lever_coord).norm() << std::endl;
-			// std::cerr << x_lever_coord << std::endl;
-			// std::cerr << nb_lever_coord << std::endl;
-			if( (nb_lever_coord-x_lever_coord).squaredNorm() <= thresh2 ){
-				// #ifdef USE_OPENMP
-				// omp_set_lock( &insert_lock );
-				// #endif
-				{
-					insert( nbkey, value );
-					++nbcount;
-				}
-				// #ifdef USE_OPENMP
-				// omp_unset_lock( &insert_lock );
-				// #endif
-			}
-			++count;
-		}
-		return nbcount;
-		// std::cout << (float)nbcount / count << std::endl;
+		return insert_sphere_impl( x, lever_bound, lever, value, nbcache );
+	}
 
+	/// same as above with a prebuilt table, which can be shared between threads
+	int insert_sphere(
+		Xform const & x,
+		Float lever_bound,
+		Float lever,
+		Value value,
+		XformHashNeighborTable<Hasher> const & nbtable
+	){
+		assert( nbtable.hasher_ == hasher_ );
+		return insert_sphere_impl( x, lever_bound, lever, value, nbtable );
+	}
+
+private:
+	template< class Neighbors >
+	int insert_sphere_impl(
+		Xform const & x,
+		Float lever_bound,
+		Float lever,
+		Value value,
+		Neighbors & nbcache
+	){
+		return for_keys_in_sphere( hasher_, cart_resl_, x, lever_bound, lever, nbcache, [&]( Key nbkey ){ insert( nbkey, value ); } );
 	}
+public:
 
-	size_t size() const { return map_.size(); }//*(1<<ArrayBits); }
+	size_t size() const { return shared_table_ ? shared_nkeys_ : map_.size(); }//*(1<<ArrayBits); }
 	// size_t total_size() const { return map_.size(); }//*(1<<ArrayBits); }
+	size_t bucket_count() const { return shared_table_ ? shared_nbuckets_ : map_.bucket_count(); }
 
-	size_t mem_use() const { return map_.bucket_count()*(sizeof(Key)+sizeof(Value)); } //*sizeof(ValArray); }
+	size_t mem_use() const { return bucket_count()*(sizeof(Key)+sizeof(Value)) + filter_.mem_use(); } //*sizeof(ValArray); }
+
+	/// f( Key, Value const & ) for every entry, of map_ or the shared table
+	template< class F >
+	void for_each( F f ) const {
+		if( !shared_table_ ){
+			for( typename Map::const_iterator i = map_.begin(); i != map_.end(); ++i ) f( i->first, i->second );
+			return;
+		}
+		for( size_t i = 0; i < shared_nbuckets_; ++i ){
+			if( shared_table_[i].first != std::numeric_limits<Key>::max() ) f( shared_table_[i].first, shared_table_[i].second );
+		}
+	}
+
+	/// bytes export_shared writes
+	size_t shared_bytes() const {
+		return SHARED_HEADER_BYTES + round64( bucket_count()*sizeof(typename Map::value_type) ) + filter_.mem_use();
+	}
+	/// copies the hash table and the filter, as laid out in memory, to out (shared_bytes(), 64 byte
+	/// aligned) for attach_shared, e.g. into a util::SharedArena other processes map. the copy is
+	/// bytewise, so Value has to be plain data, as it already is for save
+	void export_shared( void * out ) const {
+		typedef typename Map::value_type value_type;
+		SharedHeader & h = *(SharedHeader*)out;
+		h.magic = shared_magic();
+		h.sizeof_value_type = sizeof(value_type);
+		h.nbuckets = bucket_count();
+		h.nkeys = size();
+		h.filter_blocks = filter_.num_blocks();
+		h.filter_keys = filter_.num_keys();
+		h.cart_resl = cart_resl_;
+		h.ang_resl = ang_resl_;
+		h.cart_bound = cart_bound_;
+		char * p = (char*)out + SHARED_HEADER_BYTES;
+		std::memcpy( p, raw_table(), h.nbuckets*sizeof(value_type) );
+		p += round64( h.nbuckets*sizeof(value_type) );
+		if( h.filter_blocks ) std::memcpy( p, filter_.data(), filter_.mem_use() );
+	}
+	/// lookups (operator[], find_ptr), size and for_each use a table written by export_shared where it
+	/// is, read only, instead of map_, which is emptied. resolutions come from the table. data has to
+	/// stay mapped while this map is used; init, clear and load go back to an empty map_. inserting,
+	/// saving or walking map_ directly isn't supported on a shared map
+	bool attach_shared( void const * data, size_t bytes ){
+		typedef typename Map::value_type value_type;
+		SharedHeader const & h = *(SharedHeader const*)data;
+		if( bytes < SHARED_HEADER_BYTES || h.magic != shared_magic() || h.sizeof_value_type != sizeof(value_type) ){
+			std::cerr << "XformMap::attach_shared: not an exported table of this type" << std::endl;
+			return false;
+		}
+		size_t const table_bytes = round64( h.nbuckets*sizeof(value_type) );
+		if( h.nbuckets == 0 || ( h.nbuckets & (h.nbuckets-1) ) || bytes < SHARED_HEADER_BYTES + table_bytes + h.filter_blocks*sizeof(util::BlockedBloomFilter::Block) ){
+			std::cerr << "XformMap::attach_shared: damaged table" << std::endl;
+			return false;
+		}
+		Map empty;
+		empty.set_empty_key( std::numeric_limits<Key>::max() );
+		map_.swap( empty );
+		cart_resl_ = h.cart_resl;
+		ang_resl_ = h.ang_resl;
+		cart_bound_ = h.cart_bound;
+		hasher_.init( cart_resl_, ang_resl_, cart_bound_ );
+		char const * p = (char const*)data + SHARED_HEADER_BYTES;
+		shared_table_ = (value_type const*)p;
+		shared_nbuckets_ = h.nbuckets;
+		shared_nkeys_ = h.nkeys;
+		filter_.clear();
+		if( h.filter_blocks ) filter_.attach( (util::BlockedBloomFilter::Block const*)( p + table_bytes ), h.filter_blocks, h.filter_keys );
+		return true;
+	}
+	bool is_shared() const { return shared_table_ != nullptr; }
 
 	size_t count( Value val ) const {
 		// int count = 0;
@@ -263,7 +505,9 @@ struct XformMap {
 		}
 		return true;
 	}
-	bool load( std::istream & in, std::string & description ) {
+	/// everything load() reads before the hash table, leaves in at the start of the table.
+	/// see XformMapMerge.hh for reading the table one element at a time
+	bool load_header( std::istream & in, std::string & description ) {
 		// no way to check if the stream was opened binary!
 		// if( ! (in.flags() & std::ios::binary) ){
 		// 	std::cerr << "XformMap::save must be binary ostream" << std::endl;
@@ -310,7 +554,12 @@ struct XformMap {
 		if(  ang_resl_ == -1 )  ang_resl_ =  ang_resl;
 		cart_bound_ = cart_bound;
 		hasher_.init( cart_resl_, ang_resl_, cart_bound_ );
-
+		return in.good();
+	}
+	bool load( std::istream & in, std::string & description ) {
+		filter_.clear();
+		detach_shared();
+		if( ! load_header( in, description ) ) return false;
 		if( ! map_.unserialize( element_serializer_, &in ) ){
 			std::cerr << "XfromMap::load failed to unserialize sparsehash" << std::endl;
 			return false;
@@ -324,6 +573,45 @@ struct XformMap {
 		return load(in,dummy);
 	}
 
+private:
+	static uint64_t filter_tag() { return 0x524946424c4f4f4dull; } // "RIFBLOOM"
+	static uint64_t shared_magic() { return 0x5846534841524544ull; } // "XFSHARED"
+
+	struct SharedHeader {
+		uint64_t magic, sizeof_value_type, nbuckets, nkeys, filter_blocks, filter_keys;
+		Float cart_resl, ang_resl, cart_bound;
+	};
+	static size_t const SHARED_HEADER_BYTES = 128;
+	static_assert( sizeof(SharedHeader) <= SHARED_HEADER_BYTES, "XformMap SharedHeader too big" );
+	static size_t round64( size_t bytes ){ return ( bytes + 63 ) / 64 * 64; }
+
+	void detach_shared(){
+		if( shared_table_ ) filter_.clear();
+		shared_table_ = nullptr;
+		shared_nbuckets_ = shared_nkeys_ = 0;
+	}
+	// the bucket array, see bucket_range
+	typename Map::value_type const * raw_table() const {
+		if( shared_table_ ) return shared_table_;
+		return map_.begin().end - map_.bucket_count();
+	}
+	// dense_hashtable::find_position for a table without deletions: the same hash, mask and
+	// quadratic probe (JUMP_ is num_probes), so it finds keys where map_ put them
+	Value const * shared_find( Key k ) const {
+		size_t const mask = shared_nbuckets_ - 1;
+		size_t i = map_.hash_funct()( k ) & mask;
+		for( size_t nprobe = 1; ; ++nprobe ){
+			Key const kb = shared_table_[i].first;
+			if( kb == k ) return &shared_table_[i].second;
+			if( kb == std::numeric_limits<Key>::max() ) return nullptr;
+			i = ( i + nprobe ) & mask;
+		}
+	}
+	static int shard_of( Key k, int num_shards ){
+		return ( ( k * 0x9E3779B97F4A7C15ull ) >> 32 ) % num_shards;
+	}
+public:
+
 	// void super_print( std::ostream & out, shared_ptr< RotamerIndex > rot_index_p ) const {
 	// 	for(typename Map::const_iterator i = map_.begin(); i != map_.end(); ++i){
 	// 		// out << get_center(i->first).translation().transpose() << std::endl;
@@ -0,0 +1,279 @@
+#ifndef INCLUDED_objective_hash_XformMapConcurrent_HH
+#define INCLUDED_objective_hash_XformMapConcurrent_HH
+
+#include "scheme/objective/hash/XformMap.hh"
+
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace scheme { namespace objective { namespace hash {
+
+/// open addressing table with the hasher and insert api of an XformMap, that any number of threads
+/// can insert into at once. keys are claimed with a CAS, values are changed under a spinlock picked
+/// by slot (striped, so there's no per slot overhead). the table doubles when it's 70% full: inserts
+/// pass through a gate, a counter per stripe of threads, and the thread that grows the table closes
+/// the gate and waits for the counters to drain. everything else is lock free.
+/// build with this, then move_into() an XformMap to save, look up or iterate, the file format is the
+/// XformMap one. move_into and clear must not overlap with inserts
+template< class XMap >
+struct XformMapConcurrent {
+	typedef typename XMap::Key Key;
+	typedef typename XMap::Value Value;
+	typedef typename XMap::Xform Xform;
+	typedef typename XMap::Float Float;
+	typedef typename XMap::Hasher Hasher;
+
+	Hasher hasher_;
+	Float cart_resl_, ang_resl_, cart_bound_;
+
+	/// hasher and resolutions from like, its contents aren't touched
+	XformMapConcurrent( XMap const & like, size_t expected_size = 0, int num_lock_bits = 16 )
+		: hasher_( like.hasher_ ), cart_resl_( like.cart_resl_ ), ang_resl_( like.ang_resl_ ), cart_bound_( like.cart_bound_ ),
+		  locks_( (size_t)1 << num_lock_bits ), gates_( 64 ), resizing_( false )
+	{
+		for( SpinLock & l : locks_ ) l.flag.store( false );
+		for( Gate & g : gates_ ){ g.active.store( 0 ); g.size.store( 0 ); }
+		allocate( capacity_for( expected_size ) );
+	}
+
+	/// keeps the stored value if k is already there, like XformMap::insert. true if k was new
+	bool insert( Key k, Value const & val ){
+		return update( k, [&]( Value & v, bool is_new ){ if( is_new ) v = val; } );
+	}
+	bool insert( Xform const & x, Value const & val ){
+		return insert( hasher_.get_key( x ), val );
+	}
+	bool insert_min( Xform const & x, Value const & val ){
+		return update( hasher_.get_key( x ), [&]( Value & v, bool is_new ){ v = is_new ? val : std::min( v, val ); } );
+	}
+	/// f( Value &, bool is_new ) under the lock for k. the slot holds a default Value when is_new. true if k was new
+	template< class F >
+	bool update( Key k, F f ){
+		assert( k != empty_key() );
+		bool is_new = false;
+		for(;;){
+			Gate & gate = enter();
+			size_t const seen_capacity = capacity_;
+			int const status = update_in_gate( k, f, is_new );
+			leave( gate );
+			if( status == FULL ){ grow( seen_capacity ); continue; }
+			if( status == NEW && needs_grow( gate, seen_capacity ) ) grow( seen_capacity );
+			return is_new;
+		}
+	}
+
+	/// copies the value for k, false if it isn't there
+	bool find( Key k, Value & val ) const {
+		Gate & gate = enter();
+		bool found = false;
+		size_t const mask = capacity_ - 1;
+		for( size_t i = slot_of( k ), n = 0; n <= mask; i = (i+1) & mask, ++n ){
+			Key const cur = keys_[i].load( std::memory_order_acquire );
+			if( cur == empty_key() ) break;
+			if( cur == k ){
+				lock( i );
+				val = values_[i];
+				unlock( i );
+				found = true;
+				break;
+			}
+		}
+		leave( gate );
+		return found;
+	}
+	bool find( Xform const & x, Value & val ) const { return find( hasher_.get_key( x ), val ); }
+
+	/// same bins as XformMap::insert_sphere. nbtable is read only, so every thread can share one
+	int insert_sphere( Xform const & x, Float lever_bound, Float lever, Value value,
+	                   XformHashNeighborTable<Hasher> const & nbtable ){
+		assert( nbtable.hasher_ == hasher_ );
+		return for_keys_in_sphere( hasher_, cart_resl_, x, lever_bound, lever, nbtable, [&]( Key nbkey ){ insert( nbkey, value ); } );
+	}
+
+	/// exact once inserts are done
+	size_t size() const {
+		int64_t n = 0;
+		for( Gate const & g : gates_ ) n += g.size.load( std::memory_order_relaxed );
+		return n;
+	}
+	size_t capacity() const { return capacity_; }
+	size_t mem_use() const { return capacity_ * ( sizeof(Key) + sizeof(Value) ) + locks_.size() * sizeof(SpinLock); }
+
+	/// moves everything into out and empties this. keys out already has are combined with
+	/// merge( Value & in_out, Value const & from_this ). out's bin filter is cleared
+	template< class Merge >
+	void move_into( XMap & out, Merge merge ){
+		assert( out.hasher_ == hasher_ );
+		out.clear_filter();
+		out.map_.resize( out.map_.size() + size() );
+		bool const out_empty = out.map_.empty();
+		for( size_t i = 0; i < capacity_; ++i ){
+			Key const k = keys_[i].load( std::memory_order_relaxed );
+			if( k == empty_key() ) continue;
+			if( out_empty ){
+				out.map_.insert( std::make_pair( k, values_[i] ) );
+				continue;
+			}
+			typename XMap::Map::iterator iter = out.map_.find( k );
+			if( iter == out.map_.end() ) out.map_.insert( std::make_pair( k, values_[i] ) );
+			else merge( iter->second, values_[i] );
+		}
+		clear();
+	}
+	/// with Value::merge
+	void move_into( XMap & out ){
+		move_into( out, []( Value & to, Value const & from ){ to.merge( from ); } );
+	}
+
+	/// back to empty at the initial capacity
+	void clear(){
+		allocate( capacity_for( 0 ) );
+		for( Gate & g : gates_ ) g.size.store( 0 );
+	}
+
+	static Key empty_key() { return std::numeric_limits<Key>::max(); } // same as XformMap
+
+private:
+	enum { FOUND, NEW, FULL };
+	static constexpr double MAX_LOAD = 0.7;
+
+	struct SpinLock { std::atomic<bool> flag; };
+	// own cache line each, threads hash to one by thread id
+	struct Gate {
+		std::atomic<int64_t> active; // inserts in progress
+		std::atomic<int64_t> size;   // keys added through this gate
+		char pad[ 64 - 2*sizeof(std::atomic<int64_t>) ];
+	};
+
+	static size_t capacity_for( size_t n ){
+		size_t cap = 1024;
+		while( cap * MAX_LOAD < n ) cap *= 2;
+		return cap;
+	}
+	static uint64_t mix( uint64_t k ){ // murmur3 finalizer, keys are z-order bits
+		k ^= k >> 33; k *= 0xff51afd7ed558ccdull;
+		k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ull;
+		k ^= k >> 33;
+		return k;
+	}
+	size_t slot_of( Key k ) const { return mix( k ) & ( capacity_ - 1 ); }
+
+	void lock( size_t islot ) const {
+		std::atomic<bool> & f = locks_[ islot & ( locks_.size() - 1 ) ].flag;
+		while( f.exchange( true, std::memory_order_acquire ) ){
+			while( f.load( std::memory_order_relaxed ) ){}
+		}
+	}
+	void unlock( size_t islot ) const {
+		locks_[ islot & ( locks_.size() - 1 ) ].flag.store( false, std::memory_order_release );
+	}
+
+	void allocate( size_t capacity ){
+		capacity_ = capacity;
+		keys_.reset( new std::atomic<Key>[ capacity ] );
+		values_.reset( new Value[ capacity ] );
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(static) if( capacity > (1<<20) && !omp_in_parallel() )
+		#endif
+		for( int64_t i = 0; i < (int64_t)capacity; ++i ) keys_[i].store( empty_key(), std::memory_order_relaxed );
+	}
+
+	// a new key claims an empty slot with the slot's lock held, so whoever finds the key next
+	// waits for f to initialize the value
+	template< class F >
+	int update_in_gate( Key k, F & f, bool & is_new ){
+		size_t const mask = capacity_ - 1;
+		for( size_t i = slot_of( k ), n = 0; n <= mask; i = (i+1) & mask, ++n ){
+			Key cur = keys_[i].load( std::memory_order_acquire );
+			if( cur == empty_key() ){
+				lock( i );
+				if( keys_[i].compare_exchange_strong( cur, k, std::memory_order_acq_rel ) ){
+					f( values_[i], true );
+					unlock( i );
+					is_new = true;
+					return NEW;
+				}
+				unlock( i );
+			}
+			if( cur == k ){
+				lock( i );
+				f( values_[i], false );
+				unlock( i );
+				return FOUND;
+			}
+		}
+		return FULL;
+	}
+
+	Gate & enter() const {
+		static thread_local size_t const thread_hash = std::hash<std::thread::id>()( std::this_thread::get_id() );
+		Gate & g = gates_[ thread_hash % gates_.size() ];
+		for(;;){
+			g.active.fetch_add( 1 );
+			if( ! resizing_.load() ) return g;
+			g.active.fetch_sub( 1 );
+			while( resizing_.load( std::memory_order_relaxed ) ) std::this_thread::yield();
+		}
+	}
+	void leave( Gate & g ) const { g.active.fetch_sub( 1, std::memory_order_release ); }
+
+	// counts the new key, every 64 per gate checks the total
+	bool needs_grow( Gate & g, size_t seen_capacity ){
+		int64_t const n = g.size.fetch_add( 1, std::memory_order_relaxed ) + 1;
+		return n % 64 == 0 && size() > seen_capacity * MAX_LOAD;
+	}
+
+	// grows to twice seen_capacity unless another thread already did
+	void grow( size_t seen_capacity ){
+		bool expected = false;
+		if( ! resizing_.compare_exchange_strong( expected, true ) ){
+			while( resizing_.load( std::memory_order_relaxed ) ) std::this_thread::yield();
+			return;
+		}
+		if( capacity_ == seen_capacity ){
+			for( Gate const & g : gates_ ) while( g.active.load() ) std::this_thread::yield();
+			std::unique_ptr< std::atomic<Key>[] > old_keys( keys_.release() );
+			std::unique_ptr< Value[] > old_values( values_.release() );
+			size_t const old_capacity = capacity_;
+			allocate( 2 * old_capacity );
+			size_t const mask = capacity_ - 1;
+			// keys are unique, so the copy only needs the CAS, no value locks
+			#ifdef USE_OPENMP
+			#pragma omp parallel for schedule(static) if( old_capacity > (1<<20) && !omp_in_parallel() )
+			#endif
+			for( int64_t j = 0; j < (int64_t)old_capacity; ++j ){
+				Key const k = old_keys[j].load( std::memory_order_relaxed );
+				if( k == empty_key() ) continue;
+				for( size_t i = slot_of( k ); ; i = (i+1) & mask ){
+					Key cur = empty_key();
+					if( keys_[i].compare_exchange_strong( cur, k, std::memory_order_relaxed ) ){
+						values_[i] = old_values[j];
+						break;
+					}
+				}
+			}
+		}
+		resizing_.store( false );
+	}
+
+	size_t capacity_;
+	std::unique_ptr< std::atomic<Key>[] > keys_;
+	std::unique_ptr< Value[] > values_;
+	mutable std::vector< SpinLock > locks_;
+	mutable std::vector< Gate > gates_;
+	std::atomic<bool> resizing_;
+};
+
+template< class XMap > constexpr double XformMapConcurrent<XMap>::MAX_LOAD;
+
+}}}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef INCLUDED_objective_hash_XformMapLookupCache_HH
+#define INCLUDED_objective_hash_XformMapLookupCache_HH
+
+#include <vector>
+#include <limits>
+#include <stdint.h>
+#include <cassert>
+
+namespace scheme { namespace objective { namespace hash {
+
+/// small direct-mapped cache in front of XformMap::find_ptr
+/// one per thread, no locking. the map must not be modified while cached pointers are live
+/// neighboring samples tend to hash to the same keys, so this saves the dense_hash_map probe
+template< class XMap >
+struct XformMapLookupCache {
+	typedef typename XMap::Key Key;
+	typedef typename XMap::Value Value;
+
+	struct Slot {
+		Key key;
+		Value const * val;
+	};
+
+	std::vector<Slot> slots_;
+	XMap const * xmap_ = nullptr;
+	int shift_ = 64;
+	uint64_t hits_ = 0, misses_ = 0;
+
+	XformMapLookupCache() {}
+	XformMapLookupCache( XMap const & xmap, int lg_size ) { init( xmap, lg_size ); }
+
+	void init( XMap const & xmap, int lg_size ){
+		assert( lg_size > 0 && lg_size < 32 );
+		xmap_ = &xmap;
+		shift_ = 64 - lg_size;
+		slots_.resize( (size_t)1 << lg_size );
+		invalidate();
+		hits_ = misses_ = 0;
+	}
+
+	// must be called if the map changes
+	void invalidate(){
+		for( auto & s : slots_ ){
+			s.key = std::numeric_limits<Key>::max(); // also the XformMap empty key, never looked up
+			s.val = nullptr;
+		}
+	}
+
+	size_t size() const { return slots_.size(); }
+
+	// returns nullptr if k is not in the map
+	Value const * find( Key k ){
+		Slot & s = slots_[ ( k * 0x9E3779B97F4A7C15ull ) >> shift_ ];
+		if( s.key == k ){
+			++hits_;
+			return s.val;
+		}
+		++misses_;
+		s.key = k;
+		s.val = xmap_->find_ptr( k );
+		return s.val;
+	}
+
+	void reset_counts(){ hits_ = misses_ = 0; }
+
+};
+
+}}}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef INCLUDED_objective_hash_XformMapMerge_HH
+#define INCLUDED_objective_hash_XformMapMerge_HH
+
+#include "scheme/objective/hash/XformMap.hh"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace scheme { namespace objective { namespace hash {
+
+/// reads a saved XformMap one element at a time, without building the table.
+/// the header is read into header_, a default XMap, so resolutions and hasher come from the file
+template< class XMap >
+struct XformMapStreamReader {
+	typedef typename XMap::Key Key;
+	typedef typename XMap::Value Value;
+
+	XMap header_;
+	std::string description_;
+	uint64_t num_buckets_, num_elements_;
+
+	XformMapStreamReader() : num_buckets_(0), num_elements_(0), in_(nullptr), ibucket_(0), bits_(0), nread_(0) {}
+
+	/// reads everything up to the first element. false if this isn't an XMap file
+	bool open( std::istream & in ){
+		in_ = &in;
+		ibucket_ = 0;
+		nread_ = 0;
+		if( ! header_.load_header( in, description_ ) ) return false;
+		uint64_t magic;
+		if( ! read_bigendian( magic, 4 ) || magic != 0x13578642 ) return false;
+		return read_bigendian( num_buckets_, 8 ) && read_bigendian( num_elements_, 8 );
+	}
+
+	/// false at the end of the table or on a read error, check ok() to tell them apart
+	bool next( Key & key, Value & value ){
+		for( ; ibucket_ < num_buckets_; ++ibucket_ ){
+			if( ibucket_ % 8 == 0 && ! in_->read( (char*)&bits_, 1 ) ) return false;
+			if( bits_ & ( 1 << (ibucket_ % 8) ) ){
+				++ibucket_;
+				std::pair< Key const, Value > element;
+				header_.element_serializer_( in_, &element );
+				key = element.first;
+				value = element.second;
+				++nread_;
+				return in_->good();
+			}
+		}
+		return false;
+	}
+
+	bool ok() const { return in_ && !in_->fail() && nread_ == num_elements_; }
+
+private:
+	bool read_bigendian( uint64_t & x, int nbytes ){
+		unsigned char buf[8];
+		if( ! in_->read( (char*)buf, nbytes ) ) return false;
+		x = 0;
+		for( int i = 0; i < nbytes; ++i ) x = ( x << 8 ) | buf[i];
+		return true;
+	}
+	std::istream * in_;
+	uint64_t ibucket_;
+	unsigned char bits_;
+	uint64_t nread_;
+};
+
+
+/// merges any number of saved XformMaps with the same hasher and resolutions into one, with
+/// Value::merge for keys in more than one. add_stream can be called from many threads at once,
+/// each on its own stream. readers stage elements in a buffer and merge a full buffer straight into
+/// the output map under one lock, so there is no second copy of the merged table. call reserve
+/// first with the summed element counts of the inputs (count_elements reads them from the headers)
+/// and the output never rehashes: memory is then that table plus about buffer_bytes of staging.
+/// Value::merge is applied in whatever order the streams arrive, so it should be order independent
+/// (RotamerScores keeps the best N, which is up to ties in score)
+template< class XMap >
+struct XformMapMerger {
+	typedef typename XMap::Key Key;
+	typedef typename XMap::Value Value;
+	typedef typename XMap::Map Map;
+	typedef std::vector< std::pair<Key,Value> > Buffer;
+
+	XformMapMerger( XMap & out, size_t buffer_bytes )
+		: out_( out ), have_header_( false ), num_elements_read_( 0 )
+	{
+		int nthreads = 1;
+		#ifdef USE_OPENMP
+		nthreads = omp_get_max_threads();
+		#endif
+		buffer_size_ = std::max< size_t >( 1, buffer_bytes / sizeof(std::pair<Key,Value>) / nthreads );
+	}
+
+	/// element count in the header of a saved XformMap, without reading the elements
+	static bool count_elements( std::istream & in, uint64_t & num_elements ){
+		XformMapStreamReader<XMap> reader;
+		if( ! reader.open( in ) ) return false;
+		num_elements = reader.num_elements_;
+		return true;
+	}
+
+	/// sizes the output for num_elements, an upper bound like the sum over the inputs, so merging
+	/// never grows it. call before any add_stream
+	void reserve( uint64_t num_elements ){
+		std::lock_guard< std::mutex > lock( map_lock_ );
+		out_.map_.resize( out_.map_.size() + num_elements );
+	}
+
+	/// streams one saved XformMap into the output. the first stream sets the hasher and
+	/// resolutions of the output, later ones must match. description is the stream's own
+	bool add_stream( std::istream & in, std::string & description, std::string & error ){
+		XformMapStreamReader<XMap> reader;
+		{
+			std::lock_guard< std::mutex > lock( header_lock_ );
+			if( have_header_ ){ // so load_header checks them
+				reader.header_.cart_resl_ = out_.cart_resl_;
+				reader.header_.ang_resl_ = out_.ang_resl_;
+			}
+		}
+		if( ! reader.open( in ) ){
+			error = "can't read header, or hasher/resolution mismatch with the first input";
+			return false;
+		}
+		description = reader.description_;
+		{
+			std::lock_guard< std::mutex > lock( header_lock_ );
+			if( ! have_header_ ){
+				out_.cart_resl_ = reader.header_.cart_resl_;
+				out_.ang_resl_ = reader.header_.ang_resl_;
+				out_.cart_bound_ = reader.header_.cart_bound_;
+				out_.hasher_ = reader.header_.hasher_;
+				have_header_ = true;
+			} else if( reader.header_.cart_resl_ != out_.cart_resl_ || reader.header_.ang_resl_ != out_.ang_resl_
+			        || reader.header_.cart_bound_ != out_.cart_bound_ ){
+				std::ostringstream oss;
+				oss << "resolution mismatch, expected cart " << out_.cart_resl_ << " ang " << out_.ang_resl_ << " bound " << out_.cart_bound_
+				    << " got " << reader.header_.cart_resl_ << " " << reader.header_.ang_resl_ << " " << reader.header_.cart_bound_;
+				error = oss.str();
+				return false;
+			}
+		}
+
+		Buffer buffer;
+		buffer.reserve( buffer_size_ );
+		Key key;
+		Value value;
+		while( reader.next( key, value ) ){
+			buffer.push_back( std::make_pair( key, value ) );
+			if( buffer.size() >= buffer_size_ ) flush( buffer );
+		}
+		flush( buffer );
+		if( ! reader.ok() ){
+			std::ostringstream oss;
+			oss << "read error after " << reader.num_elements_ << " expected elements";
+			error = oss.str();
+			return false;
+		}
+		{
+			std::lock_guard< std::mutex > lock( header_lock_ );
+			num_elements_read_ += reader.num_elements_;
+		}
+		return true;
+	}
+
+	/// call once after all add_stream calls returned. the merged bins are already in the output,
+	/// this drops its bin filter, which doesn't know about them
+	void finish(){
+		out_.clear_filter();
+	}
+
+	uint64_t num_elements_read() const { return num_elements_read_; }
+	size_t buffer_size() const { return buffer_size_; }
+
+private:
+	void flush( Buffer & buffer ){
+		std::lock_guard< std::mutex > lock( map_lock_ );
+		Map & m = out_.map_;
+		for( std::pair<Key,Value> const & kv : buffer ){
+			typename Map::iterator iter = m.find( kv.first );
+			if( iter == m.end() ) m.insert( kv );
+			else iter->second.merge( kv.second );
+		}
+		buffer.clear();
+	}
+
+	XMap & out_;
+	std::mutex map_lock_;
+	std::mutex header_lock_;
+	bool have_header_;
+	size_t buffer_size_;
+	uint64_t num_elements_read_;
+};
+
+
+}}}
+
+#endif
@@ -65,7 +65,7 @@ struct TwoBodyTable {
   			tbt->twobody_[ir][jr] = twobody_[ir][jr];
   		}
 		}
-		runtime_assert( check_equal(*tbt));
+		ALWAYS_ASSERT( check_equal(*tbt) );
 		return tbt;
 	}
 
@@ -136,23 +136,6 @@ struct TwoBodyTable {
 			twobody_[ ir ][ jr ][ irl ][ jrl ] += upweight;
 		} 
 	}
-	void
-	restore_edge( int ires, int jres, int irot, int jrot, shared_ptr<TwoBodyTable<Data> const> twob )
-	{
-		int const ir = ires > jres ? ires : jres;
-		int const jr = ires > jres ? jres : ires;
-		if( twobody_[ir][jr].num_elements() > 0 ){
-			int const irotlocal = all2sel_[ires][irot];
-			int const jrotlocal = all2sel_[jres][jrot];
-			if( irotlocal < 0 || jrotlocal < 0 ){
-				return;
-			}
-			// swap if jres > ires
-			int const irl = ires > jres ? irotlocal : jrotlocal;
-			int const jrl = ires > jres ? jrotlocal : irotlocal;
-			twobody_[ ir ][ jr ][ irl ][ jrl ] = twob->twobody_[ ir ][ jr ][ irl ][ jrl ];
-		} 
-	}
 
 
 	// assumes onebody energies have been filled in at this point!
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "scheme/objective/voxel/BrickedVoxelArray.hh"
+
+#include <random>
+#include <sstream>
+
+namespace scheme { namespace objective { namespace voxel { namespace test_bricked {
+
+using std::cout;
+using std::endl;
+
+typedef util::SimpleArray<3,float> F3;
+typedef VoxelArray<3,float,float> VA;
+
+static VA make_field( std::mt19937 & rng ){
+	std::normal_distribution<> rnorm;
+	VA a( F3(-5,-3,-7), F3(6,4,2), F3(0.5,0.6,0.7) );
+	for( size_t i = 0; i < a.num_elements(); ++i ) a.data()[i] = rnorm(rng);
+	a.data()[7] = 1000.0; // one big clash
+	return a;
+}
+
+template< class Bricked >
+static float max_diff( VA const & a, Bricked const & b, std::mt19937 & rng, float clamp_hi ){
+	std::uniform_real_distribution<> runif;
+	float maxdiff = 0;
+	for( int i = 0; i < 100000; ++i ){
+		F3 p( runif(rng)*13-6, runif(rng)*9-4, runif(rng)*11-8 ); // some outside
+		float ref = std::min( clamp_hi, a.at( p ) );
+		maxdiff = std::max( maxdiff, std::fabs( ref - b.at( p ) ) );
+		if( a.at( p ) == 0 ) EXPECT_EQ( 0, b.at( p[0], p[1], p[2] ) ); // outside
+	}
+	return maxdiff;
+}
+
+TEST( BrickedVoxelArray, float_matches_exactly ){
+	std::mt19937 rng((unsigned int)time(0) + 23947);
+	VA a = make_field( rng );
+	BrickedVoxelArray<float,float,2> b( a );
+	BrickedVoxelArray<float,float,3> b8( a );
+	ASSERT_EQ( a.num_elements(), b.num_elements() );
+	ASSERT_EQ( 0, max_diff( a, b, rng, 9e9 ) );
+	ASSERT_EQ( 0, max_diff( a, b8, rng, 9e9 ) );
+	ASSERT_EQ( 0, b.max_error() );
+}
+
+TEST( BrickedVoxelArray, quantized_within_error_bound ){
+	std::mt19937 rng((unsigned int)time(0) + 8734);
+	VA a = make_field( rng );
+
+	BrickedVoxelArray<float,int8_t,2> b8( a, -9e9, 10.0 );
+	BrickedVoxelArray<float,int16_t,2> b16( a, -9e9, 10.0 );
+	cout << b8 << endl;
+	cout << b16 << endl;
+	ASSERT_EQ( 64, (BrickedVoxelArray<float,int8_t,2>::BRICK_SIZE*sizeof(int8_t)) );
+	ASSERT_LT( b8.mem_use(), a.num_elements()*sizeof(float)/2 );
+	ASSERT_LT( b16.max_error(), b8.max_error() );
+	ASSERT_LT( b8.max_error(), 0.05 );
+	ASSERT_LE( max_diff( a, b8 , rng, 10.0 ), b8 .max_error() );
+	ASSERT_LE( max_diff( a, b16, rng, 10.0 ), b16.max_error() );
+
+	// constant bricks are exact
+	VA c( F3(0,0,0), F3(3,3,3), F3(1,1,1) );
+	for( size_t i = 0; i < c.num_elements(); ++i ) c.data()[i] = -2.5;
+	BrickedVoxelArray<float,int8_t,2> bc( c );
+	ASSERT_EQ( 0, bc.scales_[0].step );
+	ASSERT_EQ( -2.5, bc.at( 1.5, 2.5, 0.5 ) );
+}
+
+TEST( BrickedVoxelArray, io ){
+	std::mt19937 rng((unsigned int)time(0) + 2345);
+	VA a = make_field( rng );
+
+	std::ostringstream oss;
+	a.save( oss );
+	BrickedVoxelArray<float,int8_t,2> from_va;
+	std::istringstream iss( oss.str() );
+	from_va.load_voxel_array( iss, -9e9, 10.0 );
+	BrickedVoxelArray<float,int8_t,2> direct( a, -9e9, 10.0 );
+	ASSERT_EQ( direct.data_, from_va.data_ );
+
+	std::ostringstream oss2;
+	direct.save( oss2 );
+	BrickedVoxelArray<float,int8_t,2> loaded;
+	std::istringstream iss2( oss2.str() );
+	loaded.load( iss2 );
+	ASSERT_EQ( direct.data_, loaded.data_ );
+	ASSERT_EQ( direct.max_error(), loaded.max_error() );
+	std::uniform_real_distribution<> runif;
+	for( int i = 0; i < 1000; ++i ){
+		F3 p( runif(rng)*11-5, runif(rng)*7-3, runif(rng)*9-7 );
+		ASSERT_EQ( direct.at( p ), loaded.at( p ) );
+	}
+}
+
+}}}}
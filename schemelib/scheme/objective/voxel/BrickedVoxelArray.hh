@@ -0,0 +1,256 @@
+#ifndef INCLUDED_objective_voxel_BrickedVoxelArray_HH
+#define INCLUDED_objective_voxel_BrickedVoxelArray_HH
+
+#include "scheme/objective/voxel/VoxelArray.hh"
+#include "scheme/util/SimpleArray.hh"
+#include <scheme/util/assert.hh>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace scheme { namespace objective { namespace voxel {
+
+
+/// stored values in a brick decode to offset + step*stored
+template< class Float >
+struct BrickScale {
+	Float offset, step;
+};
+
+/// read-only 3D grid with the same lb_, ub_, cs_ and at() as VoxelArray<3>, stored as
+/// cubic bricks of side 1<<BRICK_BITS. voxels are z-order within a brick and bricks are row major,
+/// so a lookup reads one brick. with BRICK_BITS=2 and int8_t a brick is one 64 byte cache line.
+///
+/// Stored can be float (exact), int16_t or int8_t. integer bricks are quantized with their own
+/// offset and step, and at() is within max_error() (the largest step/2, plus float rounding) of the source value after
+/// clamping to [clamp_lo,clamp_hi]. clamping keeps a few huge clash values from costing the rest
+/// of their brick its resolution
+template< class _Float=float, class _Stored=int8_t, int BRICK_BITS=2 >
+struct BrickedVoxelArray {
+	typedef _Float Float;
+	typedef _Stored Stored;
+	typedef Float Value;
+	typedef BrickedVoxelArray<_Float,_Stored,BRICK_BITS> THIS;
+	typedef util::SimpleArray<3,Float> Bounds;
+	typedef util::SimpleArray<3,size_t> Indices;
+	static int const BRICK_SIDE = 1 << BRICK_BITS;
+	static int const BRICK_SIZE = BRICK_SIDE*BRICK_SIDE*BRICK_SIDE;
+	static bool const QUANTIZED = std::is_integral<Stored>::value;
+
+	Bounds lb_, ub_, cs_;
+	Indices shape_, nbricks_;
+	Float clamp_lo_, clamp_hi_, max_error_;
+	std::vector<Stored> data_;
+	std::vector< BrickScale<Float> > scales_; // empty unless QUANTIZED
+
+	BrickedVoxelArray() : clamp_lo_(-std::numeric_limits<Float>::max()),
+		clamp_hi_(std::numeric_limits<Float>::max()), max_error_(0)
+	{
+		for( int i = 0; i < 3; ++i ) shape_[i] = nbricks_[i] = 0;
+	}
+
+	template< class F, class V >
+	explicit BrickedVoxelArray(
+		VoxelArray<3,F,V> const & source,
+		Float clamp_lo = -std::numeric_limits<Float>::max(),
+		Float clamp_hi =  std::numeric_limits<Float>::max()
+	){
+		init( source, clamp_lo, clamp_hi );
+	}
+
+	template< class F, class V >
+	void init( VoxelArray<3,F,V> const & source, Float clamp_lo, Float clamp_hi ){
+		ALWAYS_ASSERT( clamp_lo <= clamp_hi );
+		for( int i = 0; i < 3; ++i ){
+			lb_[i] = source.lb_[i];
+			ub_[i] = source.ub_[i];
+			cs_[i] = source.cs_[i];
+			shape_[i] = source.shape()[i];
+			nbricks_[i] = ( shape_[i] + BRICK_SIDE - 1 ) >> BRICK_BITS;
+		}
+		clamp_lo_ = clamp_lo;
+		clamp_hi_ = clamp_hi;
+		max_error_ = 0;
+		size_t const nbricks = nbricks_[0]*nbricks_[1]*nbricks_[2];
+		data_.assign( nbricks*BRICK_SIZE, Stored(0) );
+		scales_.clear();
+		if( QUANTIZED ) scales_.resize( nbricks );
+
+		std::vector<Float> brick( BRICK_SIZE );
+		std::vector<bool> inside( BRICK_SIZE );
+		for( size_t bi = 0; bi < nbricks_[0]; ++bi ){
+		for( size_t bj = 0; bj < nbricks_[1]; ++bj ){
+		for( size_t bk = 0; bk < nbricks_[2]; ++bk ){
+			Float lo = std::numeric_limits<Float>::max(), hi = -lo;
+			for( int w = 0; w < BRICK_SIZE; ++w ){
+				size_t i = ( bi << BRICK_BITS ) + unspread( w>>2 );
+				size_t j = ( bj << BRICK_BITS ) + unspread( w>>1 );
+				size_t k = ( bk << BRICK_BITS ) + unspread( w    );
+				inside[w] = i < shape_[0] && j < shape_[1] && k < shape_[2];
+				if( !inside[w] ) continue;
+				Float v = source.data()[ ( i*shape_[1] + j )*shape_[2] + k ]; // c storage order
+				v = std::min( clamp_hi_, std::max( clamp_lo_, v ) );
+				ALWAYS_ASSERT( std::isfinite( v ) );
+				brick[w] = v;
+				lo = std::min( lo, v );
+				hi = std::max( hi, v );
+			}
+			size_t const ibrick = brick_index( bi, bj, bk );
+			Stored * out = &data_[ ibrick*BRICK_SIZE ];
+			if( QUANTIZED ){
+				Float const qmax = std::numeric_limits<Stored>::max();
+				BrickScale<Float> & scale = scales_[ ibrick ];
+				scale.offset = ( lo + hi ) / 2;
+				scale.step = ( hi - lo ) / ( 2*qmax );
+				// plus float rounding in the decode
+				Float const rounding = 4 * std::numeric_limits<Float>::epsilon() * std::max( std::fabs(lo), std::fabs(hi) );
+				max_error_ = std::max( max_error_, scale.step/2 + rounding );
+				for( int w = 0; w < BRICK_SIZE; ++w ){
+					if( !inside[w] || scale.step == 0 ) continue;
+					Float q = std::floor( ( brick[w] - scale.offset ) / scale.step + 0.5 );
+					out[w] = (Stored)std::min( qmax, std::max( -qmax, q ) );
+				}
+			} else {
+				for( int w = 0; w < BRICK_SIZE; ++w ) if( inside[w] ) out[w] = brick[w];
+			}
+		}}}
+	}
+
+	/// same truncation and out of bounds behavior as VoxelArray
+	template< class Floats >
+	Indices floats_to_index( Floats const & f ) const {
+		Indices ind;
+		for( int i = 0; i < 3; ++i ){
+			Float tmp = ( ( f[i] - lb_[i] ) / cs_[i] );
+			ind[i] = tmp;
+		}
+		return ind;
+	}
+
+	Value at( Float f, Float g, Float h ) const {
+		return at_index( floats_to_index( Bounds( f, g, h ) ) );
+	}
+
+	template< class V >
+	Value at( V const & v ) const {
+		return at_index( floats_to_index( Bounds( v[0], v[1], v[2] ) ) );
+	}
+
+	template< class Floats >
+	typename boost::disable_if< boost::is_arithmetic<Floats>, Value >::type
+	operator[]( Floats const & floats ) const { return at_index( floats_to_index( floats ) ); }
+
+	Value at_index( Indices const & idx ) const {
+		if( !( idx[0] < shape_[0] && idx[1] < shape_[1] && idx[2] < shape_[2] ) ) return Value(0);
+		size_t const ibrick = brick_index( idx[0] >> BRICK_BITS, idx[1] >> BRICK_BITS, idx[2] >> BRICK_BITS );
+		int const w = ( spread( idx[0] & MASK ) << 2 ) | ( spread( idx[1] & MASK ) << 1 ) | spread( idx[2] & MASK );
+		Stored const s = data_[ ibrick*BRICK_SIZE + w ];
+		if( QUANTIZED ){
+			BrickScale<Float> const & scale = scales_[ ibrick ];
+			return scale.offset + scale.step * s;
+		}
+		return s;
+	}
+
+	Float max_error() const { return max_error_; }
+	size_t num_elements() const { return shape_[0]*shape_[1]*shape_[2]; }
+	size_t mem_use() const {
+		return data_.size()*sizeof(Stored) + scales_.size()*sizeof(BrickScale<Float>);
+	}
+
+	void save( std::ostream & out ) const {
+		std::string const tag = name();
+		size_t s = tag.size();
+		out.write( (char*)&s, sizeof(size_t) );
+		out.write( tag.c_str(), s );
+		out.write( (char*)&lb_, sizeof(Bounds) );
+		out.write( (char*)&ub_, sizeof(Bounds) );
+		out.write( (char*)&cs_, sizeof(Bounds) );
+		out.write( (char*)&shape_, sizeof(Indices) );
+		out.write( (char*)&clamp_lo_, sizeof(Float) );
+		out.write( (char*)&clamp_hi_, sizeof(Float) );
+		out.write( (char*)&max_error_, sizeof(Float) );
+		out.write( (char*)data_.data(), data_.size()*sizeof(Stored) );
+		out.write( (char*)scales_.data(), scales_.size()*sizeof(BrickScale<Float>) );
+	}
+
+	void load( std::istream & in ){
+		ALWAYS_ASSERT( in.good() );
+		size_t s;
+		in.read( (char*)&s, sizeof(size_t) );
+		ALWAYS_ASSERT( in.good() && s < 1000 );
+		std::string tag( s, ' ' );
+		in.read( &tag[0], s );
+		if( tag != name() ){
+			std::cerr << "BrickedVoxelArray::load, type mismatch, expected " << name() << " got " << tag << std::endl;
+			ALWAYS_ASSERT( tag == name() );
+		}
+		in.read( (char*)&lb_, sizeof(Bounds) );
+		in.read( (char*)&ub_, sizeof(Bounds) );
+		in.read( (char*)&cs_, sizeof(Bounds) );
+		in.read( (char*)&shape_, sizeof(Indices) );
+		in.read( (char*)&clamp_lo_, sizeof(Float) );
+		in.read( (char*)&clamp_hi_, sizeof(Float) );
+		in.read( (char*)&max_error_, sizeof(Float) );
+		ALWAYS_ASSERT( in.good() );
+		for( int i = 0; i < 3; ++i ) nbricks_[i] = ( shape_[i] + BRICK_SIDE - 1 ) >> BRICK_BITS;
+		size_t const nbricks = nbricks_[0]*nbricks_[1]*nbricks_[2];
+		data_.resize( nbricks*BRICK_SIZE );
+		scales_.resize( QUANTIZED ? nbricks : 0 );
+		in.read( (char*)data_.data(), data_.size()*sizeof(Stored) );
+		in.read( (char*)scales_.data(), scales_.size()*sizeof(BrickScale<Float>) );
+		ALWAYS_ASSERT( in.good() );
+	}
+
+	/// read a file written by VoxelArray<3,Float,Float>::save and convert it
+	void load_voxel_array(
+		std::istream & in,
+		Float clamp_lo = -std::numeric_limits<Float>::max(),
+		Float clamp_hi =  std::numeric_limits<Float>::max()
+	){
+		VoxelArray<3,Float,Float> source;
+		source.load( in );
+		init( source, clamp_lo, clamp_hi );
+	}
+
+	static std::string name() {
+		return "BrickedVoxelArray_" + std::to_string( sizeof(Float) ) + "_" + std::to_string( sizeof(Stored) )
+		       + ( QUANTIZED ? "i" : "f" ) + "_" + std::to_string( BRICK_BITS );
+	}
+
+private:
+	static size_t const MASK = BRICK_SIDE - 1;
+
+	size_t brick_index( size_t bi, size_t bj, size_t bk ) const {
+		return ( bi*nbricks_[1] + bj )*nbricks_[2] + bk;
+	}
+	// abc -> a00b00c
+	static int spread( size_t x ){
+		int r = 0;
+		for( int b = 0; b < BRICK_BITS; ++b ) r |= ( ( x >> b ) & 1 ) << ( 3*b );
+		return r;
+	}
+	// a00b00c -> abc
+	static size_t unspread( int w ){
+		size_t r = 0;
+		for( int b = 0; b < BRICK_BITS; ++b ) r |= (size_t)( ( w >> ( 3*b ) ) & 1 ) << b;
+		return r;
+	}
+};
+
+template< class F, class S, int B >
+std::ostream & operator << ( std::ostream & out, BrickedVoxelArray<F,S,B> const & v ){
+	out << "BrickedVoxelArray( lb: " << v.lb_ << " ub: " << v.ub_ << " cs: " << v.cs_ << " nelem: " << v.num_elements()
+	    << " sizeof_val: " << sizeof(S) << " brick: " << BrickedVoxelArray<F,S,B>::BRICK_SIDE
+	    << " max_error: " << v.max_error() << " mem: " << v.mem_use() << " )";
+	return out;
+}
+
+}}}
+
+#endif
@@ -2,8 +2,11 @@
 
 #include "scheme/objective/voxel/VoxelArray.hh"
 #include "scheme/io/cache.hh"
+#include "scheme/util/shared_arena.hh"
 
 #include <random>
+#include <string>
+#include <unistd.h>
 #include <boost/foreach.hpp>
 
 
@@ -91,5 +94,41 @@ TEST(VoxelArray,io){
 
 }
 
+TEST(VoxelArray,attach_view_maps_arena_in_place){
+	typedef VoxelArray<3,float,float> VA;
+	VA a( -3, 4, 0.7 );
+	for(size_t i = 0; i < a.num_elements(); ++i) a.data()[i] = i*0.25;
+
+	std::string const name = "scheme_test_voxel_view_" + std::to_string( getpid() );
+	util::SharedArena arena;
+	ASSERT_TRUE( arena.create( name, util::SharedArena::header_bytes() + util::SharedArena::round_up( a.num_elements()*sizeof(float) ) ) );
+	float * out = (float*)arena.allocate( "grid", a.num_elements()*sizeof(float) );
+	ASSERT_TRUE( out );
+	std::copy( a.data(), a.data() + a.num_elements(), out );
+	arena.publish();
+
+	util::SharedArena reader;
+	ASSERT_TRUE( reader.attach( name ) );
+	float const * in = (float const*)reader.find( "grid" );
+	ASSERT_TRUE( in );
+	VA::Indices extents;
+	for(int k = 0; k < 3; ++k) extents[k] = a.shape()[k];
+	VA b( -3, 4, 0.7 ); // owns memory before, attach_view drops it
+	b.attach_view( in, extents );
+	ASSERT_EQ( in, b.data() );
+	ASSERT_EQ( a.num_elements(), b.num_elements() );
+	ASSERT_EQ( a, b );
+	ASSERT_EQ( a.at( 1.1, -2.0, 3.3 ), b.at( 1.1, -2.0, 3.3 ) );
+
+	VA c( b ); // copies are deep
+	ASSERT_NE( in, c.data() );
+	ASSERT_EQ( a, c );
+	b.resize( extents ); // owns a copy again
+	ASSERT_NE( in, b.data() );
+	ASSERT_EQ( a, b );
+
+	ASSERT_TRUE( arena.unlink() );
+}
+
 
 }}}}
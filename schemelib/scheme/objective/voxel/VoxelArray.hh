@@ -38,6 +38,15 @@ struct VoxelArray : boost::multi_array<_Value,_DIM> {
 		this->resize(extents+Indices(1)); // pad by one
 	}
 
+	// multi_array copies from the memory it allocated itself, which isn't the data of a view
+	VoxelArray( THIS const & o ) : BASE(), lb_(o.lb_), ub_(o.ub_), cs_(o.cs_) { copy_values( o ); }
+	THIS & operator=( THIS const & o ){
+		if( &o == this ) return *this;
+		lb_ = o.lb_; ub_ = o.ub_; cs_ = o.cs_;
+		copy_values( o );
+		return *this;
+	}
+
 	template<class Floats> Indices floats_to_index(Floats const & f) const {
 		Indices ind;
 		for(int i = 0; i < DIM; ++i){
@@ -93,6 +102,16 @@ struct VoxelArray : boost::multi_array<_Value,_DIM> {
 	// 	in.read( (char*)&cs_, sizeof(Bounds) );
 	// 	in.read( (char*)this->data(), this->num_elements()*sizeof(Float) );
 	// }
+	/// this becomes a read only view of extents values at data, e.g. a grid in a util::SharedArena,
+	/// instead of a copy, like XformMap::attach_shared. data isn't owned and has to stay mapped while
+	/// this is used. copies of a view are ordinary arrays; resize, load or assigning to it make it one
+	/// again. writing through a view isn't supported
+	void attach_view( Value const * data, Indices const & extents ){
+		this->resize( Indices(0) ); // frees what this owned, multi_array only frees its own allocation
+		this->init_multi_array_ref( extents.begin() );
+		this->set_base_ptr( const_cast<Value*>( data ) );
+	}
+
 	bool operator==(THIS const & o) const {
 		return lb_==o.lb_ && ub_==o.ub_ && cs_==o.cs_ && (BASE const &)o == (BASE const &)*this;
 	}
@@ -151,6 +170,15 @@ struct VoxelArray : boost::multi_array<_Value,_DIM> {
     }
     // BOOST_SERIALIZATION_SPLIT_MEMBER()
 
+private:
+	void copy_values( THIS const & o ){
+		Indices extents;
+		for(size_t i = 0; i < DIM; ++i) extents[i] = o.shape()[i];
+		this->resize( Indices(0) ); // resize would keep this's values, and read them from a view
+		this->resize( extents );
+		std::copy( o.data(), o.data() + o.num_elements(), this->data() );
+	}
+
 };
 
 template< size_t D, class F, class V >
@@ -2,6 +2,8 @@
 
 #include <scheme/search/HackPack.hh>
 
+#include <tuple>
+
 
 namespace scheme { namespace search { namespace hptest {
 
@@ -20,4 +22,69 @@ TEST( HackPack, create_empty_packer ){
 
 }
 
+TEST( HackPack, twobody_overlay_matches_upweight_edge ){
+	typedef ::scheme::objective::storage::TwoBodyTable<float> TBT;
+	int const nres = 4, nrot = 6;
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> runif(-1,1);
+
+	shared_ptr<TBT> twob = make_shared<TBT>( nres, nrot );
+	for( int ir = 0; ir < nres; ++ir ) for( int irot = 0; irot < nrot; ++irot ){
+		twob->set_onebody( ir, irot, irot == 4 ? 100.0 : runif(rng) ); // rot 4 filtered out
+	}
+	twob->init_onebody_filter( 10.0 );
+	for( int ir = 0; ir < nres; ++ir ) for( int jr = 0; jr < ir; ++jr ){
+		if( ir == 3 && jr == 0 ) continue; // no edge, overlay terms here must be dropped
+		twob->init_twobody( ir, jr );
+		for( int k = 0; k < twob->twobody_[ir][jr].num_elements(); ++k ) twob->twobody_[ir][jr].data()[k] = runif(rng);
+	}
+
+	// ires, jres, irot, jrot, e
+	std::vector< std::tuple<int,int,int,int,float> > terms {
+		std::make_tuple( 0, 1, 2, 3, 1.5f ),
+		std::make_tuple( 2, 1, 0, 3, -0.7f ),
+		std::make_tuple( 1, 2, 3, 0, 0.4f ), // same pair again, other order
+		std::make_tuple( 3, 0, 1, 1, 2.0f ), // no edge
+		std::make_tuple( 2, 3, 4, 1, 3.0f ), // filtered rotamer
+		std::make_tuple( 3, 2, 5, 5, -1.1f ),
+		std::make_tuple( 0, 2, 0, 0, 0.9f ),
+	};
+	shared_ptr<TBT> upweighted = twob->clone();
+	HackPack ref( HackPackOpts(), 0 ), overlay( HackPackOpts(), 0 );
+	ref.reinitialize( upweighted );
+	overlay.reinitialize( twob );
+	for( auto const & t : terms ){
+		upweighted->upweight_edge( std::get<0>(t), std::get<1>(t), std::get<2>(t), std::get<3>(t), std::get<4>(t) );
+		overlay.add_twobody_overlay( std::get<0>(t), std::get<1>(t), std::get<2>(t), std::get<3>(t), std::get<4>(t) );
+	}
+	ASSERT_EQ( 5, overlay.overlay_terms_.size() );
+	for( int ir = 0; ir < nres; ++ir ) for( int irot = 0; irot < nrot; ++irot ){
+		ref.add_tmp_rot( ir, irot, twob->onebody(ir,irot) );
+		overlay.add_tmp_rot( ir, irot, twob->onebody(ir,irot) );
+	}
+	overlay.resolve_overlay();
+
+	std::vector<int32_t> rots( nres, 0 );
+	for( int iter = 0; iter < 1000; ++iter ){
+		for( int ir = 0; ir < nres; ++ir ) rots[ir] = ref.randrot( ir );
+		ASSERT_NEAR( ref.compute_energy_full( rots ), overlay.compute_energy_full( rots ), 1e-4 );
+		int32_t ilres = ref.randres(), ilrot = ref.randrot( ilres );
+		ASSERT_NEAR( ref.compute_energy_delta( rots, ilres, ilrot ), overlay.compute_energy_delta( rots, ilres, ilrot ), 1e-4 );
+	}
+
+	// the shared table is untouched and packing gives the same answer
+	for( int ir = 0; ir < nres; ++ir ) for( int jr = 0; jr < ir; ++jr ){
+		ASSERT_EQ( twob->twobody_[ir][jr].num_elements(), upweighted->twobody_[ir][jr].num_elements() );
+	}
+	ASSERT_FALSE( twob->check_equal( *upweighted ) );
+	std::vector<std::pair<int32_t,int32_t> > ref_result, overlay_result;
+	float ref_score = ref.pack( ref_result );
+	float overlay_score = overlay.pack( overlay_result );
+	ASSERT_NEAR( ref.compute_energy_full( overlay.global_best_rots_ ), overlay_score, 1e-4 );
+	ASSERT_NEAR( overlay.compute_energy_full( ref.global_best_rots_ ), ref_score, 1e-4 );
+
+	overlay.reinitialize( twob );
+	ASSERT_EQ( 0, overlay.overlay_terms_.size() );
+}
+
 }}}
@@ -75,6 +75,15 @@ std::ostream & operator<<( std::ostream & out, HackPackOpts const & hpo ){
 	return out;
 }
 
+// extra twobody energy on top of the shared TwoBodyTable, valid for one pack
+struct TwobodyOverlayTerm
+{
+	int32_t ires, jres, irot, jrot; // iresglobal/jresglobal + irottwob when added, ireslocal/irotlocal once resolved
+	float e;
+	TwobodyOverlayTerm( int32_t ires, int32_t jres, int32_t irot, int32_t jrot, float e )
+		: ires(ires), jres(jres), irot(irot), jrot(jrot), e(e) {}
+};
+
 struct HackPack
 {
 	typedef std::pair<int32_t,float> RotInfo;
@@ -84,7 +93,10 @@ struct HackPack
 	std::vector< std::pair<int32_t,int32_t> > rot_list_; // list of ireslocal / irotlocal pairs
 	std::vector< int32_t > current_rots_, trial_best_rots_, global_best_rots_; // current rotamer in local numbering
 	std::mt19937 rng;
-	shared_ptr<::scheme::objective::storage::TwoBodyTable<float>> twob_; 
+	shared_ptr<::scheme::objective::storage::TwoBodyTable<float> const> twob_; // shared between threads, never modified
+	std::vector< TwobodyOverlayTerm > overlay_terms_; // as added, in twob_ numbering
+	std::vector< int32_t > overlay_rot_offset_; // ireslocal -> first index in overlay_
+	std::vector< std::vector< TwobodyOverlayTerm > > overlay_; // per local rotamer, other side in jres/jrot
 	float score_, trial_best_score_, global_best_score_;
 	HackPackOpts opts_;
 	int32_t default_rot_num_;
@@ -102,7 +114,7 @@ struct HackPack
 	{}
 
 	void reinitialize(
-		shared_ptr<::scheme::objective::storage::TwoBodyTable<float> > twob ){
+		shared_ptr<::scheme::objective::storage::TwoBodyTable<float> const> twob ){
 
 		// Brian
 
@@ -123,6 +135,58 @@ struct HackPack
 			rotinfos.second.clear();
 		}
 		nres_ = 0;
+		overlay_terms_.clear();
+		overlay_rot_offset_.clear();
+	}
+
+	// adds e to the ires/jres irotglobal/jrotglobal pair for the next pack only, in place of
+	// TwoBodyTable::upweight_edge. same rules: dropped unless both rotamers pass the onebody
+	// filter and the edge has a twobody table. call any time between reinitialize and pack
+	template< class Int >
+	void add_twobody_overlay( int const & ires, int const & jres, Int const & irotglobal, Int const & jrotglobal, float const & e )
+	{
+		ALWAYS_ASSERT( 0 <= ires && ires < twob_->all2sel_.shape()[0] );
+		ALWAYS_ASSERT( 0 <= jres && jres < twob_->all2sel_.shape()[0] );
+		ALWAYS_ASSERT( 0 <= irotglobal && irotglobal < twob_->all2sel_.shape()[1] );
+		ALWAYS_ASSERT( 0 <= jrotglobal && jrotglobal < twob_->all2sel_.shape()[1] );
+		int const ir = ires > jres ? ires : jres;
+		int const jr = ires > jres ? jres : ires;
+		if( twob_->twobody_[ir][jr].num_elements() == 0 ) return;
+		int32_t const irottwob = twob_->all2sel_[ires][irotglobal];
+		int32_t const jrottwob = twob_->all2sel_[jres][jrotglobal];
+		if( irottwob < 0 || jrottwob < 0 ) return;
+		overlay_terms_.push_back( TwobodyOverlayTerm( ires, jres, irottwob, jrottwob, e ) );
+	}
+
+	// overlay_terms_ -> overlay_, both directions, every local copy of each rotamer
+	void resolve_overlay()
+	{
+		overlay_rot_offset_.resize( nres_+1 );
+		overlay_rot_offset_[0] = 0;
+		for( int ilres = 0; ilres < nres_; ++ilres ){
+			overlay_rot_offset_[ilres+1] = overlay_rot_offset_[ilres] + res_rots_.at(ilres).second.size();
+		}
+		if( overlay_.size() < overlay_rot_offset_[nres_] ) overlay_.resize( overlay_rot_offset_[nres_] );
+		for( int k = 0; k < overlay_rot_offset_[nres_]; ++k ) overlay_[k].clear();
+
+		for( TwobodyOverlayTerm const & term : overlay_terms_ ){
+			for( int ilres = 0; ilres < nres_; ++ilres ){
+				if( res_rots_[ilres].first != term.ires ) continue;
+				for( int jlres = 0; jlres < nres_; ++jlres ){
+					if( res_rots_[jlres].first != term.jres ) continue;
+					std::vector< RotInfo > const & irots = res_rots_[ilres].second;
+					std::vector< RotInfo > const & jrots = res_rots_[jlres].second;
+					for( int ilrot = 0; ilrot < irots.size(); ++ilrot ){
+						if( irots[ilrot].first != term.irot ) continue;
+						for( int jlrot = 0; jlrot < jrots.size(); ++jlrot ){
+							if( jrots[jlrot].first != term.jrot ) continue;
+							overlay_[ overlay_rot_offset_[ilres] + ilrot ].push_back( TwobodyOverlayTerm( ilres, jlres, ilrot, jlrot, term.e ) );
+							overlay_[ overlay_rot_offset_[jlres] + jlrot ].push_back( TwobodyOverlayTerm( jlres, ilres, jlrot, ilrot, term.e ) );
+						}
+					}
+				}
+			}
+		}
 	}
 	template< class Int >
 	bool using_rotamer( Int const & ires, Int const & irotglobal )
@@ -220,6 +284,10 @@ struct HackPack
 					//           << rot_index_.resname(jrotglobal) << I(3,jrottwob) << " "
 					//           << F(7,3,twobodye) << std::endl;
 			}
+			if( overlay_rot_offset_.empty() ) continue;
+			for( TwobodyOverlayTerm const & term : overlay_.at( overlay_rot_offset_.at(ires) + irotlocal ) ){
+				if( term.jres < ires && rots.at(term.jres) == term.jrot ) score += term.e;
+			}
 		}
 		return score;
 	}
@@ -257,6 +325,14 @@ struct HackPack
 			//           << " e " << F(7,3,twobodyeold)  << " " << F(7,3,twobodyenew)
 			//           << std::endl;
 		}
+		if( ! overlay_rot_offset_.empty() ){
+			for( TwobodyOverlayTerm const & term : overlay_.at( overlay_rot_offset_.at(ilres) + ilrotold ) ){
+				if( rots.at(term.jres) == term.jrot ) delta -= term.e;
+			}
+			for( TwobodyOverlayTerm const & term : overlay_.at( overlay_rot_offset_.at(ilres) + ilrotnew ) ){
+				if( rots.at(term.jres) == term.jrot ) delta += term.e;
+			}
+		}
 		if( -123460.0 > delta || delta > 123460.0 ){ // 10x energy cap per-rottable entry
 			bool throwerr = false;
 			#ifdef USE_OPENMP
@@ -409,6 +485,8 @@ struct HackPack
 			assert( res_rots_.at(i).second.size() > 0 );
 		}
 
+		if( ! overlay_terms_.empty() ) resolve_overlay();
+
 		assign_initial_rots();
 
 		uint64_t nchoices = 1;
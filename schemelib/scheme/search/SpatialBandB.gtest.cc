@@ -10,6 +10,9 @@
 
 #include <boost/mpl/vector.hpp>
 
+#include <algorithm>
+#include <random>
+
 namespace scheme { namespace search { namespace spbbtest {
 
 using std::cout;
@@ -138,4 +141,139 @@ TEST( SpatialBandB, test_test_utils ){
 
 }
 
+TEST( SpatialBandB, finds_best_leaves_with_exact_bounds ){
+	// 1D hierarchy, 2 children per node, leaves at resl 10
+	int const max_resl = 10;
+	uint64_t const nroots = 8;
+	uint64_t const nleaves = nroots << max_resl;
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<> runif;
+	std::vector<float> leaf( nleaves );
+	for( uint64_t i = 0; i < nleaves; ++i ){
+		float x = (float)i / nleaves;
+		leaf[i] = (x-0.37)*(x-0.37) + 0.3*(x-0.8)*(x-0.8)*(x<0.5?1:0) - 1.0 + 0.01*runif(rng);
+	}
+	// min over the leaves under a cell is an admissible (and tight) bound
+	auto bound = [&]( uint64_t i, int resl ) -> float {
+		uint64_t w = (uint64_t)1 << ( max_resl - resl );
+		return *std::min_element( leaf.begin() + i*w, leaf.begin() + (i+1)*w );
+	};
+
+	SpatialBandB<Xform> bandb;
+	bandb.opts_.max_resl = max_resl;
+	bandb.opts_.children_per_node = 2;
+	bandb.opts_.num_results = 10;
+	bandb.opts_.batch_size = 4;
+	std::vector<uint64_t> roots;
+	for( uint64_t i = 0; i < nroots; ++i ) roots.push_back( i );
+
+	auto result = bandb.search( roots, 0, bound );
+
+	std::vector<float> sorted = leaf;
+	std::sort( sorted.begin(), sorted.end() );
+	ASSERT_EQ( result->results.size(), 10 );
+	for( int i = 0; i < 10; ++i ){
+		ASSERT_EQ( result->results[i].first, sorted[i] );
+		ASSERT_EQ( leaf[ result->results[i].second ], sorted[i] );
+	}
+	ASSERT_TRUE( result->exact );
+	ASSERT_LT( result->bounds_evaluated, nleaves / 4 );
+}
+
+// nest index plus another dimension, like RifDockIndex
+struct TestBigIndex {
+	typedef uint64_t NestIndex;
+	uint64_t nest_index = 0;
+	uint64_t member = 0;
+};
+
+// 1D hierarchy on body 0, 2 children per node. size() reports 3 members, only member 0 exists
+struct TestLineDirector : public kinematics::Director< Xform, TestBigIndex, uint64_t > {
+	uint64_t nroots;
+	TestLineDirector( uint64_t n ) : nroots( n ) {}
+	virtual bool set_scene( TestBigIndex const & i, int resl, Scene & scene ) const {
+		if( i.member != 0 ) return false;
+		Xform x( Xform::Identity() );
+		x.translation()[0] = ( i.nest_index + 0.5 ) / ( nroots << resl ); // cell center in [0,1)
+		scene.set_position( 0, x );
+		return true;
+	}
+	virtual TestBigIndex size( int resl, TestBigIndex sizes ) const {
+		sizes.nest_index = nroots << resl;
+		sizes.member = 3;
+		return sizes;
+	}
+};
+
+struct TestLineScene : public kinematics::SceneBase< Xform, uint64_t > {
+	TestLineScene(){
+		this->positions_.push_back( Xform::Identity() );
+		update_symmetry( positions_.size() );
+	}
+	virtual shared_ptr< kinematics::SceneBase< Xform, uint64_t > > clone_deep() const { return make_shared<TestLineScene>( *this ); }
+};
+
+// |x - 0.3| minus the cell half width, admissible
+struct TestLineBound : public BoundingFunction< Xform, uint64_t > {
+	int max_resl;
+	uint64_t nroots;
+	virtual Float evaluate( kinematics::SceneBase< Xform, uint64_t > const & scene, int resl ) const {
+		Float half = 0.5 / ( nroots << resl );
+		if( resl == max_resl ) half = 0;
+		return std::max<Float>( 0, std::abs( scene.position(0).translation()[0] - 0.3 ) - half ) - 1.0;
+	}
+};
+
+TEST( SpatialBandB, search_from_director_roots ){
+	int const max_resl = 6;
+	uint64_t const nroots = 5;
+	SpatialBandB< Xform, TestBigIndex > bandb;
+	bandb.opts_.max_resl = max_resl;
+	bandb.opts_.children_per_node = 2;
+	bandb.opts_.num_results = 2;
+	bandb.opts_.score_cut = -0.6; // prunes the root at 0.9
+	bandb.director_ = make_shared<TestLineDirector>( nroots );
+	bandb.scene_ = make_shared<TestLineScene>();
+	auto bound = make_shared<TestLineBound>();
+	bound->max_resl = max_resl;
+	bound->nroots = nroots;
+	bandb.bounding_func_ = bound;
+
+	auto result = bandb.search();
+	ASSERT_EQ( result->results.size(), 2 );
+	ASSERT_TRUE( result->exact );
+	// the leaves either side of 0.3
+	uint64_t const nleaves = nroots << max_resl;
+	std::vector<uint64_t> found{ result->results[0].second.nest_index, result->results[1].second.nest_index };
+	std::sort( found.begin(), found.end() );
+	ASSERT_EQ( found[0], (uint64_t)( 0.3*nleaves - 0.5 ) );
+	ASSERT_EQ( found[1], found[0] + 1 );
+	for( auto const & r : result->results ) ASSERT_EQ( r.second.member, 0 );
+	ASSERT_EQ( result->roots_under_cut, nroots-1 );
+	ASSERT_LT( result->bounds_evaluated, 2*nleaves );
+}
+
+TEST( SpatialBandB, queue_cap_is_reported ){
+	int const max_resl = 8;
+	uint64_t const nleaves = (uint64_t)4 << max_resl;
+	std::vector<float> leaf( nleaves );
+	for( uint64_t i = 0; i < nleaves; ++i ) leaf[i] = -1.0 - 0.0001*(i%7);
+	// useless but admissible bound, everything ties
+	auto bound = [&]( uint64_t i, int resl ) -> float { return resl == max_resl ? leaf[i] : -2.0; };
+
+	SpatialBandB<Xform> bandb;
+	bandb.opts_.max_resl = max_resl;
+	bandb.opts_.children_per_node = 2;
+	bandb.opts_.num_results = 3;
+	bandb.opts_.max_queue_size = 16;
+	bandb.opts_.batch_size = 1;
+	std::vector<uint64_t> roots{ 0, 1, 2, 3 };
+
+	auto result = bandb.search( roots, 0, bound );
+	ASSERT_EQ( result->results.size(), 3 );
+	ASSERT_GT( result->nodes_dropped, 0 );
+	ASSERT_FALSE( result->exact );
+	ASSERT_LE( result->max_queue_size, 16 );
+}
+
 }}}
@@ -1,15 +1,27 @@
+#ifndef INCLUDED_search_SpatialBandB_HH
+#define INCLUDED_search_SpatialBandB_HH
 
 #include <scheme/kinematics/Director.hh>
 
+#include <algorithm>
+#include <cassert>
+#include <exception>
+#include <functional>
 #include <list>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 namespace scheme { namespace search {
 
 template< class Xform, class Index >
 struct BoundingFunction {
 	typedef typename Xform::Scalar Float;
-	virtual void set_resolution() = 0;
-	virtual Float evaluate( kinematics::SceneBase<Xform,Index> const & scene ) const = 0;
+	/// lower bound on the score of every pose inside the cell the scene was set to at resl
+	/// at the finest resl this must be the score itself. must be thread safe
+	virtual Float evaluate( kinematics::SceneBase<Xform,Index> const & scene, int resl ) const = 0;
 };
 
 
@@ -34,11 +46,32 @@ struct BoundingObjectiveFunction
 };
 
 
+struct SpatialBandBOptions {
+	int max_resl = 0;                       // results are cells at this resl
+	uint64_t num_results = 1;
+	uint64_t children_per_node = 64;        // 2^DIM for a NEST
+	float score_cut = 0;                    // only bounds below this are interesting
+	uint64_t max_queue_size = 100000000;    // open nodes kept, the worst are dropped past this
+	uint64_t batch_size = 8192;             // open nodes expanded together per round
+};
+
 template< class BigIndex, class Float = float >
 struct SpatialBandBResult {
-	std::vector< std::pair< float, BigIndex > > results;
+	std::vector< std::pair< Float, BigIndex > > results;   // best first
+	bool exact = true;                 // false if a dropped node could have held a better result
+	Float best_dropped_bound = 9e9;
+	uint64_t bounds_evaluated = 0;
+	uint64_t roots_under_cut = 0;      // roots bounding below score_cut
+	uint64_t nodes_expanded = 0;
+	uint64_t nodes_dropped = 0;
+	uint64_t max_queue_size = 0;
 };
 
+/// best-first branch and bound over a NEST style hierarchy: the children of
+/// (index,resl) are nest_index*children_per_node+j at resl+1, as in HSearch
+/// if the bounds are admissible the results are the best num_results cells at max_resl
+/// open nodes are expanded in batches; the bounds of a batch are computed in parallel with
+/// dynamic scheduling so idle threads pick up the remaining children
 template<
 	class _Xform,
 	class _BigIndex = uint64_t,
@@ -51,23 +84,178 @@ struct SpatialBandB {
 	typedef kinematics::SceneBase<Xform,Index> Scene;
 	typedef scheme::shared_ptr< Scene > SceneP;
 	typedef scheme::shared_ptr< BoundingFunction<Xform,Index> > BoundP;
-	typedef scheme::shared_ptr< kinematics::Director<Xform,Index,Index> > DirectorP;
+	typedef scheme::shared_ptr< kinematics::Director<Xform,BigIndex,Index> > DirectorP;
 	typedef SpatialBandBResult< BigIndex, float > Result;
 	typedef scheme::shared_ptr< Result > ResultP;
 
+	struct Node {
+		float bound;
+		int resl;
+		BigIndex index;
+		bool operator<( Node const & o ) const { return bound > o.bound; } // for a min-heap
+	};
+	typedef std::pair< float, BigIndex > Scored;
+	struct ScoredLess {
+		bool operator()( Scored const & a, Scored const & b ) const { return a.first < b.first; }
+	};
+
 	BoundP bounding_func_;
 	SceneP scene_;
 	DirectorP director_;
+	SpatialBandBOptions opts_;
 
 
 	SpatialBandB(){}
 
-	ResultP search(){
-		ResultP result = ResultP( new Result );
+	/// search everything at resl 0 of director_ with bounding_func_
+	ResultP search() const {
+		assert( director_ && scene_ && bounding_func_ );
+		BigIndex size0 = director_->size( 0, BigIndex() );
+		std::vector<BigIndex> roots;
+		for( uint64_t i = 0; i < kinematics::get_nest_index( size0 ); ++i ){
+			BigIndex bi = BigIndex(); // size0 holds sizes, not indices, past the nest index
+			kinematics::set_nest_index( i, bi );
+			roots.push_back( bi );
+		}
+		std::vector<SceneP> scenes( num_threads() );
+		for( auto & s : scenes ) s = scene_->clone_deep();
+		auto bound = [&]( BigIndex const & bi, int resl ) -> float {
+			Scene & scene = *scenes[ thread_num() ];
+			if( ! director_->set_scene( bi, resl, scene ) ) return 9e9;
+			return bounding_func_->evaluate( scene, resl );
+		};
+		return search( roots, 0, bound );
+	}
+
+	/// bound( BigIndex, resl ) -> float must be thread safe; 9e9 or anything >= score_cut prunes
+	template< class BoundFunc >
+	ResultP search( std::vector<BigIndex> const & roots, int root_resl, BoundFunc const & bound ) const {
+		assert( root_resl <= opts_.max_resl );
+		ResultP result_p = ResultP( new Result );
+		Result & result = *result_p;
 
-		return result;
+		std::vector<Node> queue;     // heap, best bound on top
+		std::vector<Scored> best;    // heap, worst of the best on top
+
+		auto cut = [&]() -> float {
+			if( best.size() < opts_.num_results ) return opts_.score_cut;
+			return std::min( opts_.score_cut, best.front().first );
+		};
+		auto offer = [&]( Node const & n ){
+			if( n.bound >= cut() ) return;
+			if( n.resl == opts_.max_resl ){
+				best.push_back( Scored( n.bound, n.index ) );
+				std::push_heap( best.begin(), best.end(), ScoredLess() );
+				if( best.size() > opts_.num_results ){
+					std::pop_heap( best.begin(), best.end(), ScoredLess() );
+					best.pop_back();
+				}
+			} else {
+				queue.push_back( n );
+				std::push_heap( queue.begin(), queue.end() );
+			}
+		};
+
+		std::vector<Node> evaluated( roots.size() );
+		for( size_t i = 0; i < roots.size(); ++i ){
+			evaluated[i].index = roots[i];
+			evaluated[i].resl = root_resl;
+		}
+
+		std::vector<Node> batch;
+		while( true ){
+
+			evaluate_bounds( evaluated, bound );
+			if( result.bounds_evaluated == 0 ){
+				for( Node const & n : evaluated ) result.roots_under_cut += n.bound < opts_.score_cut;
+			}
+			result.bounds_evaluated += evaluated.size();
+			for( Node const & n : evaluated ) offer( n );
+			evaluated.clear();
+
+			if( queue.size() > opts_.max_queue_size ) drop_worst( queue, result );
+			result.max_queue_size = std::max<uint64_t>( result.max_queue_size, queue.size() );
+
+			// best first: nothing left in the queue can beat what we have
+			batch.clear();
+			while( queue.size() && batch.size() < opts_.batch_size && queue.front().bound < cut() ){
+				std::pop_heap( queue.begin(), queue.end() );
+				batch.push_back( queue.back() );
+				queue.pop_back();
+			}
+			if( batch.empty() ) break;
+
+			result.nodes_expanded += batch.size();
+			evaluated.resize( batch.size() * opts_.children_per_node );
+			for( size_t i = 0; i < batch.size(); ++i ){
+				uint64_t const first_child = kinematics::get_nest_index( batch[i].index ) * opts_.children_per_node;
+				for( uint64_t j = 0; j < opts_.children_per_node; ++j ){
+					Node & child = evaluated[ i*opts_.children_per_node + j ];
+					child.index = batch[i].index;
+					kinematics::set_nest_index( first_child + j, child.index );
+					child.resl = batch[i].resl + 1;
+				}
+			}
+		}
+
+		std::sort( best.begin(), best.end(), ScoredLess() );
+		result.results = best;
+		result.exact = result.best_dropped_bound >= cut();
+		return result_p;
+	}
+
+private:
+
+	template< class BoundFunc >
+	static void evaluate_bounds( std::vector<Node> & nodes, BoundFunc const & bound ){
+		std::exception_ptr exception = nullptr;
+		#ifdef USE_OPENMP
+		#pragma omp parallel for schedule(dynamic,64)
+		#endif
+		for( int64_t i = 0; i < (int64_t)nodes.size(); ++i ){
+			if( exception ) continue;
+			try {
+				nodes[i].bound = bound( nodes[i].index, nodes[i].resl );
+			} catch( ... ) {
+				#ifdef USE_OPENMP
+				#pragma omp critical
+				#endif
+				exception = std::current_exception();
+			}
+		}
+		if( exception ) std::rethrow_exception( exception );
+	}
+
+	// keep the best half of the cap so this doesn't happen every round
+	void drop_worst( std::vector<Node> & queue, Result & result ) const {
+		size_t keep = std::max<size_t>( opts_.max_queue_size / 2, 1 );
+		std::nth_element( queue.begin(), queue.begin() + keep, queue.end(),
+			[]( Node const & a, Node const & b ){ return a.bound < b.bound; } );
+		for( size_t i = keep; i < queue.size(); ++i ){
+			result.best_dropped_bound = std::min( result.best_dropped_bound, queue[i].bound );
+		}
+		result.nodes_dropped += queue.size() - keep;
+		queue.resize( keep );
+		std::make_heap( queue.begin(), queue.end() );
+	}
+
+	static int num_threads(){
+		#ifdef USE_OPENMP
+		return omp_get_max_threads();
+		#else
+		return 1;
+		#endif
+	}
+	static int thread_num(){
+		#ifdef USE_OPENMP
+		return omp_get_thread_num();
+		#else
+		return 0;
+		#endif
 	}
 
 };
 
 }}
+
+#endif
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include "scheme/util/benchmark.hh"
+
+#include <sstream>
+
+namespace scheme { namespace util { namespace test_benchmark {
+
+using std::cout;
+using std::endl;
+
+TEST( benchmark, percentile ){
+	std::vector<double> v;
+	for( int i = 100; i > 0; --i ) v.push_back( i );
+	ASSERT_EQ( 50, percentile( v, 0.5 ) );
+	ASSERT_EQ( 90, percentile( v, 0.9 ) );
+	ASSERT_EQ( 99, percentile( v, 0.99 ) );
+	ASSERT_EQ( 1, percentile( v, 0.0 ) );
+	ASSERT_EQ( 100, percentile( v, 1.0 ) );
+	std::vector<double> one( 1, 7.0 );
+	ASSERT_EQ( 7, percentile( one, 0.99 ) );
+}
+
+TEST( benchmark, run_write_read_compare ){
+	uint64_t counter = 0;
+	BenchResult r = run_benchmark( "count", [&](){ for( int i = 0; i < 1000; ++i ) counter += i; return (double)counter; }, 1000, 0.01, 1234 );
+	ASSERT_EQ( "count", r.name );
+	ASSERT_GE( r.nops, 5000 );
+	ASSERT_GT( r.ops_per_sec, 0 );
+	ASSERT_LE( r.p50_ns, r.p90_ns );
+	ASSERT_LE( r.p90_ns, r.p99_ns );
+	ASSERT_EQ( 1234, r.mem_bytes );
+
+	std::stringstream ss;
+	write_bench_results( ss, std::vector<BenchResult>{ r } );
+	std::map<std::string,BenchResult> baseline = read_bench_results( ss );
+	ASSERT_EQ( 1, baseline.size() );
+	ASSERT_EQ( r.nops, baseline["count"].nops );
+	ASSERT_NEAR( r.ops_per_sec, baseline["count"].ops_per_sec, r.ops_per_sec*1e-5 );
+	ASSERT_EQ( 1234, baseline["count"].mem_bytes );
+
+	std::ostringstream report;
+	std::vector<BenchResult> now{ r };
+	ASSERT_EQ( 0, compare_bench_results( now, baseline, 0.1, report ) );
+	now[0].ops_per_sec = r.ops_per_sec * 0.8;
+	ASSERT_EQ( 1, compare_bench_results( now, baseline, 0.1, report ) );
+	now[0].ops_per_sec = r.ops_per_sec;
+	now[0].mem_bytes = 2000;
+	ASSERT_EQ( 1, compare_bench_results( now, baseline, 0.1, report ) );
+	now[0].name = "other";
+	ASSERT_EQ( 0, compare_bench_results( now, baseline, 0.1, report ) );
+}
+
+}}}
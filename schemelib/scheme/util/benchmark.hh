@@ -0,0 +1,150 @@
+#ifndef INCLUDED_util_benchmark_HH
+#define INCLUDED_util_benchmark_HH
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+namespace scheme { namespace util {
+
+/// one benchmark measurement. latencies are per op, from timing batches of ops_per_batch
+struct BenchResult {
+	std::string name;
+	uint64_t nops = 0;
+	double seconds = 0;
+	double ops_per_sec = 0;
+	double p50_ns = 0, p90_ns = 0, p99_ns = 0;
+	uint64_t mem_bytes = 0;     // fixture size, as reported by the benchmark
+	uint64_t max_rss_bytes = 0; // process peak after the benchmark ran
+};
+
+inline uint64_t max_rss_bytes(){
+	#ifdef __linux__
+		rusage u;
+		if( getrusage( RUSAGE_SELF, &u ) == 0 ) return (uint64_t)u.ru_maxrss * 1024;
+	#endif
+	return 0;
+}
+
+/// nearest rank percentile, q in [0,1]. sorts v
+inline double percentile( std::vector<double> & v, double q ){
+	if( v.empty() ) return 0;
+	std::sort( v.begin(), v.end() );
+	size_t i = (size_t)std::ceil( q * v.size() );
+	return v[ std::min( v.size(), std::max<size_t>( i, 1 ) ) - 1 ];
+}
+
+/// calls batch() until min_seconds have passed (and at least min_batches times). batch() must do
+/// ops_per_batch ops and return something that depends on the work, so it can't be optimized out
+template< class Batch >
+BenchResult
+run_benchmark(
+	std::string const & name,
+	Batch batch,
+	uint64_t ops_per_batch,
+	double min_seconds,
+	uint64_t mem_bytes = 0,
+	int min_batches = 5
+){
+	typedef std::chrono::steady_clock Clock;
+	std::vector<double> per_op_ns;
+	double sink = 0;
+	sink += batch(); // warm up
+	Clock::time_point const start = Clock::now();
+	double elapsed = 0;
+	while( elapsed < min_seconds || (int)per_op_ns.size() < min_batches ){
+		Clock::time_point const t0 = Clock::now();
+		sink += batch();
+		Clock::time_point const t1 = Clock::now();
+		per_op_ns.push_back( std::chrono::duration<double,std::nano>( t1 - t0 ).count() / ops_per_batch );
+		elapsed = std::chrono::duration<double>( t1 - start ).count();
+	}
+	static volatile double volatile_sink;
+	volatile_sink = sink;
+
+	BenchResult r;
+	r.name = name;
+	r.nops = per_op_ns.size() * ops_per_batch;
+	r.seconds = 0;
+	for( double ns : per_op_ns ) r.seconds += ns * ops_per_batch * 1e-9;
+	r.ops_per_sec = r.nops / r.seconds;
+	r.p50_ns = percentile( per_op_ns, 0.50 );
+	r.p90_ns = percentile( per_op_ns, 0.90 );
+	r.p99_ns = percentile( per_op_ns, 0.99 );
+	r.mem_bytes = mem_bytes;
+	r.max_rss_bytes = max_rss_bytes();
+	return r;
+}
+
+/// tab separated, one line per benchmark after a header, lines starting with # are comments
+inline void
+write_bench_results( std::ostream & out, std::vector<BenchResult> const & results ){
+	out << "name\tnops\tseconds\tops_per_sec\tp50_ns\tp90_ns\tp99_ns\tmem_bytes\tmax_rss_bytes\n";
+	out << std::setprecision(6);
+	for( BenchResult const & r : results ){
+		out << r.name << '\t' << r.nops << '\t' << r.seconds << '\t' << r.ops_per_sec << '\t'
+		    << r.p50_ns << '\t' << r.p90_ns << '\t' << r.p99_ns << '\t' << r.mem_bytes << '\t' << r.max_rss_bytes << '\n';
+	}
+}
+
+inline std::map<std::string,BenchResult>
+read_bench_results( std::istream & in ){
+	std::map<std::string,BenchResult> results;
+	std::string line;
+	while( std::getline( in, line ) ){
+		if( line.empty() || line[0] == '#' || line.compare( 0, 5, "name\t" ) == 0 ) continue;
+		std::istringstream iss( line );
+		BenchResult r;
+		std::getline( iss, r.name, '\t' );
+		iss >> r.nops >> r.seconds >> r.ops_per_sec >> r.p50_ns >> r.p90_ns >> r.p99_ns >> r.mem_bytes >> r.max_rss_bytes;
+		if( iss ) results[ r.name ] = r;
+	}
+	return results;
+}
+
+/// regression if throughput dropped or fixture memory grew by more than tolerance (a fraction).
+/// latency percentiles are reported but not gated, they are too noisy on shared machines.
+/// benchmarks missing from the baseline are reported and pass. returns the number of regressions
+inline int
+compare_bench_results(
+	std::vector<BenchResult> const & results,
+	std::map<std::string,BenchResult> const & baseline,
+	double tolerance,
+	std::ostream & report
+){
+	int nregress = 0;
+	report << std::fixed << std::setprecision(3);
+	for( BenchResult const & r : results ){
+		auto i = baseline.find( r.name );
+		if( i == baseline.end() ){
+			report << "NEW      " << r.name << std::endl;
+			continue;
+		}
+		BenchResult const & b = i->second;
+		double const speed = b.ops_per_sec > 0 ? r.ops_per_sec / b.ops_per_sec : 1.0;
+		bool const slower = speed < 1.0 - tolerance;
+		bool const bigger = b.mem_bytes > 0 && r.mem_bytes > b.mem_bytes * ( 1.0 + tolerance );
+		nregress += slower || bigger;
+		report << ( slower || bigger ? "REGRESS  " : "ok       " ) << r.name
+		       << " throughput x" << speed
+		       << " p50 " << r.p50_ns << "ns (was " << b.p50_ns << ")"
+		       << " p99 " << r.p99_ns << "ns (was " << b.p99_ns << ")"
+		       << " mem " << r.mem_bytes << " (was " << b.mem_bytes << ")" << std::endl;
+	}
+	return nregress;
+}
+
+}}
+
+#endif
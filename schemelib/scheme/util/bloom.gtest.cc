@@ -1,9 +1,11 @@
 #include <gtest/gtest.h>
 
 #include "bloom/bloom_filter.hpp"
+#include "scheme/util/bloom.hh"
 
 #include <boost/foreach.hpp>
 #include <random>
+#include <sstream>
 #include "scheme/util/Timer.hh"
 
 #include <sparsehash/dense_hash_map>
@@ -69,6 +71,41 @@ using std::endl;
 // 	}
 // }
 
+TEST( bloom, blocked_bloom_filter ){
+	std::mt19937_64 rng(0);
+	BlockedBloomFilter filter;
+	ASSERT_TRUE( filter.contains( 12345 ) ); // unbuilt filter passes everything
+	int const N = 100000;
+	filter.init( N, 10.0 );
+	std::vector<uint64_t> keys;
+	for( int i = 0; i < N; ++i ){ keys.push_back( rng() ); filter.insert( keys.back() ); }
+	for( uint64_t k : keys ) ASSERT_TRUE( filter.contains( k ) );
+	// sequential queries, like neighboring z-order rif keys
+	int nfalse = 0;
+	for( int i = 0; i < N; ++i ) nfalse += filter.contains( (uint64_t)i );
+	ASSERT_LT( nfalse, N * 0.02 );
+	ASSERT_LT( filter.estimated_false_positive_rate(), 0.02 );
+	ASSERT_EQ( filter.mem_use(), filter.num_blocks() * 64 );
+	ASSERT_LE( filter.mem_use(), N * 10 / 8 + 64 );
+
+	std::stringstream ss;
+	ASSERT_TRUE( filter.save( ss ) );
+	BlockedBloomFilter loaded;
+	ASSERT_TRUE( loaded.load( ss ) );
+	ASSERT_EQ( loaded.num_keys(), N );
+	for( uint64_t k : keys ) ASSERT_TRUE( loaded.contains( k ) );
+	for( int i = 0; i < 1000; ++i ) ASSERT_EQ( loaded.contains( i ), filter.contains( i ) );
+
+	BlockedBloomFilter attached;
+	attached.attach( filter.data(), filter.num_blocks(), filter.num_keys() );
+	ASSERT_TRUE( attached.is_attached() );
+	ASSERT_EQ( attached.mem_use(), filter.mem_use() );
+	for( uint64_t k : keys ) ASSERT_TRUE( attached.contains( k ) );
+	for( int i = 0; i < 1000; ++i ) ASSERT_EQ( attached.contains( i ), filter.contains( i ) );
+	attached.clear();
+	ASSERT_TRUE( attached.contains( 12345 ) );
+}
+
 #ifdef SCHEME_BENCHMARK
 
 TEST( bloom , bloom_filter_example ){
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "scheme/util/mem_budget.hh"
+
+#include <sstream>
+#include <vector>
+
+namespace scheme { namespace util { namespace test_mem_budget {
+
+using std::cout;
+using std::endl;
+
+TEST( mem_budget, categories_live_and_peak ){
+	int64_t const live0 = mem_live();
+	MemCategory & a = mem_category( "test_mem_a" );
+	MemCategory & b = mem_category( "test_mem_b" );
+	ASSERT_EQ( &a, &mem_category( "test_mem_a" ) );
+	a.add( 1000 );
+	b.set( 500 );
+	ASSERT_EQ( live0 + 1500, mem_live() );
+	b.set( 200 );
+	ASSERT_EQ( 200, b.live() );
+	ASSERT_EQ( 500, b.peak() );
+	{
+		ScopedMemCharge charge( "test_mem_a", 300 );
+		ASSERT_EQ( 1300, a.live() );
+		charge.resize( 100 );
+		ASSERT_EQ( 1100, a.live() );
+		ScopedMemCharge moved( std::move( charge ) );
+		ASSERT_EQ( 1100, a.live() );
+	}
+	ASSERT_EQ( 1000, a.live() );
+	ASSERT_EQ( 1300, a.peak() );
+	ASSERT_GE( mem_peak(), live0 + 1500 );
+	a.clear();
+	b.clear();
+	ASSERT_EQ( live0, mem_live() );
+
+	std::ostringstream oss;
+	mem_report( oss );
+	ASSERT_NE( std::string::npos, oss.str().find( "test_mem_a" ) );
+}
+
+TEST( mem_budget, budget_and_headroom ){
+	ASSERT_EQ( 0, mem_budget() );
+	ASSERT_FALSE( mem_over_budget() );
+	ASSERT_TRUE( mem_fits( int64_t(1) << 50 ) );
+	int64_t const live0 = mem_live();
+	set_mem_budget( live0 + 1000 );
+	ASSERT_EQ( 1000, mem_headroom() );
+	ASSERT_TRUE( mem_fits( 1000 ) );
+	ASSERT_FALSE( mem_fits( 1001 ) );
+	{
+		ScopedMemCharge charge( "test_mem_budget", 1500 );
+		ASSERT_TRUE( mem_over_budget() );
+		ASSERT_EQ( -500, mem_headroom() );
+	}
+	ASSERT_FALSE( mem_over_budget() );
+	set_mem_budget( 0 );
+	ASSERT_EQ( std::numeric_limits<int64_t>::max(), mem_headroom() );
+}
+
+TEST( mem_budget, threaded_charges_balance ){
+	int64_t const live0 = mem_live();
+	MemCategory & c = mem_category( "test_mem_threads" );
+	#ifdef USE_OPENMP
+	#pragma omp parallel for
+	#endif
+	for( int i = 0; i < 10000; ++i ){
+		ScopedMemCharge charge( c, i );
+	}
+	ASSERT_EQ( 0, c.live() );
+	ASSERT_EQ( live0, mem_live() );
+	ASSERT_GE( c.peak(), 9999 );
+}
+
+TEST( mem_budget, process_rss ){
+	ASSERT_GT( process_rss_bytes(), 0 );
+	ASSERT_GE( process_peak_rss_bytes(), process_rss_bytes() );
+}
+
+}}}
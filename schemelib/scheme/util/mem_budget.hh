@@ -0,0 +1,174 @@
+#ifndef INCLUDED_util_mem_budget_HH
+#define INCLUDED_util_mem_budget_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace scheme { namespace util {
+
+/// process wide memory accounting. big owners (rifs, grids, scaffold tables, search beams,
+/// rif accumulators) report their bytes into a named category, either as a running total
+/// (set) or by charging and releasing (add, ScopedMemCharge). live and peak are kept per
+/// category and in total. with set_mem_budget, anything that can shrink checks mem_headroom()
+/// or mem_over_budget() before it grows. nothing here allocates or frees, it only counts what
+/// the owners report, so compare with process_rss_bytes() for what's not covered
+class MemCategory {
+	std::string name_;
+	std::atomic<int64_t> live_, peak_;
+public:
+	explicit MemCategory( std::string const & name ) : name_( name ), live_( 0 ), peak_( 0 ) {}
+	std::string const & name() const { return name_; }
+	int64_t live() const { return live_.load( std::memory_order_relaxed ); }
+	int64_t peak() const { return peak_.load( std::memory_order_relaxed ); }
+	/// negative to release
+	inline void add( int64_t bytes );
+	/// for owners that know their own total
+	inline void set( int64_t bytes );
+	void clear(){ set( 0 ); }
+private:
+	friend class MemRegistry;
+	static void raise_peak( std::atomic<int64_t> & peak, int64_t now ){
+		int64_t p = peak.load( std::memory_order_relaxed );
+		while( now > p && !peak.compare_exchange_weak( p, now, std::memory_order_relaxed ) ){}
+	}
+};
+
+class MemRegistry {
+	std::mutex lock_;
+	std::map< std::string, std::unique_ptr<MemCategory> > categories_;
+	std::atomic<int64_t> live_, peak_, budget_;
+	MemRegistry() : live_( 0 ), peak_( 0 ), budget_( 0 ) {}
+	friend class MemCategory;
+public:
+	static MemRegistry & get(){ static MemRegistry registry; return registry; }
+
+	/// made on first use, the reference stays valid
+	MemCategory & category( std::string const & name ){
+		std::lock_guard< std::mutex > guard( lock_ );
+		std::unique_ptr<MemCategory> & c = categories_[ name ];
+		if( !c ) c.reset( new MemCategory( name ) );
+		return *c;
+	}
+
+	int64_t live() const { return live_.load( std::memory_order_relaxed ); }
+	int64_t peak() const { return peak_.load( std::memory_order_relaxed ); }
+	int64_t budget() const { return budget_.load( std::memory_order_relaxed ); }
+	void set_budget( int64_t bytes ){ budget_.store( std::max< int64_t >( 0, bytes ) ); }
+
+	/// (name, live, peak) for every category, sorted by name
+	template< class F > void for_each( F f ){
+		std::lock_guard< std::mutex > guard( lock_ );
+		for( auto const & c : categories_ ) f( c.second->name(), c.second->live(), c.second->peak() );
+	}
+	/// zeroes the peaks, e.g. between targets
+	void reset_peaks(){
+		std::lock_guard< std::mutex > guard( lock_ );
+		for( auto const & c : categories_ ) c.second->peak_.store( c.second->live() );
+		peak_.store( live() );
+	}
+};
+
+inline void MemCategory::add( int64_t bytes ){
+	if( bytes == 0 ) return;
+	MemRegistry & reg = MemRegistry::get();
+	raise_peak( peak_, live_.fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+	raise_peak( reg.peak_, reg.live_.fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+}
+inline void MemCategory::set( int64_t bytes ){
+	int64_t const delta = bytes - live_.exchange( bytes, std::memory_order_relaxed );
+	raise_peak( peak_, bytes );
+	if( delta == 0 ) return;
+	MemRegistry & reg = MemRegistry::get();
+	raise_peak( reg.peak_, reg.live_.fetch_add( delta, std::memory_order_relaxed ) + delta );
+}
+
+
+inline MemCategory & mem_category( std::string const & name ){ return MemRegistry::get().category( name ); }
+
+/// 0 for no budget
+inline void set_mem_budget( int64_t bytes ){ MemRegistry::get().set_budget( bytes ); }
+inline int64_t mem_budget(){ return MemRegistry::get().budget(); }
+inline int64_t mem_live(){ return MemRegistry::get().live(); }
+inline int64_t mem_peak(){ return MemRegistry::get().peak(); }
+
+/// bytes left under the budget, negative when over, int64 max without a budget
+inline int64_t mem_headroom(){
+	int64_t const budget = mem_budget();
+	return budget ? budget - mem_live() : std::numeric_limits<int64_t>::max();
+}
+inline bool mem_fits( int64_t more_bytes ){ return more_bytes <= mem_headroom(); }
+inline bool mem_over_budget(){ return mem_headroom() < 0; }
+
+/// charges bytes to a category for its lifetime
+class ScopedMemCharge {
+	MemCategory * category_;
+	int64_t bytes_;
+public:
+	ScopedMemCharge() : category_( nullptr ), bytes_( 0 ) {}
+	ScopedMemCharge( MemCategory & c, int64_t bytes ) : category_( &c ), bytes_( bytes ) { c.add( bytes ); }
+	ScopedMemCharge( std::string const & name, int64_t bytes ) : ScopedMemCharge( mem_category( name ), bytes ) {}
+	~ScopedMemCharge(){ if( category_ ) category_->add( -bytes_ ); }
+	ScopedMemCharge( ScopedMemCharge && o ) : category_( o.category_ ), bytes_( o.bytes_ ) { o.category_ = nullptr; }
+	ScopedMemCharge & operator=( ScopedMemCharge && o ){
+		if( this != &o ){
+			if( category_ ) category_->add( -bytes_ );
+			category_ = o.category_; bytes_ = o.bytes_;
+			o.category_ = nullptr;
+		}
+		return *this;
+	}
+	ScopedMemCharge( ScopedMemCharge const & ) = delete;
+	ScopedMemCharge & operator=( ScopedMemCharge const & ) = delete;
+
+	void resize( int64_t bytes ){
+		if( category_ ) category_->add( bytes - bytes_ );
+		bytes_ = bytes;
+	}
+	int64_t bytes() const { return bytes_; }
+};
+
+namespace impl {
+	// a "Vm...:   1234 kB" line of /proc/self/status, 0 if there isn't one
+	inline int64_t proc_status_bytes( std::string const & key ){
+		std::ifstream in( "/proc/self/status" );
+		std::string line;
+		while( std::getline( in, line ) ){
+			if( line.compare( 0, key.size(), key ) != 0 || line.size() <= key.size() || line[key.size()] != ':' ) continue;
+			return std::atoll( line.c_str() + key.size() + 1 ) * 1024;
+		}
+		return 0;
+	}
+}
+inline int64_t process_rss_bytes(){ return impl::proc_status_bytes( "VmRSS" ); }
+inline int64_t process_peak_rss_bytes(){ return impl::proc_status_bytes( "VmHWM" ); }
+
+/// live and peak per category, the totals, the budget, and the process rss for comparison
+inline void mem_report( std::ostream & out ){
+	auto M = []( int64_t bytes ){ return (double)bytes / 1024.0 / 1024.0; };
+	std::ios::fmtflags const flags = out.flags();
+	std::streamsize const precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	out << std::setw(24) << std::left << "memory category" << std::right << std::setw(14) << "live_MB" << std::setw(14) << "peak_MB" << std::endl;
+	MemRegistry::get().for_each( [&]( std::string const & name, int64_t live, int64_t peak ){
+		out << std::setw(24) << std::left << name << std::right << std::setw(14) << M(live) << std::setw(14) << M(peak) << std::endl;
+	});
+	out << std::setw(24) << std::left << "total" << std::right << std::setw(14) << M( mem_live() ) << std::setw(14) << M( mem_peak() ) << std::endl;
+	out << std::setw(24) << std::left << "process rss" << std::right << std::setw(14) << M( process_rss_bytes() ) << std::setw(14) << M( process_peak_rss_bytes() ) << std::endl;
+	if( mem_budget() ) out << "memory budget " << M( mem_budget() ) << "MB, headroom " << M( mem_headroom() ) << "MB" << std::endl;
+	out.flags( flags );
+	out.precision( precision );
+}
+
+}}
+
+#endif
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include "scheme/util/numa.hh"
+
+#include <sparsehash/dense_hash_map>
+
+#include <random>
+
+namespace scheme { namespace util { namespace test_numa {
+
+using std::cout;
+using std::endl;
+
+typedef google::dense_hash_map< uint64_t, uint64_t, SPARSEHASH_HASH<uint64_t>, std::equal_to<uint64_t>,
+                                PlacedAllocator< std::pair<uint64_t const,uint64_t> > > Map;
+
+TEST( numa, node_info ){
+	cout << "numa nodes: " << numa_num_nodes() << " current node: " << numa_current_node() << endl;
+	ASSERT_GE( numa_num_nodes(), 1 );
+	ASSERT_GE( numa_current_node(), 0 );
+	ASSERT_LT( numa_current_node(), numa_num_nodes() );
+	ASSERT_EQ( 0, numa_node_of_cpu( -1 ) );
+}
+
+TEST( numa, scoped_placement_restores ){
+	ASSERT_EQ( MEM_DEFAULT, current_mem_placement().policy );
+	{
+		ScopedMemPlacement p( MemPlacement( HUGE_TRANSPARENT, MEM_INTERLEAVE ) );
+		ASSERT_EQ( MEM_INTERLEAVE, current_mem_placement().policy );
+		{
+			ScopedMemPlacement p2( MemPlacement( HUGE_NONE, MEM_BIND, numa_num_nodes()-1 ) );
+			ASSERT_EQ( MEM_BIND, current_mem_placement().policy );
+		}
+		ASSERT_EQ( MEM_INTERLEAVE, current_mem_placement().policy );
+		ASSERT_EQ( HUGE_TRANSPARENT, current_mem_placement().huge_pages );
+	}
+	ASSERT_EQ( MEM_DEFAULT, current_mem_placement().policy );
+	ASSERT_EQ( HUGE_NONE, current_mem_placement().huge_pages );
+}
+
+TEST( numa, placed_hash_map_copies ){
+	std::mt19937 rng(0);
+	Map ref;
+	ref.set_empty_key( std::numeric_limits<uint64_t>::max() );
+	for( int i = 0; i < 200000; ++i ){ // big enough to get mmapped
+		uint64_t k = rng();
+		ref[k] = k*3;
+	}
+	std::vector<MemPlacement> placements{
+		MemPlacement( HUGE_NONE, MEM_DEFAULT ),
+		MemPlacement( HUGE_TRANSPARENT, MEM_INTERLEAVE ),
+		MemPlacement( HUGE_EXPLICIT, MEM_BIND, numa_num_nodes()-1 )
+	};
+	for( MemPlacement const & p : placements ){
+		ScopedMemPlacement scope( p );
+		Map copy( ref );
+		ASSERT_EQ( ref.size(), copy.size() );
+		for( auto const & v : ref ) ASSERT_EQ( v.second, copy.find( v.first )->second );
+		Map swapped;
+		swapped.set_empty_key( std::numeric_limits<uint64_t>::max() );
+		swapped.swap( copy );
+		ASSERT_EQ( ref.size(), swapped.size() );
+	}
+}
+
+}}}
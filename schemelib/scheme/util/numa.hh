@@ -0,0 +1,214 @@
+#ifndef INCLUDED_util_numa_HH
+#define INCLUDED_util_numa_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cctype>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace scheme { namespace util {
+
+/// where big allocations made through PlacedAllocator go. set per thread with ScopedMemPlacement,
+/// so a container copied or loaded inside the scope gets its table placed this way
+enum MemPolicy { MEM_DEFAULT, MEM_INTERLEAVE, MEM_BIND };
+enum HugePages { HUGE_NONE, HUGE_TRANSPARENT, HUGE_EXPLICIT };
+
+struct MemPlacement {
+	HugePages huge_pages = HUGE_NONE;
+	MemPolicy policy = MEM_DEFAULT;
+	int node = 0; // for MEM_BIND
+	MemPlacement(){}
+	MemPlacement( HugePages h, MemPolicy p, int n=0 ) : huge_pages(h), policy(p), node(n) {}
+};
+
+inline MemPlacement & current_mem_placement(){
+	static thread_local MemPlacement placement;
+	return placement;
+}
+
+struct ScopedMemPlacement {
+	MemPlacement saved_;
+	explicit ScopedMemPlacement( MemPlacement const & p ) : saved_( current_mem_placement() ) {
+		current_mem_placement() = p;
+	}
+	~ScopedMemPlacement(){ current_mem_placement() = saved_; }
+};
+
+
+namespace impl {
+	// cpu -> numa node from sysfs, all 0 if there's no numa info
+	inline std::vector<int> const & numa_node_of_cpu_table(){
+		static std::vector<int> const table = [](){
+			std::vector<int> t;
+			#ifdef __linux__
+			int ncpu = sysconf( _SC_NPROCESSORS_CONF );
+			t.resize( ncpu > 0 ? ncpu : 1, 0 );
+			for( int node = 0; node < 1024; ++node ){
+				std::string dir = "/sys/devices/system/node/node" + std::to_string(node);
+				std::ifstream cpulist( dir + "/cpulist" );
+				if( !cpulist ) break;
+				// like 0-15,32-47
+				std::string range;
+				while( std::getline( cpulist, range, ',' ) ){
+					if( range.empty() || !isdigit( range[0] ) ) continue; // memory only node
+					size_t dash = range.find('-');
+					int lo = std::atoi( range.substr( 0, dash ).c_str() );
+					int hi = dash == std::string::npos ? lo : std::atoi( range.substr( dash+1 ).c_str() );
+					for( int cpu = lo; cpu <= hi; ++cpu ){
+						if( cpu >= (int)t.size() ) t.resize( cpu+1, 0 );
+						t[cpu] = node;
+					}
+				}
+			}
+			#else
+			t.resize( 1, 0 );
+			#endif
+			return t;
+		}();
+		return table;
+	}
+
+	size_t const PLACED_MIN_BYTES = 1 << 20; // smaller blocks just use malloc
+	size_t const HUGE_PAGE_BYTES = 2 << 20;
+
+	inline size_t placed_length( size_t bytes ){
+		return ( bytes + HUGE_PAGE_BYTES - 1 ) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+	}
+}
+
+inline int numa_num_nodes(){
+	static int const n = [](){
+		int n = 1;
+		for( int node : impl::numa_node_of_cpu_table() ) n = std::max( n, node+1 );
+		return n;
+	}();
+	return n;
+}
+
+inline int numa_node_of_cpu( int cpu ){
+	std::vector<int> const & table = impl::numa_node_of_cpu_table();
+	return cpu >= 0 && cpu < (int)table.size() ? table[cpu] : 0;
+}
+
+/// node of the cpu this thread is on, rechecked every 1024 calls in case the thread moved
+inline int numa_current_node(){
+	#ifdef __linux__
+	static thread_local int node = -1;
+	static thread_local int calls = 0;
+	if( node < 0 || ( ++calls & 1023 ) == 0 ){
+		node = numa_node_of_cpu( sched_getcpu() );
+	}
+	return node;
+	#else
+	return 0;
+	#endif
+}
+
+/// blocks of at least 1MB are mmapped and placed according to current_mem_placement(), the rest
+/// come from malloc. placement failures (no hugetlbfs pages, no mbind permission) fall back to
+/// normal pages quietly
+inline void * placed_alloc( size_t bytes ){
+	#ifdef __linux__
+	if( bytes >= impl::PLACED_MIN_BYTES ){
+		MemPlacement const & p = current_mem_placement();
+		size_t const len = impl::placed_length( bytes );
+		void * ptr = MAP_FAILED;
+		#ifdef MAP_HUGETLB
+		if( p.huge_pages == HUGE_EXPLICIT ){
+			ptr = mmap( nullptr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0 );
+		}
+		#endif
+		if( ptr == MAP_FAILED ){
+			ptr = mmap( nullptr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+			if( ptr == MAP_FAILED ) throw std::bad_alloc();
+			#ifdef MADV_HUGEPAGE
+			if( p.huge_pages != HUGE_NONE ) madvise( ptr, len, MADV_HUGEPAGE );
+			#endif
+		}
+		#ifdef SYS_mbind
+		if( p.policy != MEM_DEFAULT && numa_num_nodes() > 1 ){
+			int const MPOL_BIND_ = 2, MPOL_INTERLEAVE_ = 3;
+			std::vector<unsigned long> mask( numa_num_nodes() / ( 8*sizeof(unsigned long) ) + 1, 0 );
+			int mode = MPOL_INTERLEAVE_;
+			if( p.policy == MEM_BIND ){
+				mode = MPOL_BIND_;
+				mask[ p.node / ( 8*sizeof(unsigned long) ) ] |= 1ul << ( p.node % ( 8*sizeof(unsigned long) ) );
+			} else {
+				for( int n = 0; n < numa_num_nodes(); ++n ) mask[ n / ( 8*sizeof(unsigned long) ) ] |= 1ul << ( n % ( 8*sizeof(unsigned long) ) );
+			}
+			syscall( SYS_mbind, ptr, len, mode, mask.data(), mask.size()*8*sizeof(unsigned long), 0 );
+		}
+		#endif
+		return ptr;
+	}
+	#endif
+	void * ptr = std::malloc( bytes );
+	if( !ptr && bytes ) throw std::bad_alloc();
+	return ptr;
+}
+
+inline void placed_free( void * ptr, size_t bytes ){
+	if( !ptr ) return;
+	#ifdef __linux__
+	if( bytes >= impl::PLACED_MIN_BYTES ){
+		munmap( ptr, impl::placed_length( bytes ) );
+		return;
+	}
+	#endif
+	std::free( ptr );
+}
+
+
+/// stateless allocator for placed_alloc, in the style of sparsehash's libc_allocator_with_realloc
+template< class T >
+class PlacedAllocator {
+ public:
+	typedef T value_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+
+	PlacedAllocator() {}
+	PlacedAllocator( PlacedAllocator const & ) {}
+	template< class U > PlacedAllocator( PlacedAllocator<U> const & ) {}
+
+	pointer address( reference r ) const { return &r; }
+	const_pointer address( const_reference r ) const { return &r; }
+
+	pointer allocate( size_type n, const_pointer = 0 ){
+		return static_cast<pointer>( placed_alloc( n * sizeof(value_type) ) );
+	}
+	void deallocate( pointer p, size_type n ){
+		placed_free( p, n * sizeof(value_type) );
+	}
+	size_type max_size() const { return static_cast<size_type>(-1) / sizeof(value_type); }
+
+	void construct( pointer p, const value_type & val ){ new(p) value_type(val); }
+	void destroy( pointer p ){ p->~value_type(); }
+
+	template< class U > struct rebind { typedef PlacedAllocator<U> other; };
+};
+
+template< class T >
+inline bool operator==( PlacedAllocator<T> const &, PlacedAllocator<T> const & ){ return true; }
+template< class T >
+inline bool operator!=( PlacedAllocator<T> const &, PlacedAllocator<T> const & ){ return false; }
+
+
+}}
+
+#endif
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "scheme/util/perf_counters.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace scheme { namespace util { namespace test_perf_counters {
+
+using std::cout;
+using std::endl;
+
+static double busy_work( int n ){
+	std::vector<double> v( n );
+	for( int i = 0; i < n; ++i ) v[i] = std::sqrt( (double)i );
+	double sum = 0;
+	for( int i = 0; i < n; ++i ) sum += v[ ( i * 7919 ) % n ];
+	return sum;
+}
+
+TEST( perf_counters, disabled_records_nothing ){
+	reset_perf_counters();
+	enable_perf_counters( false );
+	{
+		PerfRegion r( "test_disabled" );
+		busy_work( 1000 );
+	}
+	ASSERT_EQ( 0, perf_region_totals().count( "test_disabled" ) );
+}
+
+TEST( perf_counters, regions_per_thread_and_nested ){
+	reset_perf_counters();
+	enable_perf_counters( true );
+	bool const available = perf_counters_available();
+	cout << "hardware counters available: " << available << endl;
+	int const N = 64;
+	double sum = 0;
+	#ifdef USE_OPENMP
+	#pragma omp parallel for reduction(+:sum)
+	#endif
+	for( int i = 0; i < N; ++i ){
+		PerfRegion outer( "test_outer" );
+		sum += busy_work( 10000 );
+		PerfRegion inner( "test_inner" );
+		sum += busy_work( 1000 );
+	}
+	enable_perf_counters( false );
+	ASSERT_GT( sum, 0 );
+
+	std::map< std::string, PerfStats > totals = perf_region_totals();
+	ASSERT_EQ( N, totals["test_outer"].calls );
+	ASSERT_EQ( N, totals["test_inner"].calls );
+	ASSERT_GT( totals["test_outer"].seconds, 0 );
+	ASSERT_GE( totals["test_outer"].seconds, totals["test_inner"].seconds );
+	if( available && totals["test_outer"].has( PERF_INSTRUCTIONS ) ){
+		// the outer region does about 10x the work of the inner one
+		ASSERT_GT( totals["test_outer"].counts[PERF_INSTRUCTIONS], totals["test_inner"].counts[PERF_INSTRUCTIONS] );
+	}
+	perf_counters_report( cout );
+
+	std::string const fname = "perf_counters_gtest.tsv";
+	ASSERT_TRUE( write_perf_counters_tsv( fname ) );
+	std::ifstream in( fname );
+	std::string line;
+	int nall = 0;
+	while( std::getline( in, line ) ) nall += line.compare( 0, 4, "all\t" ) == 0;
+	ASSERT_EQ( 2, nall );
+	std::remove( fname.c_str() );
+
+	reset_perf_counters();
+	ASSERT_TRUE( perf_region_totals().empty() );
+}
+
+}}}
@@ -0,0 +1,288 @@
+#ifndef INCLUDED_util_perf_counters_HH
+#define INCLUDED_util_perf_counters_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace scheme { namespace util {
+
+/// hardware counters per named code region and thread, from linux perf_event_open. off until
+/// enable_perf_counters(true), then a PerfRegion reads the calling thread's counter group when
+/// it's made and destroyed and adds the difference to that thread's stats for its name. a region
+/// costs two read() calls, around a microsecond, so wrap chunks of work, not single lookups.
+/// regions nest and counts are inclusive. without perf access (not linux, perf_event_paranoid,
+/// containers) regions still count calls and time. only read or reset the stats while no
+/// regions are open
+enum PerfEvent {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_L1D_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_NUM_EVENTS
+};
+
+inline char const * perf_event_name( int ievent ){
+	static char const * const names[ PERF_NUM_EVENTS ] = {
+		"cycles", "instructions", "llc_misses", "l1d_misses", "dtlb_misses", "branch_misses" };
+	return names[ievent];
+}
+
+struct PerfStats {
+	uint64_t calls = 0;
+	double seconds = 0;
+	double counts[ PERF_NUM_EVENTS ] = {0}; // scaled up when the kernel multiplexed the group
+	uint32_t have = 0; // bit per event, set if any call counted it
+
+	bool has( int ievent ) const { return have >> ievent & 1; }
+	void add( PerfStats const & o ){
+		calls += o.calls;
+		seconds += o.seconds;
+		for( int i = 0; i < PERF_NUM_EVENTS; ++i ) counts[i] += o.counts[i];
+		have |= o.have;
+	}
+};
+
+
+namespace impl {
+
+	// one group of counters for the thread that opens it, user space only
+	struct PerfCounterGroup {
+		struct Sample {
+			std::chrono::steady_clock::time_point time;
+			uint64_t enabled = 0, running = 0;
+			uint64_t values[ PERF_NUM_EVENTS ] = {0};
+		};
+
+		PerfCounterGroup() : leader_(-1), nopen_(0) {
+			for( int i = 0; i < PERF_NUM_EVENTS; ++i ){ fds_[i] = -1; slot_[i] = -1; }
+			#ifdef __linux__
+			for( int i = 0; i < PERF_NUM_EVENTS; ++i ){
+				perf_event_attr attr;
+				std::memset( &attr, 0, sizeof(attr) );
+				attr.size = sizeof(attr);
+				event_config( i, attr.type, attr.config );
+				attr.disabled = leader_ < 0;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				int fd = syscall( __NR_perf_event_open, &attr, 0, -1, leader_, 0 );
+				if( fd < 0 ) continue; // not on this cpu, or no access
+				if( leader_ < 0 ) leader_ = fd;
+				fds_[i] = fd;
+				slot_[i] = nopen_++;
+			}
+			if( leader_ >= 0 ) ioctl( leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+			#endif
+		}
+		~PerfCounterGroup(){
+			#ifdef __linux__
+			for( int i = PERF_NUM_EVENTS-1; i >= 0; --i ) if( fds_[i] >= 0 ) close( fds_[i] );
+			#endif
+		}
+		PerfCounterGroup( PerfCounterGroup const & ) = delete;
+		PerfCounterGroup & operator=( PerfCounterGroup const & ) = delete;
+
+		bool available() const { return nopen_ > 0; }
+
+		void read( Sample & s ) const {
+			s.time = std::chrono::steady_clock::now();
+			#ifdef __linux__
+			if( !nopen_ ) return;
+			uint64_t buf[ 3 + PERF_NUM_EVENTS ]; // nr, time_enabled, time_running, values
+			if( ::read( leader_, buf, sizeof(buf) ) < (ssize_t)( ( 3 + nopen_ ) * sizeof(uint64_t) ) ) return;
+			s.enabled = buf[1];
+			s.running = buf[2];
+			for( int i = 0; i < PERF_NUM_EVENTS; ++i ) if( slot_[i] >= 0 ) s.values[i] = buf[ 3 + slot_[i] ];
+			#endif
+		}
+
+		// end - begin into stats, one call
+		void accumulate( Sample const & begin, Sample const & end, PerfStats & stats ) const {
+			stats.calls += 1;
+			stats.seconds += std::chrono::duration<double>( end.time - begin.time ).count();
+			uint64_t const running = end.running - begin.running;
+			if( !nopen_ || running == 0 ) return; // group wasn't scheduled at all
+			double const scale = (double)( end.enabled - begin.enabled ) / running;
+			for( int i = 0; i < PERF_NUM_EVENTS; ++i ){
+				if( slot_[i] < 0 ) continue;
+				stats.counts[i] += scale * ( end.values[i] - begin.values[i] );
+				stats.have |= 1u << i;
+			}
+		}
+
+	private:
+		#ifdef __linux__
+		static void event_config( int ievent, __u32 & type, __u64 & config ){
+			__u64 const read_miss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+			switch( ievent ){
+				case PERF_CYCLES       : type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CPU_CYCLES; break;
+				case PERF_INSTRUCTIONS : type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_INSTRUCTIONS; break;
+				case PERF_LLC_MISSES   : type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CACHE_MISSES; break;
+				case PERF_L1D_MISSES   : type = PERF_TYPE_HW_CACHE; config = PERF_COUNT_HW_CACHE_L1D  | read_miss; break;
+				case PERF_DTLB_MISSES  : type = PERF_TYPE_HW_CACHE; config = PERF_COUNT_HW_CACHE_DTLB | read_miss; break;
+				case PERF_BRANCH_MISSES: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_BRANCH_MISSES; break;
+			}
+		}
+		#endif
+		int leader_, nopen_;
+		int fds_[ PERF_NUM_EVENTS ], slot_[ PERF_NUM_EVENTS ];
+	};
+
+	struct PerfThread {
+		int id;
+		PerfCounterGroup group;
+		std::vector< std::pair< std::string, PerfStats > > regions; // few, linear search is fine
+
+		explicit PerfThread( int i ) : id( i ) {}
+		PerfStats & stats( char const * name ){
+			for( auto & r : regions ) if( r.first == name ) return r.second;
+			regions.push_back( std::make_pair( std::string( name ), PerfStats() ) );
+			return regions.back().second;
+		}
+	};
+
+	struct PerfRegistry {
+		std::atomic<bool> enabled;
+		std::mutex lock;
+		std::vector< std::shared_ptr<PerfThread> > threads; // kept after their threads exit
+
+		PerfRegistry() : enabled( false ) {}
+		static PerfRegistry & get(){ static PerfRegistry registry; return registry; }
+	};
+
+	// counters are opened on a thread's first region
+	inline PerfThread & this_perf_thread(){
+		static thread_local std::shared_ptr<PerfThread> thread;
+		if( !thread ){
+			PerfRegistry & reg = PerfRegistry::get();
+			std::lock_guard< std::mutex > guard( reg.lock );
+			thread = std::make_shared<PerfThread>( (int)reg.threads.size() );
+			reg.threads.push_back( thread );
+		}
+		return *thread;
+	}
+
+}
+
+
+inline void enable_perf_counters( bool enable = true ){ impl::PerfRegistry::get().enabled.store( enable ); }
+inline bool perf_counters_enabled(){ return impl::PerfRegistry::get().enabled.load( std::memory_order_relaxed ); }
+
+/// whether this thread could open any hardware counter
+inline bool perf_counters_available(){ return impl::this_perf_thread().group.available(); }
+
+/// name must outlive the region, normally a string literal
+class PerfRegion {
+	impl::PerfThread * thread_;
+	char const * name_;
+	impl::PerfCounterGroup::Sample begin_;
+public:
+	explicit PerfRegion( char const * name ) : thread_( nullptr ), name_( name ) {
+		if( !perf_counters_enabled() ) return;
+		thread_ = &impl::this_perf_thread();
+		thread_->group.read( begin_ );
+	}
+	~PerfRegion(){
+		if( !thread_ ) return;
+		impl::PerfCounterGroup::Sample end;
+		thread_->group.read( end );
+		thread_->group.accumulate( begin_, end, thread_->stats( name_ ) );
+	}
+	PerfRegion( PerfRegion const & ) = delete;
+	PerfRegion & operator=( PerfRegion const & ) = delete;
+};
+
+/// stats per region name, summed over threads
+inline std::map< std::string, PerfStats > perf_region_totals(){
+	impl::PerfRegistry & reg = impl::PerfRegistry::get();
+	std::lock_guard< std::mutex > guard( reg.lock );
+	std::map< std::string, PerfStats > totals;
+	for( auto const & t : reg.threads ) for( auto const & r : t->regions ) totals[ r.first ].add( r.second );
+	return totals;
+}
+
+inline void reset_perf_counters(){
+	impl::PerfRegistry & reg = impl::PerfRegistry::get();
+	std::lock_guard< std::mutex > guard( reg.lock );
+	for( auto const & t : reg.threads ) t->regions.clear();
+}
+
+/// one line per region, summed over threads. seconds are thread seconds, misses are per 1000
+/// instructions
+inline void perf_counters_report( std::ostream & out ){
+	std::map< std::string, PerfStats > const totals = perf_region_totals();
+	if( totals.empty() ) return;
+	bool any_counts = false;
+	for( auto const & r : totals ) any_counts |= r.second.have != 0;
+	std::ios::fmtflags const flags = out.flags();
+	std::streamsize const precision = out.precision();
+	out << "perf counters per region" << ( any_counts ? "" : " (no hardware counters, check perf_event_paranoid)" ) << std::endl;
+	out << std::setw(24) << std::left << "region" << std::right << std::setw(12) << "calls" << std::setw(12) << "thread_s"
+	    << std::setw(8) << "IPC";
+	for( int i = PERF_LLC_MISSES; i < PERF_NUM_EVENTS; ++i ) out << std::setw(18) << std::string( perf_event_name(i) ) + "/Ki";
+	out << std::endl;
+	for( auto const & r : totals ){
+		PerfStats const & s = r.second;
+		double const instr = s.counts[ PERF_INSTRUCTIONS ];
+		out << std::setw(24) << std::left << r.first << std::right << std::setw(12) << s.calls
+		    << std::setw(12) << std::fixed << std::setprecision(3) << s.seconds;
+		if( s.has( PERF_CYCLES ) && s.has( PERF_INSTRUCTIONS ) && s.counts[ PERF_CYCLES ] > 0 )
+			out << std::setw(8) << std::setprecision(2) << instr / s.counts[ PERF_CYCLES ];
+		else out << std::setw(8) << "-";
+		for( int i = PERF_LLC_MISSES; i < PERF_NUM_EVENTS; ++i ){
+			if( s.has(i) && s.has( PERF_INSTRUCTIONS ) && instr > 0 ) out << std::setw(18) << std::setprecision(3) << 1000.0 * s.counts[i] / instr;
+			else out << std::setw(18) << "-";
+		}
+		out << std::endl;
+	}
+	out.flags( flags );
+	out.precision( precision );
+}
+
+/// raw stats as tab separated text, a row per thread and region then the totals with thread
+/// "all". events that weren't counted are empty
+inline bool write_perf_counters_tsv( std::string const & fname ){
+	std::ofstream out( fname );
+	if( !out ) return false;
+	out << "thread\tregion\tcalls\tthread_seconds";
+	for( int i = 0; i < PERF_NUM_EVENTS; ++i ) out << '\t' << perf_event_name(i);
+	out << '\n';
+	auto row = [&]( std::string const & thread, std::string const & region, PerfStats const & s ){
+		out << thread << '\t' << region << '\t' << s.calls << '\t' << s.seconds;
+		for( int i = 0; i < PERF_NUM_EVENTS; ++i ){
+			out << '\t';
+			if( s.has(i) ) out << (uint64_t)s.counts[i];
+		}
+		out << '\n';
+	};
+	{
+		impl::PerfRegistry & reg = impl::PerfRegistry::get();
+		std::lock_guard< std::mutex > guard( reg.lock );
+		for( auto const & t : reg.threads ) for( auto const & r : t->regions ) row( std::to_string( t->id ), r.first, r.second );
+	}
+	for( auto const & r : perf_region_totals() ) row( "all", r.first, r.second );
+	return out.good();
+}
+
+}}
+
+#endif
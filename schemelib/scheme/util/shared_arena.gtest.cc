@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "scheme/util/shared_arena.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace scheme { namespace util { namespace test_shared_arena {
+
+using std::cout;
+using std::endl;
+
+std::string test_name( std::string const & what ){
+	return "scheme_test_" + what + "_" + std::to_string( getpid() );
+}
+
+TEST( shared_arena, create_publish_attach ){
+	std::string const name = test_name( "arena" );
+	SharedArena arena;
+	ASSERT_TRUE( arena.create( name, SharedArena::header_bytes() + SharedArena::round_up( 1000*sizeof(int) ) + SharedArena::ALIGN ) );
+	int * a = (int*)arena.allocate( "a", 1000*sizeof(int) );
+	double * b = (double*)arena.allocate( "b", 3*sizeof(double) );
+	ASSERT_TRUE( a );
+	ASSERT_TRUE( b );
+	ASSERT_FALSE( arena.allocate( "a", 10 ) ); // taken
+	ASSERT_FALSE( arena.allocate( "c", 10 ) ); // full
+	ASSERT_EQ( 0, (uintptr_t)a % SharedArena::ALIGN );
+	for( int i = 0; i < 1000; ++i ) a[i] = i*i;
+	b[0] = 1.5; b[1] = 2.5; b[2] = 3.5;
+
+	SharedArena reader;
+	ASSERT_FALSE( reader.attach( name ) ); // not published yet
+	arena.publish();
+	ASSERT_TRUE( reader.attach( name ) );
+	ASSERT_FALSE( reader.is_creator() );
+	ASSERT_EQ( 2, reader.num_blocks() );
+	size_t bytes = 0;
+	int const * ra = (int const*)reader.find( "a", &bytes );
+	ASSERT_TRUE( ra );
+	ASSERT_NE( a, ra ); // own mapping
+	ASSERT_EQ( 1000*sizeof(int), bytes );
+	for( int i = 0; i < 1000; ++i ) ASSERT_EQ( i*i, ra[i] );
+	ASSERT_EQ( 2.5, ((double const*)reader.find( "b" ))[1] );
+	ASSERT_FALSE( reader.find( "c" ) );
+
+	ASSERT_TRUE( arena.unlink() );
+	SharedArena late;
+	ASSERT_FALSE( late.attach( name ) );
+	ASSERT_EQ( 9, ra[3] ); // still mapped
+}
+
+TEST( shared_arena, work_queue_across_processes ){
+	std::string const name = test_name( "queue" );
+	int64_t const N = 10000;
+	int const nchild = 3;
+	SharedWorkQueue queue;
+	ASSERT_TRUE( queue.create( name, N ) );
+	ASSERT_EQ( 1, queue.num_members() );
+
+	// each child sums what it got, the sums have to add up to every index once
+	std::vector<int> pipes( nchild );
+	std::vector<pid_t> pids( nchild );
+	for( int ic = 0; ic < nchild; ++ic ){
+		int fds[2];
+		ASSERT_EQ( 0, pipe( fds ) );
+		pids[ic] = fork();
+		ASSERT_GE( pids[ic], 0 );
+		if( pids[ic] == 0 ){
+			close( fds[0] );
+			SharedWorkQueue q;
+			int64_t sum = 0, count = 0, i;
+			if( q.attach( name, 10 ) && q.join() ){
+				while( q.next( i ) ){ sum += i; ++count; }
+				q.leave();
+			}
+			int64_t out[2] = { sum, count };
+			ssize_t w = write( fds[1], out, sizeof(out) );
+			_exit( w == sizeof(out) ? 0 : 1 );
+		}
+		close( fds[1] );
+		pipes[ic] = fds[0];
+	}
+	int64_t sum = 0, count = 0, i;
+	while( queue.next( i ) ){ sum += i; ++count; }
+	for( int ic = 0; ic < nchild; ++ic ){
+		int64_t in[2] = { 0, 0 };
+		ASSERT_EQ( (ssize_t)sizeof(in), read( pipes[ic], in, sizeof(in) ) );
+		close( pipes[ic] );
+		int status = 0;
+		waitpid( pids[ic], &status, 0 );
+		ASSERT_EQ( 0, status );
+		sum += in[0];
+		count += in[1];
+	}
+	ASSERT_EQ( N, count );
+	ASSERT_EQ( N*(N-1)/2, sum );
+
+	// everyone else left, so the creator is last out, and nobody can join after
+	ASSERT_TRUE( queue.leave() );
+	SharedWorkQueue late;
+	ASSERT_TRUE( late.attach( name ) );
+	ASSERT_FALSE( late.join() );
+	ASSERT_TRUE( queue.unlink() );
+	ASSERT_FALSE( late.attach( name ) );
+}
+
+}}}
@@ -0,0 +1,297 @@
+#ifndef INCLUDED_util_shared_arena_HH
+#define INCLUDED_util_shared_arena_HH
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace scheme { namespace util {
+
+namespace impl {
+	// shm_open wants one leading slash and no others
+	inline std::string shm_name( std::string const & name ){
+		std::string n = name;
+		std::replace( n.begin(), n.end(), '/', '_' );
+		return "/" + n;
+	}
+	inline size_t shm_size( int fd ){
+		struct stat st;
+		return fstat( fd, &st ) == 0 ? (size_t)st.st_size : 0;
+	}
+	inline void shm_sleep(){ std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) ); }
+	inline double shm_seconds_since( std::chrono::steady_clock::time_point t ){
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - t ).count();
+	}
+}
+
+/// named blocks in one POSIX shared memory object, so processes on a node can share big read only
+/// data (rifs, grids) instead of each loading a copy. one process create()s the arena, allocate()s
+/// and fills blocks, then publish()es; the others attach() by name, which waits for the publish and
+/// maps the whole thing read only. blocks are page aligned. the object stays in /dev/shm until
+/// unlink(), mappings already made stay valid after that
+class SharedArena {
+public:
+	static uint64_t const MAGIC = 0x53484152454e4131ull; // "SHARENA1"
+	static int const MAX_BLOCKS = 1024;
+	static size_t const ALIGN = 4096;
+	struct Block { char name[112]; uint64_t offset, bytes; };
+	struct Header {
+		uint64_t magic;
+		std::atomic<uint64_t> published;
+		uint64_t capacity, used, nblocks;
+		Block blocks[ MAX_BLOCKS ];
+	};
+
+	SharedArena() : base_( nullptr ), mapped_( 0 ), creator_( false ) {}
+	~SharedArena(){ close(); }
+	SharedArena( SharedArena const & ) = delete;
+	SharedArena & operator=( SharedArena const & ) = delete;
+
+	/// the first block starts here
+	static size_t header_bytes(){ return round_up( sizeof(Header) ); }
+	static size_t round_up( size_t bytes ){ return ( bytes + ALIGN - 1 ) / ALIGN * ALIGN; }
+
+	/// replaces any object of the same name. capacity is everything allocate() will be asked for,
+	/// each block rounded up to ALIGN, plus header_bytes()
+	bool create( std::string const & name, size_t capacity ){
+		close();
+		name_ = impl::shm_name( name );
+		shm_unlink( name_.c_str() );
+		int fd = shm_open( name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+		if( fd < 0 ) return false;
+		capacity = std::max( capacity, header_bytes() );
+		void * p = MAP_FAILED;
+		if( ftruncate( fd, capacity ) == 0 ) p = mmap( nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		::close( fd );
+		if( p == MAP_FAILED ){ shm_unlink( name_.c_str() ); return false; }
+		base_ = (char*)p;
+		mapped_ = capacity;
+		creator_ = true;
+		Header & h = header();
+		h.published.store( 0 );
+		h.capacity = capacity;
+		h.used = header_bytes();
+		h.nblocks = 0;
+		h.magic = MAGIC;
+		return true;
+	}
+
+	/// uninitialized block of bytes, nullptr if the name is taken, too long, or there's no room
+	void * allocate( std::string const & block_name, size_t bytes ){
+		if( !creator_ || published() || block_name.size() >= sizeof(Block::name) || find( block_name ) ) return nullptr;
+		Header & h = header();
+		if( h.nblocks == MAX_BLOCKS || h.used + round_up( bytes ) > h.capacity ) return nullptr;
+		Block & b = h.blocks[ h.nblocks++ ];
+		std::memset( b.name, 0, sizeof(b.name) );
+		std::memcpy( b.name, block_name.c_str(), block_name.size() );
+		b.offset = h.used;
+		b.bytes = bytes;
+		h.used += round_up( bytes );
+		return base_ + b.offset;
+	}
+
+	/// after this the blocks are read only, for everyone
+	void publish(){
+		if( !creator_ || published() ) return;
+		header().published.store( 1, std::memory_order_release );
+		mprotect( base_, mapped_, PROT_READ );
+	}
+
+	/// maps a published arena read only, waiting up to timeout_seconds for it to exist and be published
+	bool attach( std::string const & name, double timeout_seconds = 0 ){
+		close();
+		name_ = impl::shm_name( name );
+		auto const start = std::chrono::steady_clock::now();
+		for(;;){
+			if( try_attach() ) return true;
+			if( impl::shm_seconds_since( start ) >= timeout_seconds ) return false;
+			impl::shm_sleep();
+		}
+	}
+
+	/// start of a block and its size, nullptr if there's no such block
+	void const * find( std::string const & block_name, size_t * bytes = nullptr ) const {
+		if( !base_ ) return nullptr;
+		Header const & h = header();
+		for( uint64_t i = 0; i < h.nblocks; ++i ){
+			if( block_name != h.blocks[i].name ) continue;
+			if( bytes ) *bytes = h.blocks[i].bytes;
+			return base_ + h.blocks[i].offset;
+		}
+		return nullptr;
+	}
+
+	bool is_open() const { return base_ != nullptr; }
+	bool is_creator() const { return creator_; }
+	bool published() const { return base_ && header().published.load( std::memory_order_acquire ); }
+	std::string const & name() const { return name_; }
+	size_t used() const { return base_ ? header().used : 0; }
+	size_t num_blocks() const { return base_ ? header().nblocks : 0; }
+
+	/// removes the name, mappings stay valid
+	bool unlink(){ return name_.size() && shm_unlink( name_.c_str() ) == 0; }
+	static bool unlink( std::string const & name ){ return shm_unlink( impl::shm_name( name ).c_str() ) == 0; }
+
+	void close(){
+		if( base_ ) munmap( base_, mapped_ );
+		base_ = nullptr;
+		mapped_ = 0;
+		creator_ = false;
+	}
+
+private:
+	Header & header(){ return *(Header*)base_; }
+	Header const & header() const { return *(Header const*)base_; }
+
+	bool try_attach(){
+		int fd = shm_open( name_.c_str(), O_RDONLY, 0 );
+		if( fd < 0 ) return false;
+		size_t const size = impl::shm_size( fd );
+		bool ok = false;
+		if( size >= header_bytes() ){
+			void * p = mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+			if( p != MAP_FAILED ){
+				Header const & h = *(Header const*)p;
+				if( h.magic == MAGIC && h.published.load( std::memory_order_acquire ) && h.used <= size ){
+					base_ = (char*)p;
+					mapped_ = size;
+					ok = true;
+				} else {
+					munmap( p, size );
+				}
+			}
+		}
+		::close( fd );
+		return ok;
+	}
+
+	char * base_;
+	size_t mapped_;
+	bool creator_;
+	std::string name_;
+};
+
+
+/// indices [0,end) handed out once each to any number of processes, through a small shared memory
+/// object. the creator is a member already, others join() after attach(). every member leave()s when
+/// next() runs dry, the last one out closes the queue (join fails after that) and is told to clean up
+class SharedWorkQueue {
+public:
+	static uint64_t const MAGIC = 0x53484152455155ull; // "SHAREQU"
+	static int64_t const CLOSED = -1;
+	struct State {
+		uint64_t magic;
+		std::atomic<uint64_t> ready;
+		int64_t end;
+		alignas(64) std::atomic<int64_t> next;
+		alignas(64) std::atomic<int64_t> members;
+	};
+
+	SharedWorkQueue() : state_( nullptr ), member_( false ) {}
+	~SharedWorkQueue(){ close(); }
+	SharedWorkQueue( SharedWorkQueue const & ) = delete;
+	SharedWorkQueue & operator=( SharedWorkQueue const & ) = delete;
+
+	/// replaces any queue of the same name, the caller is its first member
+	bool create( std::string const & name, int64_t end ){
+		close();
+		name_ = impl::shm_name( name );
+		shm_unlink( name_.c_str() );
+		int fd = shm_open( name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+		if( fd < 0 ) return false;
+		if( !map( fd, true ) ){ shm_unlink( name_.c_str() ); return false; }
+		state_->end = end;
+		state_->next.store( 0 );
+		state_->members.store( 1 );
+		state_->magic = MAGIC;
+		state_->ready.store( 1, std::memory_order_release );
+		member_ = true;
+		return true;
+	}
+
+	/// waits up to timeout_seconds for the queue to be created
+	bool attach( std::string const & name, double timeout_seconds = 0 ){
+		close();
+		name_ = impl::shm_name( name );
+		auto const start = std::chrono::steady_clock::now();
+		for(;;){
+			int fd = shm_open( name_.c_str(), O_RDWR, 0 );
+			if( fd >= 0 ){
+				if( map( fd, false ) ){
+					if( state_->magic == MAGIC && state_->ready.load( std::memory_order_acquire ) ) return true;
+					close();
+				}
+			}
+			if( impl::shm_seconds_since( start ) >= timeout_seconds ) return false;
+			impl::shm_sleep();
+		}
+	}
+
+	/// false if the queue already closed, all its work is done
+	bool join(){
+		if( member_ ) return true;
+		int64_t m = state_->members.load();
+		do {
+			if( m == CLOSED ) return false;
+		} while( !state_->members.compare_exchange_weak( m, m+1 ) );
+		member_ = true;
+		return true;
+	}
+
+	/// the next unclaimed index, false when there are none left
+	bool next( int64_t & i ){
+		if( !state_ || state_->next.load( std::memory_order_relaxed ) >= state_->end ) return false;
+		i = state_->next.fetch_add( 1 );
+		return i < state_->end;
+	}
+
+	/// true if this was the last member, the queue is closed and the caller should unlink
+	/// whatever the members shared
+	bool leave(){
+		if( !member_ ) return false;
+		member_ = false;
+		if( state_->members.fetch_sub( 1 ) != 1 ) return false;
+		int64_t zero = 0;
+		return state_->members.compare_exchange_strong( zero, CLOSED );
+	}
+
+	int64_t end() const { return state_ ? state_->end : 0; }
+	int64_t num_members() const { return state_ ? state_->members.load() : 0; }
+	std::string const & name() const { return name_; }
+
+	bool unlink(){ return name_.size() && shm_unlink( name_.c_str() ) == 0; }
+	static bool unlink( std::string const & name ){ return shm_unlink( impl::shm_name( name ).c_str() ) == 0; }
+
+	void close(){
+		if( state_ ) munmap( state_, sizeof(State) );
+		state_ = nullptr;
+		member_ = false;
+	}
+
+private:
+	bool map( int fd, bool resize ){
+		bool ok = resize ? ftruncate( fd, sizeof(State) ) == 0 : impl::shm_size( fd ) >= sizeof(State);
+		void * p = ok ? mmap( nullptr, sizeof(State), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+		::close( fd );
+		if( p == MAP_FAILED ) return false;
+		state_ = (State*)p;
+		return true;
+	}
+
+	State * state_;
+	bool member_;
+	std::string name_;
+};
+
+}}
+
+#endif
@@ -0,0 +1,262 @@
+// repeatable performance suite for the core data structures, on synthetic fixtures
+//
+//    bench_libscheme                               # run everything, results to stdout
+//    bench_libscheme -out now.tsv -baseline base.tsv -tolerance 0.15
+//    bench_libscheme -filter xform -seconds 2
+//
+// results are tab separated (scheme/util/benchmark.hh), one line per benchmark: throughput,
+// per op latency percentiles, fixture memory and process peak rss. with -baseline the exit code
+// is the number of regressions, so it can gate upgrades.
+
+#include "scheme/util/benchmark.hh"
+
+#include "scheme/nest/NEST.hh"
+#include "scheme/nest/pmap/OriTransMap.hh"
+#include "scheme/numeric/rand_xform.hh"
+#include "scheme/objective/hash/XformHash.hh"
+#include "scheme/objective/hash/XformMap.hh"
+#include "scheme/objective/storage/TwoBodyTable.hh"
+#include "scheme/objective/voxel/VoxelArray.hh"
+#include "scheme/search/HackPack.hh"
+
+#include <Eigen/Geometry>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using ::scheme::make_shared;
+using ::scheme::shared_ptr;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+typedef Eigen::Transform<float,3,Eigen::AffineCompact> Xform;
+typedef ::scheme::util::BenchResult BenchResult;
+
+struct BenchOpts {
+	double seconds = 1.0;
+	std::string filter;
+	bool quick = false; // small fixtures, for smoke testing the suite itself
+	bool run( std::string const & name ) const { return filter.empty() || name.find( filter ) != std::string::npos; }
+};
+
+
+// random rif: xforms near the origin with random values, lookups half hits half misses
+void bench_xform_map( BenchOpts const & opts, std::vector<BenchResult> & results ){
+	typedef ::scheme::objective::hash::XformMap< Xform, uint64_t > XMap;
+	std::mt19937 rng( 1 );
+	size_t const nentries = opts.quick ? 100000 : 4000000;
+	float const cart_bound = 16.0;
+
+	XMap xmap( 0.5, 16.0, 512.0 );
+	std::vector<Xform> hits;
+	Xform x;
+	for( size_t i = 0; i < nentries; ++i ){
+		::scheme::numeric::rand_xform( rng, x, cart_bound );
+		xmap.insert( x, i );
+		if( hits.size() < 100000 ) hits.push_back( x );
+	}
+	std::vector<Xform> queries;
+	for( size_t i = 0; i < 200000; ++i ){
+		if( i % 2 ) queries.push_back( hits[ rng() % hits.size() ] );
+		else { ::scheme::numeric::rand_xform( rng, x, cart_bound ); queries.push_back( x ); }
+	}
+	std::shuffle( queries.begin(), queries.end(), rng );
+
+	int const NOPS = 10000;
+	size_t iq = 0;
+	if( opts.run( "xform_map_lookup" ) ){
+		results.push_back( ::scheme::util::run_benchmark( "xform_map_lookup", [&](){
+			uint64_t sum = 0;
+			for( int i = 0; i < NOPS; ++i ) sum += xmap[ queries[ iq++ % queries.size() ] ];
+			return (double)sum;
+		}, NOPS, opts.seconds, xmap.mem_use() ) );
+	}
+	if( opts.run( "xform_map_lookup_filter" ) ){
+		XMap filtered = xmap;
+		filtered.build_filter( 10.0 );
+		results.push_back( ::scheme::util::run_benchmark( "xform_map_lookup_filter", [&](){
+			uint64_t sum = 0;
+			for( int i = 0; i < NOPS; ++i ) sum += filtered[ queries[ iq++ % queries.size() ] ];
+			return (double)sum;
+		}, NOPS, opts.seconds, filtered.mem_use() ) );
+	}
+	if( opts.run( "xform_hash_key" ) ){
+		::scheme::objective::hash::XformHash_Quat_BCC7_Zorder<Xform> hasher( 0.5f, 16.0f, 512.0f );
+		results.push_back( ::scheme::util::run_benchmark( "xform_hash_key", [&](){
+			uint64_t sum = 0;
+			for( int i = 0; i < NOPS; ++i ) sum += hasher.get_key( queries[ iq++ % queries.size() ] );
+			return (double)sum;
+		}, NOPS, opts.seconds ) );
+	}
+}
+
+// target field grids, one per atom type, and synthetic rotamers (atoms within 6A of the CB)
+// placed at random: the field part of score_rotamer_v_target
+void bench_voxel_array( BenchOpts const & opts, std::vector<BenchResult> & results ){
+	typedef ::scheme::objective::voxel::VoxelArray< 3, float, float > VoxelArray;
+	typedef ::scheme::util::SimpleArray<3,float> F3;
+	std::mt19937 rng( 2 );
+	std::uniform_real_distribution<float> runif( -1, 1 );
+	int const NATYPE = 21;
+	float const extent = opts.quick ? 8.0 : 20.0;
+
+	std::vector< shared_ptr<VoxelArray> > fields( NATYPE+1 );
+	uint64_t mem = 0;
+	for( int itype = 1; itype <= NATYPE; ++itype ){
+		fields[itype] = make_shared<VoxelArray>( F3(-extent,-extent,-extent), F3(extent,extent,extent), F3(0.25,0.25,0.25) );
+		for( size_t k = 0; k < fields[itype]->num_elements(); ++k ) fields[itype]->data()[k] = runif(rng);
+		mem += fields[itype]->num_elements() * sizeof(float);
+	}
+
+	struct SynthAtom { Eigen::Vector3f pos; int type; };
+	std::vector< std::vector<SynthAtom> > rotamers( 300 );
+	for( auto & rot : rotamers ){
+		rot.resize( 1 + rng() % 10 );
+		for( auto & a : rot ){
+			a.pos = Eigen::Vector3f( runif(rng), runif(rng), runif(rng) ) * 6.0;
+			a.type = 1 + rng() % NATYPE;
+		}
+	}
+	std::vector<Xform> placements( 10000 );
+	for( Xform & x : placements ) ::scheme::numeric::rand_xform( rng, x, extent );
+
+	int const NOPS = 10000;
+	size_t iop = 0;
+	if( opts.run( "voxel_array_at" ) ){
+		std::vector<Eigen::Vector3f> points( 100000 );
+		for( auto & p : points ) p = Eigen::Vector3f( runif(rng), runif(rng), runif(rng) ) * extent * 1.1;
+		results.push_back( ::scheme::util::run_benchmark( "voxel_array_at", [&](){
+			float sum = 0;
+			for( int i = 0; i < NOPS; ++i ) sum += fields[ 1 + iop % NATYPE ]->at( points[ iop++ % points.size() ] );
+			return (double)sum;
+		}, NOPS, opts.seconds, fields[1]->num_elements() * sizeof(float) ) );
+	}
+	if( opts.run( "rotamer_vs_field" ) ){
+		results.push_back( ::scheme::util::run_benchmark( "rotamer_vs_field", [&](){
+			float sum = 0;
+			for( int i = 0; i < NOPS; ++i ){
+				Xform const & x = placements[ iop % placements.size() ];
+				for( SynthAtom const & a : rotamers[ iop % rotamers.size() ] ) sum += fields[a.type]->at( x * a.pos );
+				++iop;
+			}
+			return (double)sum;
+		}, NOPS, opts.seconds, mem ) );
+	}
+}
+
+// the hsearch nest, random indices and the 64 children of random parents
+void bench_nest( BenchOpts const & opts, std::vector<BenchResult> & results ){
+	typedef ::scheme::nest::NEST< 6, Xform, ::scheme::nest::pmap::OriTransMap, ::scheme::util::StoreNothing, uint64_t, float, false > Nest;
+	Nest nest( 30.0, Eigen::Vector3f(-16,-16,-16), Eigen::Vector3f(16,16,16), Eigen::Vector3i(8,8,8) );
+	std::mt19937_64 rng( 3 );
+	int const resl = 4;
+	int const NOPS = 64*200;
+	if( opts.run( "nest_get_state_random" ) ){
+		std::vector<uint64_t> indices( 100000 );
+		for( auto & i : indices ) i = rng() % nest.size( resl );
+		size_t iop = 0;
+		results.push_back( ::scheme::util::run_benchmark( "nest_get_state_random", [&](){
+			float sum = 0;
+			Xform x;
+			for( int i = 0; i < NOPS; ++i ) if( nest.get_state( indices[ iop++ % indices.size() ], resl, x ) ) sum += x.translation()[0];
+			return (double)sum;
+		}, NOPS, opts.seconds ) );
+	}
+	if( opts.run( "nest_get_state_children" ) ){
+		Nest::ValueCache cache;
+		results.push_back( ::scheme::util::run_benchmark( "nest_get_state_children", [&](){
+			float sum = 0;
+			Xform x;
+			for( int i = 0; i < NOPS/64; ++i ){
+				uint64_t const parent = rng() % nest.size( resl-1 );
+				for( int k = 0; k < 64; ++k ) if( nest.get_state_cached( parent*64 + k, resl, x, cache ) ) sum += x.translation()[0];
+			}
+			return (double)sum;
+		}, NOPS, opts.seconds ) );
+	}
+}
+
+// random scaffold: nres positions, a band of nonzero twobody energies between sequence neighbors,
+// 20 designable positions with 20 rotamers each
+void bench_hackpack( BenchOpts const & opts, std::vector<BenchResult> & results ){
+	if( !opts.run( "hackpack_trial" ) ) return;
+	typedef ::scheme::objective::storage::TwoBodyTable<float> TwoBodyTable;
+	std::mt19937 rng( 4 );
+	std::uniform_real_distribution<float> runif( 0, 1 );
+	int const nres = 60, nrot = opts.quick ? 100 : 400;
+	auto twob = make_shared<TwoBodyTable>( nres, nrot );
+	for( int ir = 0; ir < nres; ++ir ){
+		for( int irot = 0; irot < nrot; ++irot ) twob->onebody_[ir][irot] = irot == 0 ? 0.0 : runif(rng)*6.0 - 3.0;
+	}
+	twob->init_onebody_filter( 2.0 );
+	for( int ir = 0; ir < nres; ++ir ){
+		for( int jr = std::max( 0, ir-8 ); jr < ir; ++jr ){
+			twob->init_twobody( ir, jr );
+			auto & t = twob->twobody_[ir][jr];
+			for( int i = 0; i < twob->nsel_[ir]; ++i ) for( int j = 0; j < twob->nsel_[jr]; ++j ) t[i][j] = runif(rng) < 0.7 ? 0.0 : runif(rng)*4.0 - 2.0;
+		}
+	}
+
+	::scheme::search::HackPackOpts hpopts;
+	::scheme::search::HackPack packer( hpopts, 0, 1 );
+	packer.reinitialize( twob );
+	for( int ir = 0; ir < nres; ir += 3 ){
+		for( int k = 0; k < 20; ++k ){
+			int const irot = 1 + rng() % ( nrot-1 );
+			if( packer.using_rotamer( ir, irot ) ) packer.add_tmp_rot( ir, irot, twob->onebody_[ir][irot] );
+		}
+	}
+	// pack does 8 temperature stages of pack_iter_mult * nrots + 10 trials each
+	std::vector< std::pair<int32_t,int32_t> > result_rots;
+	packer.pack( result_rots );
+	uint64_t const trials = hpopts.pack_n_iters * 8 * (uint64_t)( hpopts.pack_iter_mult * packer.rot_list_.size() + 10 );
+	results.push_back( ::scheme::util::run_benchmark( "hackpack_trial", [&](){
+		result_rots.clear();
+		return (double)packer.pack( result_rots );
+	}, trials, opts.seconds, twob->twobody_mem_use() ) );
+}
+
+
+int main( int argc, char *argv[] ){
+	BenchOpts opts;
+	std::string outfile, baselinefile;
+	double tolerance = 0.10;
+	for( int i = 1; i < argc; ++i ){
+		std::string const arg = argv[i];
+		bool const has_val = i+1 < argc;
+		if     ( arg == "-seconds"   && has_val ) opts.seconds = std::atof( argv[++i] );
+		else if( arg == "-filter"    && has_val ) opts.filter = argv[++i];
+		else if( arg == "-out"       && has_val ) outfile = argv[++i];
+		else if( arg == "-baseline"  && has_val ) baselinefile = argv[++i];
+		else if( arg == "-tolerance" && has_val ) tolerance = std::atof( argv[++i] );
+		else if( arg == "-quick" ) opts.quick = true;
+		else {
+			cerr << "usage: " << argv[0] << " [-seconds S] [-filter substr] [-out results.tsv] [-baseline base.tsv] [-tolerance 0.1] [-quick]" << endl;
+			return -1;
+		}
+	}
+
+	std::vector<BenchResult> results;
+	bench_xform_map( opts, results );
+	bench_voxel_array( opts, results );
+	bench_nest( opts, results );
+	bench_hackpack( opts, results );
+
+	::scheme::util::write_bench_results( cout, results );
+	if( outfile.size() ){
+		std::ofstream out( outfile.c_str() );
+		::scheme::util::write_bench_results( out, results );
+		if( !out ){ cerr << "can't write " << outfile << endl; return -1; }
+	}
+	if( baselinefile.size() ){
+		std::ifstream in( baselinefile.c_str() );
+		if( !in ){ cerr << "can't read baseline " << baselinefile << endl; return -1; }
+		int nregress = ::scheme::util::compare_bench_results( results, ::scheme::util::read_bench_results( in ), tolerance, cout );
+		cout << nregress << " regressions vs " << baselinefile << " at tolerance " << tolerance << endl;
+		return nregress;
+	}
+	return 0;
+}